@@ -17,14 +17,25 @@ static void append_common_flags(Nob_Cmd* command)
 
 static bool build_and_run_tests(const char* compiler)
 {
-    const char* tests[][5] = {
-        { "protocol", "src/test/test_protocol.c", "src/protocol.c", NULL, NULL },
+    const char* tests[][16] = {
+        { "protocol", "src/test/test_protocol.c", "src/protocol.c", "src/buffer_pool.c", NULL },
         { "relay_policy", "src/test/test_relay_policy.c", "src/relay_policy.c",
-            "src/protocol.c", NULL },
+            "src/protocol.c", "src/buffer_pool.c", "src/timer_wheel.c", "src/id_map.c", NULL },
         { "file_transfer", "src/test/test_file_transfer.c", "src/file_transfer.c",
-            "src/protocol.c", NULL },
+            "src/protocol.c", "src/buffer_pool.c", NULL },
         { "client_network", "src/test/test_client_network.c", "src/client_network.c",
-            "src/protocol.c", NULL }
+            "src/protocol.c", "src/buffer_pool.c", NULL },
+        { "id_map", "src/test/test_id_map.c", "src/id_map.c", NULL, NULL },
+        { "timer_wheel", "src/test/test_timer_wheel.c", "src/timer_wheel.c", NULL, NULL },
+        { "buffer_pool", "src/test/test_buffer_pool.c", "src/buffer_pool.c", NULL, NULL },
+        { "memory_governor", "src/test/test_memory_governor.c", "src/memory_governor.c",
+            "src/buffer_pool.c", NULL },
+#ifndef _WIN32
+        { "spool", "src/test/test_spool.c", "src/spool.c", "src/id_map.c", NULL },
+        { "server", "src/test/test_server.c", "src/server.c", "src/relay_policy.c",
+            "src/protocol.c", "src/buffer_pool.c", "src/uring.c", "src/id_map.c",
+            "src/timer_wheel.c", "src/spool.c", "src/memory_governor.c", NULL },
+#endif
     };
     for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
         Nob_Cmd command = { 0 };
@@ -33,8 +44,8 @@ static bool build_and_run_tests(const char* compiler)
         nob_cmd_append(&command, "-I./src/test");
         const char* executable = nob_temp_sprintf("build/test_%s", tests[i][0]);
         nob_cmd_append(&command, "-o", executable, tests[i][1], tests[i][2]);
-        if (tests[i][3])
-            nob_cmd_append(&command, tests[i][3]);
+        for (size_t source = 3; tests[i][source]; ++source)
+            nob_cmd_append(&command, tests[i][source]);
         nob_cmd_append(&command, "src/test/unity.c");
 #ifdef _WIN32
         if (cstr_equal(tests[i][0], "file_transfer"))
@@ -42,7 +53,7 @@ static bool build_and_run_tests(const char* compiler)
         if (cstr_equal(tests[i][0], "client_network"))
             nob_cmd_append(&command, "-lws2_32", "-lpthread");
 #else
-        if (cstr_equal(tests[i][0], "client_network"))
+        if (cstr_equal(tests[i][0], "client_network") || cstr_equal(tests[i][0], "server"))
             nob_cmd_append(&command, "-lpthread");
 #endif
         if (!nob_cmd_run_sync(command))
@@ -56,6 +67,21 @@ static bool build_and_run_tests(const char* compiler)
     return true;
 }
 
+static bool build_and_run_benchmark(const char* compiler)
+{
+    Nob_Cmd command = { 0 };
+    nob_cmd_append(&command, compiler);
+    append_common_flags(&command);
+    nob_cmd_append(&command, "-O2", "-o", "build/bench_protocol", "src/bench/bench_protocol.c",
+        "src/protocol.c", "src/buffer_pool.c");
+    bool ok = nob_cmd_run_sync(command);
+    command.count = 0;
+    nob_cmd_append(&command, "./build/bench_protocol");
+    ok = ok && nob_cmd_run_sync(command);
+    nob_cmd_free(command);
+    return ok;
+}
+
 int main(int argc, char** argv)
 {
     NOB_GO_REBUILD_URSELF(argc, argv);
@@ -64,6 +90,8 @@ int main(int argc, char** argv)
 
     if (argc >= 2 && cstr_equal(argv[1], "test"))
         return build_and_run_tests("gcc") ? 0 : 1;
+    if (argc >= 2 && cstr_equal(argv[1], "bench"))
+        return build_and_run_benchmark("gcc") ? 0 : 1;
     if (argc >= 2 && cstr_equal(argv[1], "run")) {
         Nob_Cmd command = { 0 };
         nob_cmd_append(&command, "./build/client_gui");
@@ -106,6 +134,7 @@ int main(int argc, char** argv)
         "src/message.c",
         "src/file_transfer.c",
         "src/protocol.c",
+        "src/buffer_pool.c",
         "src/ui_components.c",
         "thirdparty/tinyfiledialogs.c",
         "-L", raylib_library);
@@ -124,9 +153,13 @@ int main(int argc, char** argv)
     nob_cmd_append(&command, compiler);
     append_common_flags(&command);
     nob_cmd_append(&command, "-o", target_windows ? "build/server.exe" : "build/server",
-        "src/server.c", "src/server_cli.c", "src/relay_policy.c", "src/protocol.c");
+        "src/server.c", "src/server_cli.c", "src/relay_policy.c", "src/protocol.c",
+        "src/buffer_pool.c", "src/uring.c", "src/id_map.c", "src/timer_wheel.c", "src/spool.c",
+        "src/memory_governor.c");
     if (target_windows)
         nob_cmd_append(&command, "-lws2_32");
+    else
+        nob_cmd_append(&command, "-lpthread");
     if (!nob_cmd_run_sync(command))
         return 1;
 
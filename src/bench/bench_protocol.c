@@ -0,0 +1,151 @@
+#include "protocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_RECEIVE_CHUNK (64u * 1024u)
+#define BENCH_TARGET_BYTES (2048ull * 1024u * 1024u)
+
+typedef struct {
+    const uint8_t* bytes;
+    size_t length;
+    size_t position;
+} BenchSocket;
+
+static size_t decoded_frames;
+static uint64_t decoded_bytes;
+
+static double now_seconds(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static void count_view(void* context, const RelayMessageView* view)
+{
+    (void)context;
+    decoded_frames++;
+    if (view->type == RELAY_MESSAGE_FILE_CHUNK)
+        decoded_bytes += view->as.file_chunk.data[view->as.file_chunk.data_length - 1u];
+    else if (view->type == RELAY_MESSAGE_CHAT_DELIVER)
+        decoded_bytes += (uint8_t)view->as.chat_deliver.text.text[0];
+}
+
+static size_t socket_receive(BenchSocket* socket, uint8_t* target, size_t space)
+{
+    if (socket->position == socket->length)
+        socket->position = 0;
+    size_t available = socket->length - socket->position;
+    size_t taken = space < available ? space : available;
+    memcpy(target, socket->bytes + socket->position, taken);
+    socket->position += taken;
+    return taken;
+}
+
+static bool append_frame(uint8_t** stream, size_t* length, size_t* capacity,
+    const RelayMessage* message)
+{
+    uint8_t* frame = NULL;
+    size_t frame_length = 0;
+    if (!protocol_encode(message, &frame, &frame_length))
+        return false;
+    if (*length + frame_length > *capacity) {
+        size_t grown = (*capacity ? *capacity * 2u : 1u << 20) + frame_length;
+        uint8_t* resized = realloc(*stream, grown);
+        if (!resized) {
+            free(frame);
+            return false;
+        }
+        *stream = resized;
+        *capacity = grown;
+    }
+    memcpy(*stream + *length, frame, frame_length);
+    *length += frame_length;
+    free(frame);
+    return true;
+}
+
+static bool run(const char* name, const uint8_t* stream, size_t length)
+{
+    BenchSocket socket = { .bytes = stream, .length = length, .position = 0 };
+    ProtocolDecoder decoder;
+    protocol_decoder_init(&decoder);
+    uint8_t* buffer = malloc(BENCH_RECEIVE_CHUNK);
+    if (!buffer)
+        return false;
+
+    decoded_frames = 0;
+    uint64_t received_total = 0;
+    bool ok = true;
+    double started = now_seconds();
+    while (ok && received_total < BENCH_TARGET_BYTES) {
+        size_t space = 0;
+        uint8_t* target = protocol_decoder_receive_space(&decoder, &space);
+        if (!target) {
+            target = buffer;
+            space = BENCH_RECEIVE_CHUNK;
+        } else if (space > BENCH_RECEIVE_CHUNK) {
+            space = BENCH_RECEIVE_CHUNK;
+        }
+        size_t received = socket_receive(&socket, target, space);
+        received_total += received;
+        ok = target == buffer
+            ? protocol_decoder_feed_views(&decoder, buffer, received, count_view, NULL)
+            : protocol_decoder_commit_views(&decoder, received, count_view, NULL);
+    }
+    double elapsed = now_seconds() - started;
+
+    if (ok) {
+        printf("%-22s %8.2f GB/s %12zu frames\n", name,
+            (double)received_total / elapsed / 1e9, decoded_frames);
+    } else {
+        fprintf(stderr, "%s: decoder rejected the stream\n", name);
+    }
+    protocol_decoder_destroy(&decoder);
+    free(buffer);
+    return ok;
+}
+
+int main(void)
+{
+    uint8_t* stream = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+
+    RelayMessage chat = { .type = RELAY_MESSAGE_CHAT_DELIVER };
+    chat.as.chat_deliver.participant_id = 7;
+    strcpy(chat.as.chat_deliver.display_name, "Alice");
+    memset(chat.as.chat_deliver.text, 'x', 48);
+    RelayMessage progress = { .type = RELAY_MESSAGE_FILE_DELIVERY_PROGRESS };
+    progress.as.file_delivery_progress.offer_id = 3;
+    while (length < (8u << 20)) {
+        progress.as.file_delivery_progress.written_bytes += 4096u;
+        if (!append_frame(&stream, &length, &capacity, &chat)
+            || !append_frame(&stream, &length, &capacity, &progress))
+            return 1;
+    }
+    if (!run("coalesced small frames", stream, length))
+        return 1;
+
+    uint8_t* data = malloc(PROTOCOL_FILE_CHUNK_MAX);
+    if (!data)
+        return 1;
+    memset(data, 0x5a, PROTOCOL_FILE_CHUNK_MAX);
+    RelayMessage chunk = { .type = RELAY_MESSAGE_FILE_CHUNK };
+    chunk.as.file_chunk.offer_id = 3;
+    chunk.as.file_chunk.data = data;
+    chunk.as.file_chunk.data_length = PROTOCOL_FILE_CHUNK_MAX;
+    length = 0;
+    for (int i = 0; i < 8; ++i) {
+        chunk.as.file_chunk.offset = (uint64_t)i * PROTOCOL_FILE_CHUNK_MAX;
+        if (!append_frame(&stream, &length, &capacity, &chunk))
+            return 1;
+    }
+    bool ok = run("1 MB chunks", stream, length);
+    free(data);
+    free(stream);
+    return ok ? 0 : 1;
+}
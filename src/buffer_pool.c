@@ -0,0 +1,139 @@
+#include "buffer_pool.h"
+#include "protocol.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUFFER_POOL_CLASS_COUNT 8u
+
+typedef struct {
+    atomic_flag lock;
+    void* idle;
+    size_t idle_count;
+} BufferPoolClass;
+
+static const size_t class_capacities[BUFFER_POOL_CLASS_COUNT] = {
+    64u, 256u, 1024u, 4096u, 16384u, 65536u, 262144u, PROTOCOL_FRAME_CAPACITY
+};
+
+static BufferPoolClass classes[BUFFER_POOL_CLASS_COUNT] = {
+    { ATOMIC_FLAG_INIT, NULL, 0 }, { ATOMIC_FLAG_INIT, NULL, 0 },
+    { ATOMIC_FLAG_INIT, NULL, 0 }, { ATOMIC_FLAG_INIT, NULL, 0 },
+    { ATOMIC_FLAG_INIT, NULL, 0 }, { ATOMIC_FLAG_INIT, NULL, 0 },
+    { ATOMIC_FLAG_INIT, NULL, 0 }, { ATOMIC_FLAG_INIT, NULL, 0 }
+};
+
+static atomic_size_t system_allocations;
+static atomic_size_t reuses;
+static atomic_size_t idle_bytes;
+
+static bool class_for(size_t length, size_t* index)
+{
+    for (size_t i = 0; i < BUFFER_POOL_CLASS_COUNT; ++i) {
+        if (length <= class_capacities[i]) {
+            *index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// One budget across every class, so a burst in a single size cannot pin memory in all of them.
+static bool reserve_idle(size_t capacity)
+{
+    size_t held = atomic_load_explicit(&idle_bytes, memory_order_relaxed);
+    do {
+        if (capacity > BUFFER_POOL_IDLE_BYTES - held)
+            return false;
+    } while (!atomic_compare_exchange_weak_explicit(&idle_bytes, &held, held + capacity,
+        memory_order_relaxed, memory_order_relaxed));
+    return true;
+}
+
+static void lock_class(BufferPoolClass* pool_class)
+{
+    while (atomic_flag_test_and_set_explicit(&pool_class->lock, memory_order_acquire)) { }
+}
+
+static void unlock_class(BufferPoolClass* pool_class)
+{
+    atomic_flag_clear_explicit(&pool_class->lock, memory_order_release);
+}
+
+void* buffer_pool_acquire(size_t length)
+{
+    size_t index = 0;
+    if (length == 0)
+        return NULL;
+    if (!class_for(length, &index)) {
+        atomic_fetch_add_explicit(&system_allocations, 1u, memory_order_relaxed);
+        return malloc(length);
+    }
+    BufferPoolClass* pool_class = &classes[index];
+    lock_class(pool_class);
+    void* bytes = pool_class->idle;
+    if (bytes) {
+        memcpy(&pool_class->idle, bytes, sizeof(pool_class->idle));
+        pool_class->idle_count--;
+    }
+    unlock_class(pool_class);
+    if (bytes) {
+        atomic_fetch_sub_explicit(&idle_bytes, class_capacities[index], memory_order_relaxed);
+        atomic_fetch_add_explicit(&reuses, 1u, memory_order_relaxed);
+        return bytes;
+    }
+    atomic_fetch_add_explicit(&system_allocations, 1u, memory_order_relaxed);
+    return malloc(class_capacities[index]);
+}
+
+void buffer_pool_release(void* bytes, size_t length)
+{
+    size_t index = 0;
+    if (!bytes)
+        return;
+    if (!class_for(length, &index)) {
+        free(bytes);
+        return;
+    }
+    if (!reserve_idle(class_capacities[index])) {
+        free(bytes);
+        return;
+    }
+    BufferPoolClass* pool_class = &classes[index];
+    lock_class(pool_class);
+    memcpy(bytes, &pool_class->idle, sizeof(pool_class->idle));
+    pool_class->idle = bytes;
+    pool_class->idle_count++;
+    unlock_class(pool_class);
+}
+
+void buffer_pool_stats(BufferPoolStats* stats)
+{
+    if (!stats)
+        return;
+    stats->system_allocations = atomic_load_explicit(&system_allocations, memory_order_relaxed);
+    stats->reuses = atomic_load_explicit(&reuses, memory_order_relaxed);
+    stats->idle_bytes = atomic_load_explicit(&idle_bytes, memory_order_relaxed);
+}
+
+void buffer_pool_trim(void)
+{
+    for (size_t i = 0; i < BUFFER_POOL_CLASS_COUNT; ++i) {
+        BufferPoolClass* pool_class = &classes[i];
+        lock_class(pool_class);
+        void* bytes = pool_class->idle;
+        pool_class->idle = NULL;
+        atomic_fetch_sub_explicit(&idle_bytes, pool_class->idle_count * class_capacities[i],
+            memory_order_relaxed);
+        pool_class->idle_count = 0;
+        unlock_class(pool_class);
+        while (bytes) {
+            void* next = NULL;
+            memcpy(&next, bytes, sizeof(next));
+            free(bytes);
+            bytes = next;
+        }
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+
+#define BUFFER_POOL_IDLE_BYTES (16u * 1024u * 1024u)
+
+typedef struct {
+    size_t system_allocations;
+    size_t reuses;
+    size_t idle_bytes;
+} BufferPoolStats;
+
+void* buffer_pool_acquire(size_t length);
+void buffer_pool_release(void* bytes, size_t length);
+void buffer_pool_stats(BufferPoolStats* stats);
+void buffer_pool_trim(void);
+
+#endif
@@ -49,28 +49,35 @@ static void transfer_notice(void* context, const char* message)
 
 static bool is_file_message(RelayMessageType type)
 {
-    return type >= RELAY_MESSAGE_FILE_OFFER_CREATED
-        && type <= RELAY_MESSAGE_FILE_TRANSFER_CANCEL;
+    return (type >= RELAY_MESSAGE_FILE_OFFER_CREATED
+               && type <= RELAY_MESSAGE_FILE_TRANSFER_CANCEL)
+        || type == RELAY_MESSAGE_FILE_TRANSFER_CREDIT;
 }
 
-static void handle_server_message(void* context, const RelayMessage* message)
+static void handle_server_message(void* context, const RelayMessageView* view)
 {
     ClientUiContext* ui = context;
-    if (message->type == RELAY_MESSAGE_CHAT_DELIVER) {
-        add_message(ui->messages, message->as.chat_deliver.display_name,
-            message->as.chat_deliver.text);
+    if (is_file_message(view->type)) {
+        file_transfer_handle_view(ui->transfers, ui->transport, view);
+        return;
+    }
+    RelayMessage message;
+    if (!protocol_view_to_message(view, &message))
+        return;
+    if (message.type == RELAY_MESSAGE_CHAT_DELIVER) {
+        add_message(ui->messages, message.as.chat_deliver.display_name,
+            message.as.chat_deliver.text);
         *ui->should_scroll = true;
         return;
     }
-    if (message->type == RELAY_MESSAGE_WELCOME) {
+    if (message.type == RELAY_MESSAGE_WELCOME) {
         add_message(ui->messages, "SYSTEM", "Connected to the Relay Workspace");
         *ui->should_scroll = true;
         return;
     }
-    if (is_file_message(message->type) || message->type == RELAY_MESSAGE_ACTION_REJECTED)
-        file_transfer_handle_message(ui->transfers, ui->transport, message);
-    if (message->type == RELAY_MESSAGE_ACTION_REJECTED) {
-        add_message(ui->messages, "SYSTEM", message->as.action_rejected.reason);
+    if (message.type == RELAY_MESSAGE_ACTION_REJECTED) {
+        file_transfer_handle_message(ui->transfers, ui->transport, &message);
+        add_message(ui->messages, "SYSTEM", message.as.action_rejected.reason);
         *ui->should_scroll = true;
     }
 }
@@ -145,7 +152,7 @@ int main(void)
             panel_scroll_msg(font, &message_queue, &should_scroll_to_bottom);
             text_input(connection, display_name, &message_queue, &should_scroll_to_bottom);
 
-            if (client_connection_poll(connection, handle_server_message, &ui) < 0) {
+            if (client_connection_poll_views(connection, handle_server_message, &ui) < 0) {
                 connected = false;
                 file_transfer_abort_all(transfers, "Connection lost; active File Transfers stopped");
                 disconnect_from_server(connection);
@@ -1,7 +1,9 @@
 #include "platform.h"
 #include "client_network.h"
+#include "buffer_pool.h"
 
 #include <errno.h>
+#include <limits.h>
 #include <pthread.h>
 #include <stdatomic.h>
 #include <stdio.h>
@@ -11,21 +13,43 @@
 #ifdef _WIN32
 #include <io.h>
 #else
+#include <sys/uio.h>
 #include <unistd.h>
 #endif
 
 #define CLIENT_OUTBOUND_MAX_BYTES (32u * 1024u * 1024u)
 #define CLIENT_RECEIVE_CHUNK (64u * 1024u)
+#define CLIENT_NOTSENT_LOWAT (128u * 1024u)
+#define CLIENT_BULK_BATCH_BYTES (256u * 1024u)
+#if defined(__linux__) && !defined(TCP_NOTSENT_LOWAT)
+#define TCP_NOTSENT_LOWAT 25
+#endif
+#if defined(IOV_MAX) && IOV_MAX < 64
+#define CLIENT_WRITE_BATCH IOV_MAX
+#else
+#define CLIENT_WRITE_BATCH 64
+#endif
+
+typedef enum {
+    FRAME_LANE_CONTROL,
+    FRAME_LANE_BULK,
+    FRAME_LANE_COUNT
+} FrameLane;
 
 typedef struct FrameNode {
     uint8_t* bytes;
     size_t length;
+    uint8_t* payload;
+    size_t payload_length;
+    size_t payload_capacity;
+    uint64_t offer_id;
     struct FrameNode* next;
+    uint8_t header[PROTOCOL_CHUNK_HEADER_SIZE];
 } FrameNode;
 
 typedef struct {
-    FrameNode* head;
-    FrameNode* tail;
+    FrameNode* head[FRAME_LANE_COUNT];
+    FrameNode* tail[FRAME_LANE_COUNT];
     size_t bytes;
     bool closed;
     pthread_mutex_t mutex;
@@ -41,6 +65,7 @@ struct ClientConnection {
     ProtocolDecoder decoder;
     char display_name[PROTOCOL_DISPLAY_NAME_MAX + 1u];
     atomic_uint_fast64_t participant_id;
+    atomic_uint_fast32_t features;
 };
 
 static void frame_queue_init(FrameQueue* queue)
@@ -50,22 +75,51 @@ static void frame_queue_init(FrameQueue* queue)
     pthread_cond_init(&queue->available, NULL);
 }
 
+static FrameNode* frame_node_create(void)
+{
+    FrameNode* node = buffer_pool_acquire(sizeof(*node));
+    if (node)
+        memset(node, 0, sizeof(*node));
+    return node;
+}
+
+static size_t frame_node_size(const FrameNode* node)
+{
+    return node->length + node->payload_length;
+}
+
 static void frame_node_destroy(FrameNode* node)
 {
     if (!node)
         return;
-    free(node->bytes);
-    free(node);
+    if (node->bytes != node->header)
+        buffer_pool_release(node->bytes, node->length);
+    buffer_pool_release(node->payload, node->payload_capacity);
+    buffer_pool_release(node, sizeof(*node));
 }
 
-static RelaySendResult frame_queue_push(FrameQueue* queue, uint8_t* bytes, size_t length)
+static bool bulk_lane_holds_offer(const FrameQueue* queue, uint64_t offer_id)
 {
-    FrameNode* node = malloc(sizeof(*node));
-    if (!node)
-        return RELAY_SEND_ERROR;
-    node->bytes = bytes;
-    node->length = length;
-    node->next = NULL;
+    for (const FrameNode* node = queue->head[FRAME_LANE_BULK]; node; node = node->next) {
+        if (node->offer_id == offer_id)
+            return true;
+    }
+    return false;
+}
+
+static FrameLane frame_lane(const FrameQueue* queue, const FrameNode* node)
+{
+    if (node->offer_id == 0)
+        return FRAME_LANE_CONTROL;
+    if (node->bytes[0] != RELAY_MESSAGE_FILE_TRANSFER_CANCEL)
+        return FRAME_LANE_BULK;
+    return bulk_lane_holds_offer(queue, node->offer_id) ? FRAME_LANE_BULK : FRAME_LANE_CONTROL;
+}
+
+static RelaySendResult frame_queue_push(FrameQueue* queue, FrameNode* node)
+{
+    size_t length = frame_node_size(node);
+    (void)protocol_frame_offer_id(node->bytes, node->length, &node->offer_id);
 
     pthread_mutex_lock(&queue->mutex);
     RelaySendResult result = RELAY_SEND_OK;
@@ -74,35 +128,76 @@ static RelaySendResult frame_queue_push(FrameQueue* queue, uint8_t* bytes, size_
     } else if (length > CLIENT_OUTBOUND_MAX_BYTES - queue->bytes) {
         result = RELAY_SEND_BACKPRESSURE;
     } else {
-        if (queue->tail)
-            queue->tail->next = node;
+        FrameLane lane = frame_lane(queue, node);
+        if (queue->tail[lane])
+            queue->tail[lane]->next = node;
         else
-            queue->head = node;
-        queue->tail = node;
+            queue->head[lane] = node;
+        queue->tail[lane] = node;
         queue->bytes += length;
         pthread_cond_signal(&queue->available);
     }
     pthread_mutex_unlock(&queue->mutex);
-
-    if (result != RELAY_SEND_OK)
-        free(node);
     return result;
 }
 
-static FrameNode* frame_queue_pop(FrameQueue* queue)
+static size_t frame_queue_pop_batch(FrameQueue* queue, FrameNode** nodes, size_t capacity)
 {
     pthread_mutex_lock(&queue->mutex);
-    while (!queue->head && !queue->closed)
+    while (!queue->head[FRAME_LANE_CONTROL] && !queue->head[FRAME_LANE_BULK] && !queue->closed)
         pthread_cond_wait(&queue->available, &queue->mutex);
-    FrameNode* node = queue->head;
-    if (node) {
-        queue->head = node->next;
-        if (!queue->head)
-            queue->tail = NULL;
-        queue->bytes -= node->length;
+    size_t count = 0;
+    size_t bulk_bytes = 0;
+    for (int lane = 0; lane < FRAME_LANE_COUNT; ++lane) {
+        while (queue->head[lane] && count < capacity && bulk_bytes < CLIENT_BULK_BATCH_BYTES) {
+            FrameNode* node = queue->head[lane];
+            queue->head[lane] = node->next;
+            queue->bytes -= frame_node_size(node);
+            if (lane == FRAME_LANE_BULK)
+                bulk_bytes += frame_node_size(node);
+            node->next = NULL;
+            nodes[count++] = node;
+        }
+        if (!queue->head[lane])
+            queue->tail[lane] = NULL;
     }
     pthread_mutex_unlock(&queue->mutex);
-    return node;
+    return count;
+}
+
+static size_t frame_queue_purge(FrameQueue* queue, uint64_t offer_id)
+{
+    FrameNode* purged = NULL;
+    size_t count = 0;
+    pthread_mutex_lock(&queue->mutex);
+    FrameNode* previous = NULL;
+    FrameNode* node = queue->head[FRAME_LANE_BULK];
+    while (node) {
+        FrameNode* next = node->next;
+        if (node->offer_id != offer_id || node->bytes[0] == RELAY_MESSAGE_FILE_TRANSFER_CANCEL) {
+            previous = node;
+            node = next;
+            continue;
+        }
+        if (previous)
+            previous->next = next;
+        else
+            queue->head[FRAME_LANE_BULK] = next;
+        if (queue->tail[FRAME_LANE_BULK] == node)
+            queue->tail[FRAME_LANE_BULK] = previous;
+        queue->bytes -= frame_node_size(node);
+        node->next = purged;
+        purged = node;
+        count++;
+        node = next;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    while (purged) {
+        FrameNode* next = purged->next;
+        frame_node_destroy(purged);
+        purged = next;
+    }
+    return count;
 }
 
 static void frame_queue_close(FrameQueue* queue)
@@ -123,15 +218,21 @@ static void frame_queue_reopen(FrameQueue* queue)
 static void frame_queue_discard(FrameQueue* queue)
 {
     pthread_mutex_lock(&queue->mutex);
-    FrameNode* node = queue->head;
-    queue->head = NULL;
-    queue->tail = NULL;
+    FrameNode* heads[FRAME_LANE_COUNT];
+    for (int lane = 0; lane < FRAME_LANE_COUNT; ++lane) {
+        heads[lane] = queue->head[lane];
+        queue->head[lane] = NULL;
+        queue->tail[lane] = NULL;
+    }
     queue->bytes = 0;
     pthread_mutex_unlock(&queue->mutex);
-    while (node) {
-        FrameNode* next = node->next;
-        frame_node_destroy(node);
-        node = next;
+    for (int lane = 0; lane < FRAME_LANE_COUNT; ++lane) {
+        FrameNode* node = heads[lane];
+        while (node) {
+            FrameNode* next = node->next;
+            frame_node_destroy(node);
+            node = next;
+        }
     }
 }
 
@@ -158,37 +259,89 @@ static void optimize_socket_for_lan(int socket_fd)
 {
 #ifdef _WIN32
     char nodelay = 1;
-    int buffer_size = 8 * 1024 * 1024;
     (void)setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
-    (void)setsockopt(socket_fd, SOL_SOCKET, SO_SNDBUF, (char*)&buffer_size, sizeof(buffer_size));
-    (void)setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, (char*)&buffer_size, sizeof(buffer_size));
 #else
     int nodelay = 1;
-    int buffer_size = 8 * 1024 * 1024;
     (void)setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
-    (void)setsockopt(socket_fd, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
-    (void)setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+#ifdef TCP_NOTSENT_LOWAT
+    int lowat = CLIENT_NOTSENT_LOWAT;
+    (void)setsockopt(socket_fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+#endif
 #endif
 }
 
-static ssize_t send_all(int socket_fd, const uint8_t* bytes, size_t length)
+static size_t frame_slices(FrameNode** frames, size_t count, size_t first_offset,
+    ProtocolSlice* slices)
 {
-    size_t sent = 0;
-    unsigned stalled = 0;
-    while (sent < length) {
+    size_t used = 0;
+    for (size_t i = 0; i < count && used < CLIENT_WRITE_BATCH; ++i) {
+        size_t offset = i == 0 ? first_offset : 0;
+        if (offset < frames[i]->length) {
+            slices[used++] = (ProtocolSlice) {
+                .bytes = frames[i]->bytes + offset,
+                .length = frames[i]->length - offset
+            };
+            offset = 0;
+        } else {
+            offset -= frames[i]->length;
+        }
+        if (frames[i]->payload_length > 0 && used < CLIENT_WRITE_BATCH) {
+            slices[used++] = (ProtocolSlice) {
+                .bytes = frames[i]->payload + offset,
+                .length = frames[i]->payload_length - offset
+            };
+        }
+    }
+    return used;
+}
+
+static ssize_t send_frame_batch(int socket_fd, FrameNode** frames, size_t count,
+    size_t first_offset)
+{
+    ProtocolSlice slices[CLIENT_WRITE_BATCH];
+    size_t used = frame_slices(frames, count, first_offset, slices);
 #ifdef _WIN32
-        ssize_t result = send(socket_fd, (const char*)bytes + sent, (int)(length - sent), 0);
+    WSABUF buffers[CLIENT_WRITE_BATCH];
+    for (size_t i = 0; i < used; ++i) {
+        buffers[i].buf = (char*)slices[i].bytes;
+        buffers[i].len = slices[i].length > (size_t)ULONG_MAX ? ULONG_MAX : (ULONG)slices[i].length;
+    }
+    DWORD sent = 0;
+    if (WSASend(socket_fd, buffers, (DWORD)used, &sent, 0, NULL, NULL) != 0)
+        return -1;
+    return (ssize_t)sent;
 #else
-        ssize_t result = send(socket_fd, bytes + sent, length - sent, MSG_NOSIGNAL);
+    struct iovec buffers[CLIENT_WRITE_BATCH];
+    for (size_t i = 0; i < used; ++i) {
+        buffers[i].iov_base = (void*)slices[i].bytes;
+        buffers[i].iov_len = slices[i].length;
+    }
+    struct msghdr header = { .msg_iov = buffers, .msg_iovlen = used };
+    return sendmsg(socket_fd, &header, MSG_NOSIGNAL);
 #endif
+}
+
+static bool send_all_frames(int socket_fd, FrameNode** frames, size_t count)
+{
+    size_t index = 0;
+    size_t offset = 0;
+    unsigned stalled = 0;
+    while (index < count) {
+        ssize_t result = send_frame_batch(socket_fd, frames + index, count - index, offset);
         if (result > 0) {
-            sent += (size_t)result;
+            size_t sent = (size_t)result;
+            while (index < count && sent >= frame_node_size(frames[index]) - offset) {
+                sent -= frame_node_size(frames[index]) - offset;
+                offset = 0;
+                index++;
+            }
+            offset += sent;
             stalled = 0;
             continue;
         }
         if (result == 0) {
             if (++stalled > 20)
-                return -1;
+                return false;
             (void)wait_socket_writable(socket_fd, 100);
             continue;
         }
@@ -203,25 +356,26 @@ static ssize_t send_all(int socket_fd, const uint8_t* bytes, size_t length)
             if (++stalled <= 20)
                 continue;
         }
-        return -1;
+        return false;
     }
-    return (ssize_t)sent;
+    return true;
 }
 
 static void* sender_thread_main(void* argument)
 {
     ClientConnection* connection = argument;
     for (;;) {
-        FrameNode* frame = frame_queue_pop(&connection->outbound);
-        if (!frame)
+        FrameNode* frames[CLIENT_WRITE_BATCH];
+        size_t count = frame_queue_pop_batch(&connection->outbound, frames, CLIENT_WRITE_BATCH);
+        if (count == 0)
             break;
         if (atomic_load(&connection->connected)
-            && send_all(connection->socket_fd, frame->bytes, frame->length)
-                != (ssize_t)frame->length) {
+            && !send_all_frames(connection->socket_fd, frames, count)) {
             atomic_store(&connection->connected, false);
             frame_queue_close(&connection->outbound);
         }
-        frame_node_destroy(frame);
+        for (size_t i = 0; i < count; ++i)
+            frame_node_destroy(frames[i]);
     }
     return NULL;
 }
@@ -234,6 +388,7 @@ ClientConnection* client_connection_create(void)
     connection->socket_fd = -1;
     atomic_init(&connection->connected, false);
     atomic_init(&connection->participant_id, 0);
+    atomic_init(&connection->features, 0);
     frame_queue_init(&connection->outbound);
     protocol_decoder_init(&connection->decoder);
     return connection;
@@ -314,6 +469,7 @@ int connect_to_server(ClientConnection* connection, const char* host, const char
     frame_queue_reopen(&connection->outbound);
     protocol_decoder_reset(&connection->decoder);
     atomic_store(&connection->participant_id, 0);
+    atomic_store(&connection->features, 0);
     snprintf(connection->display_name, sizeof(connection->display_name), "%s", display_name);
     atomic_store(&connection->connected, true);
 
@@ -328,6 +484,7 @@ int connect_to_server(ClientConnection* connection, const char* host, const char
 
     RelayMessage hello = { .type = RELAY_MESSAGE_HELLO };
     hello.as.hello.version = PROTOCOL_VERSION;
+    hello.as.hello.features = PROTOCOL_FEATURES_SUPPORTED;
     snprintf(hello.as.hello.display_name, sizeof(hello.as.hello.display_name), "%s", display_name);
     if (client_connection_send(connection, &hello) != RELAY_SEND_OK) {
         disconnect_from_server(connection);
@@ -361,6 +518,7 @@ void disconnect_from_server(ClientConnection* connection)
     frame_queue_discard(&connection->outbound);
     protocol_decoder_reset(&connection->decoder);
     atomic_store(&connection->participant_id, 0);
+    atomic_store(&connection->features, 0);
 }
 
 bool client_connection_is_connected(const ClientConnection* connection)
@@ -373,6 +531,11 @@ uint64_t client_connection_participant_id(const ClientConnection* connection)
     return connection ? atomic_load(&connection->participant_id) : 0;
 }
 
+uint32_t client_connection_features(const ClientConnection* connection)
+{
+    return connection ? (uint32_t)atomic_load(&connection->features) : 0;
+}
+
 const char* client_connection_display_name(const ClientConnection* connection)
 {
     return connection ? connection->display_name : "";
@@ -383,13 +546,44 @@ RelaySendResult client_connection_send(ClientConnection* connection,
 {
     if (!connection || !atomic_load(&connection->connected))
         return RELAY_SEND_CLOSED;
-    uint8_t* frame = NULL;
-    size_t frame_length = 0;
-    if (!protocol_encode(message, &frame, &frame_length))
+    FrameNode* node = frame_node_create();
+    if (!node)
         return RELAY_SEND_ERROR;
-    RelaySendResult result = frame_queue_push(&connection->outbound, frame, frame_length);
+    if (!protocol_encode(message, &node->bytes, &node->length)) {
+        frame_node_destroy(node);
+        return RELAY_SEND_ERROR;
+    }
+    RelaySendResult result = frame_queue_push(&connection->outbound, node);
     if (result != RELAY_SEND_OK)
-        free(frame);
+        frame_node_destroy(node);
+    return result;
+}
+
+RelaySendResult client_connection_send_chunk(ClientConnection* connection,
+    const RelayMessage* chunk, size_t data_capacity)
+{
+    if (!connection || !atomic_load(&connection->connected))
+        return RELAY_SEND_CLOSED;
+    if (!chunk || chunk->type != RELAY_MESSAGE_FILE_CHUNK)
+        return RELAY_SEND_ERROR;
+    FrameNode* node = frame_node_create();
+    if (!node)
+        return RELAY_SEND_ERROR;
+    ProtocolSlice slices[2];
+    if (protocol_encode_iov(chunk, node->header, sizeof(node->header), slices) != 2) {
+        frame_node_destroy(node);
+        return RELAY_SEND_ERROR;
+    }
+    node->bytes = node->header;
+    node->length = slices[0].length;
+    node->payload = chunk->as.file_chunk.data;
+    node->payload_length = slices[1].length;
+    node->payload_capacity = data_capacity;
+    RelaySendResult result = frame_queue_push(&connection->outbound, node);
+    if (result != RELAY_SEND_OK) {
+        node->payload = NULL;
+        frame_node_destroy(node);
+    }
     return result;
 }
 
@@ -402,21 +596,31 @@ RelaySendResult client_connection_send_chat(ClientConnection* connection, const
     return client_connection_send(connection, &message);
 }
 
+size_t client_connection_purge_offer(ClientConnection* connection, uint64_t offer_id)
+{
+    if (!connection || offer_id == 0)
+        return 0;
+    return frame_queue_purge(&connection->outbound, offer_id);
+}
+
 typedef struct {
     ClientConnection* connection;
-    RelayMessageHandler handler;
+    RelayMessageViewHandler handler;
     void* context;
 } PollContext;
 
-static void handle_incoming(void* opaque, const RelayMessage* message)
+static void handle_incoming(void* opaque, const RelayMessageView* view)
 {
     PollContext* poll = opaque;
-    if (message->type == RELAY_MESSAGE_WELCOME)
-        atomic_store(&poll->connection->participant_id, message->as.welcome.participant_id);
-    poll->handler(poll->context, message);
+    if (view->type == RELAY_MESSAGE_WELCOME) {
+        atomic_store(&poll->connection->participant_id, view->as.welcome.participant_id);
+        atomic_store(&poll->connection->features,
+            view->as.welcome.features & PROTOCOL_FEATURES_SUPPORTED);
+    }
+    poll->handler(poll->context, view);
 }
 
-int client_connection_poll(ClientConnection* connection, RelayMessageHandler handler,
+int client_connection_poll_views(ClientConnection* connection, RelayMessageViewHandler handler,
     void* context)
 {
     if (!connection || !handler)
@@ -429,15 +633,25 @@ int client_connection_poll(ClientConnection* connection, RelayMessageHandler han
     PollContext poll = { .connection = connection, .handler = handler, .context = context };
     int messages_available = 0;
     for (;;) {
+        size_t space = 0;
+        uint8_t* target = protocol_decoder_receive_space(&connection->decoder, &space);
+        if (!target) {
+            target = buffer;
+            space = sizeof(buffer);
+        }
 #ifdef _WIN32
-        int received = recv(connection->socket_fd, (char*)buffer, (int)sizeof(buffer), 0);
+        int received = recv(connection->socket_fd, (char*)target, (int)space, 0);
 #else
-        ssize_t received = recv(connection->socket_fd, buffer, sizeof(buffer), 0);
+        ssize_t received = recv(connection->socket_fd, target, space, 0);
 #endif
         if (received > 0) {
             messages_available = 1;
-            if (!protocol_decoder_feed(&connection->decoder, buffer, (size_t)received,
-                    handle_incoming, &poll)) {
+            bool decoded = target == buffer
+                ? protocol_decoder_feed_views(&connection->decoder, buffer, (size_t)received,
+                      handle_incoming, &poll)
+                : protocol_decoder_commit_views(&connection->decoder, (size_t)received,
+                      handle_incoming, &poll);
+            if (!decoded) {
                 disconnect_from_server(connection);
                 return -1;
             }
@@ -461,21 +675,56 @@ int client_connection_poll(ClientConnection* connection, RelayMessageHandler han
     return messages_available;
 }
 
+typedef struct {
+    RelayMessageHandler handler;
+    void* context;
+} MessagePoll;
+
+static void deliver_incoming(void* opaque, const RelayMessageView* view)
+{
+    MessagePoll* poll = opaque;
+    RelayMessage message;
+    if (protocol_view_to_message(view, &message))
+        poll->handler(poll->context, &message);
+}
+
+int client_connection_poll(ClientConnection* connection, RelayMessageHandler handler,
+    void* context)
+{
+    if (!handler)
+        return -1;
+    MessagePoll poll = { .handler = handler, .context = context };
+    return client_connection_poll_views(connection, deliver_incoming, &poll);
+}
+
 static RelaySendResult transport_send(void* context, const RelayMessage* message)
 {
     return client_connection_send(context, message);
 }
 
+static RelaySendResult transport_send_chunk(void* context, const RelayMessage* chunk,
+    size_t data_capacity)
+{
+    return client_connection_send_chunk(context, chunk, data_capacity);
+}
+
 static bool transport_connected(void* context)
 {
     return client_connection_is_connected(context);
 }
 
+static void transport_purge(void* context, uint64_t offer_id)
+{
+    (void)client_connection_purge_offer(context, offer_id);
+}
+
 RelayTransport client_connection_transport(ClientConnection* connection)
 {
     return (RelayTransport) {
         .context = connection,
         .send = transport_send,
-        .connected = transport_connected
+        .connected = transport_connected,
+        .purge = transport_purge,
+        .send_chunk = transport_send_chunk
     };
 }
@@ -5,6 +5,7 @@
 #include "relay_transport.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef struct ClientConnection ClientConnection;
@@ -18,15 +19,21 @@ void disconnect_from_server(ClientConnection* connection);
 
 bool client_connection_is_connected(const ClientConnection* connection);
 uint64_t client_connection_participant_id(const ClientConnection* connection);
+uint32_t client_connection_features(const ClientConnection* connection);
 const char* client_connection_display_name(const ClientConnection* connection);
 
 RelaySendResult client_connection_send(ClientConnection* connection,
     const RelayMessage* message);
+RelaySendResult client_connection_send_chunk(ClientConnection* connection,
+    const RelayMessage* chunk, size_t data_capacity);
 RelaySendResult client_connection_send_chat(ClientConnection* connection,
     const char* text);
+size_t client_connection_purge_offer(ClientConnection* connection, uint64_t offer_id);
 
 int client_connection_poll(ClientConnection* connection, RelayMessageHandler handler,
     void* context);
+int client_connection_poll_views(ClientConnection* connection, RelayMessageViewHandler handler,
+    void* context);
 
 RelayTransport client_connection_transport(ClientConnection* connection);
 
@@ -1,4 +1,5 @@
 #include "file_transfer.h"
+#include "buffer_pool.h"
 #include "platform.h"
 
 #include <errno.h>
@@ -35,6 +36,8 @@ typedef struct {
     char filename[PROTOCOL_FILENAME_MAX + 1u];
     uint64_t total_size;
     uint64_t sent_size;
+    uint64_t credit_limit;
+    uint64_t delivered_size;
     uint32_t chunk_size;
     uint16_t pending_results;
 } OutgoingTransfer;
@@ -117,6 +120,23 @@ static bool pump_controls(FileTransferModule* module, const RelayTransport* tran
     return true;
 }
 
+static bool send_progress(FileTransferModule* module, const RelayTransport* transport,
+    uint64_t offer_id, uint64_t written_bytes)
+{
+    for (size_t i = 0; i < module->pending_control_count; ++i) {
+        RelayMessage* pending = &module->pending_controls[i];
+        if (pending->type == RELAY_MESSAGE_FILE_DELIVERY_PROGRESS
+            && pending->as.file_delivery_progress.offer_id == offer_id) {
+            pending->as.file_delivery_progress.written_bytes = written_bytes;
+            return true;
+        }
+    }
+    RelayMessage progress = { .type = RELAY_MESSAGE_FILE_DELIVERY_PROGRESS };
+    progress.as.file_delivery_progress.offer_id = offer_id;
+    progress.as.file_delivery_progress.written_bytes = written_bytes;
+    return send_control(module, transport, &progress);
+}
+
 static bool secure_random_bytes(uint8_t* bytes, size_t length)
 {
 #ifdef _WIN32
@@ -269,10 +289,11 @@ static IncomingTransfer* incoming_by_offer(FileTransferModule* module, uint64_t
     return NULL;
 }
 
-static void clear_outgoing(OutgoingTransfer* transfer)
+static void clear_outgoing(const RelayTransport* transport, OutgoingTransfer* transfer)
 {
     if (!transfer)
         return;
+    relay_transport_purge(transport, transfer->offer_id);
     if (transfer->file)
         fclose(transfer->file);
     memset(transfer, 0, sizeof(*transfer));
@@ -287,11 +308,12 @@ static void cancel_outgoing(FileTransferModule* module, const RelayTransport* tr
     cancel.as.file_transfer_cancel.offer_id = transfer->offer_id;
     snprintf(cancel.as.file_transfer_cancel.reason,
         sizeof(cancel.as.file_transfer_cancel.reason), "%s", reason ? reason : "Cancelled");
-    if (transfer->offer_id != 0)
+    char filename[PROTOCOL_FILENAME_MAX + 1u];
+    snprintf(filename, sizeof(filename), "%s", transfer->filename);
+    clear_outgoing(transport, transfer);
+    if (cancel.as.file_transfer_cancel.offer_id != 0)
         (void)send_control(module, transport, &cancel);
-    notify(module, "%s was cancelled (%s)", transfer->filename,
-        reason ? reason : "Cancelled");
-    clear_outgoing(transfer);
+    notify(module, "%s was cancelled (%s)", filename, reason ? reason : "Cancelled");
 }
 
 static void clear_incoming(IncomingTransfer* transfer, bool remove_partial)
@@ -439,7 +461,7 @@ bool file_transfer_offer_file(FileTransferModule* module, const RelayTransport*
     snprintf(transfer->filename, sizeof(transfer->filename), "%s", base_name(path));
     sanitize_filename(transfer->filename);
     if (transfer->request_id == 0) {
-        clear_outgoing(transfer);
+        clear_outgoing(transport, transfer);
         notify(module, "Could not create a secure File Offer identity");
         return false;
     }
@@ -451,7 +473,7 @@ bool file_transfer_offer_file(FileTransferModule* module, const RelayTransport*
     snprintf(create.as.file_offer_create.filename,
         sizeof(create.as.file_offer_create.filename), "%s", transfer->filename);
     if (!send_control(module, transport, &create)) {
-        clear_outgoing(transfer);
+        clear_outgoing(transport, transfer);
         notify(module, "File Offer could not be queued");
         return false;
     }
@@ -508,25 +530,41 @@ static void handle_transfer_ready(FileTransferModule* module, const RelayMessage
     notify(module, "%u Recipients accepted %s", transfer->pending_results, transfer->filename);
 }
 
+static void handle_transfer_credit(FileTransferModule* module, const RelayMessage* message)
+{
+    OutgoingTransfer* transfer = outgoing_by_offer(module,
+        message->as.file_transfer_credit.offer_id);
+    if (!transfer || (transfer->state != OUTGOING_SENDING
+                         && transfer->state != OUTGOING_AWAITING_RESULTS))
+        return;
+    if (message->as.file_transfer_credit.credit_limit > transfer->credit_limit)
+        transfer->credit_limit = message->as.file_transfer_credit.credit_limit;
+    if (message->as.file_transfer_credit.delivered_bytes > transfer->delivered_size)
+        transfer->delivered_size = message->as.file_transfer_credit.delivered_bytes;
+}
+
 static void handle_incoming_chunk(FileTransferModule* module,
-    const RelayTransport* transport, const RelayMessage* message)
+    const RelayTransport* transport, uint64_t offer_id, uint64_t offset,
+    const uint8_t* data, uint32_t data_length)
 {
-    IncomingTransfer* transfer = incoming_by_offer(module, message->as.file_chunk.offer_id);
+    IncomingTransfer* transfer = incoming_by_offer(module, offer_id);
     if (!transfer || transfer->state != INCOMING_RECEIVING || !transfer->file)
         return;
-    if (message->as.file_chunk.offset != transfer->received_size
+    if (offset != transfer->received_size
         || transfer->received_size > transfer->total_size
-        || message->as.file_chunk.data_length > transfer->total_size - transfer->received_size) {
+        || data_length > transfer->total_size - transfer->received_size) {
         fail_incoming(module, transport, transfer, "File Transfer offset or size mismatch");
         return;
     }
-    size_t written = fwrite(message->as.file_chunk.data, 1,
-        message->as.file_chunk.data_length, transfer->file);
-    if (written != message->as.file_chunk.data_length) {
+    size_t written = fwrite(data, 1, data_length, transfer->file);
+    if (written != data_length) {
         fail_incoming(module, transport, transfer, "Disk write failed");
         return;
     }
     transfer->received_size += written;
+
+    if (!send_progress(module, transport, transfer->offer_id, transfer->received_size))
+        fail_incoming(module, transport, transfer, "Delivery progress could not be queued");
 }
 
 static void handle_incoming_end(FileTransferModule* module,
@@ -562,7 +600,8 @@ static void handle_incoming_end(FileTransferModule* module,
     notify(module, "Received File %s", filename);
 }
 
-static void handle_delivery_update(FileTransferModule* module, const RelayMessage* message)
+static void handle_delivery_update(FileTransferModule* module,
+    const RelayTransport* transport, const RelayMessage* message)
 {
     OutgoingTransfer* transfer = outgoing_by_offer(module,
         message->as.file_delivery_update.offer_id);
@@ -577,10 +616,11 @@ static void handle_delivery_update(FileTransferModule* module, const RelayMessag
     if (transfer->pending_results > 0)
         transfer->pending_results--;
     if (transfer->pending_results == 0 && transfer->state == OUTGOING_AWAITING_RESULTS)
-        clear_outgoing(transfer);
+        clear_outgoing(transport, transfer);
 }
 
-static void handle_cancel(FileTransferModule* module, const RelayMessage* message)
+static void handle_cancel(FileTransferModule* module, const RelayTransport* transport,
+    const RelayMessage* message)
 {
     IncomingTransfer* incoming = incoming_by_offer(module,
         message->as.file_transfer_cancel.offer_id);
@@ -596,7 +636,7 @@ static void handle_cancel(FileTransferModule* module, const RelayMessage* messag
     if (outgoing) {
         char filename[PROTOCOL_FILENAME_MAX + 1u];
         snprintf(filename, sizeof(filename), "%s", outgoing->filename);
-        clear_outgoing(outgoing);
+        clear_outgoing(transport, outgoing);
         notify(module, "%s was cancelled (%s)", filename,
             message->as.file_transfer_cancel.reason);
     }
@@ -617,14 +657,19 @@ void file_transfer_handle_message(FileTransferModule* module,
     case RELAY_MESSAGE_FILE_TRANSFER_READY:
         handle_transfer_ready(module, message);
         break;
+    case RELAY_MESSAGE_FILE_TRANSFER_CREDIT:
+        handle_transfer_credit(module, message);
+        break;
     case RELAY_MESSAGE_FILE_CHUNK:
-        handle_incoming_chunk(module, transport, message);
+        handle_incoming_chunk(module, transport, message->as.file_chunk.offer_id,
+            message->as.file_chunk.offset, message->as.file_chunk.data,
+            message->as.file_chunk.data_length);
         break;
     case RELAY_MESSAGE_FILE_TRANSFER_END:
         handle_incoming_end(module, transport, message);
         break;
     case RELAY_MESSAGE_FILE_DELIVERY_UPDATE:
-        handle_delivery_update(module, message);
+        handle_delivery_update(module, transport, message);
         break;
     case RELAY_MESSAGE_FILE_OFFER_DECLINED: {
         OutgoingTransfer* transfer = outgoing_by_offer(module,
@@ -632,13 +677,13 @@ void file_transfer_handle_message(FileTransferModule* module,
         if (transfer) {
             char filename[PROTOCOL_FILENAME_MAX + 1u];
             snprintf(filename, sizeof(filename), "%s", transfer->filename);
-            clear_outgoing(transfer);
+            clear_outgoing(transport, transfer);
             notify(module, "File Offer for %s was declined", filename);
         }
         break;
     }
     case RELAY_MESSAGE_FILE_TRANSFER_CANCEL:
-        handle_cancel(module, message);
+        handle_cancel(module, transport, message);
         break;
     case RELAY_MESSAGE_ACTION_REJECTED: {
         OutgoingTransfer* transfer = message->as.action_rejected.rejected_type
@@ -648,7 +693,7 @@ void file_transfer_handle_message(FileTransferModule* module,
         if (transfer) {
             char filename[PROTOCOL_FILENAME_MAX + 1u];
             snprintf(filename, sizeof(filename), "%s", transfer->filename);
-            clear_outgoing(transfer);
+            clear_outgoing(transport, transfer);
             notify(module, "%s was rejected (%s)", filename,
                 message->as.action_rejected.reason);
         }
@@ -659,6 +704,22 @@ void file_transfer_handle_message(FileTransferModule* module,
     }
 }
 
+void file_transfer_handle_view(FileTransferModule* module,
+    const RelayTransport* transport, const RelayMessageView* view)
+{
+    if (!module || !transport || !view)
+        return;
+    if (view->type == RELAY_MESSAGE_FILE_CHUNK) {
+        handle_incoming_chunk(module, transport, view->as.file_chunk.offer_id,
+            view->as.file_chunk.offset, view->as.file_chunk.data,
+            view->as.file_chunk.data_length);
+        return;
+    }
+    RelayMessage message;
+    if (protocol_view_to_message(view, &message))
+        file_transfer_handle_message(module, transport, &message);
+}
+
 void file_transfer_pump(FileTransferModule* module, const RelayTransport* transport)
 {
     if (!module || !transport || !relay_transport_is_connected(transport))
@@ -670,18 +731,21 @@ void file_transfer_pump(FileTransferModule* module, const RelayTransport* transp
         OutgoingTransfer* transfer = &module->outgoing[i];
         if (transfer->state != OUTGOING_SENDING)
             continue;
-        while (transfer->sent_size < transfer->total_size && budget > 0) {
-            uint64_t remaining = transfer->total_size - transfer->sent_size;
+        while (transfer->sent_size < transfer->total_size
+            && transfer->sent_size < transfer->credit_limit && budget > 0) {
+            uint64_t remaining = transfer->credit_limit < transfer->total_size
+                ? transfer->credit_limit - transfer->sent_size
+                : transfer->total_size - transfer->sent_size;
             uint32_t wanted = remaining > transfer->chunk_size
                 ? transfer->chunk_size : (uint32_t)remaining;
-            uint8_t* bytes = malloc(wanted);
+            uint8_t* bytes = buffer_pool_acquire(wanted);
             if (!bytes) {
                 notify(module, "Could not allocate a File Transfer chunk");
                 return;
             }
             size_t read_count = fread(bytes, 1, wanted, transfer->file);
             if (read_count != wanted) {
-                free(bytes);
+                buffer_pool_release(bytes, wanted);
                 cancel_outgoing(module, transport, transfer, "File read failed");
                 break;
             }
@@ -690,8 +754,9 @@ void file_transfer_pump(FileTransferModule* module, const RelayTransport* transp
             chunk.as.file_chunk.offset = transfer->sent_size;
             chunk.as.file_chunk.data = bytes;
             chunk.as.file_chunk.data_length = (uint32_t)read_count;
-            RelaySendResult result = relay_transport_send(transport, &chunk);
-            free(bytes);
+            RelaySendResult result = relay_transport_send_chunk(transport, &chunk, wanted);
+            if (result != RELAY_SEND_OK)
+                buffer_pool_release(bytes, wanted);
             if (result == RELAY_SEND_BACKPRESSURE) {
                 if (fseek(transfer->file, -(long)read_count, SEEK_CUR) != 0)
                     cancel_outgoing(module, transport, transfer,
@@ -700,7 +765,7 @@ void file_transfer_pump(FileTransferModule* module, const RelayTransport* transp
             }
             if (result != RELAY_SEND_OK) {
                 notify(module, "File Transfer connection closed");
-                clear_outgoing(transfer);
+                clear_outgoing(transport, transfer);
                 return;
             }
             transfer->sent_size += read_count;
@@ -715,7 +780,7 @@ void file_transfer_pump(FileTransferModule* module, const RelayTransport* transp
             if (result == RELAY_SEND_BACKPRESSURE)
                 return;
             if (result != RELAY_SEND_OK) {
-                clear_outgoing(transfer);
+                clear_outgoing(transport, transfer);
                 return;
             }
             fclose(transfer->file);
@@ -732,7 +797,7 @@ void file_transfer_abort_all(FileTransferModule* module, const char* reason)
         return;
     for (size_t i = 0; i < FILE_TRANSFER_MAX_ACTIVE; ++i) {
         if (module->outgoing[i].state != OUTGOING_FREE)
-            clear_outgoing(&module->outgoing[i]);
+            clear_outgoing(NULL, &module->outgoing[i]);
         if (module->incoming[i].state != INCOMING_FREE)
             clear_incoming(&module->incoming[i], true);
     }
@@ -864,7 +929,7 @@ bool file_transfer_progress(const FileTransferModule* module, size_t index,
                 progress->offer_id = outgoing->offer_id;
                 progress->direction = FILE_TRANSFER_SENDING;
                 progress->total_size = outgoing->total_size;
-                progress->transferred_size = outgoing->sent_size;
+                progress->transferred_size = outgoing->delivered_size;
                 snprintf(progress->filename, sizeof(progress->filename), "%s",
                     outgoing->filename);
                 return true;
@@ -51,6 +51,8 @@ bool file_transfer_offer_file(FileTransferModule* module, const RelayTransport*
     const char* path);
 void file_transfer_handle_message(FileTransferModule* module,
     const RelayTransport* transport, const RelayMessage* message);
+void file_transfer_handle_view(FileTransferModule* module,
+    const RelayTransport* transport, const RelayMessageView* view);
 void file_transfer_pump(FileTransferModule* module, const RelayTransport* transport);
 void file_transfer_abort_all(FileTransferModule* module, const char* reason);
 
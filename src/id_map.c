@@ -0,0 +1,120 @@
+#include "id_map.h"
+
+#include <stdlib.h>
+
+#define ID_MAP_MIN_CAPACITY 16u
+
+static size_t id_map_slot(uint64_t key, size_t capacity)
+{
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31;
+    return (size_t)key & (capacity - 1u);
+}
+
+static size_t id_map_capacity_for(size_t count)
+{
+    size_t capacity = ID_MAP_MIN_CAPACITY;
+    while (capacity / 2u < count)
+        capacity *= 2u;
+    return capacity;
+}
+
+static void id_map_insert(IdMapEntry* entries, size_t capacity, uint64_t key, void* value)
+{
+    size_t slot = id_map_slot(key, capacity);
+    while (entries[slot].key != 0 && entries[slot].key != key)
+        slot = (slot + 1u) & (capacity - 1u);
+    entries[slot].key = key;
+    entries[slot].value = value;
+}
+
+static bool id_map_grow(IdMap* map, size_t capacity)
+{
+    IdMapEntry* entries = calloc(capacity, sizeof(*entries));
+    if (!entries)
+        return false;
+    for (size_t i = 0; i < map->capacity; ++i) {
+        if (map->entries[i].key != 0)
+            id_map_insert(entries, capacity, map->entries[i].key, map->entries[i].value);
+    }
+    free(map->entries);
+    map->entries = entries;
+    map->capacity = capacity;
+    return true;
+}
+
+bool id_map_init(IdMap* map, size_t expected_count)
+{
+    if (!map)
+        return false;
+    map->entries = NULL;
+    map->capacity = 0;
+    map->count = 0;
+    return id_map_grow(map, id_map_capacity_for(expected_count));
+}
+
+void id_map_destroy(IdMap* map)
+{
+    if (!map)
+        return;
+    free(map->entries);
+    map->entries = NULL;
+    map->capacity = 0;
+    map->count = 0;
+}
+
+bool id_map_put(IdMap* map, uint64_t key, void* value)
+{
+    if (!map || !map->entries || key == 0)
+        return false;
+    if (!id_map_get(map, key)) {
+        if (map->count + 1u > map->capacity / 2u
+            && !id_map_grow(map, id_map_capacity_for(map->count + 1u)))
+            return false;
+        map->count++;
+    }
+    id_map_insert(map->entries, map->capacity, key, value);
+    return true;
+}
+
+void* id_map_get(const IdMap* map, uint64_t key)
+{
+    if (!map || !map->entries || key == 0)
+        return NULL;
+    size_t slot = id_map_slot(key, map->capacity);
+    while (map->entries[slot].key != 0) {
+        if (map->entries[slot].key == key)
+            return map->entries[slot].value;
+        slot = (slot + 1u) & (map->capacity - 1u);
+    }
+    return NULL;
+}
+
+bool id_map_remove(IdMap* map, uint64_t key)
+{
+    if (!map || !map->entries || key == 0)
+        return false;
+    size_t mask = map->capacity - 1u;
+    size_t slot = id_map_slot(key, map->capacity);
+    while (map->entries[slot].key != key) {
+        if (map->entries[slot].key == 0)
+            return false;
+        slot = (slot + 1u) & mask;
+    }
+    size_t hole = slot;
+    for (size_t next = (hole + 1u) & mask; map->entries[next].key != 0;
+        next = (next + 1u) & mask) {
+        size_t home = id_map_slot(map->entries[next].key, map->capacity);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            map->entries[hole] = map->entries[next];
+            hole = next;
+        }
+    }
+    map->entries[hole].key = 0;
+    map->entries[hole].value = NULL;
+    map->count--;
+    return true;
+}
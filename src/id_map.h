@@ -0,0 +1,26 @@
+#ifndef ID_MAP_H
+#define ID_MAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint64_t key;
+    void* value;
+} IdMapEntry;
+
+typedef struct {
+    IdMapEntry* entries;
+    size_t capacity;
+    size_t count;
+} IdMap;
+
+bool id_map_init(IdMap* map, size_t expected_count);
+void id_map_destroy(IdMap* map);
+
+bool id_map_put(IdMap* map, uint64_t key, void* value);
+void* id_map_get(const IdMap* map, uint64_t key);
+bool id_map_remove(IdMap* map, uint64_t key);
+
+#endif
@@ -0,0 +1,115 @@
+#include "memory_governor.h"
+#include "buffer_pool.h"
+
+void memory_governor_reset(MemoryGovernor* governor, size_t budget_bytes)
+{
+    governor->budget_bytes = budget_bytes;
+    atomic_store(&governor->pressure, (int)SERVER_MEMORY_NORMAL);
+    atomic_store(&governor->peak_bytes, memory_governor_in_use(governor));
+    atomic_store(&governor->shed_deliveries, 0u);
+    governor->next_shed_ms = 0;
+    governor->pressure_since_ms = 0;
+    governor->pressure_mark = 0;
+}
+
+static void note_change(MemoryGovernor* governor, atomic_size_t* counter, size_t previous,
+    size_t current)
+{
+    if (current < previous) {
+        atomic_fetch_sub_explicit(counter, previous - current, memory_order_relaxed);
+        return;
+    }
+    atomic_fetch_add_explicit(counter, current - previous, memory_order_relaxed);
+    size_t total = memory_governor_in_use(governor);
+    size_t peak = atomic_load_explicit(&governor->peak_bytes, memory_order_relaxed);
+    while (total > peak
+        && !atomic_compare_exchange_weak_explicit(&governor->peak_bytes, &peak, total,
+            memory_order_relaxed, memory_order_relaxed)) { }
+}
+
+void memory_governor_note_frames(MemoryGovernor* governor, size_t previous, size_t current)
+{
+    note_change(governor, &governor->frame_bytes, previous, current);
+}
+
+void memory_governor_note_decoder(MemoryGovernor* governor, size_t previous, size_t current)
+{
+    note_change(governor, &governor->decoder_bytes, previous, current);
+}
+
+size_t memory_governor_in_use(const MemoryGovernor* governor)
+{
+    return atomic_load_explicit(&governor->frame_bytes, memory_order_relaxed)
+        + atomic_load_explicit(&governor->decoder_bytes, memory_order_relaxed);
+}
+
+size_t memory_governor_frame_bytes(const MemoryGovernor* governor)
+{
+    return atomic_load_explicit(&governor->frame_bytes, memory_order_relaxed);
+}
+
+ServerMemoryPressure memory_governor_pressure_for(const MemoryGovernor* governor, size_t used)
+{
+    if (used >= governor->budget_bytes)
+        return SERVER_MEMORY_SHEDDING;
+    if (used >= governor->budget_bytes / 4u * 3u)
+        return SERVER_MEMORY_REFUSING_OFFERS;
+    if (used >= governor->budget_bytes / 2u)
+        return SERVER_MEMORY_THROTTLING;
+    return SERVER_MEMORY_NORMAL;
+}
+
+ServerMemoryPressure memory_governor_live_pressure(const MemoryGovernor* governor)
+{
+    return memory_governor_pressure_for(governor, memory_governor_in_use(governor));
+}
+
+ServerMemoryPressure memory_governor_pressure(const MemoryGovernor* governor)
+{
+    return (ServerMemoryPressure)atomic_load_explicit(&governor->pressure, memory_order_relaxed);
+}
+
+bool memory_governor_update(MemoryGovernor* governor, uint64_t now_ms)
+{
+    size_t used = memory_governor_in_use(governor);
+    ServerMemoryPressure pressure = memory_governor_pressure_for(governor, used);
+    // Idle pooled blocks are not counted against the budget, so they are returned on pressure.
+    if (pressure != SERVER_MEMORY_NORMAL
+        && memory_governor_pressure(governor) == SERVER_MEMORY_NORMAL)
+        buffer_pool_trim();
+    atomic_store_explicit(&governor->pressure, (int)pressure, memory_order_relaxed);
+
+    // Throttling that frees nothing means a Recipient has stopped reading, so it escalates.
+    // Only queued frames can be released, so decoder buffers alone never shed a Delivery.
+    if (pressure == SERVER_MEMORY_NORMAL || memory_governor_frame_bytes(governor) == 0) {
+        governor->pressure_since_ms = 0;
+        return false;
+    }
+    if (governor->pressure_since_ms == 0 || used < governor->pressure_mark) {
+        governor->pressure_since_ms = now_ms;
+        governor->pressure_mark = used;
+    }
+    bool stalled = now_ms - governor->pressure_since_ms >= MEMORY_GOVERNOR_STALL_MS;
+    if ((pressure < SERVER_MEMORY_SHEDDING && !stalled) || now_ms < governor->next_shed_ms)
+        return false;
+    governor->next_shed_ms = now_ms + MEMORY_GOVERNOR_SHED_INTERVAL_MS;
+    return true;
+}
+
+void memory_governor_note_shed(MemoryGovernor* governor, uint64_t now_ms)
+{
+    atomic_fetch_add_explicit(&governor->shed_deliveries, 1u, memory_order_relaxed);
+    governor->pressure_since_ms = now_ms;
+    governor->pressure_mark = memory_governor_in_use(governor);
+}
+
+void memory_governor_stats(const MemoryGovernor* governor, ServerMemoryStats* stats)
+{
+    stats->budget_bytes = governor->budget_bytes;
+    stats->frame_bytes = memory_governor_frame_bytes(governor);
+    stats->decoder_bytes = atomic_load_explicit(&governor->decoder_bytes, memory_order_relaxed);
+    stats->peak_bytes = atomic_load_explicit(&governor->peak_bytes, memory_order_relaxed);
+    stats->pressure = memory_governor_pressure(governor);
+    stats->shed_deliveries
+        = atomic_load_explicit(&governor->shed_deliveries, memory_order_relaxed);
+}
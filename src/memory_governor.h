@@ -0,0 +1,41 @@
+#ifndef MEMORY_GOVERNOR_H
+#define MEMORY_GOVERNOR_H
+
+#include "server.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MEMORY_GOVERNOR_SHED_INTERVAL_MS 1000u
+#define MEMORY_GOVERNOR_STALL_MS 2000u
+
+typedef struct {
+    size_t budget_bytes;
+    atomic_size_t frame_bytes;
+    atomic_size_t decoder_bytes;
+    atomic_size_t peak_bytes;
+    atomic_int pressure;
+    atomic_size_t shed_deliveries;
+    uint64_t next_shed_ms;
+    uint64_t pressure_since_ms;
+    size_t pressure_mark;
+} MemoryGovernor;
+
+/* Bytes still held are kept, so a governor can be reset while frames drain. */
+void memory_governor_reset(MemoryGovernor* governor, size_t budget_bytes);
+void memory_governor_note_frames(MemoryGovernor* governor, size_t previous, size_t current);
+void memory_governor_note_decoder(MemoryGovernor* governor, size_t previous, size_t current);
+size_t memory_governor_in_use(const MemoryGovernor* governor);
+size_t memory_governor_frame_bytes(const MemoryGovernor* governor);
+ServerMemoryPressure memory_governor_pressure_for(const MemoryGovernor* governor, size_t used);
+ServerMemoryPressure memory_governor_live_pressure(const MemoryGovernor* governor);
+ServerMemoryPressure memory_governor_pressure(const MemoryGovernor* governor);
+
+/* Publishes the current stage and returns true when the slowest Delivery should be shed. */
+bool memory_governor_update(MemoryGovernor* governor, uint64_t now_ms);
+void memory_governor_note_shed(MemoryGovernor* governor, uint64_t now_ms);
+void memory_governor_stats(const MemoryGovernor* governor, ServerMemoryStats* stats);
+
+#endif
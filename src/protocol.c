@@ -1,4 +1,5 @@
 #include "protocol.h"
+#include "buffer_pool.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -17,108 +18,242 @@ typedef struct {
 
 static bool message_type_is_valid(uint8_t type)
 {
-    return type >= RELAY_MESSAGE_HELLO && type <= RELAY_MESSAGE_ACTION_REJECTED;
+    return type >= RELAY_MESSAGE_HELLO && type <= RELAY_MESSAGE_BATCH;
 }
 
-static bool text_is_valid(const char* text, size_t maximum, bool allow_newlines)
+static ProtocolString string_of(const char* text, size_t capacity)
 {
-    if (!text)
-        return false;
+    return (ProtocolString) { text, text ? (uint16_t)strnlen(text, capacity) : 0u };
+}
 
-    size_t length = strnlen(text, maximum + 1u);
-    if (length == 0 || length > maximum)
+static bool text_is_valid(ProtocolString text, size_t maximum, bool allow_newlines)
+{
+    if (!text.text || text.length == 0 || text.length > maximum)
         return false;
 
-    for (size_t i = 0; i < length; ++i) {
-        unsigned char c = (unsigned char)text[i];
+    for (size_t i = 0; i < text.length; ++i) {
+        unsigned char c = (unsigned char)text.text[i];
         if (c == 0x7f || c == 0 || (c < 0x20 && !(allow_newlines && (c == '\n' || c == '\t'))))
             return false;
     }
     return true;
 }
 
+static bool display_name_is_valid(ProtocolString display_name)
+{
+    return text_is_valid(display_name, PROTOCOL_DISPLAY_NAME_MAX, false)
+        && display_name.text[0] != ' ' && display_name.text[display_name.length - 1u] != ' ';
+}
+
 bool protocol_display_name_is_valid(const char* display_name)
 {
-    if (!text_is_valid(display_name, PROTOCOL_DISPLAY_NAME_MAX, false))
-        return false;
-    size_t length = strlen(display_name);
-    return display_name[0] != ' ' && display_name[length - 1u] != ' ';
+    return display_name_is_valid(string_of(display_name, PROTOCOL_DISPLAY_NAME_MAX + 1u));
 }
 
-static bool reason_is_valid(const char* reason)
+static bool reason_is_valid(ProtocolString reason)
 {
-    if (!reason)
+    if (!reason.text)
         return false;
-    if (reason[0] == '\0')
+    if (reason.length == 0)
         return true;
     return text_is_valid(reason, PROTOCOL_REASON_MAX, true);
 }
 
-bool protocol_message_is_valid(const RelayMessage* message)
+static bool view_is_valid(const RelayMessageView* view)
 {
-    if (!message || !message_type_is_valid((uint8_t)message->type))
+    switch (view->type) {
+    case RELAY_MESSAGE_HELLO:
+        return view->as.hello.version == PROTOCOL_VERSION
+            && display_name_is_valid(view->as.hello.display_name);
+    case RELAY_MESSAGE_WELCOME:
+        return view->as.welcome.participant_id != 0;
+    case RELAY_MESSAGE_CHAT_SEND:
+        return text_is_valid(view->as.chat_send.text, PROTOCOL_CHAT_MAX, true);
+    case RELAY_MESSAGE_CHAT_DELIVER:
+        return view->as.chat_deliver.participant_id != 0
+            && display_name_is_valid(view->as.chat_deliver.display_name)
+            && text_is_valid(view->as.chat_deliver.text, PROTOCOL_CHAT_MAX, true);
+    case RELAY_MESSAGE_FILE_OFFER_CREATE:
+        return view->as.file_offer_create.request_id != 0
+            && text_is_valid(view->as.file_offer_create.filename, PROTOCOL_FILENAME_MAX, false)
+            && view->as.file_offer_create.total_size <= PROTOCOL_FILE_MAX_SIZE
+            && view->as.file_offer_create.chunk_size > 0
+            && view->as.file_offer_create.chunk_size <= PROTOCOL_FILE_CHUNK_MAX;
+    case RELAY_MESSAGE_FILE_OFFER_CREATED:
+        return view->as.file_offer_created.request_id != 0
+            && view->as.file_offer_created.offer_id != 0
+            && view->as.file_offer_created.offer_window_ms > 0;
+    case RELAY_MESSAGE_FILE_OFFER_PUBLISHED:
+        return view->as.file_offer_published.offer_id != 0
+            && view->as.file_offer_published.sender_id != 0
+            && display_name_is_valid(view->as.file_offer_published.sender_name)
+            && text_is_valid(view->as.file_offer_published.filename, PROTOCOL_FILENAME_MAX, false)
+            && view->as.file_offer_published.total_size <= PROTOCOL_FILE_MAX_SIZE
+            && view->as.file_offer_published.offer_window_ms > 0;
+    case RELAY_MESSAGE_FILE_OFFER_RESPONSE:
+        return view->as.file_offer_response.offer_id != 0;
+    case RELAY_MESSAGE_FILE_TRANSFER_READY:
+        return view->as.file_transfer_ready.offer_id != 0
+            && view->as.file_transfer_ready.recipient_count > 0;
+    case RELAY_MESSAGE_FILE_CHUNK:
+        return view->as.file_chunk.offer_id != 0
+            && view->as.file_chunk.data != NULL
+            && view->as.file_chunk.data_length > 0
+            && view->as.file_chunk.data_length <= PROTOCOL_FILE_CHUNK_MAX;
+    case RELAY_MESSAGE_FILE_TRANSFER_END:
+        return view->as.file_transfer_end.offer_id != 0
+            && view->as.file_transfer_end.total_size <= PROTOCOL_FILE_MAX_SIZE;
+    case RELAY_MESSAGE_FILE_DELIVERY_RESULT:
+        return view->as.file_delivery_result.offer_id != 0
+            && reason_is_valid(view->as.file_delivery_result.reason);
+    case RELAY_MESSAGE_FILE_DELIVERY_UPDATE:
+        return view->as.file_delivery_update.offer_id != 0
+            && view->as.file_delivery_update.recipient_id != 0
+            && display_name_is_valid(view->as.file_delivery_update.recipient_name)
+            && reason_is_valid(view->as.file_delivery_update.reason);
+    case RELAY_MESSAGE_FILE_OFFER_DECLINED:
+        return view->as.file_offer_declined.offer_id != 0;
+    case RELAY_MESSAGE_FILE_TRANSFER_CANCEL:
+        return view->as.file_transfer_cancel.offer_id != 0
+            && reason_is_valid(view->as.file_transfer_cancel.reason);
+    case RELAY_MESSAGE_ACTION_REJECTED:
+        return message_type_is_valid((uint8_t)view->as.action_rejected.rejected_type)
+            && reason_is_valid(view->as.action_rejected.reason);
+    case RELAY_MESSAGE_FILE_DELIVERY_PROGRESS:
+        return view->as.file_delivery_progress.offer_id != 0
+            && view->as.file_delivery_progress.written_bytes <= PROTOCOL_FILE_MAX_SIZE;
+    case RELAY_MESSAGE_FILE_TRANSFER_CREDIT:
+        return view->as.file_transfer_credit.offer_id != 0
+            && view->as.file_transfer_credit.delivered_bytes
+            <= view->as.file_transfer_credit.credit_limit;
+    case RELAY_MESSAGE_BATCH:
         return false;
+    }
+    return false;
+}
 
+static bool view_of_message(const RelayMessage* message, RelayMessageView* view)
+{
+    if (!message_type_is_valid((uint8_t)message->type))
+        return false;
+    view->type = message->type;
     switch (message->type) {
     case RELAY_MESSAGE_HELLO:
-        return message->as.hello.version == PROTOCOL_VERSION
-            && protocol_display_name_is_valid(message->as.hello.display_name);
+        view->as.hello.version = message->as.hello.version;
+        view->as.hello.display_name = string_of(message->as.hello.display_name,
+            sizeof(message->as.hello.display_name));
+        view->as.hello.features = message->as.hello.features;
+        break;
     case RELAY_MESSAGE_WELCOME:
-        return message->as.welcome.participant_id != 0;
+        view->as.welcome.participant_id = message->as.welcome.participant_id;
+        view->as.welcome.features = message->as.welcome.features;
+        break;
     case RELAY_MESSAGE_CHAT_SEND:
-        return text_is_valid(message->as.chat_send.text, PROTOCOL_CHAT_MAX, true);
+        view->as.chat_send.text = string_of(message->as.chat_send.text,
+            sizeof(message->as.chat_send.text));
+        break;
     case RELAY_MESSAGE_CHAT_DELIVER:
-        return message->as.chat_deliver.participant_id != 0
-            && protocol_display_name_is_valid(message->as.chat_deliver.display_name)
-            && text_is_valid(message->as.chat_deliver.text, PROTOCOL_CHAT_MAX, true);
+        view->as.chat_deliver.participant_id = message->as.chat_deliver.participant_id;
+        view->as.chat_deliver.display_name = string_of(message->as.chat_deliver.display_name,
+            sizeof(message->as.chat_deliver.display_name));
+        view->as.chat_deliver.text = string_of(message->as.chat_deliver.text,
+            sizeof(message->as.chat_deliver.text));
+        break;
     case RELAY_MESSAGE_FILE_OFFER_CREATE:
-        return message->as.file_offer_create.request_id != 0
-            && text_is_valid(message->as.file_offer_create.filename, PROTOCOL_FILENAME_MAX, false)
-            && message->as.file_offer_create.total_size <= PROTOCOL_FILE_MAX_SIZE
-            && message->as.file_offer_create.chunk_size > 0
-            && message->as.file_offer_create.chunk_size <= PROTOCOL_FILE_CHUNK_MAX;
+        view->as.file_offer_create.request_id = message->as.file_offer_create.request_id;
+        view->as.file_offer_create.filename = string_of(message->as.file_offer_create.filename,
+            sizeof(message->as.file_offer_create.filename));
+        view->as.file_offer_create.total_size = message->as.file_offer_create.total_size;
+        view->as.file_offer_create.chunk_size = message->as.file_offer_create.chunk_size;
+        break;
     case RELAY_MESSAGE_FILE_OFFER_CREATED:
-        return message->as.file_offer_created.request_id != 0
-            && message->as.file_offer_created.offer_id != 0
-            && message->as.file_offer_created.offer_window_ms > 0;
+        view->as.file_offer_created.request_id = message->as.file_offer_created.request_id;
+        view->as.file_offer_created.offer_id = message->as.file_offer_created.offer_id;
+        view->as.file_offer_created.offer_window_ms = message->as.file_offer_created.offer_window_ms;
+        break;
     case RELAY_MESSAGE_FILE_OFFER_PUBLISHED:
-        return message->as.file_offer_published.offer_id != 0
-            && message->as.file_offer_published.sender_id != 0
-            && protocol_display_name_is_valid(message->as.file_offer_published.sender_name)
-            && text_is_valid(message->as.file_offer_published.filename, PROTOCOL_FILENAME_MAX, false)
-            && message->as.file_offer_published.total_size <= PROTOCOL_FILE_MAX_SIZE
-            && message->as.file_offer_published.offer_window_ms > 0;
+        view->as.file_offer_published.offer_id = message->as.file_offer_published.offer_id;
+        view->as.file_offer_published.sender_id = message->as.file_offer_published.sender_id;
+        view->as.file_offer_published.sender_name = string_of(
+            message->as.file_offer_published.sender_name,
+            sizeof(message->as.file_offer_published.sender_name));
+        view->as.file_offer_published.filename = string_of(
+            message->as.file_offer_published.filename,
+            sizeof(message->as.file_offer_published.filename));
+        view->as.file_offer_published.total_size = message->as.file_offer_published.total_size;
+        view->as.file_offer_published.offer_window_ms
+            = message->as.file_offer_published.offer_window_ms;
+        break;
     case RELAY_MESSAGE_FILE_OFFER_RESPONSE:
-        return message->as.file_offer_response.offer_id != 0;
+        view->as.file_offer_response.offer_id = message->as.file_offer_response.offer_id;
+        view->as.file_offer_response.accepted = message->as.file_offer_response.accepted;
+        break;
     case RELAY_MESSAGE_FILE_TRANSFER_READY:
-        return message->as.file_transfer_ready.offer_id != 0
-            && message->as.file_transfer_ready.recipient_count > 0;
+        view->as.file_transfer_ready.offer_id = message->as.file_transfer_ready.offer_id;
+        view->as.file_transfer_ready.recipient_count
+            = message->as.file_transfer_ready.recipient_count;
+        break;
     case RELAY_MESSAGE_FILE_CHUNK:
-        return message->as.file_chunk.offer_id != 0
-            && message->as.file_chunk.data != NULL
-            && message->as.file_chunk.data_length > 0
-            && message->as.file_chunk.data_length <= PROTOCOL_FILE_CHUNK_MAX;
+        view->as.file_chunk.offer_id = message->as.file_chunk.offer_id;
+        view->as.file_chunk.offset = message->as.file_chunk.offset;
+        view->as.file_chunk.data = message->as.file_chunk.data;
+        view->as.file_chunk.data_length = message->as.file_chunk.data_length;
+        break;
     case RELAY_MESSAGE_FILE_TRANSFER_END:
-        return message->as.file_transfer_end.offer_id != 0
-            && message->as.file_transfer_end.total_size <= PROTOCOL_FILE_MAX_SIZE;
+        view->as.file_transfer_end.offer_id = message->as.file_transfer_end.offer_id;
+        view->as.file_transfer_end.total_size = message->as.file_transfer_end.total_size;
+        break;
     case RELAY_MESSAGE_FILE_DELIVERY_RESULT:
-        return message->as.file_delivery_result.offer_id != 0
-            && reason_is_valid(message->as.file_delivery_result.reason);
+        view->as.file_delivery_result.offer_id = message->as.file_delivery_result.offer_id;
+        view->as.file_delivery_result.success = message->as.file_delivery_result.success;
+        view->as.file_delivery_result.reason = string_of(message->as.file_delivery_result.reason,
+            sizeof(message->as.file_delivery_result.reason));
+        break;
     case RELAY_MESSAGE_FILE_DELIVERY_UPDATE:
-        return message->as.file_delivery_update.offer_id != 0
-            && message->as.file_delivery_update.recipient_id != 0
-            && protocol_display_name_is_valid(message->as.file_delivery_update.recipient_name)
-            && reason_is_valid(message->as.file_delivery_update.reason);
+        view->as.file_delivery_update.offer_id = message->as.file_delivery_update.offer_id;
+        view->as.file_delivery_update.recipient_id = message->as.file_delivery_update.recipient_id;
+        view->as.file_delivery_update.recipient_name = string_of(
+            message->as.file_delivery_update.recipient_name,
+            sizeof(message->as.file_delivery_update.recipient_name));
+        view->as.file_delivery_update.success = message->as.file_delivery_update.success;
+        view->as.file_delivery_update.reason = string_of(message->as.file_delivery_update.reason,
+            sizeof(message->as.file_delivery_update.reason));
+        break;
     case RELAY_MESSAGE_FILE_OFFER_DECLINED:
-        return message->as.file_offer_declined.offer_id != 0;
+        view->as.file_offer_declined.offer_id = message->as.file_offer_declined.offer_id;
+        break;
     case RELAY_MESSAGE_FILE_TRANSFER_CANCEL:
-        return message->as.file_transfer_cancel.offer_id != 0
-            && reason_is_valid(message->as.file_transfer_cancel.reason);
+        view->as.file_transfer_cancel.offer_id = message->as.file_transfer_cancel.offer_id;
+        view->as.file_transfer_cancel.reason = string_of(message->as.file_transfer_cancel.reason,
+            sizeof(message->as.file_transfer_cancel.reason));
+        break;
     case RELAY_MESSAGE_ACTION_REJECTED:
-        return message_type_is_valid((uint8_t)message->as.action_rejected.rejected_type)
-            && reason_is_valid(message->as.action_rejected.reason);
+        view->as.action_rejected.rejected_type = message->as.action_rejected.rejected_type;
+        view->as.action_rejected.correlation_id = message->as.action_rejected.correlation_id;
+        view->as.action_rejected.reason = string_of(message->as.action_rejected.reason,
+            sizeof(message->as.action_rejected.reason));
+        break;
+    case RELAY_MESSAGE_FILE_DELIVERY_PROGRESS:
+        view->as.file_delivery_progress.offer_id = message->as.file_delivery_progress.offer_id;
+        view->as.file_delivery_progress.written_bytes
+            = message->as.file_delivery_progress.written_bytes;
+        break;
+    case RELAY_MESSAGE_FILE_TRANSFER_CREDIT:
+        view->as.file_transfer_credit.offer_id = message->as.file_transfer_credit.offer_id;
+        view->as.file_transfer_credit.credit_limit = message->as.file_transfer_credit.credit_limit;
+        view->as.file_transfer_credit.delivered_bytes
+            = message->as.file_transfer_credit.delivered_bytes;
+        break;
+    case RELAY_MESSAGE_BATCH:
+        return false;
     }
-    return false;
+    return true;
+}
+
+bool protocol_message_is_valid(const RelayMessage* message)
+{
+    RelayMessageView view;
+    return message && view_of_message(message, &view) && view_is_valid(&view);
 }
 
 static bool write_bytes(Writer* writer, const void* source, size_t length)
@@ -166,6 +301,12 @@ static bool write_string(Writer* writer, const char* value)
         && write_bytes(writer, value, length);
 }
 
+// Feature bits trail HELLO and WELCOME only when set, so peers without them parse the same payload.
+static bool write_features(Writer* writer, uint32_t features)
+{
+    return features == 0 || write_u32(writer, features);
+}
+
 static bool read_bytes(Reader* reader, void* destination, size_t length)
 {
     if (!reader || length > reader->length - reader->position)
@@ -211,14 +352,33 @@ static bool read_u64(Reader* reader, uint64_t* value)
     return true;
 }
 
-static bool read_string(Reader* reader, char* value, size_t capacity)
+static bool read_string(Reader* reader, ProtocolString* value)
 {
     uint16_t length = 0;
-    if (!read_u16(reader, &length) || (size_t)length >= capacity)
+    if (!read_u16(reader, &length) || length > reader->length - reader->position)
         return false;
-    if (!read_bytes(reader, value, length))
+    value->text = (const char*)reader->bytes + reader->position;
+    value->length = length;
+    reader->position += length;
+    return true;
+}
+
+static bool read_features(Reader* reader, uint32_t* features)
+{
+    *features = 0;
+    return reader->position == reader->length || read_u32(reader, features);
+}
+
+static bool read_frame_length(const uint8_t* header, size_t* frame_length)
+{
+    Reader reader = { .bytes = header, .length = PROTOCOL_FRAME_HEADER_SIZE, .position = 0 };
+    uint8_t type = 0;
+    uint32_t payload_length = 0;
+    if (!read_u8(&reader, &type) || !read_u32(&reader, &payload_length)
+        || !message_type_is_valid(type) || payload_length == 0
+        || payload_length > PROTOCOL_MAX_PAYLOAD)
         return false;
-    value[length] = '\0';
+    *frame_length = PROTOCOL_FRAME_HEADER_SIZE + (size_t)payload_length;
     return true;
 }
 
@@ -227,13 +387,19 @@ static size_t string_wire_size(const char* value)
     return 2u + strlen(value);
 }
 
+static size_t features_wire_size(uint32_t features)
+{
+    return features != 0 ? 4u : 0u;
+}
+
 static size_t payload_size(const RelayMessage* message)
 {
     switch (message->type) {
     case RELAY_MESSAGE_HELLO:
-        return 2u + string_wire_size(message->as.hello.display_name);
+        return 2u + string_wire_size(message->as.hello.display_name)
+            + features_wire_size(message->as.hello.features);
     case RELAY_MESSAGE_WELCOME:
-        return 8u;
+        return 8u + features_wire_size(message->as.welcome.features);
     case RELAY_MESSAGE_CHAT_SEND:
         return string_wire_size(message->as.chat_send.text);
     case RELAY_MESSAGE_CHAT_DELIVER:
@@ -265,6 +431,12 @@ static size_t payload_size(const RelayMessage* message)
         return 8u + string_wire_size(message->as.file_transfer_cancel.reason);
     case RELAY_MESSAGE_ACTION_REJECTED:
         return 1u + 8u + string_wire_size(message->as.action_rejected.reason);
+    case RELAY_MESSAGE_FILE_DELIVERY_PROGRESS:
+        return 8u + 8u;
+    case RELAY_MESSAGE_FILE_TRANSFER_CREDIT:
+        return 8u + 8u + 8u;
+    case RELAY_MESSAGE_BATCH:
+        return 0;
     }
     return 0;
 }
@@ -274,9 +446,11 @@ static bool encode_payload(Writer* writer, const RelayMessage* message)
     switch (message->type) {
     case RELAY_MESSAGE_HELLO:
         return write_u16(writer, message->as.hello.version)
-            && write_string(writer, message->as.hello.display_name);
+            && write_string(writer, message->as.hello.display_name)
+            && write_features(writer, message->as.hello.features);
     case RELAY_MESSAGE_WELCOME:
-        return write_u64(writer, message->as.welcome.participant_id);
+        return write_u64(writer, message->as.welcome.participant_id)
+            && write_features(writer, message->as.welcome.features);
     case RELAY_MESSAGE_CHAT_SEND:
         return write_string(writer, message->as.chat_send.text);
     case RELAY_MESSAGE_CHAT_DELIVER:
@@ -331,34 +505,96 @@ static bool encode_payload(Writer* writer, const RelayMessage* message)
         return write_u8(writer, (uint8_t)message->as.action_rejected.rejected_type)
             && write_u64(writer, message->as.action_rejected.correlation_id)
             && write_string(writer, message->as.action_rejected.reason);
+    case RELAY_MESSAGE_FILE_DELIVERY_PROGRESS:
+        return write_u64(writer, message->as.file_delivery_progress.offer_id)
+            && write_u64(writer, message->as.file_delivery_progress.written_bytes);
+    case RELAY_MESSAGE_FILE_TRANSFER_CREDIT:
+        return write_u64(writer, message->as.file_transfer_credit.offer_id)
+            && write_u64(writer, message->as.file_transfer_credit.credit_limit)
+            && write_u64(writer, message->as.file_transfer_credit.delivered_bytes);
+    case RELAY_MESSAGE_BATCH:
+        return false;
     }
     return false;
 }
 
+size_t protocol_encoded_size(const RelayMessage* message)
+{
+    if (!protocol_message_is_valid(message))
+        return 0;
+    size_t body_length = payload_size(message);
+    if (body_length == 0 || body_length > PROTOCOL_MAX_PAYLOAD || body_length > UINT32_MAX)
+        return 0;
+    return PROTOCOL_FRAME_HEADER_SIZE + body_length;
+}
+
+static bool encode_frame(const RelayMessage* message, size_t frame_length, Writer* writer)
+{
+    return write_u8(writer, (uint8_t)message->type)
+        && write_u32(writer, (uint32_t)(frame_length - PROTOCOL_FRAME_HEADER_SIZE))
+        && encode_payload(writer, message) && writer->position == writer->length;
+}
+
+bool protocol_encode_into(const RelayMessage* message, uint8_t* buffer, size_t capacity,
+    size_t* frame_length)
+{
+    if (!buffer || !frame_length)
+        return false;
+    size_t total_length = protocol_encoded_size(message);
+    if (total_length == 0 || total_length > capacity)
+        return false;
+    Writer writer = { .bytes = buffer, .length = total_length, .position = 0 };
+    if (!encode_frame(message, total_length, &writer))
+        return false;
+    *frame_length = total_length;
+    return true;
+}
+
+size_t protocol_encode_iov(const RelayMessage* message, uint8_t* buffer, size_t capacity,
+    ProtocolSlice slices[2])
+{
+    if (!message || !buffer || !slices)
+        return 0;
+    if (message->type != RELAY_MESSAGE_FILE_CHUNK) {
+        size_t frame_length = 0;
+        if (!protocol_encode_into(message, buffer, capacity, &frame_length))
+            return 0;
+        slices[0] = (ProtocolSlice) { .bytes = buffer, .length = frame_length };
+        return 1;
+    }
+    size_t total_length = protocol_encoded_size(message);
+    if (total_length == 0 || capacity < PROTOCOL_CHUNK_HEADER_SIZE)
+        return 0;
+    Writer writer = { .bytes = buffer, .length = PROTOCOL_CHUNK_HEADER_SIZE, .position = 0 };
+    if (!write_u8(&writer, RELAY_MESSAGE_FILE_CHUNK)
+        || !write_u32(&writer, (uint32_t)(total_length - PROTOCOL_FRAME_HEADER_SIZE))
+        || !write_u64(&writer, message->as.file_chunk.offer_id)
+        || !write_u64(&writer, message->as.file_chunk.offset))
+        return 0;
+    slices[0] = (ProtocolSlice) { .bytes = buffer, .length = PROTOCOL_CHUNK_HEADER_SIZE };
+    slices[1] = (ProtocolSlice) {
+        .bytes = message->as.file_chunk.data,
+        .length = message->as.file_chunk.data_length
+    };
+    return 2;
+}
+
 bool protocol_encode(const RelayMessage* message, uint8_t** frame, size_t* frame_length)
 {
     if (!frame || !frame_length)
         return false;
     *frame = NULL;
     *frame_length = 0;
-    if (!protocol_message_is_valid(message))
-        return false;
-
-    size_t body_length = payload_size(message);
-    if (body_length == 0 || body_length > PROTOCOL_MAX_PAYLOAD || body_length > UINT32_MAX)
+    size_t total_length = protocol_encoded_size(message);
+    if (total_length == 0)
         return false;
-
-    size_t total_length = PROTOCOL_FRAME_HEADER_SIZE + body_length;
-    uint8_t* bytes = malloc(total_length);
+    uint8_t* bytes = buffer_pool_acquire(total_length);
     if (!bytes)
         return false;
 
     Writer writer = { .bytes = bytes, .length = total_length, .position = 0 };
-    if (!write_u8(&writer, (uint8_t)message->type)
-        || !write_u32(&writer, (uint32_t)body_length)
-        || !encode_payload(&writer, message)
-        || writer.position != total_length) {
-        free(bytes);
+    if (!encode_frame(message, total_length, &writer)) {
+        buffer_pool_release(bytes, total_length);
         return false;
     }
 
@@ -367,216 +603,584 @@ bool protocol_encode(const RelayMessage* message, uint8_t** frame, size_t* frame
     return true;
 }
 
+bool protocol_encode_batch(const ProtocolSlice* frames, size_t count, uint8_t* buffer,
+    size_t capacity, size_t* batch_length)
+{
+    if (!frames || count == 0 || !buffer || !batch_length)
+        return false;
+    size_t total_length = PROTOCOL_FRAME_HEADER_SIZE;
+    for (size_t i = 0; i < count; ++i) {
+        size_t frame_length = 0;
+        if (!frames[i].bytes || frames[i].length < PROTOCOL_FRAME_HEADER_SIZE
+            || !read_frame_length(frames[i].bytes, &frame_length)
+            || frame_length != frames[i].length
+            || frames[i].bytes[0] == RELAY_MESSAGE_BATCH
+            || frames[i].bytes[0] == RELAY_MESSAGE_FILE_CHUNK
+            || frame_length > PROTOCOL_MAX_PAYLOAD - (total_length - PROTOCOL_FRAME_HEADER_SIZE))
+            return false;
+        total_length += frame_length;
+    }
+    if (total_length > capacity)
+        return false;
+    Writer writer = { .bytes = buffer, .length = total_length, .position = 0 };
+    if (!write_u8(&writer, RELAY_MESSAGE_BATCH)
+        || !write_u32(&writer, (uint32_t)(total_length - PROTOCOL_FRAME_HEADER_SIZE)))
+        return false;
+    for (size_t i = 0; i < count; ++i) {
+        if (!write_bytes(&writer, frames[i].bytes, frames[i].length))
+            return false;
+    }
+    *batch_length = total_length;
+    return true;
+}
+
+bool protocol_parse_chunk_header(const uint8_t* frame, size_t frame_length,
+    ProtocolChunkHeader* chunk)
+{
+    if (!frame || !chunk || frame_length < PROTOCOL_FRAME_HEADER_SIZE)
+        return false;
+    Reader reader = { .bytes = frame, .length = frame_length, .position = 0 };
+    uint8_t type = 0;
+    uint32_t payload_length = 0;
+    uint64_t offer_id = 0;
+    uint64_t offset = 0;
+    if (!read_u8(&reader, &type) || type != RELAY_MESSAGE_FILE_CHUNK
+        || !read_u32(&reader, &payload_length)
+        || (size_t)payload_length != frame_length - PROTOCOL_FRAME_HEADER_SIZE
+        || !read_u64(&reader, &offer_id) || !read_u64(&reader, &offset))
+        return false;
+    size_t data_length = reader.length - reader.position;
+    if (offer_id == 0 || data_length == 0 || data_length > PROTOCOL_FILE_CHUNK_MAX)
+        return false;
+    chunk->offer_id = offer_id;
+    chunk->offset = offset;
+    chunk->data = frame + reader.position;
+    chunk->data_length = (uint32_t)data_length;
+    chunk->frame = frame;
+    chunk->frame_length = frame_length;
+    return true;
+}
+
+bool protocol_frame_offer_id(const uint8_t* frame, size_t frame_length, uint64_t* offer_id)
+{
+    if (!frame || !offer_id || frame_length < PROTOCOL_FRAME_HEADER_SIZE + 8u)
+        return false;
+    if (frame[0] != RELAY_MESSAGE_FILE_CHUNK && frame[0] != RELAY_MESSAGE_FILE_TRANSFER_END
+        && frame[0] != RELAY_MESSAGE_FILE_TRANSFER_CANCEL)
+        return false;
+    Reader reader = {
+        .bytes = frame, .length = frame_length, .position = PROTOCOL_FRAME_HEADER_SIZE
+    };
+    return read_u64(&reader, offer_id) && *offer_id != 0;
+}
+
 static bool decode_payload(RelayMessageType type, const uint8_t* payload, size_t payload_length,
-    RelayMessage* message)
+    RelayMessageView* view)
 {
     Reader reader = { .bytes = payload, .length = payload_length, .position = 0 };
-    memset(message, 0, sizeof(*message));
-    message->type = type;
+    view->type = type;
     uint8_t flag = 0;
     uint8_t rejected_type = 0;
 
     switch (type) {
     case RELAY_MESSAGE_HELLO:
-        if (!read_u16(&reader, &message->as.hello.version)
-            || !read_string(&reader, message->as.hello.display_name, sizeof(message->as.hello.display_name)))
+        if (!read_u16(&reader, &view->as.hello.version)
+            || !read_string(&reader, &view->as.hello.display_name)
+            || !read_features(&reader, &view->as.hello.features))
             return false;
         break;
     case RELAY_MESSAGE_WELCOME:
-        if (!read_u64(&reader, &message->as.welcome.participant_id))
+        if (!read_u64(&reader, &view->as.welcome.participant_id)
+            || !read_features(&reader, &view->as.welcome.features))
             return false;
         break;
     case RELAY_MESSAGE_CHAT_SEND:
-        if (!read_string(&reader, message->as.chat_send.text, sizeof(message->as.chat_send.text)))
+        if (!read_string(&reader, &view->as.chat_send.text))
             return false;
         break;
     case RELAY_MESSAGE_CHAT_DELIVER:
-        if (!read_u64(&reader, &message->as.chat_deliver.participant_id)
-            || !read_string(&reader, message->as.chat_deliver.display_name, sizeof(message->as.chat_deliver.display_name))
-            || !read_string(&reader, message->as.chat_deliver.text, sizeof(message->as.chat_deliver.text)))
+        if (!read_u64(&reader, &view->as.chat_deliver.participant_id)
+            || !read_string(&reader, &view->as.chat_deliver.display_name)
+            || !read_string(&reader, &view->as.chat_deliver.text))
             return false;
         break;
     case RELAY_MESSAGE_FILE_OFFER_CREATE:
-        if (!read_u64(&reader, &message->as.file_offer_create.request_id)
-            || !read_string(&reader, message->as.file_offer_create.filename, sizeof(message->as.file_offer_create.filename))
-            || !read_u64(&reader, &message->as.file_offer_create.total_size)
-            || !read_u32(&reader, &message->as.file_offer_create.chunk_size))
+        if (!read_u64(&reader, &view->as.file_offer_create.request_id)
+            || !read_string(&reader, &view->as.file_offer_create.filename)
+            || !read_u64(&reader, &view->as.file_offer_create.total_size)
+            || !read_u32(&reader, &view->as.file_offer_create.chunk_size))
             return false;
         break;
     case RELAY_MESSAGE_FILE_OFFER_CREATED:
-        if (!read_u64(&reader, &message->as.file_offer_created.request_id)
-            || !read_u64(&reader, &message->as.file_offer_created.offer_id)
-            || !read_u32(&reader, &message->as.file_offer_created.offer_window_ms))
+        if (!read_u64(&reader, &view->as.file_offer_created.request_id)
+            || !read_u64(&reader, &view->as.file_offer_created.offer_id)
+            || !read_u32(&reader, &view->as.file_offer_created.offer_window_ms))
             return false;
         break;
     case RELAY_MESSAGE_FILE_OFFER_PUBLISHED:
-        if (!read_u64(&reader, &message->as.file_offer_published.offer_id)
-            || !read_u64(&reader, &message->as.file_offer_published.sender_id)
-            || !read_string(&reader, message->as.file_offer_published.sender_name, sizeof(message->as.file_offer_published.sender_name))
-            || !read_string(&reader, message->as.file_offer_published.filename, sizeof(message->as.file_offer_published.filename))
-            || !read_u64(&reader, &message->as.file_offer_published.total_size)
-            || !read_u32(&reader, &message->as.file_offer_published.offer_window_ms))
+        if (!read_u64(&reader, &view->as.file_offer_published.offer_id)
+            || !read_u64(&reader, &view->as.file_offer_published.sender_id)
+            || !read_string(&reader, &view->as.file_offer_published.sender_name)
+            || !read_string(&reader, &view->as.file_offer_published.filename)
+            || !read_u64(&reader, &view->as.file_offer_published.total_size)
+            || !read_u32(&reader, &view->as.file_offer_published.offer_window_ms))
             return false;
         break;
     case RELAY_MESSAGE_FILE_OFFER_RESPONSE:
-        if (!read_u64(&reader, &message->as.file_offer_response.offer_id) || !read_u8(&reader, &flag) || flag > 1)
+        if (!read_u64(&reader, &view->as.file_offer_response.offer_id) || !read_u8(&reader, &flag) || flag > 1)
             return false;
-        message->as.file_offer_response.accepted = flag != 0;
+        view->as.file_offer_response.accepted = flag != 0;
         break;
     case RELAY_MESSAGE_FILE_TRANSFER_READY:
-        if (!read_u64(&reader, &message->as.file_transfer_ready.offer_id)
-            || !read_u16(&reader, &message->as.file_transfer_ready.recipient_count))
+        if (!read_u64(&reader, &view->as.file_transfer_ready.offer_id)
+            || !read_u16(&reader, &view->as.file_transfer_ready.recipient_count))
             return false;
         break;
     case RELAY_MESSAGE_FILE_CHUNK:
-        if (!read_u64(&reader, &message->as.file_chunk.offer_id)
-            || !read_u64(&reader, &message->as.file_chunk.offset))
+        if (!read_u64(&reader, &view->as.file_chunk.offer_id)
+            || !read_u64(&reader, &view->as.file_chunk.offset))
             return false;
         if (reader.length - reader.position == 0 || reader.length - reader.position > PROTOCOL_FILE_CHUNK_MAX)
             return false;
-        message->as.file_chunk.data_length = (uint32_t)(reader.length - reader.position);
-        message->as.file_chunk.data = malloc(message->as.file_chunk.data_length);
-        if (!message->as.file_chunk.data
-            || !read_bytes(&reader, message->as.file_chunk.data, message->as.file_chunk.data_length)) {
-            protocol_message_destroy(message);
-            return false;
-        }
+        view->as.file_chunk.data = reader.bytes + reader.position;
+        view->as.file_chunk.data_length = (uint32_t)(reader.length - reader.position);
+        reader.position = reader.length;
         break;
     case RELAY_MESSAGE_FILE_TRANSFER_END:
-        if (!read_u64(&reader, &message->as.file_transfer_end.offer_id)
-            || !read_u64(&reader, &message->as.file_transfer_end.total_size))
+        if (!read_u64(&reader, &view->as.file_transfer_end.offer_id)
+            || !read_u64(&reader, &view->as.file_transfer_end.total_size))
             return false;
         break;
     case RELAY_MESSAGE_FILE_DELIVERY_RESULT:
-        if (!read_u64(&reader, &message->as.file_delivery_result.offer_id)
+        if (!read_u64(&reader, &view->as.file_delivery_result.offer_id)
             || !read_u8(&reader, &flag) || flag > 1
-            || !read_string(&reader, message->as.file_delivery_result.reason, sizeof(message->as.file_delivery_result.reason)))
+            || !read_string(&reader, &view->as.file_delivery_result.reason))
             return false;
-        message->as.file_delivery_result.success = flag != 0;
+        view->as.file_delivery_result.success = flag != 0;
         break;
     case RELAY_MESSAGE_FILE_DELIVERY_UPDATE:
-        if (!read_u64(&reader, &message->as.file_delivery_update.offer_id)
-            || !read_u64(&reader, &message->as.file_delivery_update.recipient_id)
-            || !read_string(&reader, message->as.file_delivery_update.recipient_name, sizeof(message->as.file_delivery_update.recipient_name))
+        if (!read_u64(&reader, &view->as.file_delivery_update.offer_id)
+            || !read_u64(&reader, &view->as.file_delivery_update.recipient_id)
+            || !read_string(&reader, &view->as.file_delivery_update.recipient_name)
             || !read_u8(&reader, &flag) || flag > 1
-            || !read_string(&reader, message->as.file_delivery_update.reason, sizeof(message->as.file_delivery_update.reason)))
+            || !read_string(&reader, &view->as.file_delivery_update.reason))
             return false;
-        message->as.file_delivery_update.success = flag != 0;
+        view->as.file_delivery_update.success = flag != 0;
         break;
     case RELAY_MESSAGE_FILE_OFFER_DECLINED:
-        if (!read_u64(&reader, &message->as.file_offer_declined.offer_id))
+        if (!read_u64(&reader, &view->as.file_offer_declined.offer_id))
             return false;
         break;
     case RELAY_MESSAGE_FILE_TRANSFER_CANCEL:
-        if (!read_u64(&reader, &message->as.file_transfer_cancel.offer_id)
-            || !read_string(&reader, message->as.file_transfer_cancel.reason, sizeof(message->as.file_transfer_cancel.reason)))
+        if (!read_u64(&reader, &view->as.file_transfer_cancel.offer_id)
+            || !read_string(&reader, &view->as.file_transfer_cancel.reason))
             return false;
         break;
     case RELAY_MESSAGE_ACTION_REJECTED:
         if (!read_u8(&reader, &rejected_type) || !message_type_is_valid(rejected_type)
-            || !read_u64(&reader, &message->as.action_rejected.correlation_id)
-            || !read_string(&reader, message->as.action_rejected.reason, sizeof(message->as.action_rejected.reason)))
+            || !read_u64(&reader, &view->as.action_rejected.correlation_id)
+            || !read_string(&reader, &view->as.action_rejected.reason))
+            return false;
+        view->as.action_rejected.rejected_type = (RelayMessageType)rejected_type;
+        break;
+    case RELAY_MESSAGE_FILE_DELIVERY_PROGRESS:
+        if (!read_u64(&reader, &view->as.file_delivery_progress.offer_id)
+            || !read_u64(&reader, &view->as.file_delivery_progress.written_bytes))
+            return false;
+        break;
+    case RELAY_MESSAGE_FILE_TRANSFER_CREDIT:
+        if (!read_u64(&reader, &view->as.file_transfer_credit.offer_id)
+            || !read_u64(&reader, &view->as.file_transfer_credit.credit_limit)
+            || !read_u64(&reader, &view->as.file_transfer_credit.delivered_bytes))
             return false;
-        message->as.action_rejected.rejected_type = (RelayMessageType)rejected_type;
         break;
+    default:
+        return false;
     }
 
-    return reader.position == reader.length && protocol_message_is_valid(message);
+    return reader.position == reader.length && view_is_valid(view);
+}
+
+bool protocol_decode_view(const uint8_t* frame, size_t frame_length, RelayMessageView* view)
+{
+    if (!frame || !view || frame_length < PROTOCOL_FRAME_HEADER_SIZE)
+        return false;
+    Reader header = { .bytes = frame, .length = PROTOCOL_FRAME_HEADER_SIZE, .position = 0 };
+    uint8_t type = 0;
+    uint32_t payload_length = 0;
+    return read_u8(&header, &type) && read_u32(&header, &payload_length)
+        && (size_t)payload_length == frame_length - PROTOCOL_FRAME_HEADER_SIZE
+        && decode_payload((RelayMessageType)type, frame + PROTOCOL_FRAME_HEADER_SIZE,
+            payload_length, view);
+}
+
+bool protocol_string_copy(ProtocolString string, char* destination, size_t capacity)
+{
+    if (!destination || capacity == 0 || string.length >= capacity
+        || (string.length > 0 && !string.text))
+        return false;
+    if (string.length > 0)
+        memcpy(destination, string.text, string.length);
+    destination[string.length] = '\0';
+    return true;
+}
+
+#define COPY_STRING(destination, source) \
+    protocol_string_copy((source), (destination), sizeof(destination))
+
+bool protocol_view_to_message(const RelayMessageView* view, RelayMessage* message)
+{
+    if (!view || !message)
+        return false;
+    message->type = view->type;
+    switch (view->type) {
+    case RELAY_MESSAGE_HELLO:
+        message->as.hello.version = view->as.hello.version;
+        message->as.hello.features = view->as.hello.features;
+        return COPY_STRING(message->as.hello.display_name, view->as.hello.display_name);
+    case RELAY_MESSAGE_WELCOME:
+        message->as.welcome.participant_id = view->as.welcome.participant_id;
+        message->as.welcome.features = view->as.welcome.features;
+        return true;
+    case RELAY_MESSAGE_CHAT_SEND:
+        return COPY_STRING(message->as.chat_send.text, view->as.chat_send.text);
+    case RELAY_MESSAGE_CHAT_DELIVER:
+        message->as.chat_deliver.participant_id = view->as.chat_deliver.participant_id;
+        return COPY_STRING(message->as.chat_deliver.display_name, view->as.chat_deliver.display_name)
+            && COPY_STRING(message->as.chat_deliver.text, view->as.chat_deliver.text);
+    case RELAY_MESSAGE_FILE_OFFER_CREATE:
+        message->as.file_offer_create.request_id = view->as.file_offer_create.request_id;
+        message->as.file_offer_create.total_size = view->as.file_offer_create.total_size;
+        message->as.file_offer_create.chunk_size = view->as.file_offer_create.chunk_size;
+        return COPY_STRING(message->as.file_offer_create.filename, view->as.file_offer_create.filename);
+    case RELAY_MESSAGE_FILE_OFFER_CREATED:
+        message->as.file_offer_created.request_id = view->as.file_offer_created.request_id;
+        message->as.file_offer_created.offer_id = view->as.file_offer_created.offer_id;
+        message->as.file_offer_created.offer_window_ms = view->as.file_offer_created.offer_window_ms;
+        return true;
+    case RELAY_MESSAGE_FILE_OFFER_PUBLISHED:
+        message->as.file_offer_published.offer_id = view->as.file_offer_published.offer_id;
+        message->as.file_offer_published.sender_id = view->as.file_offer_published.sender_id;
+        message->as.file_offer_published.total_size = view->as.file_offer_published.total_size;
+        message->as.file_offer_published.offer_window_ms
+            = view->as.file_offer_published.offer_window_ms;
+        return COPY_STRING(message->as.file_offer_published.sender_name,
+                   view->as.file_offer_published.sender_name)
+            && COPY_STRING(message->as.file_offer_published.filename,
+                view->as.file_offer_published.filename);
+    case RELAY_MESSAGE_FILE_OFFER_RESPONSE:
+        message->as.file_offer_response.offer_id = view->as.file_offer_response.offer_id;
+        message->as.file_offer_response.accepted = view->as.file_offer_response.accepted;
+        return true;
+    case RELAY_MESSAGE_FILE_TRANSFER_READY:
+        message->as.file_transfer_ready.offer_id = view->as.file_transfer_ready.offer_id;
+        message->as.file_transfer_ready.recipient_count = view->as.file_transfer_ready.recipient_count;
+        return true;
+    case RELAY_MESSAGE_FILE_CHUNK:
+        message->as.file_chunk.offer_id = view->as.file_chunk.offer_id;
+        message->as.file_chunk.offset = view->as.file_chunk.offset;
+        message->as.file_chunk.data = (uint8_t*)view->as.file_chunk.data;
+        message->as.file_chunk.data_length = view->as.file_chunk.data_length;
+        return true;
+    case RELAY_MESSAGE_FILE_TRANSFER_END:
+        message->as.file_transfer_end.offer_id = view->as.file_transfer_end.offer_id;
+        message->as.file_transfer_end.total_size = view->as.file_transfer_end.total_size;
+        return true;
+    case RELAY_MESSAGE_FILE_DELIVERY_RESULT:
+        message->as.file_delivery_result.offer_id = view->as.file_delivery_result.offer_id;
+        message->as.file_delivery_result.success = view->as.file_delivery_result.success;
+        return COPY_STRING(message->as.file_delivery_result.reason, view->as.file_delivery_result.reason);
+    case RELAY_MESSAGE_FILE_DELIVERY_UPDATE:
+        message->as.file_delivery_update.offer_id = view->as.file_delivery_update.offer_id;
+        message->as.file_delivery_update.recipient_id = view->as.file_delivery_update.recipient_id;
+        message->as.file_delivery_update.success = view->as.file_delivery_update.success;
+        return COPY_STRING(message->as.file_delivery_update.recipient_name,
+                   view->as.file_delivery_update.recipient_name)
+            && COPY_STRING(message->as.file_delivery_update.reason,
+                view->as.file_delivery_update.reason);
+    case RELAY_MESSAGE_FILE_OFFER_DECLINED:
+        message->as.file_offer_declined.offer_id = view->as.file_offer_declined.offer_id;
+        return true;
+    case RELAY_MESSAGE_FILE_TRANSFER_CANCEL:
+        message->as.file_transfer_cancel.offer_id = view->as.file_transfer_cancel.offer_id;
+        return COPY_STRING(message->as.file_transfer_cancel.reason, view->as.file_transfer_cancel.reason);
+    case RELAY_MESSAGE_ACTION_REJECTED:
+        message->as.action_rejected.rejected_type = view->as.action_rejected.rejected_type;
+        message->as.action_rejected.correlation_id = view->as.action_rejected.correlation_id;
+        return COPY_STRING(message->as.action_rejected.reason, view->as.action_rejected.reason);
+    case RELAY_MESSAGE_FILE_DELIVERY_PROGRESS:
+        message->as.file_delivery_progress.offer_id = view->as.file_delivery_progress.offer_id;
+        message->as.file_delivery_progress.written_bytes
+            = view->as.file_delivery_progress.written_bytes;
+        return true;
+    case RELAY_MESSAGE_FILE_TRANSFER_CREDIT:
+        message->as.file_transfer_credit.offer_id = view->as.file_transfer_credit.offer_id;
+        message->as.file_transfer_credit.credit_limit = view->as.file_transfer_credit.credit_limit;
+        message->as.file_transfer_credit.delivered_bytes
+            = view->as.file_transfer_credit.delivered_bytes;
+        return true;
+    case RELAY_MESSAGE_BATCH:
+        return false;
+    }
+    return false;
+}
+
+static void decoder_use_inline(ProtocolDecoder* decoder)
+{
+    decoder->buffer = decoder->inline_bytes;
+    decoder->capacity = sizeof(decoder->inline_bytes);
+}
+
+static void decoder_release(ProtocolDecoder* decoder)
+{
+    if (!decoder->borrowed)
+        return;
+    memcpy(decoder->inline_bytes, decoder->borrowed, decoder->length);
+    buffer_pool_release(decoder->borrowed, PROTOCOL_FRAME_CAPACITY);
+    decoder->borrowed = NULL;
+    decoder_use_inline(decoder);
 }
 
 void protocol_decoder_init(ProtocolDecoder* decoder)
 {
-    if (decoder)
-        memset(decoder, 0, sizeof(*decoder));
+    if (!decoder)
+        return;
+    decoder->length = 0;
+    decoder->borrowed = NULL;
+    decoder->chunk_handler = NULL;
+    decoder_use_inline(decoder);
 }
 
 void protocol_decoder_reset(ProtocolDecoder* decoder)
 {
-    if (decoder)
-        decoder->length = 0;
+    if (!decoder)
+        return;
+    decoder->length = 0;
+    decoder_release(decoder);
 }
 
 void protocol_decoder_destroy(ProtocolDecoder* decoder)
 {
     if (!decoder)
         return;
-    free(decoder->buffer);
-    memset(decoder, 0, sizeof(*decoder));
+    protocol_decoder_reset(decoder);
+    decoder->chunk_handler = NULL;
+}
+
+void protocol_decoder_set_chunk_handler(ProtocolDecoder* decoder, RelayChunkHandler handler)
+{
+    if (decoder)
+        decoder->chunk_handler = handler;
 }
 
 static bool decoder_reserve(ProtocolDecoder* decoder, size_t needed)
 {
     if (needed <= decoder->capacity)
         return true;
-    if (needed > PROTOCOL_MAX_PAYLOAD + PROTOCOL_FRAME_HEADER_SIZE)
+    if (needed > PROTOCOL_FRAME_CAPACITY)
+        return false;
+    uint8_t* borrowed = buffer_pool_acquire(PROTOCOL_FRAME_CAPACITY);
+    if (!borrowed)
         return false;
-    size_t capacity = decoder->capacity ? decoder->capacity : 4096u;
-    while (capacity < needed) {
-        if (capacity > (PROTOCOL_MAX_PAYLOAD + PROTOCOL_FRAME_HEADER_SIZE) / 2u) {
-            capacity = PROTOCOL_MAX_PAYLOAD + PROTOCOL_FRAME_HEADER_SIZE;
-            break;
+    memcpy(borrowed, decoder->buffer, decoder->length);
+    decoder->borrowed = borrowed;
+    decoder->buffer = borrowed;
+    decoder->capacity = PROTOCOL_FRAME_CAPACITY;
+    return true;
+}
+
+static bool dispatch_batch(const uint8_t* payload, size_t payload_length,
+    RelayMessageViewHandler handler, void* handler_context)
+{
+    size_t position = 0;
+    while (position < payload_length) {
+        size_t frame_length = 0;
+        if (payload_length - position < PROTOCOL_FRAME_HEADER_SIZE
+            || !read_frame_length(payload + position, &frame_length)
+            || frame_length > payload_length - position
+            || payload[position] == RELAY_MESSAGE_BATCH
+            || payload[position] == RELAY_MESSAGE_FILE_CHUNK)
+            return false;
+        RelayMessageView view;
+        if (!decode_payload((RelayMessageType)payload[position],
+                payload + position + PROTOCOL_FRAME_HEADER_SIZE,
+                frame_length - PROTOCOL_FRAME_HEADER_SIZE, &view))
+            return false;
+        handler(handler_context, &view);
+        position += frame_length;
+    }
+    return true;
+}
+
+static bool dispatch_frame(ProtocolDecoder* decoder, const uint8_t* frame, size_t frame_length,
+    RelayMessageViewHandler handler, void* handler_context, void* context)
+{
+    if (frame[0] == RELAY_MESSAGE_BATCH)
+        return dispatch_batch(frame + PROTOCOL_FRAME_HEADER_SIZE,
+            frame_length - PROTOCOL_FRAME_HEADER_SIZE, handler, handler_context);
+    if (frame[0] == RELAY_MESSAGE_FILE_CHUNK && decoder->chunk_handler) {
+        ProtocolChunkHeader chunk;
+        if (!protocol_parse_chunk_header(frame, frame_length, &chunk))
+            return false;
+        decoder->chunk_handler(context, &chunk);
+        return true;
+    }
+    RelayMessageView view;
+    if (!decode_payload((RelayMessageType)frame[0], frame + PROTOCOL_FRAME_HEADER_SIZE,
+            frame_length - PROTOCOL_FRAME_HEADER_SIZE, &view))
+        return false;
+    handler(handler_context, &view);
+    return true;
+}
+
+static bool pending_frame_length(const ProtocolDecoder* decoder, size_t* frame_length)
+{
+    if (decoder->length < PROTOCOL_FRAME_HEADER_SIZE) {
+        *frame_length = PROTOCOL_FRAME_HEADER_SIZE;
+        return true;
+    }
+    return read_frame_length(decoder->buffer, frame_length);
+}
+
+static bool complete_pending(ProtocolDecoder* decoder, RelayMessageViewHandler handler,
+    void* handler_context, void* context)
+{
+    size_t frame_length = 0;
+    if (!pending_frame_length(decoder, &frame_length))
+        return false;
+    if (decoder->length < frame_length)
+        return true;
+    if (!dispatch_frame(decoder, decoder->buffer, frame_length, handler, handler_context, context))
+        return false;
+    decoder->length = 0;
+    decoder_release(decoder);
+    return true;
+}
+
+static bool feed_frames(ProtocolDecoder* decoder, const uint8_t* bytes, size_t length,
+    RelayMessageViewHandler handler, void* handler_context, void* context)
+{
+    while (length > 0) {
+        if (decoder->length == 0) {
+            size_t frame_length = 0;
+            while (length >= PROTOCOL_FRAME_HEADER_SIZE) {
+                if (!read_frame_length(bytes, &frame_length))
+                    return false;
+                if (length < frame_length)
+                    break;
+                if (!dispatch_frame(decoder, bytes, frame_length, handler, handler_context, context))
+                    return false;
+                bytes += frame_length;
+                length -= frame_length;
+            }
+            if (length == 0)
+                break;
         }
-        capacity *= 2u;
+        size_t frame_length = 0;
+        if (!pending_frame_length(decoder, &frame_length) || !decoder_reserve(decoder, frame_length))
+            return false;
+        size_t taken = frame_length - decoder->length;
+        if (taken > length)
+            taken = length;
+        memcpy(decoder->buffer + decoder->length, bytes, taken);
+        decoder->length += taken;
+        bytes += taken;
+        length -= taken;
+        if (!complete_pending(decoder, handler, handler_context, context))
+            return false;
     }
-    uint8_t* resized = realloc(decoder->buffer, capacity);
-    if (!resized)
+    return true;
+}
+
+bool protocol_decoder_peek_chunk(const ProtocolDecoder* decoder, ProtocolChunkHeader* chunk)
+{
+    if (!decoder || !chunk)
+        return false;
+    Reader reader = { .bytes = decoder->buffer, .length = decoder->length, .position = 0 };
+    uint8_t type = 0;
+    uint32_t payload_length = 0;
+    uint64_t offer_id = 0;
+    uint64_t offset = 0;
+    if (!read_u8(&reader, &type) || type != RELAY_MESSAGE_FILE_CHUNK
+        || !read_u32(&reader, &payload_length) || payload_length > PROTOCOL_MAX_PAYLOAD
+        || decoder->length >= PROTOCOL_FRAME_HEADER_SIZE + (size_t)payload_length
+        || !read_u64(&reader, &offer_id) || !read_u64(&reader, &offset))
         return false;
-    decoder->buffer = resized;
-    decoder->capacity = capacity;
+    size_t frame_length = PROTOCOL_FRAME_HEADER_SIZE + (size_t)payload_length;
+    size_t data_length = frame_length - reader.position;
+    if (offer_id == 0 || data_length == 0 || data_length > PROTOCOL_FILE_CHUNK_MAX)
+        return false;
+    chunk->offer_id = offer_id;
+    chunk->offset = offset;
+    chunk->data = decoder->buffer + reader.position;
+    chunk->data_length = (uint32_t)data_length;
+    chunk->frame = decoder->buffer;
+    chunk->frame_length = frame_length;
     return true;
 }
 
+typedef struct {
+    RelayMessageHandler handler;
+    void* context;
+} MessageDelivery;
+
+static void deliver_message(void* opaque, const RelayMessageView* view)
+{
+    MessageDelivery* delivery = opaque;
+    RelayMessage message;
+    if (protocol_view_to_message(view, &message))
+        delivery->handler(delivery->context, &message);
+}
+
 bool protocol_decoder_feed(ProtocolDecoder* decoder, const uint8_t* bytes, size_t length,
     RelayMessageHandler handler, void* context)
 {
     if (!decoder || !handler || (length > 0 && !bytes))
         return false;
-    if (length > PROTOCOL_MAX_PAYLOAD + PROTOCOL_FRAME_HEADER_SIZE - decoder->length
-        || !decoder_reserve(decoder, decoder->length + length)) {
-        protocol_decoder_reset(decoder);
+    MessageDelivery delivery = { .handler = handler, .context = context };
+    if (feed_frames(decoder, bytes, length, deliver_message, &delivery, context))
+        return true;
+    protocol_decoder_reset(decoder);
+    return false;
+}
+
+bool protocol_decoder_feed_views(ProtocolDecoder* decoder, const uint8_t* bytes, size_t length,
+    RelayMessageViewHandler handler, void* context)
+{
+    if (!decoder || !handler || (length > 0 && !bytes))
         return false;
-    }
-    if (length > 0) {
-        memcpy(decoder->buffer + decoder->length, bytes, length);
-        decoder->length += length;
-    }
+    if (feed_frames(decoder, bytes, length, handler, context, context))
+        return true;
+    protocol_decoder_reset(decoder);
+    return false;
+}
 
-    size_t processed = 0;
-    while (decoder->length - processed >= PROTOCOL_FRAME_HEADER_SIZE) {
-        Reader header = {
-            .bytes = decoder->buffer + processed,
-            .length = PROTOCOL_FRAME_HEADER_SIZE,
-            .position = 0
-        };
-        uint8_t type = 0;
-        uint32_t payload_length = 0;
-        if (!read_u8(&header, &type) || !read_u32(&header, &payload_length)
-            || !message_type_is_valid(type) || payload_length == 0
-            || payload_length > PROTOCOL_MAX_PAYLOAD) {
-            protocol_decoder_reset(decoder);
-            return false;
-        }
-        size_t frame_length = PROTOCOL_FRAME_HEADER_SIZE + (size_t)payload_length;
-        if (decoder->length - processed < frame_length)
-            break;
-
-        RelayMessage message;
-        if (!decode_payload((RelayMessageType)type,
-                decoder->buffer + processed + PROTOCOL_FRAME_HEADER_SIZE,
-                payload_length, &message)) {
-            protocol_decoder_reset(decoder);
-            return false;
-        }
-        handler(context, &message);
-        protocol_message_destroy(&message);
-        processed += frame_length;
-    }
+uint8_t* protocol_decoder_receive_space(ProtocolDecoder* decoder, size_t* space)
+{
+    size_t frame_length = 0;
+    if (!decoder || !space || decoder->length < PROTOCOL_FRAME_HEADER_SIZE
+        || !read_frame_length(decoder->buffer, &frame_length)
+        || frame_length <= sizeof(decoder->inline_bytes) || !decoder_reserve(decoder, frame_length))
+        return NULL;
+    *space = frame_length - decoder->length;
+    return decoder->buffer + decoder->length;
+}
 
-    if (processed > 0) {
-        decoder->length -= processed;
-        memmove(decoder->buffer, decoder->buffer + processed, decoder->length);
+bool protocol_decoder_commit_views(ProtocolDecoder* decoder, size_t length,
+    RelayMessageViewHandler handler, void* context)
+{
+    if (!decoder || !handler)
+        return false;
+    size_t frame_length = 0;
+    if (decoder->length >= PROTOCOL_FRAME_HEADER_SIZE
+        && read_frame_length(decoder->buffer, &frame_length)
+        && length <= frame_length - decoder->length) {
+        decoder->length += length;
+        if (complete_pending(decoder, handler, context, context))
+            return true;
     }
-    return true;
+    protocol_decoder_reset(decoder);
+    return false;
 }
 
 void protocol_message_destroy(RelayMessage* message)
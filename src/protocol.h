@@ -5,7 +5,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#define PROTOCOL_VERSION 2u
+#define PROTOCOL_VERSION 3u
 #define PROTOCOL_FRAME_HEADER_SIZE 5u
 #define PROTOCOL_DISPLAY_NAME_MAX 24u
 #define PROTOCOL_CHAT_MAX 4000u
@@ -14,6 +14,11 @@
 #define PROTOCOL_FILE_CHUNK_MAX (1024u * 1024u)
 #define PROTOCOL_FILE_MAX_SIZE (500ull * 1024ull * 1024ull)
 #define PROTOCOL_MAX_PAYLOAD (PROTOCOL_FILE_CHUNK_MAX + 64u)
+#define PROTOCOL_FRAME_CAPACITY (PROTOCOL_MAX_PAYLOAD + PROTOCOL_FRAME_HEADER_SIZE)
+#define PROTOCOL_DECODER_INLINE_CAPACITY 4096u
+#define PROTOCOL_CHUNK_HEADER_SIZE (PROTOCOL_FRAME_HEADER_SIZE + 16u)
+#define PROTOCOL_FEATURE_BATCH (1u << 0)
+#define PROTOCOL_FEATURES_SUPPORTED PROTOCOL_FEATURE_BATCH
 
 typedef enum {
     RELAY_MESSAGE_HELLO = 1,
@@ -31,7 +36,10 @@ typedef enum {
     RELAY_MESSAGE_FILE_DELIVERY_UPDATE = 13,
     RELAY_MESSAGE_FILE_OFFER_DECLINED = 14,
     RELAY_MESSAGE_FILE_TRANSFER_CANCEL = 15,
-    RELAY_MESSAGE_ACTION_REJECTED = 16
+    RELAY_MESSAGE_ACTION_REJECTED = 16,
+    RELAY_MESSAGE_FILE_DELIVERY_PROGRESS = 17,
+    RELAY_MESSAGE_FILE_TRANSFER_CREDIT = 18,
+    RELAY_MESSAGE_BATCH = 19
 } RelayMessageType;
 
 typedef struct {
@@ -40,9 +48,11 @@ typedef struct {
         struct {
             uint16_t version;
             char display_name[PROTOCOL_DISPLAY_NAME_MAX + 1u];
+            uint32_t features;
         } hello;
         struct {
             uint64_t participant_id;
+            uint32_t features;
         } welcome;
         struct {
             char text[PROTOCOL_CHAT_MAX + 1u];
@@ -113,27 +123,177 @@ typedef struct {
             uint64_t correlation_id;
             char reason[PROTOCOL_REASON_MAX + 1u];
         } action_rejected;
+        struct {
+            uint64_t offer_id;
+            uint64_t written_bytes;
+        } file_delivery_progress;
+        struct {
+            uint64_t offer_id;
+            uint64_t credit_limit;
+            uint64_t delivered_bytes;
+        } file_transfer_credit;
     } as;
 } RelayMessage;
 
+typedef struct {
+    const char* text;
+    uint16_t length;
+} ProtocolString;
+
+// Strings and chunk data point into the frame and stay valid only while it does.
+typedef struct {
+    RelayMessageType type;
+    union {
+        struct {
+            uint16_t version;
+            ProtocolString display_name;
+            uint32_t features;
+        } hello;
+        struct {
+            uint64_t participant_id;
+            uint32_t features;
+        } welcome;
+        struct {
+            ProtocolString text;
+        } chat_send;
+        struct {
+            uint64_t participant_id;
+            ProtocolString display_name;
+            ProtocolString text;
+        } chat_deliver;
+        struct {
+            uint64_t request_id;
+            ProtocolString filename;
+            uint64_t total_size;
+            uint32_t chunk_size;
+        } file_offer_create;
+        struct {
+            uint64_t request_id;
+            uint64_t offer_id;
+            uint32_t offer_window_ms;
+        } file_offer_created;
+        struct {
+            uint64_t offer_id;
+            uint64_t sender_id;
+            ProtocolString sender_name;
+            ProtocolString filename;
+            uint64_t total_size;
+            uint32_t offer_window_ms;
+        } file_offer_published;
+        struct {
+            uint64_t offer_id;
+            bool accepted;
+        } file_offer_response;
+        struct {
+            uint64_t offer_id;
+            uint16_t recipient_count;
+        } file_transfer_ready;
+        struct {
+            uint64_t offer_id;
+            uint64_t offset;
+            const uint8_t* data;
+            uint32_t data_length;
+        } file_chunk;
+        struct {
+            uint64_t offer_id;
+            uint64_t total_size;
+        } file_transfer_end;
+        struct {
+            uint64_t offer_id;
+            bool success;
+            ProtocolString reason;
+        } file_delivery_result;
+        struct {
+            uint64_t offer_id;
+            uint64_t recipient_id;
+            ProtocolString recipient_name;
+            bool success;
+            ProtocolString reason;
+        } file_delivery_update;
+        struct {
+            uint64_t offer_id;
+        } file_offer_declined;
+        struct {
+            uint64_t offer_id;
+            ProtocolString reason;
+        } file_transfer_cancel;
+        struct {
+            RelayMessageType rejected_type;
+            uint64_t correlation_id;
+            ProtocolString reason;
+        } action_rejected;
+        struct {
+            uint64_t offer_id;
+            uint64_t written_bytes;
+        } file_delivery_progress;
+        struct {
+            uint64_t offer_id;
+            uint64_t credit_limit;
+            uint64_t delivered_bytes;
+        } file_transfer_credit;
+    } as;
+} RelayMessageView;
+
+typedef struct {
+    uint64_t offer_id;
+    uint64_t offset;
+    const uint8_t* data;
+    uint32_t data_length;
+    const uint8_t* frame;
+    size_t frame_length;
+} ProtocolChunkHeader;
+
+typedef struct {
+    const uint8_t* bytes;
+    size_t length;
+} ProtocolSlice;
+
+typedef void (*RelayMessageHandler)(void* context, const RelayMessage* message);
+typedef void (*RelayMessageViewHandler)(void* context, const RelayMessageView* view);
+typedef void (*RelayChunkHandler)(void* context, const ProtocolChunkHeader* chunk);
+
 typedef struct {
     uint8_t* buffer;
     size_t length;
     size_t capacity;
+    uint8_t* borrowed;
+    RelayChunkHandler chunk_handler;
+    uint8_t inline_bytes[PROTOCOL_DECODER_INLINE_CAPACITY];
 } ProtocolDecoder;
 
-typedef void (*RelayMessageHandler)(void* context, const RelayMessage* message);
-
 bool protocol_display_name_is_valid(const char* display_name);
 bool protocol_message_is_valid(const RelayMessage* message);
 
 bool protocol_encode(const RelayMessage* message, uint8_t** frame, size_t* frame_length);
+size_t protocol_encoded_size(const RelayMessage* message);
+bool protocol_encode_into(const RelayMessage* message, uint8_t* buffer, size_t capacity,
+    size_t* frame_length);
+/* FILE_CHUNK encodes only its header into buffer; the second slice borrows the data. */
+size_t protocol_encode_iov(const RelayMessage* message, uint8_t* buffer, size_t capacity,
+    ProtocolSlice slices[2]);
+/* Wraps complete non-chunk frames in one BATCH frame that decoders unpack transparently. */
+bool protocol_encode_batch(const ProtocolSlice* frames, size_t count, uint8_t* buffer,
+    size_t capacity, size_t* batch_length);
+bool protocol_parse_chunk_header(const uint8_t* frame, size_t frame_length,
+    ProtocolChunkHeader* chunk);
+bool protocol_frame_offer_id(const uint8_t* frame, size_t frame_length, uint64_t* offer_id);
+bool protocol_decode_view(const uint8_t* frame, size_t frame_length, RelayMessageView* view);
+bool protocol_view_to_message(const RelayMessageView* view, RelayMessage* message);
+bool protocol_string_copy(ProtocolString string, char* destination, size_t capacity);
 
 void protocol_decoder_init(ProtocolDecoder* decoder);
 void protocol_decoder_reset(ProtocolDecoder* decoder);
 void protocol_decoder_destroy(ProtocolDecoder* decoder);
+void protocol_decoder_set_chunk_handler(ProtocolDecoder* decoder, RelayChunkHandler handler);
+bool protocol_decoder_peek_chunk(const ProtocolDecoder* decoder, ProtocolChunkHeader* chunk);
 bool protocol_decoder_feed(ProtocolDecoder* decoder, const uint8_t* bytes, size_t length,
     RelayMessageHandler handler, void* context);
+bool protocol_decoder_feed_views(ProtocolDecoder* decoder, const uint8_t* bytes, size_t length,
+    RelayMessageViewHandler handler, void* context);
+/* Space for the rest of a partially buffered large frame, or NULL when none is pending. */
+uint8_t* protocol_decoder_receive_space(ProtocolDecoder* decoder, size_t* space);
+bool protocol_decoder_commit_views(ProtocolDecoder* decoder, size_t length,
+    RelayMessageViewHandler handler, void* context);
 
 void protocol_message_destroy(RelayMessage* message);
 
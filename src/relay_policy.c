@@ -1,13 +1,28 @@
 #include "relay_policy.h"
+#include "id_map.h"
+#include "timer_wheel.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define RELAY_POLICY_SENDER_ROLE SIZE_MAX
+
+typedef struct {
+    uint64_t offer_id;
+    size_t recipient_index;
+} OfferMembership;
+
 typedef struct {
     bool active;
     uint64_t id;
     char display_name[PROTOCOL_DISPLAY_NAME_MAX + 1u];
+    size_t roster_index;
+    size_t sent_offer_count;
+    uint64_t message_allowed_at_us;
+    OfferMembership* memberships;
+    size_t membership_count;
+    size_t membership_capacity;
 } Participant;
 
 typedef enum {
@@ -19,9 +34,17 @@ typedef enum {
     RECIPIENT_FAILED
 } RecipientStatus;
 
+typedef enum {
+    RECIPIENT_SET_PENDING,
+    RECIPIENT_SET_ACCEPTED,
+    RECIPIENT_SET_ACTIVE,
+    RECIPIENT_SET_COUNT
+} RecipientSet;
+
 typedef struct {
     uint64_t participant_id;
     RecipientStatus status;
+    uint64_t written_bytes;
 } OfferRecipient;
 
 typedef enum {
@@ -38,29 +61,45 @@ typedef struct {
     char filename[PROTOCOL_FILENAME_MAX + 1u];
     uint64_t total_size;
     uint32_t chunk_size;
-    uint64_t deadline_ms;
+    TimerEntry window_timer;
     uint64_t forwarded_bytes;
+    uint64_t credit_limit;
+    uint64_t delivered_bytes;
     bool sender_finished;
-    OfferRecipient recipients[RELAY_POLICY_MAX_PARTICIPANTS];
+    OfferRecipient* recipients;
     size_t recipient_count;
+    uint64_t* recipient_sets;
+    size_t set_words;
 } FileOffer;
 
 struct RelayPolicy {
-    Participant participants[RELAY_POLICY_MAX_PARTICIPANTS];
-    FileOffer offers[RELAY_POLICY_MAX_FILE_OFFERS];
+    Participant* participants;
+    size_t* free_participants;
+    size_t free_participant_count;
+    Participant** roster;
+    size_t roster_count;
+    IdMap participants_by_id;
+    FileOffer* offers;
+    size_t* free_offers;
+    size_t free_offer_count;
+    IdMap offers_by_id;
+    uint64_t* scratch_ids;
+    size_t* scratch_indices;
+    bool* scratch_delivered;
     uint64_t next_participant_id;
     uint64_t next_offer_id;
+    RelayPolicyOptions options;
+    bool refusing_offers;
+    size_t rate_limited_count;
+    size_t refused_offer_count;
+    TimerWheel timers;
 };
 
 static Participant* find_participant(RelayPolicy* policy, uint64_t participant_id)
 {
     if (!policy || participant_id == 0)
         return NULL;
-    for (size_t i = 0; i < RELAY_POLICY_MAX_PARTICIPANTS; ++i) {
-        if (policy->participants[i].active && policy->participants[i].id == participant_id)
-            return &policy->participants[i];
-    }
-    return NULL;
+    return id_map_get(&policy->participants_by_id, participant_id);
 }
 
 static const Participant* find_participant_const(const RelayPolicy* policy, uint64_t participant_id)
@@ -72,20 +111,94 @@ static FileOffer* find_offer(RelayPolicy* policy, uint64_t offer_id)
 {
     if (!policy || offer_id == 0)
         return NULL;
-    for (size_t i = 0; i < RELAY_POLICY_MAX_FILE_OFFERS; ++i) {
-        if (policy->offers[i].active && policy->offers[i].id == offer_id)
-            return &policy->offers[i];
+    return id_map_get(&policy->offers_by_id, offer_id);
+}
+
+static uint64_t* recipient_set(const FileOffer* offer, RecipientSet set)
+{
+    return offer->recipient_sets + (size_t)set * offer->set_words;
+}
+
+static size_t recipient_set_count(const FileOffer* offer, RecipientSet set)
+{
+    const uint64_t* bits = recipient_set(offer, set);
+    size_t count = 0;
+    for (size_t i = 0; i < offer->set_words; ++i)
+        count += (size_t)__builtin_popcountll(bits[i]);
+    return count;
+}
+
+static size_t next_in_set(const FileOffer* offer, RecipientSet set, size_t from)
+{
+    const uint64_t* bits = recipient_set(offer, set);
+    size_t word = from / 64u;
+    if (word >= offer->set_words)
+        return offer->recipient_count;
+    uint64_t remaining = bits[word] & (~0ull << (from % 64u));
+    while (remaining == 0) {
+        if (++word >= offer->set_words)
+            return offer->recipient_count;
+        remaining = bits[word];
     }
-    return NULL;
+    return word * 64u + (size_t)__builtin_ctzll(remaining);
+}
+
+static void set_recipient_status(FileOffer* offer, OfferRecipient* recipient,
+    RecipientStatus status)
+{
+    size_t index = (size_t)(recipient - offer->recipients);
+    uint64_t mask = 1ull << (index % 64u);
+    for (size_t set = 0; set < RECIPIENT_SET_COUNT; ++set)
+        recipient_set(offer, (RecipientSet)set)[index / 64u] &= ~mask;
+    if (status == RECIPIENT_PENDING)
+        recipient_set(offer, RECIPIENT_SET_PENDING)[index / 64u] |= mask;
+    else if (status == RECIPIENT_ACCEPTED)
+        recipient_set(offer, RECIPIENT_SET_ACCEPTED)[index / 64u] |= mask;
+    else if (status == RECIPIENT_ACTIVE)
+        recipient_set(offer, RECIPIENT_SET_ACTIVE)[index / 64u] |= mask;
+    recipient->status = status;
+}
+
+static bool membership_is_live(RelayPolicy* policy, const OfferMembership* membership)
+{
+    return find_offer(policy, membership->offer_id) != NULL;
+}
+
+static bool add_membership(RelayPolicy* policy, Participant* participant, uint64_t offer_id,
+    size_t recipient_index)
+{
+    if (participant->membership_count == participant->membership_capacity) {
+        size_t kept = 0;
+        for (size_t i = 0; i < participant->membership_count; ++i) {
+            if (membership_is_live(policy, &participant->memberships[i]))
+                participant->memberships[kept++] = participant->memberships[i];
+        }
+        participant->membership_count = kept;
+    }
+    if (participant->membership_count == participant->membership_capacity) {
+        size_t capacity = participant->membership_capacity ? participant->membership_capacity * 2u : 4u;
+        OfferMembership* memberships = realloc(participant->memberships,
+            capacity * sizeof(*memberships));
+        if (!memberships)
+            return false;
+        participant->memberships = memberships;
+        participant->membership_capacity = capacity;
+    }
+    OfferMembership* membership = &participant->memberships[participant->membership_count++];
+    membership->offer_id = offer_id;
+    membership->recipient_index = recipient_index;
+    return true;
 }
 
-static OfferRecipient* find_recipient(FileOffer* offer, uint64_t participant_id)
+static OfferRecipient* find_recipient(FileOffer* offer, const Participant* participant)
 {
-    if (!offer)
+    if (!offer || !participant)
         return NULL;
-    for (size_t i = 0; i < offer->recipient_count; ++i) {
-        if (offer->recipients[i].participant_id == participant_id)
-            return &offer->recipients[i];
+    for (size_t i = 0; i < participant->membership_count; ++i) {
+        const OfferMembership* membership = &participant->memberships[i];
+        if (membership->offer_id == offer->id
+            && membership->recipient_index != RELAY_POLICY_SENDER_ROLE)
+            return &offer->recipients[membership->recipient_index];
     }
     return NULL;
 }
@@ -96,6 +209,46 @@ static bool send_effect(const RelayPolicyEffects* effects, uint64_t participant_
     return effects && effects->send && effects->send(effects->context, participant_id, message);
 }
 
+static void broadcast_effect(const RelayPolicyEffects* effects, const uint64_t* participant_ids,
+    size_t participant_count, const RelayMessage* message, bool* delivered)
+{
+    if (participant_count == 0)
+        return;
+    if (effects && effects->broadcast) {
+        effects->broadcast(effects->context, participant_ids, participant_count, message,
+            delivered);
+        return;
+    }
+    for (size_t i = 0; i < participant_count; ++i)
+        delivered[i] = send_effect(effects, participant_ids[i], message);
+}
+
+static void forward_chunk_effect(const RelayPolicyEffects* effects,
+    const uint64_t* participant_ids, size_t participant_count, const ProtocolChunkHeader* chunk,
+    bool* delivered)
+{
+    if (participant_count == 0)
+        return;
+    if (effects && effects->forward_chunk && chunk->frame) {
+        effects->forward_chunk(effects->context, participant_ids, participant_count, chunk,
+            delivered);
+        return;
+    }
+    RelayMessage message = { .type = RELAY_MESSAGE_FILE_CHUNK };
+    message.as.file_chunk.offer_id = chunk->offer_id;
+    message.as.file_chunk.offset = chunk->offset;
+    message.as.file_chunk.data = (uint8_t*)chunk->data;
+    message.as.file_chunk.data_length = chunk->data_length;
+    broadcast_effect(effects, participant_ids, participant_count, &message, delivered);
+}
+
+static void purge_effect(const RelayPolicyEffects* effects, uint64_t participant_id,
+    uint64_t offer_id)
+{
+    if (effects && effects->purge)
+        effects->purge(effects->context, participant_id, offer_id);
+}
+
 static void reject_action(const RelayPolicyEffects* effects, uint64_t participant_id,
     RelayMessageType rejected_type, uint64_t correlation_id, const char* reason)
 {
@@ -107,73 +260,90 @@ static void reject_action(const RelayPolicyEffects* effects, uint64_t participan
     (void)send_effect(effects, participant_id, &rejection);
 }
 
-static size_t active_offer_count_for_sender(const RelayPolicy* policy, uint64_t sender_id)
+static bool take_message_token(RelayPolicy* policy, Participant* participant, uint64_t now_ms)
 {
-    size_t count = 0;
-    for (size_t i = 0; i < RELAY_POLICY_MAX_FILE_OFFERS; ++i) {
-        if (policy->offers[i].active && policy->offers[i].sender_id == sender_id)
-            count++;
+    uint64_t interval_us = 1000000u / policy->options.message_rate;
+    uint64_t now_us = now_ms * 1000u;
+    uint64_t allowed_at = participant->message_allowed_at_us > now_us
+        ? participant->message_allowed_at_us
+        : now_us;
+    if (allowed_at > now_us + interval_us * (policy->options.message_burst - 1u)) {
+        policy->rate_limited_count++;
+        return false;
     }
-    return count;
+    participant->message_allowed_at_us = allowed_at + interval_us;
+    return true;
 }
 
-static bool request_id_is_active(const RelayPolicy* policy, uint64_t sender_id,
+static bool request_id_is_active(RelayPolicy* policy, const Participant* sender,
     uint64_t request_id)
 {
-    for (size_t i = 0; i < RELAY_POLICY_MAX_FILE_OFFERS; ++i) {
-        const FileOffer* offer = &policy->offers[i];
-        if (offer->active && offer->sender_id == sender_id
-            && offer->request_id == request_id)
+    for (size_t i = 0; i < sender->membership_count; ++i) {
+        const OfferMembership* membership = &sender->memberships[i];
+        if (membership->recipient_index != RELAY_POLICY_SENDER_ROLE)
+            continue;
+        const FileOffer* offer = find_offer(policy, membership->offer_id);
+        if (offer && offer->request_id == request_id)
             return true;
     }
     return false;
 }
 
-static FileOffer* allocate_offer(RelayPolicy* policy)
+static FileOffer* allocate_offer(RelayPolicy* policy, uint64_t offer_id, size_t recipient_capacity)
 {
-    for (size_t i = 0; i < RELAY_POLICY_MAX_FILE_OFFERS; ++i) {
-        if (!policy->offers[i].active) {
-            memset(&policy->offers[i], 0, sizeof(policy->offers[i]));
-            policy->offers[i].active = true;
-            return &policy->offers[i];
-        }
+    if (policy->free_offer_count == 0)
+        return NULL;
+    FileOffer* offer = &policy->offers[policy->free_offers[policy->free_offer_count - 1u]];
+    memset(offer, 0, sizeof(*offer));
+    offer->set_words = (recipient_capacity + 63u) / 64u;
+    offer->recipients = recipient_capacity
+        ? calloc(recipient_capacity, sizeof(*offer->recipients))
+        : NULL;
+    offer->recipient_sets = offer->set_words
+        ? calloc(offer->set_words * RECIPIENT_SET_COUNT, sizeof(*offer->recipient_sets))
+        : NULL;
+    if ((recipient_capacity && (!offer->recipients || !offer->recipient_sets))
+        || !id_map_put(&policy->offers_by_id, offer_id, offer)) {
+        free(offer->recipients);
+        free(offer->recipient_sets);
+        memset(offer, 0, sizeof(*offer));
+        return NULL;
     }
-    return NULL;
+    policy->free_offer_count--;
+    offer->active = true;
+    offer->id = offer_id;
+    return offer;
 }
 
-static void clear_offer(FileOffer* offer)
+static void clear_offer(RelayPolicy* policy, FileOffer* offer)
 {
-    if (offer)
-        memset(offer, 0, sizeof(*offer));
+    if (!offer || !offer->active)
+        return;
+    timer_wheel_cancel(&policy->timers, &offer->window_timer);
+    Participant* sender = find_participant(policy, offer->sender_id);
+    if (sender && sender->sent_offer_count > 0)
+        sender->sent_offer_count--;
+    (void)id_map_remove(&policy->offers_by_id, offer->id);
+    free(offer->recipients);
+    free(offer->recipient_sets);
+    memset(offer, 0, sizeof(*offer));
+    policy->free_offers[policy->free_offer_count++] = (size_t)(offer - policy->offers);
 }
 
 static bool response_set_is_closed(const FileOffer* offer)
 {
-    for (size_t i = 0; i < offer->recipient_count; ++i) {
-        if (offer->recipients[i].status == RECIPIENT_PENDING)
-            return false;
-    }
-    return true;
+    return recipient_set_count(offer, RECIPIENT_SET_PENDING) == 0;
 }
 
 static size_t active_delivery_count(const FileOffer* offer)
 {
-    size_t count = 0;
-    for (size_t i = 0; i < offer->recipient_count; ++i) {
-        if (offer->recipients[i].status == RECIPIENT_ACTIVE)
-            count++;
-    }
-    return count;
+    return recipient_set_count(offer, RECIPIENT_SET_ACTIVE);
 }
 
 static bool all_deliveries_terminal(const FileOffer* offer)
 {
-    for (size_t i = 0; i < offer->recipient_count; ++i) {
-        RecipientStatus status = offer->recipients[i].status;
-        if (status == RECIPIENT_ACTIVE || status == RECIPIENT_ACCEPTED)
-            return false;
-    }
-    return true;
+    return recipient_set_count(offer, RECIPIENT_SET_ACTIVE) == 0
+        && recipient_set_count(offer, RECIPIENT_SET_ACCEPTED) == 0;
 }
 
 static void send_cancel(const RelayPolicyEffects* effects, uint64_t participant_id,
@@ -186,19 +356,21 @@ static void send_cancel(const RelayPolicyEffects* effects, uint64_t participant_
     (void)send_effect(effects, participant_id, &cancel);
 }
 
-static void cancel_offer(FileOffer* offer, const RelayPolicyEffects* effects,
-    const char* reason, bool notify_sender)
+static void cancel_offer(RelayPolicy* policy, FileOffer* offer,
+    const RelayPolicyEffects* effects, const char* reason, bool notify_sender)
 {
     if (!offer || !offer->active)
         return;
     if (notify_sender)
         send_cancel(effects, offer->sender_id, offer->id, reason);
-    for (size_t i = 0; i < offer->recipient_count; ++i) {
-        RecipientStatus status = offer->recipients[i].status;
-        if (status == RECIPIENT_PENDING || status == RECIPIENT_ACCEPTED || status == RECIPIENT_ACTIVE)
+    for (size_t set = 0; set < RECIPIENT_SET_COUNT; ++set) {
+        for (size_t i = next_in_set(offer, (RecipientSet)set, 0); i < offer->recipient_count;
+            i = next_in_set(offer, (RecipientSet)set, i + 1u)) {
+            purge_effect(effects, offer->recipients[i].participant_id, offer->id);
             send_cancel(effects, offer->recipients[i].participant_id, offer->id, reason);
+        }
     }
-    clear_offer(offer);
+    clear_offer(policy, offer);
 }
 
 static void send_delivery_update(RelayPolicy* policy, FileOffer* offer,
@@ -223,25 +395,121 @@ static void fail_delivery(RelayPolicy* policy, FileOffer* offer, OfferRecipient*
 {
     if (!offer || !recipient || recipient->status != RECIPIENT_ACTIVE)
         return;
-    recipient->status = RECIPIENT_FAILED;
+    set_recipient_status(offer, recipient, RECIPIENT_FAILED);
+    purge_effect(effects, recipient->participant_id, offer->id);
     send_delivery_update(policy, offer, recipient, false, reason, effects);
 }
 
+static size_t collect_active_deliveries(RelayPolicy* policy, FileOffer* offer)
+{
+    size_t count = 0;
+    for (size_t i = next_in_set(offer, RECIPIENT_SET_ACTIVE, 0); i < offer->recipient_count;
+        i = next_in_set(offer, RECIPIENT_SET_ACTIVE, i + 1u)) {
+        policy->scratch_indices[count] = i;
+        policy->scratch_ids[count++] = offer->recipients[i].participant_id;
+    }
+    return count;
+}
+
+static void fail_undelivered(RelayPolicy* policy, FileOffer* offer, size_t count,
+    const RelayPolicyEffects* effects)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (!policy->scratch_delivered[i])
+            fail_delivery(policy, offer, &offer->recipients[policy->scratch_indices[i]],
+                "Recipient delivery queue is full", effects);
+    }
+}
+
+static void forward_to_active_deliveries(RelayPolicy* policy, FileOffer* offer,
+    const RelayMessage* message, const RelayPolicyEffects* effects)
+{
+    size_t count = collect_active_deliveries(policy, offer);
+    broadcast_effect(effects, policy->scratch_ids, count, message, policy->scratch_delivered);
+    fail_undelivered(policy, offer, count, effects);
+}
+
+static void forward_chunk_to_active_deliveries(RelayPolicy* policy, FileOffer* offer,
+    const ProtocolChunkHeader* chunk, const RelayPolicyEffects* effects)
+{
+    size_t count = collect_active_deliveries(policy, offer);
+    forward_chunk_effect(effects, policy->scratch_ids, count, chunk, policy->scratch_delivered);
+    fail_undelivered(policy, offer, count, effects);
+}
+
+static void fail_stragglers(RelayPolicy* policy, FileOffer* offer,
+    const RelayPolicyEffects* effects)
+{
+    uint64_t lag = policy->options.straggler_lag_bytes;
+    if (lag == 0)
+        return;
+    uint64_t fastest = 0;
+    for (size_t i = next_in_set(offer, RECIPIENT_SET_ACTIVE, 0); i < offer->recipient_count;
+        i = next_in_set(offer, RECIPIENT_SET_ACTIVE, i + 1u)) {
+        if (offer->recipients[i].written_bytes > fastest)
+            fastest = offer->recipients[i].written_bytes;
+    }
+    for (size_t i = next_in_set(offer, RECIPIENT_SET_ACTIVE, 0); i < offer->recipient_count;
+        i = next_in_set(offer, RECIPIENT_SET_ACTIVE, i + 1u)) {
+        OfferRecipient* recipient = &offer->recipients[i];
+        if (fastest - recipient->written_bytes > lag)
+            fail_delivery(policy, offer, recipient, "Recipient fell too far behind", effects);
+    }
+}
+
+static void grant_credit(RelayPolicy* policy, FileOffer* offer, bool force,
+    const RelayPolicyEffects* effects)
+{
+    if (!offer->active || offer->state != OFFER_TRANSFERRING)
+        return;
+    fail_stragglers(policy, offer, effects);
+
+    bool found = false;
+    uint64_t slowest = 0;
+    for (size_t i = next_in_set(offer, RECIPIENT_SET_ACTIVE, 0); i < offer->recipient_count;
+        i = next_in_set(offer, RECIPIENT_SET_ACTIVE, i + 1u)) {
+        if (!found || offer->recipients[i].written_bytes < slowest)
+            slowest = offer->recipients[i].written_bytes;
+        found = true;
+    }
+    if (!found)
+        return;
+
+    uint64_t window = policy->options.credit_window_bytes;
+    uint64_t base = policy->options.store_and_forward ? offer->forwarded_bytes : slowest;
+    uint64_t limit = window >= offer->total_size - base
+        ? offer->total_size
+        : base + window;
+    if (limit < offer->credit_limit)
+        limit = offer->credit_limit;
+    if (!force && limit == offer->credit_limit && slowest == offer->delivered_bytes)
+        return;
+    offer->credit_limit = limit;
+    offer->delivered_bytes = slowest;
+
+    RelayMessage credit = { .type = RELAY_MESSAGE_FILE_TRANSFER_CREDIT };
+    credit.as.file_transfer_credit.offer_id = offer->id;
+    credit.as.file_transfer_credit.credit_limit = limit;
+    credit.as.file_transfer_credit.delivered_bytes = slowest;
+    (void)send_effect(effects, offer->sender_id, &credit);
+}
+
 static void close_offer_window(RelayPolicy* policy, FileOffer* offer,
     const RelayPolicyEffects* effects)
 {
     if (!offer || offer->state != OFFER_OPEN)
         return;
+    timer_wheel_cancel(&policy->timers, &offer->window_timer);
 
     uint16_t accepted_count = 0;
     for (size_t i = 0; i < offer->recipient_count; ++i) {
         OfferRecipient* recipient = &offer->recipients[i];
-        if (recipient->status == RECIPIENT_PENDING)
-            recipient->status = RECIPIENT_REJECTED;
         if (recipient->status == RECIPIENT_ACCEPTED) {
-            recipient->status = RECIPIENT_ACTIVE;
+            set_recipient_status(offer, recipient, RECIPIENT_ACTIVE);
             accepted_count++;
         } else {
+            if (recipient->status == RECIPIENT_PENDING)
+                set_recipient_status(offer, recipient, RECIPIENT_REJECTED);
             send_cancel(effects, recipient->participant_id, offer->id, "File Offer closed");
         }
     }
@@ -250,7 +518,7 @@ static void close_offer_window(RelayPolicy* policy, FileOffer* offer,
         RelayMessage declined = { .type = RELAY_MESSAGE_FILE_OFFER_DECLINED };
         declined.as.file_offer_declined.offer_id = offer->id;
         (void)send_effect(effects, offer->sender_id, &declined);
-        clear_offer(offer);
+        clear_offer(policy, offer);
         return;
     }
 
@@ -259,7 +527,7 @@ static void close_offer_window(RelayPolicy* policy, FileOffer* offer,
     ready.as.file_transfer_ready.offer_id = offer->id;
     ready.as.file_transfer_ready.recipient_count = accepted_count;
     (void)send_effect(effects, offer->sender_id, &ready);
-    (void)policy;
+    grant_credit(policy, offer, true, effects);
 }
 
 static void handle_chat(RelayPolicy* policy, const Participant* sender,
@@ -272,39 +540,52 @@ static void handle_chat(RelayPolicy* policy, const Participant* sender,
     snprintf(delivered.as.chat_deliver.text, sizeof(delivered.as.chat_deliver.text),
         "%s", message->as.chat_send.text);
 
-    for (size_t i = 0; i < RELAY_POLICY_MAX_PARTICIPANTS; ++i) {
-        if (policy->participants[i].active && policy->participants[i].id != sender->id)
-            (void)send_effect(effects, policy->participants[i].id, &delivered);
+    size_t count = 0;
+    for (size_t i = 0; i < policy->roster_count; ++i) {
+        if (policy->roster[i]->id != sender->id)
+            policy->scratch_ids[count++] = policy->roster[i]->id;
     }
+    broadcast_effect(effects, policy->scratch_ids, count, &delivered, policy->scratch_delivered);
 }
 
-static void handle_offer_create(RelayPolicy* policy, const Participant* sender,
+static void handle_offer_create(RelayPolicy* policy, Participant* sender,
     const RelayMessage* message, uint64_t now_ms, const RelayPolicyEffects* effects)
 {
     uint64_t request_id = message->as.file_offer_create.request_id;
-    if (request_id_is_active(policy, sender->id, request_id)) {
+    if (request_id_is_active(policy, sender, request_id)) {
         reject_action(effects, sender->id, message->type, request_id,
             "File Offer request identity is already active");
         return;
     }
-    if (active_offer_count_for_sender(policy, sender->id) >= RELAY_POLICY_MAX_OFFERS_PER_SENDER) {
+    if (policy->refusing_offers) {
+        policy->refused_offer_count++;
+        reject_action(effects, sender->id, message->type, request_id, "Relay Server is low on memory");
+        return;
+    }
+    if (sender->sent_offer_count >= policy->options.max_offers_per_sender) {
         reject_action(effects, sender->id, message->type, request_id, "Too many active File Offers");
         return;
     }
 
-    FileOffer* offer = allocate_offer(policy);
-    if (!offer) {
+    uint64_t offer_id = policy->next_offer_id++;
+    if (offer_id == 0)
+        offer_id = policy->next_offer_id++;
+    FileOffer* offer = allocate_offer(policy, offer_id, policy->roster_count - 1u);
+    if (offer) {
+        offer->sender_id = sender->id;
+        sender->sent_offer_count++;
+    }
+    if (!offer || !add_membership(policy, sender, offer_id, RELAY_POLICY_SENDER_ROLE)) {
+        clear_offer(policy, offer);
         reject_action(effects, sender->id, message->type, request_id, "Relay Server is at capacity");
         return;
     }
-    offer->id = policy->next_offer_id++;
-    if (offer->id == 0)
-        offer->id = policy->next_offer_id++;
     offer->request_id = request_id;
-    offer->sender_id = sender->id;
     offer->total_size = message->as.file_offer_create.total_size;
     offer->chunk_size = message->as.file_offer_create.chunk_size;
-    offer->deadline_ms = now_ms + RELAY_POLICY_OFFER_WINDOW_MS;
+    offer->window_timer.owner = offer;
+    timer_wheel_schedule(&policy->timers, &offer->window_timer,
+        now_ms + RELAY_POLICY_OFFER_WINDOW_MS);
     snprintf(offer->filename, sizeof(offer->filename), "%s",
         message->as.file_offer_create.filename);
 
@@ -324,15 +605,21 @@ static void handle_offer_create(RelayPolicy* policy, const Participant* sender,
     snprintf(published.as.file_offer_published.filename,
         sizeof(published.as.file_offer_published.filename), "%s", offer->filename);
 
-    for (size_t i = 0; i < RELAY_POLICY_MAX_PARTICIPANTS; ++i) {
-        Participant* participant = &policy->participants[i];
-        if (!participant->active || participant->id == sender->id)
+    for (size_t i = 0; i < policy->roster_count; ++i) {
+        Participant* participant = policy->roster[i];
+        if (participant->id == sender->id
+            || !add_membership(policy, participant, offer->id, offer->recipient_count))
             continue;
         OfferRecipient* recipient = &offer->recipients[offer->recipient_count++];
         recipient->participant_id = participant->id;
-        recipient->status = RECIPIENT_PENDING;
-        if (!send_effect(effects, participant->id, &published))
-            recipient->status = RECIPIENT_REJECTED;
+        set_recipient_status(offer, recipient, RECIPIENT_PENDING);
+        policy->scratch_ids[offer->recipient_count - 1u] = participant->id;
+    }
+    broadcast_effect(effects, policy->scratch_ids, offer->recipient_count, &published,
+        policy->scratch_delivered);
+    for (size_t i = 0; i < offer->recipient_count; ++i) {
+        if (!policy->scratch_delivered[i])
+            set_recipient_status(offer, &offer->recipients[i], RECIPIENT_REJECTED);
     }
 
     if (offer->recipient_count == 0 || response_set_is_closed(offer))
@@ -343,45 +630,49 @@ static void handle_offer_response(RelayPolicy* policy, const Participant* partic
     const RelayMessage* message, const RelayPolicyEffects* effects)
 {
     FileOffer* offer = find_offer(policy, message->as.file_offer_response.offer_id);
-    OfferRecipient* recipient = find_recipient(offer, participant->id);
+    OfferRecipient* recipient = find_recipient(offer, participant);
     if (!offer || offer->state != OFFER_OPEN || !recipient
         || recipient->status != RECIPIENT_PENDING) {
         reject_action(effects, participant->id, message->type,
             message->as.file_offer_response.offer_id, "File Offer is not open");
         return;
     }
-    recipient->status = message->as.file_offer_response.accepted
-        ? RECIPIENT_ACCEPTED
-        : RECIPIENT_REJECTED;
+    set_recipient_status(offer, recipient, message->as.file_offer_response.accepted
+            ? RECIPIENT_ACCEPTED
+            : RECIPIENT_REJECTED);
     if (response_set_is_closed(offer))
         close_offer_window(policy, offer, effects);
 }
 
 static void handle_chunk(RelayPolicy* policy, const Participant* sender,
-    const RelayMessage* message, const RelayPolicyEffects* effects)
+    const ProtocolChunkHeader* chunk, const RelayPolicyEffects* effects)
 {
-    FileOffer* offer = find_offer(policy, message->as.file_chunk.offer_id);
+    FileOffer* offer = find_offer(policy, chunk->offer_id);
     if (!offer || offer->state != OFFER_TRANSFERRING || offer->sender_id != sender->id
-        || offer->sender_finished || message->as.file_chunk.offset != offer->forwarded_bytes
-        || message->as.file_chunk.data_length > offer->chunk_size
+        || offer->sender_finished || chunk->offset != offer->forwarded_bytes
+        || chunk->data_length > offer->chunk_size
         || offer->forwarded_bytes > offer->total_size
-        || message->as.file_chunk.data_length > offer->total_size - offer->forwarded_bytes) {
-        reject_action(effects, sender->id, message->type,
-            message->as.file_chunk.offer_id, "Invalid File Transfer chunk");
+        || chunk->data_length > offer->total_size - offer->forwarded_bytes) {
+        reject_action(effects, sender->id, RELAY_MESSAGE_FILE_CHUNK,
+            chunk->offer_id, "Invalid File Transfer chunk");
         if (offer && offer->sender_id == sender->id)
-            cancel_offer(offer, effects, "Invalid File Transfer chunk", false);
+            cancel_offer(policy, offer, effects, "Invalid File Transfer chunk", false);
         return;
     }
-
-    for (size_t i = 0; i < offer->recipient_count; ++i) {
-        OfferRecipient* recipient = &offer->recipients[i];
-        if (recipient->status == RECIPIENT_ACTIVE
-            && !send_effect(effects, recipient->participant_id, message))
-            fail_delivery(policy, offer, recipient, "Recipient delivery queue is full", effects);
+    if (chunk->data_length > offer->credit_limit - offer->forwarded_bytes) {
+        reject_action(effects, sender->id, RELAY_MESSAGE_FILE_CHUNK,
+            chunk->offer_id, "File Transfer exceeded its credit");
+        cancel_offer(policy, offer, effects, "File Transfer exceeded its credit", false);
+        return;
     }
-    offer->forwarded_bytes += message->as.file_chunk.data_length;
+
+    size_t active_before = active_delivery_count(offer);
+    forward_chunk_to_active_deliveries(policy, offer, chunk, effects);
+    offer->forwarded_bytes += chunk->data_length;
     if (active_delivery_count(offer) == 0)
-        cancel_offer(offer, effects, "No Recipients remain", true);
+        cancel_offer(policy, offer, effects, "No Recipients remain", true);
+    else if (policy->options.store_and_forward || active_delivery_count(offer) != active_before)
+        grant_credit(policy, offer, false, effects);
 }
 
 static void handle_transfer_end(RelayPolicy* policy, const Participant* sender,
@@ -394,25 +685,20 @@ static void handle_transfer_end(RelayPolicy* policy, const Participant* sender,
         reject_action(effects, sender->id, message->type,
             message->as.file_transfer_end.offer_id, "File Transfer size mismatch");
         if (offer && offer->sender_id == sender->id)
-            cancel_offer(offer, effects, "File Transfer size mismatch", false);
+            cancel_offer(policy, offer, effects, "File Transfer size mismatch", false);
         return;
     }
     offer->sender_finished = true;
-    for (size_t i = 0; i < offer->recipient_count; ++i) {
-        OfferRecipient* recipient = &offer->recipients[i];
-        if (recipient->status == RECIPIENT_ACTIVE
-            && !send_effect(effects, recipient->participant_id, message))
-            fail_delivery(policy, offer, recipient, "Recipient delivery queue is full", effects);
-    }
+    forward_to_active_deliveries(policy, offer, message, effects);
     if (all_deliveries_terminal(offer))
-        clear_offer(offer);
+        clear_offer(policy, offer);
 }
 
 static void handle_delivery_result(RelayPolicy* policy, const Participant* participant,
     const RelayMessage* message, const RelayPolicyEffects* effects)
 {
     FileOffer* offer = find_offer(policy, message->as.file_delivery_result.offer_id);
-    OfferRecipient* recipient = find_recipient(offer, participant->id);
+    OfferRecipient* recipient = find_recipient(offer, participant);
     if (!offer || offer->state != OFFER_TRANSFERRING || !recipient
         || recipient->status != RECIPIENT_ACTIVE
         || (message->as.file_delivery_result.success && !offer->sender_finished)) {
@@ -421,19 +707,40 @@ static void handle_delivery_result(RelayPolicy* policy, const Participant* parti
         return;
     }
 
-    recipient->status = message->as.file_delivery_result.success
-        ? RECIPIENT_SUCCEEDED
-        : RECIPIENT_FAILED;
+    set_recipient_status(offer, recipient, message->as.file_delivery_result.success
+            ? RECIPIENT_SUCCEEDED
+            : RECIPIENT_FAILED);
     send_delivery_update(policy, offer, recipient,
         message->as.file_delivery_result.success,
         message->as.file_delivery_result.reason, effects);
     if (!message->as.file_delivery_result.success && !offer->sender_finished
         && active_delivery_count(offer) == 0) {
-        cancel_offer(offer, effects, "No Recipients remain", true);
+        cancel_offer(policy, offer, effects, "No Recipients remain", true);
         return;
     }
     if (all_deliveries_terminal(offer))
-        clear_offer(offer);
+        clear_offer(policy, offer);
+    else
+        grant_credit(policy, offer, false, effects);
+}
+
+static void handle_delivery_progress(RelayPolicy* policy, const Participant* participant,
+    const RelayMessage* message, const RelayPolicyEffects* effects)
+{
+    // Progress races terminal Delivery transitions, so stale reports are dropped quietly.
+    FileOffer* offer = find_offer(policy, message->as.file_delivery_progress.offer_id);
+    OfferRecipient* recipient = find_recipient(offer, participant);
+    if (!offer || offer->state != OFFER_TRANSFERRING || !recipient
+        || recipient->status != RECIPIENT_ACTIVE)
+        return;
+    uint64_t written_bytes = message->as.file_delivery_progress.written_bytes;
+    if (written_bytes < recipient->written_bytes || written_bytes > offer->forwarded_bytes) {
+        reject_action(effects, participant->id, message->type, offer->id,
+            "Delivery progress is out of range");
+        return;
+    }
+    recipient->written_bytes = written_bytes;
+    grant_credit(policy, offer, false, effects);
 }
 
 static void handle_transfer_cancel(RelayPolicy* policy, const Participant* participant,
@@ -446,10 +753,10 @@ static void handle_transfer_cancel(RelayPolicy* policy, const Participant* parti
         return;
     }
     if (offer->sender_id == participant->id) {
-        cancel_offer(offer, effects, message->as.file_transfer_cancel.reason, false);
+        cancel_offer(policy, offer, effects, message->as.file_transfer_cancel.reason, false);
         return;
     }
-    OfferRecipient* recipient = find_recipient(offer, participant->id);
+    OfferRecipient* recipient = find_recipient(offer, participant);
     if (!recipient || recipient->status != RECIPIENT_ACTIVE) {
         reject_action(effects, participant->id, message->type,
             message->as.file_transfer_cancel.offer_id, "Participant has no active Delivery");
@@ -457,42 +764,137 @@ static void handle_transfer_cancel(RelayPolicy* policy, const Participant* parti
     }
     fail_delivery(policy, offer, recipient, message->as.file_transfer_cancel.reason, effects);
     if (active_delivery_count(offer) == 0)
-        cancel_offer(offer, effects, "No Recipients remain", true);
+        cancel_offer(policy, offer, effects, "No Recipients remain", true);
+    else
+        grant_credit(policy, offer, false, effects);
 }
 
 RelayPolicy* relay_policy_create(void)
+{
+    return relay_policy_create_with_options(NULL);
+}
+
+static size_t option_or_default(size_t value, size_t fallback)
+{
+    return value > 0 ? value : fallback;
+}
+
+RelayPolicy* relay_policy_create_with_options(const RelayPolicyOptions* options)
 {
     RelayPolicy* policy = calloc(1, sizeof(*policy));
-    if (policy) {
-        policy->next_participant_id = 1;
-        policy->next_offer_id = 1;
+    if (!policy)
+        return NULL;
+    policy->next_participant_id = 1;
+    policy->next_offer_id = 1;
+    if (options)
+        policy->options = *options;
+    if (policy->options.credit_window_bytes == 0)
+        policy->options.credit_window_bytes = RELAY_POLICY_CREDIT_WINDOW_BYTES;
+    policy->options.max_participants = option_or_default(policy->options.max_participants,
+        RELAY_POLICY_DEFAULT_MAX_PARTICIPANTS);
+    if (policy->options.max_participants > RELAY_POLICY_MAX_PARTICIPANTS_LIMIT)
+        policy->options.max_participants = RELAY_POLICY_MAX_PARTICIPANTS_LIMIT;
+    policy->options.max_file_offers = option_or_default(policy->options.max_file_offers,
+        RELAY_POLICY_DEFAULT_MAX_FILE_OFFERS);
+    policy->options.max_offers_per_sender = option_or_default(
+        policy->options.max_offers_per_sender, RELAY_POLICY_DEFAULT_MAX_OFFERS_PER_SENDER);
+    policy->options.message_rate = option_or_default(policy->options.message_rate,
+        RELAY_POLICY_DEFAULT_MESSAGE_RATE);
+    if (policy->options.message_rate > 1000000u)
+        policy->options.message_rate = 1000000u;
+    policy->options.message_burst = option_or_default(policy->options.message_burst,
+        RELAY_POLICY_DEFAULT_MESSAGE_BURST);
+    timer_wheel_init(&policy->timers, 0);
+
+    size_t participant_capacity = policy->options.max_participants;
+    size_t offer_capacity = policy->options.max_file_offers;
+    policy->participants = calloc(participant_capacity, sizeof(*policy->participants));
+    policy->free_participants = calloc(participant_capacity, sizeof(*policy->free_participants));
+    policy->roster = calloc(participant_capacity, sizeof(*policy->roster));
+    policy->scratch_ids = calloc(participant_capacity, sizeof(*policy->scratch_ids));
+    policy->scratch_indices = calloc(participant_capacity, sizeof(*policy->scratch_indices));
+    policy->scratch_delivered = calloc(participant_capacity, sizeof(*policy->scratch_delivered));
+    policy->offers = calloc(offer_capacity, sizeof(*policy->offers));
+    policy->free_offers = calloc(offer_capacity, sizeof(*policy->free_offers));
+    if (!policy->participants || !policy->free_participants || !policy->roster
+        || !policy->scratch_ids || !policy->scratch_indices || !policy->scratch_delivered
+        || !policy->offers || !policy->free_offers
+        || !id_map_init(&policy->participants_by_id, participant_capacity)
+        || !id_map_init(&policy->offers_by_id, offer_capacity)) {
+        relay_policy_destroy(policy);
+        return NULL;
     }
+    for (size_t i = 0; i < participant_capacity; ++i)
+        policy->free_participants[i] = participant_capacity - 1u - i;
+    policy->free_participant_count = participant_capacity;
+    for (size_t i = 0; i < offer_capacity; ++i)
+        policy->free_offers[i] = offer_capacity - 1u - i;
+    policy->free_offer_count = offer_capacity;
     return policy;
 }
 
 void relay_policy_destroy(RelayPolicy* policy)
 {
+    if (!policy)
+        return;
+    if (policy->participants) {
+        for (size_t i = 0; i < policy->options.max_participants; ++i)
+            free(policy->participants[i].memberships);
+    }
+    if (policy->offers) {
+        for (size_t i = 0; i < policy->options.max_file_offers; ++i) {
+            free(policy->offers[i].recipients);
+            free(policy->offers[i].recipient_sets);
+        }
+    }
+    id_map_destroy(&policy->participants_by_id);
+    id_map_destroy(&policy->offers_by_id);
+    free(policy->participants);
+    free(policy->free_participants);
+    free(policy->roster);
+    free(policy->scratch_ids);
+    free(policy->scratch_indices);
+    free(policy->scratch_delivered);
+    free(policy->offers);
+    free(policy->free_offers);
     free(policy);
 }
 
 bool relay_policy_join(RelayPolicy* policy, const char* display_name, uint64_t* participant_id)
 {
-    if (!policy || !participant_id || !protocol_display_name_is_valid(display_name))
+    if (!policy || !participant_id || !protocol_display_name_is_valid(display_name)
+        || policy->free_participant_count == 0)
         return false;
-    for (size_t i = 0; i < RELAY_POLICY_MAX_PARTICIPANTS; ++i) {
-        if (!policy->participants[i].active) {
-            Participant* participant = &policy->participants[i];
-            memset(participant, 0, sizeof(*participant));
-            participant->active = true;
-            participant->id = policy->next_participant_id++;
-            if (participant->id == 0)
-                participant->id = policy->next_participant_id++;
-            snprintf(participant->display_name, sizeof(participant->display_name), "%s", display_name);
-            *participant_id = participant->id;
-            return true;
-        }
-    }
-    return false;
+    size_t slot = policy->free_participants[policy->free_participant_count - 1u];
+    Participant* participant = &policy->participants[slot];
+    uint64_t id = policy->next_participant_id++;
+    if (id == 0)
+        id = policy->next_participant_id++;
+    if (!id_map_put(&policy->participants_by_id, id, participant))
+        return false;
+    policy->free_participant_count--;
+    OfferMembership* memberships = participant->memberships;
+    size_t membership_capacity = participant->membership_capacity;
+    memset(participant, 0, sizeof(*participant));
+    participant->memberships = memberships;
+    participant->membership_capacity = membership_capacity;
+    participant->active = true;
+    participant->id = id;
+    snprintf(participant->display_name, sizeof(participant->display_name), "%s", display_name);
+    participant->roster_index = policy->roster_count;
+    policy->roster[policy->roster_count++] = participant;
+    *participant_id = id;
+    return true;
+}
+
+static void remove_from_roster(RelayPolicy* policy, Participant* participant)
+{
+    (void)id_map_remove(&policy->participants_by_id, participant->id);
+    Participant* moved = policy->roster[--policy->roster_count];
+    moved->roster_index = participant->roster_index;
+    policy->roster[participant->roster_index] = moved;
+    policy->roster[policy->roster_count] = NULL;
+    participant->active = false;
 }
 
 void relay_policy_leave(RelayPolicy* policy, uint64_t participant_id, uint64_t now_ms,
@@ -502,32 +904,36 @@ void relay_policy_leave(RelayPolicy* policy, uint64_t participant_id, uint64_t n
     Participant* participant = find_participant(policy, participant_id);
     if (!participant)
         return;
-    participant->active = false;
+    remove_from_roster(policy, participant);
 
-    for (size_t i = 0; i < RELAY_POLICY_MAX_FILE_OFFERS; ++i) {
-        FileOffer* offer = &policy->offers[i];
-        if (!offer->active)
+    for (size_t i = 0; i < participant->membership_count; ++i) {
+        const OfferMembership* membership = &participant->memberships[i];
+        FileOffer* offer = find_offer(policy, membership->offer_id);
+        if (!offer)
             continue;
-        if (offer->sender_id == participant_id) {
-            cancel_offer(offer, effects, "Sender disconnected", false);
+        if (membership->recipient_index == RELAY_POLICY_SENDER_ROLE) {
+            if (!policy->options.store_and_forward || !offer->sender_finished)
+                cancel_offer(policy, offer, effects, "Sender disconnected", false);
             continue;
         }
-        OfferRecipient* recipient = find_recipient(offer, participant_id);
-        if (!recipient)
-            continue;
+        OfferRecipient* recipient = &offer->recipients[membership->recipient_index];
         if (offer->state == OFFER_OPEN
             && (recipient->status == RECIPIENT_PENDING || recipient->status == RECIPIENT_ACCEPTED)) {
-            recipient->status = RECIPIENT_REJECTED;
+            set_recipient_status(offer, recipient, RECIPIENT_REJECTED);
             if (response_set_is_closed(offer))
                 close_offer_window(policy, offer, effects);
         } else if (offer->state == OFFER_TRANSFERRING
             && recipient->status == RECIPIENT_ACTIVE) {
             fail_delivery(policy, offer, recipient, "Recipient disconnected", effects);
             if (active_delivery_count(offer) == 0)
-                cancel_offer(offer, effects, "No Recipients remain", true);
+                cancel_offer(policy, offer, effects, "No Recipients remain", true);
+            else
+                grant_credit(policy, offer, false, effects);
         }
     }
-    memset(participant, 0, sizeof(*participant));
+    participant->membership_count = 0;
+    policy->free_participants[policy->free_participant_count++]
+        = (size_t)(participant - policy->participants);
 }
 
 void relay_policy_handle(RelayPolicy* policy, uint64_t participant_id,
@@ -537,6 +943,16 @@ void relay_policy_handle(RelayPolicy* policy, uint64_t participant_id,
     if (!participant || !protocol_message_is_valid(message))
         return;
 
+    if ((message->type == RELAY_MESSAGE_CHAT_SEND
+            || message->type == RELAY_MESSAGE_FILE_OFFER_CREATE)
+        && !take_message_token(policy, participant, now_ms)) {
+        uint64_t correlation = message->type == RELAY_MESSAGE_FILE_OFFER_CREATE
+            ? message->as.file_offer_create.request_id
+            : 0;
+        reject_action(effects, participant_id, message->type, correlation, "Rate limit exceeded");
+        return;
+    }
+
     switch (message->type) {
     case RELAY_MESSAGE_CHAT_SEND:
         handle_chat(policy, participant, message, effects);
@@ -547,9 +963,16 @@ void relay_policy_handle(RelayPolicy* policy, uint64_t participant_id,
     case RELAY_MESSAGE_FILE_OFFER_RESPONSE:
         handle_offer_response(policy, participant, message, effects);
         break;
-    case RELAY_MESSAGE_FILE_CHUNK:
-        handle_chunk(policy, participant, message, effects);
+    case RELAY_MESSAGE_FILE_CHUNK: {
+        ProtocolChunkHeader chunk = {
+            .offer_id = message->as.file_chunk.offer_id,
+            .offset = message->as.file_chunk.offset,
+            .data = message->as.file_chunk.data,
+            .data_length = message->as.file_chunk.data_length
+        };
+        handle_chunk(policy, participant, &chunk, effects);
         break;
+    }
     case RELAY_MESSAGE_FILE_TRANSFER_END:
         handle_transfer_end(policy, participant, message, effects);
         break;
@@ -559,6 +982,9 @@ void relay_policy_handle(RelayPolicy* policy, uint64_t participant_id,
     case RELAY_MESSAGE_FILE_TRANSFER_CANCEL:
         handle_transfer_cancel(policy, participant, message, effects);
         break;
+    case RELAY_MESSAGE_FILE_DELIVERY_PROGRESS:
+        handle_delivery_progress(policy, participant, message, effects);
+        break;
     default:
         reject_action(effects, participant_id, message->type, 0,
             "Message type is not accepted from a Participant");
@@ -566,38 +992,101 @@ void relay_policy_handle(RelayPolicy* policy, uint64_t participant_id,
     }
 }
 
+void relay_policy_handle_chunk(RelayPolicy* policy, uint64_t participant_id,
+    const ProtocolChunkHeader* chunk, uint64_t now_ms, const RelayPolicyEffects* effects)
+{
+    (void)now_ms;
+    Participant* participant = find_participant(policy, participant_id);
+    if (!participant || !chunk || chunk->offer_id == 0 || !chunk->data
+        || chunk->data_length == 0 || chunk->data_length > PROTOCOL_FILE_CHUNK_MAX)
+        return;
+    handle_chunk(policy, participant, chunk, effects);
+}
+
+typedef struct {
+    RelayPolicy* policy;
+    const RelayPolicyEffects* effects;
+} OfferWindowExpiry;
+
+static void offer_window_expired(void* context, TimerEntry* entry)
+{
+    OfferWindowExpiry* expiry = context;
+    close_offer_window(expiry->policy, entry->owner, expiry->effects);
+}
+
 void relay_policy_tick(RelayPolicy* policy, uint64_t now_ms,
     const RelayPolicyEffects* effects)
 {
     if (!policy)
         return;
-    for (size_t i = 0; i < RELAY_POLICY_MAX_FILE_OFFERS; ++i) {
-        FileOffer* offer = &policy->offers[i];
-        if (offer->active && offer->state == OFFER_OPEN && now_ms >= offer->deadline_ms)
-            close_offer_window(policy, offer, effects);
-    }
+    OfferWindowExpiry expiry = { .policy = policy, .effects = effects };
+    (void)timer_wheel_advance(&policy->timers, now_ms, offer_window_expired, &expiry);
 }
 
-size_t relay_policy_participant_count(const RelayPolicy* policy)
+bool relay_policy_next_deadline(const RelayPolicy* policy, uint64_t* deadline_ms)
+{
+    if (!policy || !deadline_ms)
+        return false;
+    return timer_wheel_next_expiry(&policy->timers, deadline_ms);
+}
+
+void relay_policy_set_refusing_offers(RelayPolicy* policy, bool refusing)
+{
+    if (policy)
+        policy->refusing_offers = refusing;
+}
+
+bool relay_policy_fail_slowest_delivery(RelayPolicy* policy, const char* reason,
+    const RelayPolicyEffects* effects)
 {
     if (!policy)
-        return 0;
-    size_t count = 0;
-    for (size_t i = 0; i < RELAY_POLICY_MAX_PARTICIPANTS; ++i) {
-        if (policy->participants[i].active)
-            count++;
+        return false;
+    FileOffer* slowest_offer = NULL;
+    OfferRecipient* slowest = NULL;
+    uint64_t largest_backlog = 0;
+    for (size_t index = 0; index < policy->options.max_file_offers; ++index) {
+        FileOffer* offer = &policy->offers[index];
+        if (!offer->active || offer->state != OFFER_TRANSFERRING)
+            continue;
+        for (size_t i = next_in_set(offer, RECIPIENT_SET_ACTIVE, 0); i < offer->recipient_count;
+            i = next_in_set(offer, RECIPIENT_SET_ACTIVE, i + 1u)) {
+            uint64_t backlog = offer->forwarded_bytes - offer->recipients[i].written_bytes;
+            if (backlog > largest_backlog) {
+                largest_backlog = backlog;
+                slowest_offer = offer;
+                slowest = &offer->recipients[i];
+            }
+        }
     }
-    return count;
+    if (!slowest)
+        return false;
+    fail_delivery(policy, slowest_offer, slowest, reason, effects);
+    send_cancel(effects, slowest->participant_id, slowest_offer->id, reason);
+    if (!slowest_offer->sender_finished && active_delivery_count(slowest_offer) == 0)
+        cancel_offer(policy, slowest_offer, effects, "No Recipients remain", true);
+    else if (all_deliveries_terminal(slowest_offer))
+        clear_offer(policy, slowest_offer);
+    else
+        grant_credit(policy, slowest_offer, false, effects);
+    return true;
+}
+
+size_t relay_policy_participant_count(const RelayPolicy* policy)
+{
+    return policy ? policy->roster_count : 0;
 }
 
 size_t relay_policy_file_offer_count(const RelayPolicy* policy)
 {
-    if (!policy)
-        return 0;
-    size_t count = 0;
-    for (size_t i = 0; i < RELAY_POLICY_MAX_FILE_OFFERS; ++i) {
-        if (policy->offers[i].active)
-            count++;
-    }
-    return count;
+    return policy ? policy->offers_by_id.count : 0;
+}
+
+size_t relay_policy_rate_limited_count(const RelayPolicy* policy)
+{
+    return policy ? policy->rate_limited_count : 0;
+}
+
+size_t relay_policy_refused_offer_count(const RelayPolicy* policy)
+{
+    return policy ? policy->refused_offer_count : 0;
 }
@@ -7,22 +7,46 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#define RELAY_POLICY_MAX_PARTICIPANTS 32u
-#define RELAY_POLICY_MAX_FILE_OFFERS 32u
-#define RELAY_POLICY_MAX_OFFERS_PER_SENDER 8u
+#define RELAY_POLICY_DEFAULT_MAX_PARTICIPANTS 32u
+#define RELAY_POLICY_DEFAULT_MAX_FILE_OFFERS 32u
+#define RELAY_POLICY_DEFAULT_MAX_OFFERS_PER_SENDER 8u
+#define RELAY_POLICY_MAX_PARTICIPANTS_LIMIT 65535u
+#define RELAY_POLICY_DEFAULT_MESSAGE_RATE 50u
+#define RELAY_POLICY_DEFAULT_MESSAGE_BURST 100u
 #define RELAY_POLICY_OFFER_WINDOW_MS 60000u
+#define RELAY_POLICY_CREDIT_WINDOW_BYTES (8ull * 1024ull * 1024ull)
 
 typedef struct RelayPolicy RelayPolicy;
 
 typedef bool (*RelayPolicySend)(void* context, uint64_t participant_id,
     const RelayMessage* message);
+typedef void (*RelayPolicyBroadcast)(void* context, const uint64_t* participant_ids,
+    size_t participant_count, const RelayMessage* message, bool* delivered);
+typedef void (*RelayPolicyForwardChunk)(void* context, const uint64_t* participant_ids,
+    size_t participant_count, const ProtocolChunkHeader* chunk, bool* delivered);
+typedef void (*RelayPolicyPurge)(void* context, uint64_t participant_id, uint64_t offer_id);
 
 typedef struct {
     RelayPolicySend send;
+    RelayPolicyBroadcast broadcast;
+    RelayPolicyForwardChunk forward_chunk;
+    RelayPolicyPurge purge;
     void* context;
 } RelayPolicyEffects;
 
+typedef struct {
+    uint64_t credit_window_bytes;
+    uint64_t straggler_lag_bytes;
+    bool store_and_forward;
+    size_t max_participants;
+    size_t max_file_offers;
+    size_t max_offers_per_sender;
+    size_t message_rate;
+    size_t message_burst;
+} RelayPolicyOptions;
+
 RelayPolicy* relay_policy_create(void);
+RelayPolicy* relay_policy_create_with_options(const RelayPolicyOptions* options);
 void relay_policy_destroy(RelayPolicy* policy);
 
 bool relay_policy_join(RelayPolicy* policy, const char* display_name, uint64_t* participant_id);
@@ -31,10 +55,18 @@ void relay_policy_leave(RelayPolicy* policy, uint64_t participant_id, uint64_t n
 
 void relay_policy_handle(RelayPolicy* policy, uint64_t participant_id,
     const RelayMessage* message, uint64_t now_ms, const RelayPolicyEffects* effects);
+void relay_policy_handle_chunk(RelayPolicy* policy, uint64_t participant_id,
+    const ProtocolChunkHeader* chunk, uint64_t now_ms, const RelayPolicyEffects* effects);
 void relay_policy_tick(RelayPolicy* policy, uint64_t now_ms,
     const RelayPolicyEffects* effects);
+bool relay_policy_next_deadline(const RelayPolicy* policy, uint64_t* deadline_ms);
+void relay_policy_set_refusing_offers(RelayPolicy* policy, bool refusing);
+bool relay_policy_fail_slowest_delivery(RelayPolicy* policy, const char* reason,
+    const RelayPolicyEffects* effects);
 
 size_t relay_policy_participant_count(const RelayPolicy* policy);
 size_t relay_policy_file_offer_count(const RelayPolicy* policy);
+size_t relay_policy_rate_limited_count(const RelayPolicy* policy);
+size_t relay_policy_refused_offer_count(const RelayPolicy* policy);
 
 #endif
@@ -1,9 +1,11 @@
 #ifndef RELAY_TRANSPORT_H
 #define RELAY_TRANSPORT_H
 
+#include "buffer_pool.h"
 #include "protocol.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef enum {
     RELAY_SEND_OK = 0,
@@ -14,11 +16,17 @@ typedef enum {
 
 typedef RelaySendResult (*RelayTransportSend)(void* context, const RelayMessage* message);
 typedef bool (*RelayTransportConnected)(void* context);
+typedef void (*RelayTransportPurge)(void* context, uint64_t offer_id);
+/* On RELAY_SEND_OK the transport owns the chunk data, a buffer_pool block of data_capacity. */
+typedef RelaySendResult (*RelayTransportSendChunk)(void* context, const RelayMessage* chunk,
+    size_t data_capacity);
 
 typedef struct {
     void* context;
     RelayTransportSend send;
     RelayTransportConnected connected;
+    RelayTransportPurge purge;
+    RelayTransportSendChunk send_chunk;
 } RelayTransport;
 
 static inline RelaySendResult relay_transport_send(const RelayTransport* transport,
@@ -29,9 +37,26 @@ static inline RelaySendResult relay_transport_send(const RelayTransport* transpo
     return transport->send(transport->context, message);
 }
 
+static inline RelaySendResult relay_transport_send_chunk(const RelayTransport* transport,
+    const RelayMessage* chunk, size_t data_capacity)
+{
+    if (transport && transport->send_chunk)
+        return transport->send_chunk(transport->context, chunk, data_capacity);
+    RelaySendResult result = relay_transport_send(transport, chunk);
+    if (result == RELAY_SEND_OK)
+        buffer_pool_release(chunk->as.file_chunk.data, data_capacity);
+    return result;
+}
+
 static inline bool relay_transport_is_connected(const RelayTransport* transport)
 {
     return transport && transport->connected && transport->connected(transport->context);
 }
 
+static inline void relay_transport_purge(const RelayTransport* transport, uint64_t offer_id)
+{
+    if (transport && transport->purge && offer_id != 0)
+        transport->purge(transport->context, offer_id);
+}
+
 #endif
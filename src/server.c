@@ -1,59 +1,346 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
 #include "server.h"
 
+#include "buffer_pool.h"
+#include "id_map.h"
+#include "memory_governor.h"
 #include "platform.h"
 #include "protocol.h"
 #include "relay_policy.h"
+#include "spool.h"
+#include "timer_wheel.h"
+#include "uring.h"
 
 #include <errno.h>
 #include <limits.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+#ifdef __linux__
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#define SERVER_HAS_WORKERS 1
+#define SERVER_HAS_SPLICE 1
+#define SERVER_HAS_SOCKET_TUNING 1
+#elif !defined(_WIN32)
+#include <sys/select.h>
+#endif
+
 #define SERVER_OUTBOUND_MAX_BYTES (32u * 1024u * 1024u)
 #define SERVER_RECEIVE_CHUNK (64u * 1024u)
+#define SERVER_EVENT_BATCH 64
+#define SERVER_URING_ENTRIES 256u
+#define SERVER_SPLICE_MIN (64u * 1024u)
+#define SERVER_SPLICE_STEP (256u * 1024u)
+#define SERVER_PIPE_CAPACITY (1024u * 1024u)
+#define SERVER_SPOOL_MEMORY_BYTES (4u * 1024u * 1024u)
+#define SERVER_HANDSHAKE_TIMEOUT_MS 10000u
+#define SERVER_REFUSAL_LINGER_MS 500u
+#define SERVER_REFUSAL_LINGER_MAX 64u
+#define SERVER_IO_QUANTUM (256u * 1024u)
+#define SERVER_CONTROL_WEIGHT 4u
+#define SERVER_MEMORY_BUDGET (256u * 1024u * 1024u)
+#define SERVER_ALLOCATION_WARMUP_CHUNKS 64u
+#define SERVER_THROTTLE_RECHECK_MS 50
+#define SERVER_BYTE_RATE_BURST_US 1000000u
+#define SERVER_NOTSENT_LOWAT (128u * 1024u)
+#define SERVER_SOCKET_TUNE_MS 250u
+#define SERVER_SOCKET_ACTIVE_BYTES (64u * 1024u)
+#define SERVER_BATCH_MAX_BYTES (16u * 1024u)
+#define SERVER_SOCKET_BUFFER_MIN (256u * 1024u)
+#define SERVER_SOCKET_BUFFER_MAX (8u * 1024u * 1024u)
+#if defined(IOV_MAX) && IOV_MAX < 64
+#define SERVER_WRITE_BATCH IOV_MAX
+#else
+#define SERVER_WRITE_BATCH 64
+#endif
 
-typedef struct OutboundFrame {
+typedef struct {
+    atomic_size_t references;
     uint8_t* bytes;
     size_t length;
+} SharedFrame;
+
+typedef struct OutboundFrame {
+    SharedFrame* shared;
     size_t offset;
+    size_t pipe_pending;
+    size_t pipe_ready;
+    SpoolFile* spool;
+    uint64_t spool_offset;
+    size_t spool_length;
+    bool bulk;
+    bool spliced;
+    bool continuation;
+    bool discard;
+    uint64_t offer_id;
     struct OutboundFrame* next;
 } OutboundFrame;
 
+typedef struct ServerQueueNode {
+    _Atomic(struct ServerQueueNode*) next;
+} ServerQueueNode;
+
+typedef struct {
+    _Atomic(ServerQueueNode*) head;
+    ServerQueueNode* tail;
+    ServerQueueNode stub;
+} ServerQueue;
+
+typedef struct {
+    int event_fd;
+    atomic_bool pending;
+} ServerWake;
+
+typedef struct ServerShard ServerShard;
+
+typedef struct {
+    uint64_t connection_id;
+    size_t teed;
+} SpliceTarget;
+
+typedef struct PendingLink {
+    struct PendingLink* next;
+    struct PendingLink* prev;
+    void* owner;
+} PendingLink;
+
 typedef struct {
     bool active;
     bool disconnect_requested;
+    bool watching_writes;
+    bool watching_reads;
+    bool streaming;
+    bool peer_hung_up;
+    bool hello_received;
+    bool receive_armed;
+    bool send_armed;
+    bool shutdown_started;
     int socket_fd;
+    size_t send_frames;
+    size_t slab_index;
+    size_t table_index;
+    uint64_t budget_pass;
+    size_t read_deficit;
+    size_t write_deficit;
+    size_t decoder_bytes;
+    uint64_t connection_id;
     uint64_t participant_id;
+    uint32_t features;
     char display_name[PROTOCOL_DISPLAY_NAME_MAX + 1u];
     char ip_address[64];
     ProtocolDecoder decoder;
     OutboundFrame* outbound_head;
     OutboundFrame* outbound_tail;
     size_t outbound_bytes;
+    int ingress_pipe[2];
+    int egress_pipe[2];
+    size_t splice_remaining;
+    size_t splice_target_count;
+    SpliceTarget* splice_targets;
+    OutboundFrame* splice_segment;
+    TimerEntry handshake_timer;
+    uint64_t read_allowed_at_us;
+    uint64_t received_bytes;
+    uint64_t sent_bytes;
+    uint64_t tuned_at_ms;
+    uint64_t tuned_received_bytes;
+    uint64_t tuned_sent_bytes;
+    size_t send_buffer;
+    size_t receive_buffer;
+    PendingLink pending;
+    ServerShard* shard;
 } ServerClient;
 
+struct ServerShard {
+    ServerClient* slab;
+    ServerClient** clients;
+    size_t* free_slots;
+    size_t free_count;
+    size_t client_count;
+    size_t capacity;
+    uint64_t pass;
+    PendingLink pending;
+    size_t paused_count;
+    IdMap by_socket;
+    IdMap by_connection;
+    IdMap by_participant;
+    int poller_fd;
+    ServerWake wake;
+    ServerQueue commands;
+    atomic_bool running;
+#ifdef SERVER_HAS_WORKERS
+    pthread_t thread;
+#endif
+};
+
+typedef enum {
+    POLICY_EVENT_MESSAGE,
+    POLICY_EVENT_CHUNK,
+    POLICY_EVENT_CLOSED
+} PolicyEventKind;
+
+typedef struct {
+    ServerQueueNode node;
+    PolicyEventKind kind;
+    uint64_t connection_id;
+    SharedFrame* frame;
+    ProtocolChunkHeader chunk;
+    RelayMessage message;
+} PolicyEvent;
+
+typedef enum {
+    WORKER_COMMAND_ADOPT,
+    WORKER_COMMAND_SEND,
+    WORKER_COMMAND_CLOSE,
+    WORKER_COMMAND_PURGE
+} WorkerCommandKind;
+
+typedef struct {
+    ServerQueueNode node;
+    WorkerCommandKind kind;
+    uint64_t connection_id;
+    int socket_fd;
+    SharedFrame* frame;
+    uint64_t offer_id;
+    char ip_address[64];
+} WorkerCommand;
+
+typedef struct {
+    bool active;
+    uint64_t connection_id;
+    uint64_t participant_id;
+    size_t shard_index;
+    char display_name[PROTOCOL_DISPLAY_NAME_MAX + 1u];
+    TimerEntry handshake_timer;
+} ServerConnection;
+
 static int server_fd = -1;
-static ServerClient clients[MAX_CLIENTS];
-static size_t client_count;
+static int poller_fd = -1;
+static ServerShard shards[SERVER_MAX_WORKERS];
+static size_t shard_count;
+static bool worker_mode;
 static bool server_running;
 static RelayPolicy* policy;
 static server_msg_cb message_callback;
+static uint64_t next_connection_id;
+static size_t client_capacity = MAX_CLIENTS;
+static IdMap connections_by_id;
+static IdMap connections_by_participant;
+static size_t connection_count;
+static size_t next_shard;
+static ServerQueue policy_events;
+static ServerWake policy_wake;
+static uint64_t splice_sender_id;
+static TimerWheel handshake_timers;
+static TimerWheel refusal_timers;
+static size_t lingering_refusals;
+static size_t io_quantum = SERVER_IO_QUANTUM;
+static size_t control_weight = SERVER_CONTROL_WEIGHT;
+static MemoryGovernor memory;
+static size_t byte_rate;
+static atomic_size_t throttled_reads;
+static atomic_size_t purged_frames;
+static atomic_size_t purged_bytes;
+static atomic_size_t relayed_chunks;
+static atomic_size_t spliced_chunks;
+static atomic_size_t batched_frames;
+static atomic_size_t batches;
+static atomic_size_t rate_limited_reads;
+static atomic_size_t refused_connections;
+static atomic_size_t tuned_buffers;
+static atomic_size_t socket_buffer_bytes;
+static atomic_size_t largest_socket_buffer;
+static atomic_size_t socket_retunes;
+static size_t send_buffer_limit;
+static size_t receive_buffer_limit;
+static atomic_size_t warm_allocations;
+#ifdef SERVER_HAS_SPLICE
+static int splice_sink_fd = -1;
+#endif
+#ifdef RELAY_HAS_SPOOL
+static Spool offer_spool;
+#endif
 
-static uint64_t monotonic_milliseconds(void)
+#ifdef RELAY_HAS_URING
+enum {
+    URING_OP_ACCEPT,
+    URING_OP_RECEIVE,
+    URING_OP_SEND
+};
+
+typedef struct {
+    struct iovec buffers[SERVER_WRITE_BATCH];
+    struct msghdr message;
+} UringSendSlot;
+
+static bool uring_mode;
+static bool uring_stopping;
+static bool uring_accept_armed;
+static bool uring_fixed_buffers;
+static Uring uring;
+static uint8_t* uring_receive_area;
+static UringSendSlot* uring_send_slots;
+#endif
+
+static uint64_t monotonic_microseconds(void)
 {
 #ifdef _WIN32
-    return (uint64_t)GetTickCount64();
+    return (uint64_t)GetTickCount64() * 1000u;
 #else
     struct timespec now;
     if (clock_gettime(CLOCK_MONOTONIC, &now) != 0)
         return 0;
-    return (uint64_t)now.tv_sec * 1000u + (uint64_t)now.tv_nsec / 1000000u;
+    return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
 #endif
 }
 
+static uint64_t monotonic_milliseconds(void)
+{
+    return monotonic_microseconds() / 1000u;
+}
+
+static void schedule_handshake_timeout(TimerEntry* timer, void* owner)
+{
+    timer->owner = owner;
+    timer_wheel_schedule(&handshake_timers, timer,
+        monotonic_milliseconds() + SERVER_HANDSHAKE_TIMEOUT_MS);
+}
+
+static void replenish_deficits(ServerClient* client)
+{
+    if (client->budget_pass == client->shard->pass)
+        return;
+    client->budget_pass = client->shard->pass;
+    client->read_deficit = io_quantum;
+    client->write_deficit = io_quantum;
+}
+
+static size_t deficit_bytes(size_t deficit, bool bulk)
+{
+    if (bulk)
+        return deficit;
+    return deficit > SIZE_MAX / control_weight ? SIZE_MAX : deficit * control_weight;
+}
+
+static void charge_deficit(size_t* deficit, size_t length, bool bulk)
+{
+    size_t cost = bulk ? length : (length + control_weight - 1u) / control_weight;
+    *deficit = cost < *deficit ? *deficit - cost : 0;
+}
+
 static bool socket_would_block(void)
 {
 #ifdef _WIN32
@@ -78,322 +365,2705 @@ static void optimize_socket_for_lan(int socket_fd)
 {
 #ifdef _WIN32
     char nodelay = 1;
-    int buffer_size = 8 * 1024 * 1024;
     (void)setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
-    (void)setsockopt(socket_fd, SOL_SOCKET, SO_SNDBUF, (char*)&buffer_size,
-        sizeof(buffer_size));
-    (void)setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, (char*)&buffer_size,
-        sizeof(buffer_size));
 #else
     int nodelay = 1;
-    int buffer_size = 8 * 1024 * 1024;
     (void)setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
-    (void)setsockopt(socket_fd, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
-    (void)setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+#ifdef TCP_NOTSENT_LOWAT
+    int lowat = SERVER_NOTSENT_LOWAT;
+    (void)setsockopt(socket_fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+#endif
 #endif
 }
 
-static ServerClient* client_by_participant(uint64_t participant_id)
+static void server_queue_init(ServerQueue* queue)
 {
-    for (size_t i = 0; i < client_count; ++i) {
-        if (clients[i].active && clients[i].participant_id == participant_id)
-            return &clients[i];
-    }
-    return NULL;
+    atomic_init(&queue->stub.next, NULL);
+    atomic_init(&queue->head, &queue->stub);
+    queue->tail = &queue->stub;
 }
 
-static void discard_outbound(ServerClient* client)
+static void server_queue_push(ServerQueue* queue, ServerQueueNode* node)
 {
-    OutboundFrame* frame = client->outbound_head;
-    while (frame) {
-        OutboundFrame* next = frame->next;
-        free(frame->bytes);
-        free(frame);
-        frame = next;
-    }
-    client->outbound_head = NULL;
-    client->outbound_tail = NULL;
-    client->outbound_bytes = 0;
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    ServerQueueNode* previous = atomic_exchange_explicit(&queue->head, node,
+        memory_order_acq_rel);
+    atomic_store_explicit(&previous->next, node, memory_order_release);
 }
 
-static bool queue_message(ServerClient* client, const RelayMessage* message)
+static ServerQueueNode* server_queue_pop(ServerQueue* queue)
 {
-    if (!client || !client->active || client->disconnect_requested)
-        return false;
-    uint8_t* bytes = NULL;
-    size_t length = 0;
-    if (!protocol_encode(message, &bytes, &length))
-        return false;
-    if (length > SERVER_OUTBOUND_MAX_BYTES - client->outbound_bytes) {
-        free(bytes);
-        return false;
+    ServerQueueNode* tail = queue->tail;
+    ServerQueueNode* next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (tail == &queue->stub) {
+        if (!next)
+            return NULL;
+        queue->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
     }
-    OutboundFrame* frame = calloc(1, sizeof(*frame));
-    if (!frame) {
-        free(bytes);
-        return false;
+    if (next) {
+        queue->tail = next;
+        return tail;
     }
-    frame->bytes = bytes;
-    frame->length = length;
-    if (client->outbound_tail)
-        client->outbound_tail->next = frame;
-    else
-        client->outbound_head = frame;
-    client->outbound_tail = frame;
-    client->outbound_bytes += length;
-    return true;
+    if (tail != atomic_load_explicit(&queue->head, memory_order_acquire))
+        return NULL;
+    server_queue_push(queue, &queue->stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (!next)
+        return NULL;
+    queue->tail = next;
+    return tail;
 }
 
-static bool policy_send(void* context, uint64_t participant_id,
-    const RelayMessage* message)
+
+static void close_descriptor(int* descriptor)
 {
-    (void)context;
-    ServerClient* client = client_by_participant(participant_id);
-    if (!client)
-        return false;
-    if (queue_message(client, message))
-        return true;
-    client->disconnect_requested = true;
-    return false;
+#ifdef __linux__
+    if (*descriptor != -1)
+        close(*descriptor);
+#endif
+    *descriptor = -1;
 }
 
-static RelayPolicyEffects policy_effects(void)
+static void server_wake_signal(ServerWake* wake)
 {
-    RelayPolicyEffects effects = { .send = policy_send, .context = NULL };
-    return effects;
+    if (atomic_exchange(&wake->pending, true))
+        return;
+#ifdef SERVER_HAS_WORKERS
+    uint64_t one = 1;
+    ssize_t written = write(wake->event_fd, &one, sizeof(one));
+    (void)written;
+#endif
 }
 
-static bool flush_outbound(ServerClient* client)
+
+static uint64_t socket_key(int socket_fd)
 {
-    while (client->outbound_head) {
-        OutboundFrame* frame = client->outbound_head;
-        size_t remaining = frame->length - frame->offset;
-#ifdef _WIN32
-        int requested = remaining > (size_t)INT_MAX ? INT_MAX : (int)remaining;
-        int sent = send(client->socket_fd, (const char*)frame->bytes + frame->offset,
-            requested, 0);
-#else
-        ssize_t sent = send(client->socket_fd, frame->bytes + frame->offset,
-            remaining, MSG_NOSIGNAL);
-#endif
-        if (sent > 0) {
-            frame->offset += (size_t)sent;
-            if (frame->offset != frame->length)
-                continue;
-            client->outbound_head = frame->next;
-            if (!client->outbound_head)
-                client->outbound_tail = NULL;
-            client->outbound_bytes -= frame->length;
-            free(frame->bytes);
-            free(frame);
-            continue;
-        }
-        if (sent < 0 && socket_would_block())
-            return true;
-        return false;
-    }
-    return true;
+    return (uint64_t)socket_fd + 1u;
 }
 
-static void handle_decoded_message(void* context, const RelayMessage* message)
+static ServerClient* client_by_socket(ServerShard* shard, int socket_fd)
 {
-    ServerClient* client = context;
-    if (!client || client->disconnect_requested)
-        return;
-    if (client->participant_id == 0) {
-        if (message->type != RELAY_MESSAGE_HELLO
-            || message->as.hello.version != PROTOCOL_VERSION
-            || !relay_policy_join(policy, message->as.hello.display_name,
-                &client->participant_id)) {
-            client->disconnect_requested = true;
-            return;
-        }
-        snprintf(client->display_name, sizeof(client->display_name), "%s",
-            message->as.hello.display_name);
-        RelayMessage welcome = { .type = RELAY_MESSAGE_WELCOME };
-        welcome.as.welcome.participant_id = client->participant_id;
-        if (!queue_message(client, &welcome))
-            client->disconnect_requested = true;
+    return id_map_get(&shard->by_socket, socket_key(socket_fd));
+}
+
+static void pending_init(PendingLink* head)
+{
+    head->next = head;
+    head->prev = head;
+}
+
+static void pending_push(PendingLink* head, PendingLink* link)
+{
+    link->prev = head->prev;
+    link->next = head;
+    head->prev->next = link;
+    head->prev = link;
+}
+
+static void pending_unlink(PendingLink* link)
+{
+    if (!link->next)
         return;
-    }
-    if (message->type == RELAY_MESSAGE_HELLO || message->type == RELAY_MESSAGE_WELCOME) {
-        client->disconnect_requested = true;
+    link->prev->next = link->next;
+    link->next->prev = link->prev;
+    link->next = NULL;
+    link->prev = NULL;
+}
+
+// Only clients on this list are flushed and re-armed after a wake, so anything that gives a
+// client output, closes it, or changes what it waits for must mark it.
+static void mark_pending(ServerClient* client)
+{
+    if (client->pending.next || !client->shard)
         return;
-    }
-    if (message_callback && message->type == RELAY_MESSAGE_CHAT_SEND)
-        message_callback(message->as.chat_send.text, client->display_name);
-    RelayPolicyEffects effects = policy_effects();
-    relay_policy_handle(policy, client->participant_id, message,
-        monotonic_milliseconds(), &effects);
+    client->pending.owner = client;
+    pending_push(&client->shard->pending, &client->pending);
+}
+
+static void request_disconnect(ServerClient* client)
+{
+    client->disconnect_requested = true;
+    mark_pending(client);
+}
+
+static void account_decoder(ServerClient* client)
+{
+    size_t held = client->decoder.borrowed ? client->decoder.capacity : 0u;
+    memory_governor_note_decoder(&memory, client->decoder_bytes, held);
+    client->decoder_bytes = held;
 }
 
-static void remove_client(size_t index)
+static void note_relayed_chunk(void)
 {
-    if (index >= client_count)
+    size_t relayed = atomic_fetch_add_explicit(&relayed_chunks, 1u, memory_order_relaxed) + 1u;
+    if (relayed != SERVER_ALLOCATION_WARMUP_CHUNKS)
         return;
-    ServerClient* client = &clients[index];
-    uint64_t participant_id = client->participant_id;
-    client->active = false;
-    if (client->socket_fd != -1)
-        closesocket(client->socket_fd);
-    protocol_decoder_destroy(&client->decoder);
-    discard_outbound(client);
+    BufferPoolStats pool;
+    buffer_pool_stats(&pool);
+    atomic_store_explicit(&warm_allocations, pool.system_allocations, memory_order_relaxed);
+}
 
-    if (participant_id != 0 && policy) {
-        RelayPolicyEffects effects = policy_effects();
-        relay_policy_leave(policy, participant_id, monotonic_milliseconds(), &effects);
-    }
-    if (index + 1u < client_count)
-        memmove(&clients[index], &clients[index + 1u],
-            (client_count - index - 1u) * sizeof(clients[0]));
-    client_count--;
-    memset(&clients[client_count], 0, sizeof(clients[client_count]));
+static bool receiving_bulk(const ServerClient* client)
+{
+    return client->splice_remaining > 0
+        || (client->decoder.length > 0 && client->decoder.buffer[0] == RELAY_MESSAGE_FILE_CHUNK);
 }
 
-void server_set_msg_cb(server_msg_cb callback)
+static bool reads_throttled(const ServerClient* client)
 {
-    message_callback = callback;
+    return memory_governor_live_pressure(&memory) >= SERVER_MEMORY_THROTTLING
+        && !client->peer_hung_up
+        && memory_governor_frame_bytes(&memory) > 0
+        && (client->streaming || receiving_bulk(client));
 }
 
-int get_client_count(void)
+static bool read_rate_exhausted(const ServerClient* client)
 {
-    return (int)client_count;
+    return byte_rate > 0
+        && !client->peer_hung_up
+        && client->read_allowed_at_us > monotonic_microseconds() + SERVER_BYTE_RATE_BURST_US;
 }
 
-bool is_server_running(void)
+static bool reads_paused(const ServerClient* client)
 {
-    return server_running;
+    return reads_throttled(client) || read_rate_exhausted(client);
 }
 
-bool init_server(void)
+static void note_received(ServerClient* client, size_t bytes)
 {
-    if (server_running)
-        return true;
-    if (init_network() != 0)
-        return false;
-    policy = relay_policy_create();
-    if (!policy) {
-        cleanup_network();
-        return false;
-    }
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd == -1)
-        goto fail;
+    client->received_bytes += bytes;
+    if (byte_rate == 0)
+        return;
+    uint64_t now = monotonic_microseconds();
+    uint64_t start = client->read_allowed_at_us > now ? client->read_allowed_at_us : now;
+    client->read_allowed_at_us = start + (uint64_t)bytes * 1000000u / byte_rate;
+}
 
-#ifdef _WIN32
-    char reuse = 1;
+static bool poller_watch(int poller, int socket_fd)
+{
+#ifdef __linux__
+    struct epoll_event event = { .events = EPOLLIN };
+    event.data.fd = socket_fd;
+    return epoll_ctl(poller, EPOLL_CTL_ADD, socket_fd, &event) == 0;
 #else
-    int reuse = 1;
-#endif
-    (void)setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-    struct sockaddr_in address = { 0 };
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = htonl(INADDR_ANY);
-    address.sin_port = htons(PORT);
-    if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) != 0
-        || listen(server_fd, MAX_CLIENTS) != 0
-        || !set_socket_nonblocking(server_fd))
-        goto fail;
-    memset(clients, 0, sizeof(clients));
-    client_count = 0;
-    server_running = true;
+    (void)poller;
+    (void)socket_fd;
     return true;
+#endif
+}
 
-fail:
-    if (server_fd != -1) {
-        closesocket(server_fd);
-        server_fd = -1;
-    }
-    relay_policy_destroy(policy);
-    policy = NULL;
-    cleanup_network();
-    return false;
+static void poller_forget(int poller, int socket_fd)
+{
+#ifdef __linux__
+    struct epoll_event event = { 0 };
+    (void)epoll_ctl(poller, EPOLL_CTL_DEL, socket_fd, &event);
+#else
+    (void)poller;
+    (void)socket_fd;
+#endif
 }
 
-void cleanup_server(void)
+static void note_read_interest(ServerClient* client, bool wants_reads)
 {
-    while (client_count > 0)
-        remove_client(client_count - 1u);
-    if (server_fd != -1) {
-        closesocket(server_fd);
-        server_fd = -1;
-    }
-    relay_policy_destroy(policy);
-    policy = NULL;
-    server_running = false;
-    cleanup_network();
+    if (wants_reads == client->watching_reads)
+        return;
+    if (wants_reads)
+        client->shard->paused_count--;
+    else
+        client->shard->paused_count++;
+    client->watching_reads = wants_reads;
 }
 
-int server_accept_client(void)
+static void update_interest(ServerClient* client)
 {
-    if (!server_running || server_fd == -1)
-        return -1;
-    struct sockaddr_in address;
-    socklen_t address_length = sizeof(address);
-    int accepted = accept(server_fd, (struct sockaddr*)&address, &address_length);
-    if (accepted == -1)
-        return -1;
-    if (client_count >= MAX_CLIENTS) {
-        closesocket(accepted);
-        return -1;
-    }
-    optimize_socket_for_lan(accepted);
-    if (!set_socket_nonblocking(accepted)) {
-        closesocket(accepted);
-        return -1;
+    const OutboundFrame* head = client->outbound_head;
+    bool wants_writes = head && (head->shared || head->spool || head->pipe_ready > 0);
+    bool wants_reads = !reads_paused(client);
+    if (wants_writes == client->watching_writes && wants_reads == client->watching_reads)
+        return;
+#ifdef __linux__
+    struct epoll_event event = {
+        .events = (wants_reads ? (uint32_t)EPOLLIN : 0u) | (wants_writes ? (uint32_t)EPOLLOUT : 0u)
+    };
+    event.data.fd = client->socket_fd;
+    if (epoll_ctl(client->shard->poller_fd, EPOLL_CTL_MOD, client->socket_fd, &event) != 0) {
+        request_disconnect(client);
+        return;
     }
+#endif
+    note_read_interest(client, wants_reads);
+    client->watching_writes = wants_writes;
+}
 
-    ServerClient* client = &clients[client_count++];
-    memset(client, 0, sizeof(*client));
-    client->active = true;
-    client->socket_fd = accepted;
-    protocol_decoder_init(&client->decoder);
-    const char* printable = inet_ntoa(address.sin_addr);
-    snprintf(client->ip_address, sizeof(client->ip_address), "%s",
-        printable ? printable : "unknown");
-    return accepted;
+#ifdef SERVER_HAS_SOCKET_TUNING
+static size_t read_buffer_limit(const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+        return 0;
+    unsigned long long value = 0;
+    if (fscanf(file, "%llu", &value) != 1)
+        value = 0;
+    fclose(file);
+    return (size_t)value;
 }
 
-void server_recv_msgs(void)
+static size_t socket_buffer_target(uint64_t moved, uint64_t elapsed_ms, uint32_t rtt_us)
 {
-    if (!server_running || !policy)
+    uint64_t bandwidth_delay = moved * rtt_us / (elapsed_ms * 1000u);
+    size_t target = SERVER_SOCKET_BUFFER_MIN;
+    while (target < bandwidth_delay * 2u && target < SERVER_SOCKET_BUFFER_MAX)
+        target *= 2u;
+    return target;
+}
+
+static void note_socket_buffer(size_t previous, size_t current)
+{
+    if (previous == 0 && current > 0)
+        atomic_fetch_add_explicit(&tuned_buffers, 1u, memory_order_relaxed);
+    else if (previous > 0 && current == 0)
+        atomic_fetch_sub_explicit(&tuned_buffers, 1u, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&socket_buffer_bytes, previous, memory_order_relaxed);
+    atomic_fetch_add_explicit(&socket_buffer_bytes, current, memory_order_relaxed);
+    size_t largest = atomic_load_explicit(&largest_socket_buffer, memory_order_relaxed);
+    while (current > largest
+        && !atomic_compare_exchange_weak_explicit(&largest_socket_buffer, &largest, current,
+            memory_order_relaxed, memory_order_relaxed)) { }
+}
+
+static void resize_socket_buffer(ServerClient* client, int option, size_t* applied,
+    size_t target, size_t limit)
+{
+    if (limit > 0 && target > limit)
+        target = limit;
+    int current = 0;
+    socklen_t length = sizeof(current);
+    if (target == *applied
+        || getsockopt(client->socket_fd, SOL_SOCKET, option, &current, &length) != 0)
         return;
-    RelayPolicyEffects effects = policy_effects();
-    relay_policy_tick(policy, monotonic_milliseconds(), &effects);
+    if (*applied == 0 && target <= (size_t)current / 2u)
+        return;
+    int requested = (int)target;
+    if (setsockopt(client->socket_fd, SOL_SOCKET, option, &requested, sizeof(requested)) != 0)
+        return;
+    note_socket_buffer(*applied, target);
+    *applied = target;
+    atomic_fetch_add_explicit(&socket_retunes, 1u, memory_order_relaxed);
+}
 
-    size_t index = 0;
-    while (index < client_count) {
-        ServerClient* client = &clients[index];
-        if (!flush_outbound(client))
-            client->disconnect_requested = true;
+static void retune_socket(ServerClient* client)
+{
+    uint64_t now = monotonic_milliseconds();
+    if (client->tuned_at_ms == 0) {
+        client->tuned_at_ms = now;
+        return;
+    }
+    uint64_t elapsed = now - client->tuned_at_ms;
+    if (elapsed < SERVER_SOCKET_TUNE_MS)
+        return;
+    uint64_t received = client->received_bytes - client->tuned_received_bytes;
+    uint64_t sent = client->sent_bytes - client->tuned_sent_bytes;
+    client->tuned_at_ms = now;
+    client->tuned_received_bytes = client->received_bytes;
+    client->tuned_sent_bytes = client->sent_bytes;
+    bool receiving = received >= SERVER_SOCKET_ACTIVE_BYTES;
+    bool sending = sent >= SERVER_SOCKET_ACTIVE_BYTES;
+    if (!receiving && !sending && client->send_buffer == 0 && client->receive_buffer == 0)
+        return;
 
-        while (!client->disconnect_requested) {
-            uint8_t buffer[SERVER_RECEIVE_CHUNK];
-#ifdef _WIN32
-            int received = recv(client->socket_fd, (char*)buffer, sizeof(buffer), 0);
+    struct tcp_info info = { 0 };
+    socklen_t length = sizeof(info);
+    if ((receiving || sending)
+        && getsockopt(client->socket_fd, IPPROTO_TCP, TCP_INFO, &info, &length) != 0)
+        return;
+    uint32_t receive_rtt = info.tcpi_rcv_rtt > 0 ? info.tcpi_rcv_rtt : info.tcpi_rtt;
+    if (receiving) {
+        size_t target = socket_buffer_target(received, elapsed, receive_rtt);
+        if (target > client->receive_buffer)
+            resize_socket_buffer(client, SO_RCVBUF, &client->receive_buffer, target,
+                receive_buffer_limit);
+    } else if (client->receive_buffer > SERVER_SOCKET_BUFFER_MIN) {
+        resize_socket_buffer(client, SO_RCVBUF, &client->receive_buffer,
+            SERVER_SOCKET_BUFFER_MIN, receive_buffer_limit);
+    }
+    if (sending) {
+        size_t target = socket_buffer_target(sent, elapsed, info.tcpi_rtt);
+        if (target > client->send_buffer)
+            resize_socket_buffer(client, SO_SNDBUF, &client->send_buffer, target,
+                send_buffer_limit);
+    } else if (client->send_buffer > SERVER_SOCKET_BUFFER_MIN) {
+        resize_socket_buffer(client, SO_SNDBUF, &client->send_buffer, SERVER_SOCKET_BUFFER_MIN,
+            send_buffer_limit);
+    }
+}
+#else
+static void retune_socket(ServerClient* client)
+{
+    (void)client;
+}
+#endif
+
+static ServerClient* client_by_participant(uint64_t participant_id)
+{
+    return id_map_get(&shards[0].by_participant, participant_id);
+}
+
+static ServerClient* client_by_connection(ServerShard* shard, uint64_t connection_id)
+{
+    return id_map_get(&shard->by_connection, connection_id);
+}
+
+static ServerConnection* connection_by_id(uint64_t connection_id)
+{
+    return id_map_get(&connections_by_id, connection_id);
+}
+
+static ServerConnection* connection_by_participant(uint64_t participant_id)
+{
+    return id_map_get(&connections_by_participant, participant_id);
+}
+
+static void* acquire_zeroed(size_t size)
+{
+    void* bytes = buffer_pool_acquire(size);
+    if (bytes)
+        memset(bytes, 0, size);
+    return bytes;
+}
+
+static SharedFrame* shared_frame_create(size_t length)
+{
+    SharedFrame* shared = acquire_zeroed(sizeof(*shared));
+    if (!shared)
+        return NULL;
+    atomic_init(&shared->references, 1u);
+    shared->length = length;
+    if (length > 0) {
+        shared->bytes = buffer_pool_acquire(length);
+        if (!shared->bytes) {
+            buffer_pool_release(shared, sizeof(*shared));
+            return NULL;
+        }
+    }
+    memory_governor_note_frames(&memory, 0, length);
+    return shared;
+}
+
+static SharedFrame* shared_frame_encode(const RelayMessage* message)
+{
+    SharedFrame* shared = shared_frame_create(0);
+    if (!shared)
+        return NULL;
+    if (!protocol_encode(message, &shared->bytes, &shared->length)) {
+        buffer_pool_release(shared, sizeof(*shared));
+        return NULL;
+    }
+    memory_governor_note_frames(&memory, 0, shared->length);
+    return shared;
+}
+
+static SharedFrame* shared_frame_copy(const uint8_t* bytes, size_t length)
+{
+    SharedFrame* shared = shared_frame_create(length);
+    if (shared)
+        memcpy(shared->bytes, bytes, length);
+    return shared;
+}
+
+static SharedFrame* shared_frame_retain(SharedFrame* shared)
+{
+    atomic_fetch_add_explicit(&shared->references, 1u, memory_order_relaxed);
+    return shared;
+}
+
+static void shared_frame_release(SharedFrame* shared)
+{
+    if (!shared || atomic_fetch_sub_explicit(&shared->references, 1u, memory_order_acq_rel) > 1u)
+        return;
+    memory_governor_note_frames(&memory, shared->length, 0);
+    buffer_pool_release(shared->bytes, shared->length);
+    buffer_pool_release(shared, sizeof(*shared));
+}
+
+#ifdef RELAY_HAS_SPOOL
+static bool load_spooled_frame(ServerClient* client)
+{
+    OutboundFrame* head = client->outbound_head;
+    if (!head || !head->spool)
+        return true;
+    SharedFrame* shared = shared_frame_create(head->spool_length);
+    if (!shared)
+        return false;
+    if (!spool_file_read(head->spool, head->spool_offset, shared->bytes, shared->length)) {
+        shared_frame_release(shared);
+        return false;
+    }
+    spool_file_release(&offer_spool, head->spool);
+    head->spool = NULL;
+    head->shared = shared;
+    client->outbound_bytes += shared->length;
+    return true;
+}
+#endif
+
+static void outbound_frame_destroy(OutboundFrame* frame)
+{
+    shared_frame_release(frame->shared);
+#ifdef RELAY_HAS_SPOOL
+    spool_file_release(&offer_spool, frame->spool);
+#endif
+    buffer_pool_release(frame, sizeof(*frame));
+}
+
+static void discard_outbound(ServerClient* client)
+{
+    OutboundFrame* frame = client->outbound_head;
+    while (frame) {
+        OutboundFrame* next = frame->next;
+        outbound_frame_destroy(frame);
+        frame = next;
+    }
+    client->outbound_head = NULL;
+    client->outbound_tail = NULL;
+    client->outbound_bytes = 0;
+}
+
+static OutboundFrame* allocate_outbound(ServerClient* client, size_t length)
+{
+    if (!client || !client->active || client->disconnect_requested)
+        return NULL;
+    if (length > SERVER_OUTBOUND_MAX_BYTES - client->outbound_bytes)
+        return NULL;
+    OutboundFrame* frame = acquire_zeroed(sizeof(*frame));
+    if (frame) {
+        client->outbound_bytes += length;
+        mark_pending(client);
+    }
+    return frame;
+}
+
+static OutboundFrame* append_outbound(ServerClient* client, size_t length)
+{
+    OutboundFrame* frame = allocate_outbound(client, length);
+    if (!frame)
+        return NULL;
+    if (client->outbound_tail)
+        client->outbound_tail->next = frame;
+    else
+        client->outbound_head = frame;
+    client->outbound_tail = frame;
+    return frame;
+}
+
+static void insert_outbound_after(ServerClient* client, OutboundFrame* position,
+    OutboundFrame* frame)
+{
+    frame->next = position->next;
+    position->next = frame;
+    if (client->outbound_tail == position)
+        client->outbound_tail = frame;
+}
+
+static bool outbound_holds_offer(const ServerClient* client, uint64_t offer_id)
+{
+    for (const OutboundFrame* frame = client->outbound_head; frame; frame = frame->next) {
+        if (frame->offer_id == offer_id)
+            return true;
+    }
+    return false;
+}
+
+static void insert_priority_frame(ServerClient* client, OutboundFrame* frame)
+{
+    size_t position = 0;
+    size_t in_flight = client->send_armed ? client->send_frames : 0u;
+    OutboundFrame* previous = NULL;
+    OutboundFrame* next = client->outbound_head;
+    while (next
+        && (position++ < in_flight || next->offset > 0 || next->continuation || !next->bulk)) {
+        previous = next;
+        next = next->next;
+    }
+    if (previous) {
+        insert_outbound_after(client, previous, frame);
+        return;
+    }
+    frame->next = client->outbound_head;
+    client->outbound_head = frame;
+    if (!client->outbound_tail)
+        client->outbound_tail = frame;
+}
+
+static bool queue_shared_frame(ServerClient* client, SharedFrame* shared)
+{
+    OutboundFrame* frame = allocate_outbound(client, shared->length);
+    if (!frame)
+        return false;
+    frame->shared = shared_frame_retain(shared);
+    uint64_t offer_id = 0;
+    bool ordered = protocol_frame_offer_id(shared->bytes, shared->length, &offer_id);
+    frame->bulk = shared->bytes[0] == RELAY_MESSAGE_FILE_CHUNK;
+    if (frame->bulk)
+        frame->offer_id = offer_id;
+    if (ordered && (shared->bytes[0] != RELAY_MESSAGE_FILE_TRANSFER_CANCEL
+            || outbound_holds_offer(client, offer_id))) {
+        frame->next = NULL;
+        if (client->outbound_tail)
+            client->outbound_tail->next = frame;
+        else
+            client->outbound_head = frame;
+        client->outbound_tail = frame;
+    } else {
+        insert_priority_frame(client, frame);
+    }
+    return true;
+}
+
+static bool queue_message(ServerClient* client, const RelayMessage* message)
+{
+    if (!client || !client->active || client->disconnect_requested)
+        return false;
+    SharedFrame* shared = shared_frame_encode(message);
+    if (!shared)
+        return false;
+    bool queued = queue_shared_frame(client, shared);
+    shared_frame_release(shared);
+    return queued;
+}
+
+static bool splice_group_in_progress(const ServerClient* client, const OutboundFrame* head)
+{
+    for (const OutboundFrame* frame = head->next; frame && frame->continuation;
+        frame = frame->next) {
+        if (frame == client->splice_segment)
+            return true;
+    }
+    return false;
+}
+
+static void purge_offer_frames(ServerClient* client, uint64_t offer_id)
+{
+    size_t position = 0;
+    size_t in_flight = client->send_armed ? client->send_frames : 0u;
+    bool dropping = false;
+    OutboundFrame* previous = NULL;
+    OutboundFrame* frame = client->outbound_head;
+    mark_pending(client);
+    while (frame) {
+        OutboundFrame* next = frame->next;
+        bool started = position++ < in_flight || frame->offset > 0;
+        if (!frame->continuation) {
+            dropping = frame->offer_id == offer_id && !started
+                && !(frame->spliced && splice_group_in_progress(client, frame));
+        }
+        if (!dropping || started) {
+            previous = frame;
+            frame = next;
+            continue;
+        }
+        // Relayed bytes already sit in the egress pipe in order, so they are drained, not sent.
+        if (!frame->shared && !frame->spool) {
+            frame->discard = true;
+            previous = frame;
+            frame = next;
+            continue;
+        }
+        if (previous)
+            previous->next = next;
+        else
+            client->outbound_head = next;
+        if (client->outbound_tail == frame)
+            client->outbound_tail = previous;
+        size_t length = frame->shared ? frame->shared->length : frame->spool_length;
+        if (frame->shared)
+            client->outbound_bytes -= frame->shared->length;
+        atomic_fetch_add_explicit(&purged_frames, 1u, memory_order_relaxed);
+        atomic_fetch_add_explicit(&purged_bytes, length, memory_order_relaxed);
+        outbound_frame_destroy(frame);
+        frame = next;
+    }
+}
+
+static void post_worker_command(size_t shard_index, WorkerCommand* command)
+{
+    ServerShard* shard = &shards[shard_index];
+    server_queue_push(&shard->commands, &command->node);
+    server_wake_signal(&shard->wake);
+}
+
+static bool post_connection_command(const ServerConnection* connection,
+    WorkerCommandKind kind, SharedFrame* shared)
+{
+    WorkerCommand* command = acquire_zeroed(sizeof(*command));
+    if (!command)
+        return false;
+    command->kind = kind;
+    command->connection_id = connection->connection_id;
+    command->socket_fd = -1;
+    command->frame = shared ? shared_frame_retain(shared) : NULL;
+    post_worker_command(connection->shard_index, command);
+    return true;
+}
+
+static bool deliver_shared_frame(uint64_t participant_id, SharedFrame* shared)
+{
+    if (worker_mode) {
+        ServerConnection* connection = connection_by_participant(participant_id);
+        return shared && connection
+            && post_connection_command(connection, WORKER_COMMAND_SEND, shared);
+    }
+    ServerClient* client = client_by_participant(participant_id);
+    if (!client)
+        return false;
+    if (shared && queue_shared_frame(client, shared))
+        return true;
+    request_disconnect(client);
+    return false;
+}
+
+static void purge_participant_offer(uint64_t participant_id, uint64_t offer_id)
+{
+    if (worker_mode) {
+        ServerConnection* connection = connection_by_participant(participant_id);
+        WorkerCommand* command = connection ? acquire_zeroed(sizeof(*command)) : NULL;
+        if (!command)
+            return;
+        command->kind = WORKER_COMMAND_PURGE;
+        command->connection_id = connection->connection_id;
+        command->socket_fd = -1;
+        command->offer_id = offer_id;
+        post_worker_command(connection->shard_index, command);
+        return;
+    }
+    ServerClient* client = client_by_participant(participant_id);
+    if (client)
+        purge_offer_frames(client, offer_id);
+}
+
+static bool policy_send(void* context, uint64_t participant_id,
+    const RelayMessage* message)
+{
+    (void)context;
+    SharedFrame* shared = shared_frame_encode(message);
+    bool delivered = deliver_shared_frame(participant_id, shared);
+    shared_frame_release(shared);
+    return delivered;
+}
+
+static void queue_shared_to_participants(SharedFrame* shared, const uint64_t* participant_ids,
+    size_t participant_count, bool* delivered)
+{
+    for (size_t i = 0; i < participant_count; ++i)
+        delivered[i] = deliver_shared_frame(participant_ids[i], shared);
+    shared_frame_release(shared);
+}
+
+static void policy_broadcast(void* context, const uint64_t* participant_ids,
+    size_t participant_count, const RelayMessage* message, bool* delivered)
+{
+    (void)context;
+    queue_shared_to_participants(shared_frame_encode(message), participant_ids,
+        participant_count, delivered);
+}
+
+#ifdef RELAY_HAS_SPOOL
+static bool queue_spooled_frame(ServerClient* client, SpoolFile* spool, uint64_t offset,
+    size_t length)
+{
+    OutboundFrame* frame = append_outbound(client, 0);
+    if (!frame)
+        return false;
+    frame->spool = spool;
+    frame->spool_offset = offset;
+    frame->spool_length = length;
+    frame->bulk = true;
+    frame->offer_id = spool->offer_id;
+    spool_file_retain(spool);
+    return true;
+}
+
+static void spool_shared_to_participants(SharedFrame* shared, uint64_t offer_id,
+    const uint64_t* participant_ids, size_t participant_count, bool* delivered)
+{
+    SpoolFile* spool = NULL;
+    bool spool_attempted = false;
+    uint64_t offset = 0;
+    for (size_t i = 0; i < participant_count; ++i) {
+        ServerClient* client = client_by_participant(participant_ids[i]);
+        if (shared && client && !client->disconnect_requested
+            && client->outbound_bytes + shared->length > SERVER_SPOOL_MEMORY_BYTES) {
+            if (!spool_attempted) {
+                spool_attempted = true;
+                spool = spool_file_for_offer(&offer_spool, offer_id);
+                if (spool
+                    && !spool_file_append(spool, shared->bytes, shared->length, &offset)) {
+                    spool_file_close_if_idle(&offer_spool, spool);
+                    spool = NULL;
+                }
+            }
+            if (spool) {
+                delivered[i] = queue_spooled_frame(client, spool, offset, shared->length);
+                if (!delivered[i])
+                    request_disconnect(client);
+                continue;
+            }
+        }
+        delivered[i] = deliver_shared_frame(participant_ids[i], shared);
+    }
+    spool_file_close_if_idle(&offer_spool, spool);
+    shared_frame_release(shared);
+}
+#endif
+
+static void policy_forward_chunk(void* context, const uint64_t* participant_ids,
+    size_t participant_count, const ProtocolChunkHeader* chunk, bool* delivered)
+{
+    SharedFrame* source = context;
+    SharedFrame* shared = source && source->bytes == chunk->frame
+        ? shared_frame_retain(source)
+        : shared_frame_copy(chunk->frame, chunk->frame_length);
+#ifdef RELAY_HAS_SPOOL
+    if (spool_is_open(&offer_spool)) {
+        spool_shared_to_participants(shared, chunk->offer_id, participant_ids,
+            participant_count, delivered);
+        return;
+    }
+#endif
+    queue_shared_to_participants(shared, participant_ids, participant_count, delivered);
+}
+
+static void policy_purge(void* context, uint64_t participant_id, uint64_t offer_id)
+{
+    (void)context;
+    purge_participant_offer(participant_id, offer_id);
+}
+
+static RelayPolicyEffects policy_effects(SharedFrame* chunk_frame)
+{
+    RelayPolicyEffects effects = {
+        .send = policy_send,
+        .broadcast = policy_broadcast,
+        .forward_chunk = policy_forward_chunk,
+        .purge = policy_purge,
+        .context = chunk_frame
+    };
+    return effects;
+}
+
+#ifdef SERVER_HAS_SPLICE
+static bool flush_outbound(ServerClient* client);
+
+typedef struct {
+    ServerClient* sender;
+    SharedFrame* prefix;
+    size_t length;
+} SplicedChunk;
+
+static bool open_relay_pipe(int pipe_fds[2], unsigned capacity)
+{
+    if (pipe_fds[0] != -1)
+        return true;
+    if (pipe2(pipe_fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+        pipe_fds[0] = -1;
+        pipe_fds[1] = -1;
+        return false;
+    }
+    (void)fcntl(pipe_fds[1], F_SETPIPE_SZ, (int)capacity);
+    return true;
+}
+
+static bool open_splice_sink(void)
+{
+    if (splice_sink_fd == -1)
+        splice_sink_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    return splice_sink_fd != -1;
+}
+
+static ServerClient* splice_target(const ServerClient* sender, size_t index)
+{
+    ServerClient* recipient = client_by_connection(&shards[0],
+        sender->splice_targets[index].connection_id);
+    if (!recipient || recipient->disconnect_requested || !recipient->splice_segment)
+        return NULL;
+    return recipient;
+}
+
+static bool send_spooled_frame(ServerClient* client, size_t* sent)
+{
+    OutboundFrame* segment = client->outbound_head;
+    off_t position = (off_t)(segment->spool_offset + segment->offset);
+    size_t length = segment->spool_length - segment->offset;
+    if (length > client->write_deficit)
+        length = client->write_deficit;
+    ssize_t moved = sendfile(client->socket_fd, segment->spool->fd, &position, length);
+    if (moved < 0)
+        return false;
+    *sent = (size_t)moved;
+    charge_deficit(&client->write_deficit, (size_t)moved, true);
+    segment->offset += (size_t)moved;
+    if (segment->offset == segment->spool_length) {
+        client->outbound_head = segment->next;
+        if (!client->outbound_head)
+            client->outbound_tail = NULL;
+        outbound_frame_destroy(segment);
+    }
+    return true;
+}
+
+static bool discard_pipe_bytes(int pipe_fd, size_t length)
+{
+    while (length > 0) {
+        ssize_t moved = splice(pipe_fd, NULL, splice_sink_fd, NULL, length, SPLICE_F_MOVE);
+        if (moved <= 0)
+            return false;
+        length -= (size_t)moved;
+    }
+    return true;
+}
+
+static bool splice_outbound(ServerClient* client, size_t* sent)
+{
+    OutboundFrame* segment = client->outbound_head;
+    *sent = 0;
+    if (segment->discard) {
+        if (!discard_pipe_bytes(client->egress_pipe[0], segment->pipe_ready))
+            return false;
+        atomic_fetch_add_explicit(&purged_bytes, segment->pipe_ready, memory_order_relaxed);
+        client->outbound_bytes -= segment->pipe_ready;
+        segment->pipe_pending -= segment->pipe_ready;
+        segment->pipe_ready = 0;
+    } else if (segment->pipe_ready > 0) {
+        size_t length = segment->pipe_ready < client->write_deficit
+            ? segment->pipe_ready
+            : client->write_deficit;
+        unsigned flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+        if (segment->pipe_pending == length && segment->next && length < client->write_deficit)
+            flags |= SPLICE_F_MORE;
+        ssize_t moved = splice(client->egress_pipe[0], NULL, client->socket_fd, NULL, length,
+            flags);
+        if (moved < 0)
+            return false;
+        *sent = (size_t)moved;
+        charge_deficit(&client->write_deficit, (size_t)moved, true);
+        segment->pipe_ready -= (size_t)moved;
+        segment->pipe_pending -= (size_t)moved;
+        client->outbound_bytes -= (size_t)moved;
+    }
+    if (segment->pipe_pending == 0) {
+        client->outbound_head = segment->next;
+        if (!client->outbound_head)
+            client->outbound_tail = NULL;
+        outbound_frame_destroy(segment);
+    }
+    return true;
+}
+
+static bool divert_spliced_bytes(ServerClient* recipient, SharedFrame* fill, size_t fill_offset)
+{
+    OutboundFrame* segment = recipient->splice_segment;
+    size_t missing = segment->pipe_pending - segment->pipe_ready;
+    size_t rest = missing - (fill->length - fill_offset);
+    OutboundFrame* copy = acquire_zeroed(sizeof(*copy));
+    OutboundFrame* remainder = rest > 0 ? acquire_zeroed(sizeof(*remainder)) : NULL;
+    if (!copy || (rest > 0 && !remainder)) {
+        buffer_pool_release(copy, sizeof(*copy));
+        buffer_pool_release(remainder, sizeof(*remainder));
+        return false;
+    }
+    copy->shared = shared_frame_retain(fill);
+    copy->offset = fill_offset;
+    copy->bulk = true;
+    copy->spliced = true;
+    copy->continuation = true;
+    copy->offer_id = segment->offer_id;
+    segment->pipe_pending = segment->pipe_ready;
+    insert_outbound_after(recipient, segment, copy);
+    if (remainder) {
+        remainder->pipe_pending = rest;
+        remainder->bulk = true;
+        remainder->spliced = true;
+        remainder->continuation = true;
+        remainder->offer_id = segment->offer_id;
+        insert_outbound_after(recipient, copy, remainder);
+    }
+    recipient->outbound_bytes = recipient->outbound_bytes - missing + fill->length + rest;
+    recipient->splice_segment = remainder;
+    mark_pending(recipient);
+    return true;
+}
+
+static void splice_forward_chunk(void* context, const uint64_t* participant_ids,
+    size_t participant_count, const ProtocolChunkHeader* chunk, bool* delivered)
+{
+    SplicedChunk* spliced = context;
+    ServerClient* sender = spliced->sender;
+    for (size_t i = 0; i < participant_count; ++i) {
+        ServerClient* recipient = client_by_participant(participant_ids[i]);
+        OutboundFrame* prefix = NULL;
+        delivered[i] = recipient && open_relay_pipe(recipient->egress_pipe, SERVER_PIPE_CAPACITY)
+            && queue_shared_frame(recipient, spliced->prefix)
+            && (prefix = recipient->outbound_tail) != NULL
+            && (recipient->splice_segment = append_outbound(recipient, spliced->length)) != NULL;
+        if (delivered[i]) {
+            prefix->spliced = true;
+            prefix->offer_id = chunk->offer_id;
+            recipient->splice_segment->pipe_pending = spliced->length;
+            recipient->splice_segment->bulk = true;
+            recipient->splice_segment->spliced = true;
+            recipient->splice_segment->continuation = true;
+            recipient->splice_segment->offer_id = chunk->offer_id;
+            SpliceTarget* target = &sender->splice_targets[sender->splice_target_count++];
+            target->connection_id = recipient->connection_id;
+        } else if (recipient) {
+            request_disconnect(recipient);
+        }
+    }
+}
+
+static void begin_spliced_chunk(ServerClient* client)
+{
+    ProtocolChunkHeader chunk;
+    if (worker_mode || spool_is_open(&offer_spool) || splice_sender_id != 0
+        || client->participant_id == 0
+        || memory_governor_live_pressure(&memory) >= SERVER_MEMORY_THROTTLING
+        || !protocol_decoder_peek_chunk(&client->decoder, &chunk)
+        || chunk.frame_length - client->decoder.length < SERVER_SPLICE_MIN
+        || !open_splice_sink() || !open_relay_pipe(client->ingress_pipe, SERVER_SPLICE_STEP))
+        return;
+    if (!client->splice_targets) {
+        client->splice_targets = calloc(client->shard->capacity, sizeof(*client->splice_targets));
+        if (!client->splice_targets)
+            return;
+    }
+    SplicedChunk spliced = {
+        .sender = client,
+        .prefix = shared_frame_copy(chunk.frame, client->decoder.length),
+        .length = chunk.frame_length - client->decoder.length
+    };
+    if (!spliced.prefix)
+        return;
+    client->splice_target_count = 0;
+    RelayPolicyEffects effects = policy_effects(NULL);
+    effects.forward_chunk = splice_forward_chunk;
+    effects.context = &spliced;
+    relay_policy_handle_chunk(policy, client->participant_id, &chunk, monotonic_milliseconds(),
+        &effects);
+    shared_frame_release(spliced.prefix);
+    note_relayed_chunk();
+    atomic_fetch_add_explicit(&spliced_chunks, 1u, memory_order_relaxed);
+    protocol_decoder_reset(&client->decoder);
+    account_decoder(client);
+    client->splice_remaining = spliced.length;
+    splice_sender_id = client->connection_id;
+}
+
+static bool read_pipe_bytes(int pipe_fd, uint8_t* bytes, size_t length)
+{
+    while (length > 0) {
+        ssize_t received = read(pipe_fd, bytes, length);
+        if (received <= 0)
+            return false;
+        bytes += received;
+        length -= (size_t)received;
+    }
+    return true;
+}
+
+static bool fan_out_spliced_bytes(ServerClient* sender, size_t length)
+{
+    bool short_tee = false;
+    for (size_t i = 0; i < sender->splice_target_count; ++i) {
+        ServerClient* recipient = splice_target(sender, i);
+        SpliceTarget* target = &sender->splice_targets[i];
+        target->teed = length;
+        if (!recipient)
+            continue;
+        ssize_t copied = tee(sender->ingress_pipe[0], recipient->egress_pipe[1], length,
+            SPLICE_F_NONBLOCK);
+        target->teed = copied > 0 ? (size_t)copied : 0u;
+        recipient->splice_segment->pipe_ready += target->teed;
+        mark_pending(recipient);
+        short_tee = short_tee || target->teed < length;
+    }
+    if (!short_tee) {
+        if (!discard_pipe_bytes(sender->ingress_pipe[0], length))
+            return false;
+    } else {
+        SharedFrame* spilled = shared_frame_create(length);
+        if (!spilled || !read_pipe_bytes(sender->ingress_pipe[0], spilled->bytes, length)) {
+            shared_frame_release(spilled);
+            return false;
+        }
+        for (size_t i = 0; i < sender->splice_target_count; ++i) {
+            ServerClient* recipient = splice_target(sender, i);
+            size_t teed = sender->splice_targets[i].teed;
+            if (recipient && teed < length && !divert_spliced_bytes(recipient, spilled, teed))
+                request_disconnect(recipient);
+        }
+        shared_frame_release(spilled);
+    }
+    for (size_t i = 0; i < sender->splice_target_count; ++i) {
+        ServerClient* recipient = splice_target(sender, i);
+        if (!recipient)
+            continue;
+        if (recipient->splice_segment->pipe_pending == recipient->splice_segment->pipe_ready)
+            recipient->splice_segment = NULL;
+        if (!flush_outbound(recipient))
+            request_disconnect(recipient);
+    }
+    return true;
+}
+
+static bool pump_spliced_chunk(ServerClient* client)
+{
+    size_t wanted = client->splice_remaining < SERVER_SPLICE_STEP
+        ? client->splice_remaining
+        : SERVER_SPLICE_STEP;
+    if (wanted > client->read_deficit)
+        wanted = client->read_deficit;
+    ssize_t moved = splice(client->socket_fd, NULL, client->ingress_pipe[1], NULL, wanted,
+        SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (moved <= 0) {
+        if (moved == 0 || !socket_would_block())
+            request_disconnect(client);
+        return false;
+    }
+    client->splice_remaining -= (size_t)moved;
+    charge_deficit(&client->read_deficit, (size_t)moved, true);
+    note_received(client, (size_t)moved);
+    if (!fan_out_spliced_bytes(client, (size_t)moved)) {
+        request_disconnect(client);
+        return false;
+    }
+    if (client->splice_remaining == 0)
+        splice_sender_id = 0;
+    return true;
+}
+
+static void abandon_spliced_chunk(ServerClient* sender)
+{
+    if (sender->splice_remaining == 0)
+        return;
+    // Pad the half-relayed frame so recipients stay framed; leaving cancels the transfer.
+    SharedFrame* padding = shared_frame_create(sender->splice_remaining);
+    if (padding)
+        memset(padding->bytes, 0, padding->length);
+    for (size_t i = 0; i < sender->splice_target_count; ++i) {
+        ServerClient* recipient = splice_target(sender, i);
+        if (recipient && (!padding || !divert_spliced_bytes(recipient, padding, 0)))
+            request_disconnect(recipient);
+    }
+    shared_frame_release(padding);
+    sender->splice_remaining = 0;
+    splice_sender_id = 0;
+}
+#endif
+
+static bool frame_is_batchable(const OutboundFrame* frame, size_t batch_length)
+{
+    return frame->shared && frame->offset == 0 && !frame->bulk && !frame->spliced
+        && !frame->continuation && !frame->discard && !frame->spool
+        && frame->shared->bytes[0] != RELAY_MESSAGE_BATCH
+        && frame->shared->length <= SERVER_BATCH_MAX_BYTES - batch_length;
+}
+
+// Runs of small frames that have not started sending go out as one BATCH frame, ahead of bulk.
+static void coalesce_outbound(ServerClient* client)
+{
+    if (!(client->features & PROTOCOL_FEATURE_BATCH))
+        return;
+    size_t in_flight = client->send_armed ? client->send_frames : 0u;
+    OutboundFrame* frame = client->outbound_head;
+    for (size_t i = 0; frame && i < in_flight; ++i)
+        frame = frame->next;
+    while (frame && !frame->bulk
+        && client->outbound_bytes <= SERVER_OUTBOUND_MAX_BYTES - PROTOCOL_FRAME_HEADER_SIZE) {
+        ProtocolSlice slices[SERVER_WRITE_BATCH];
+        size_t count = 0;
+        size_t length = PROTOCOL_FRAME_HEADER_SIZE;
+        OutboundFrame* end = frame;
+        for (; end && count < SERVER_WRITE_BATCH && frame_is_batchable(end, length);
+            end = end->next) {
+            slices[count++] = (ProtocolSlice) { end->shared->bytes, end->shared->length };
+            length += end->shared->length;
+        }
+        if (count < 2) {
+            frame = count > 0 ? end : frame->next;
+            continue;
+        }
+        SharedFrame* batch = shared_frame_create(length);
+        if (!batch || !protocol_encode_batch(slices, count, batch->bytes, length, &length)) {
+            shared_frame_release(batch);
+            return;
+        }
+        for (OutboundFrame* merged = frame->next; merged != end;) {
+            OutboundFrame* next = merged->next;
+            outbound_frame_destroy(merged);
+            merged = next;
+        }
+        shared_frame_release(frame->shared);
+        frame->shared = batch;
+        frame->next = end;
+        if (!end)
+            client->outbound_tail = frame;
+        client->outbound_bytes += PROTOCOL_FRAME_HEADER_SIZE;
+        atomic_fetch_add_explicit(&batched_frames, count, memory_order_relaxed);
+        atomic_fetch_add_explicit(&batches, 1u, memory_order_relaxed);
+        frame = end;
+    }
+}
+
+static bool send_outbound_batch(ServerClient* client, size_t* sent_bytes)
+{
+    size_t count = 0;
+    size_t allowance = client->write_deficit;
+#ifdef _WIN32
+    WSABUF buffers[SERVER_WRITE_BATCH];
+#else
+    struct iovec buffers[SERVER_WRITE_BATCH];
+#endif
+    OutboundFrame* frame = client->outbound_head;
+    for (; frame && frame->shared && count < SERVER_WRITE_BATCH && allowance > 0;
+        frame = frame->next) {
+        size_t length = frame->shared->length - frame->offset;
+        size_t limit = deficit_bytes(allowance, frame->bulk);
+        if (length > limit)
+            length = limit;
+        charge_deficit(&allowance, length, frame->bulk);
+#ifdef _WIN32
+        buffers[count].buf = (char*)frame->shared->bytes + frame->offset;
+        buffers[count++].len = length > (size_t)ULONG_MAX ? ULONG_MAX : (ULONG)length;
+#else
+        buffers[count].iov_base = frame->shared->bytes + frame->offset;
+        buffers[count++].iov_len = length;
+#endif
+    }
+#ifdef _WIN32
+    DWORD sent = 0;
+    if (WSASend(client->socket_fd, buffers, (DWORD)count, &sent, 0, NULL, NULL) != 0)
+        return false;
+#else
+    struct msghdr header = { .msg_iov = buffers, .msg_iovlen = count };
+    int flags = MSG_NOSIGNAL;
+#ifdef MSG_MORE
+    if (frame && allowance > 0)
+        flags |= MSG_MORE;
+#endif
+    ssize_t sent = sendmsg(client->socket_fd, &header, flags);
+    if (sent < 0)
+        return false;
+#endif
+    *sent_bytes = (size_t)sent;
+    return true;
+}
+
+static void consume_outbound(ServerClient* client, size_t sent)
+{
+    while (sent > 0 && client->outbound_head) {
+        OutboundFrame* frame = client->outbound_head;
+        size_t remaining = frame->shared->length - frame->offset;
+        if (sent < remaining) {
+            charge_deficit(&client->write_deficit, sent, frame->bulk);
+            frame->offset += sent;
+            return;
+        }
+        charge_deficit(&client->write_deficit, remaining, frame->bulk);
+        sent -= remaining;
+        client->outbound_head = frame->next;
+        if (!client->outbound_head)
+            client->outbound_tail = NULL;
+        client->outbound_bytes -= frame->shared->length;
+        outbound_frame_destroy(frame);
+    }
+}
+
+static bool flush_outbound(ServerClient* client)
+{
+    replenish_deficits(client);
+    while (client->outbound_head && client->write_deficit > 0) {
+        size_t sent = 0;
+#ifdef SERVER_HAS_SPLICE
+        OutboundFrame* head = client->outbound_head;
+        if (head->spool) {
+            if (!send_spooled_frame(client, &sent))
+                return socket_would_block();
+            if (sent == 0)
+                return false;
+            client->sent_bytes += sent;
+            continue;
+        }
+        if (!head->shared) {
+            if (!splice_outbound(client, &sent))
+                return socket_would_block();
+            client->sent_bytes += sent;
+            if (sent == 0 && client->outbound_head == head)
+                return true;
+            continue;
+        }
+#elif defined(RELAY_HAS_SPOOL)
+        if (!load_spooled_frame(client))
+            return false;
+#endif
+        coalesce_outbound(client);
+        if (!send_outbound_batch(client, &sent))
+            return socket_would_block();
+        if (sent == 0)
+            return false;
+        client->sent_bytes += sent;
+        consume_outbound(client, sent);
+    }
+    return true;
+}
+
+static uint32_t negotiated_features(uint32_t offered)
+{
+    return offered & PROTOCOL_FEATURES_SUPPORTED;
+}
+
+static bool admit_participant(const RelayMessage* hello, uint64_t* participant_id)
+{
+    return hello->type == RELAY_MESSAGE_HELLO
+        && hello->as.hello.version == PROTOCOL_VERSION
+        && relay_policy_join(policy, hello->as.hello.display_name, participant_id);
+}
+
+static void post_policy_event(PolicyEvent* event)
+{
+    server_queue_push(&policy_events, &event->node);
+    server_wake_signal(&policy_wake);
+}
+
+static void forward_message_to_policy(ServerClient* client, const RelayMessageView* view)
+{
+    PolicyEvent* event = acquire_zeroed(sizeof(*event));
+    if (!event || !protocol_view_to_message(view, &event->message)) {
+        buffer_pool_release(event, sizeof(*event));
+        request_disconnect(client);
+        return;
+    }
+    event->kind = POLICY_EVENT_MESSAGE;
+    event->connection_id = client->connection_id;
+    event->frame = NULL;
+    post_policy_event(event);
+}
+
+static void forward_chunk_to_policy(ServerClient* client, const ProtocolChunkHeader* chunk)
+{
+    PolicyEvent* event = acquire_zeroed(sizeof(*event));
+    SharedFrame* shared = event ? shared_frame_copy(chunk->frame, chunk->frame_length) : NULL;
+    if (!shared) {
+        buffer_pool_release(event, sizeof(*event));
+        request_disconnect(client);
+        return;
+    }
+    event->kind = POLICY_EVENT_CHUNK;
+    event->connection_id = client->connection_id;
+    event->frame = shared;
+    event->chunk = *chunk;
+    event->chunk.frame = shared->bytes;
+    event->chunk.data = shared->bytes + (chunk->data - chunk->frame);
+    post_policy_event(event);
+}
+
+static void handle_decoded_message(void* context, const RelayMessageView* view)
+{
+    ServerClient* client = context;
+    if (!client || client->disconnect_requested)
+        return;
+    if (!client->hello_received) {
+        if (view->type != RELAY_MESSAGE_HELLO) {
+            request_disconnect(client);
+            return;
+        }
+        client->hello_received = true;
+        client->features = negotiated_features(view->as.hello.features);
+        if (!worker_mode)
+            timer_wheel_cancel(&handshake_timers, &client->handshake_timer);
+    } else if (view->type == RELAY_MESSAGE_HELLO || view->type == RELAY_MESSAGE_WELCOME) {
+        request_disconnect(client);
+        return;
+    }
+    client->streaming = view->type == RELAY_MESSAGE_FILE_CHUNK;
+    if (worker_mode) {
+        forward_message_to_policy(client, view);
+        return;
+    }
+    RelayMessage message;
+    if (!protocol_view_to_message(view, &message)) {
+        request_disconnect(client);
+        return;
+    }
+    if (message.type == RELAY_MESSAGE_HELLO) {
+        if (!admit_participant(&message, &client->participant_id)) {
+            request_disconnect(client);
+            return;
+        }
+        if (!id_map_put(&client->shard->by_participant, client->participant_id, client)) {
+            request_disconnect(client);
+            return;
+        }
+        snprintf(client->display_name, sizeof(client->display_name), "%s",
+            message.as.hello.display_name);
+        RelayMessage welcome = { .type = RELAY_MESSAGE_WELCOME };
+        welcome.as.welcome.participant_id = client->participant_id;
+        welcome.as.welcome.features = client->features;
+        if (!queue_message(client, &welcome))
+            request_disconnect(client);
+        return;
+    }
+    if (message_callback && message.type == RELAY_MESSAGE_CHAT_SEND)
+        message_callback(message.as.chat_send.text, client->display_name);
+    RelayPolicyEffects effects = policy_effects(NULL);
+    relay_policy_handle(policy, client->participant_id, &message,
+        monotonic_milliseconds(), &effects);
+}
+
+static void handle_decoded_chunk(void* context, const ProtocolChunkHeader* chunk)
+{
+    ServerClient* client = context;
+    if (!client || client->disconnect_requested)
+        return;
+    if (!client->hello_received) {
+        request_disconnect(client);
+        return;
+    }
+    client->streaming = true;
+    note_relayed_chunk();
+    if (worker_mode) {
+        forward_chunk_to_policy(client, chunk);
+        return;
+    }
+    RelayPolicyEffects effects = policy_effects(NULL);
+    relay_policy_handle_chunk(policy, client->participant_id, chunk,
+        monotonic_milliseconds(), &effects);
+}
+
+static void remove_client(ServerShard* shard, size_t index)
+{
+    if (index >= shard->client_count)
+        return;
+    ServerClient* client = shard->clients[index];
+    uint64_t participant_id = client->participant_id;
+    pending_unlink(&client->pending);
+#ifdef SERVER_HAS_SPLICE
+    abandon_spliced_chunk(client);
+#endif
+    client->active = false;
+    if (client->socket_fd != -1) {
+        (void)id_map_remove(&shard->by_socket, socket_key(client->socket_fd));
+        if (shard->poller_fd != -1)
+            poller_forget(shard->poller_fd, client->socket_fd);
+        closesocket(client->socket_fd);
+    }
+    (void)id_map_remove(&shard->by_connection, client->connection_id);
+    if (participant_id != 0)
+        (void)id_map_remove(&shard->by_participant, participant_id);
+    protocol_decoder_destroy(&client->decoder);
+    account_decoder(client);
+    if (!client->watching_reads)
+        shard->paused_count--;
+#ifdef SERVER_HAS_SOCKET_TUNING
+    note_socket_buffer(client->send_buffer, 0);
+    note_socket_buffer(client->receive_buffer, 0);
+#endif
+    discard_outbound(client);
+    free(client->splice_targets);
+    for (size_t i = 0; i < 2u; ++i) {
+        close_descriptor(&client->ingress_pipe[i]);
+        close_descriptor(&client->egress_pipe[i]);
+    }
+
+    if (worker_mode) {
+        PolicyEvent* event = acquire_zeroed(sizeof(*event));
+        if (event) {
+            event->kind = POLICY_EVENT_CLOSED;
+            event->connection_id = client->connection_id;
+            post_policy_event(event);
+        }
+    } else {
+        timer_wheel_cancel(&handshake_timers, &client->handshake_timer);
+        if (participant_id != 0 && policy) {
+            RelayPolicyEffects effects = policy_effects(NULL);
+            relay_policy_leave(policy, participant_id, monotonic_milliseconds(), &effects);
+        }
+    }
+    shard->client_count--;
+    ServerClient* moved = shard->clients[shard->client_count];
+    moved->table_index = index;
+    shard->clients[index] = moved;
+    shard->clients[shard->client_count] = NULL;
+    shard->free_slots[shard->free_count++] = client->slab_index;
+    memset(client, 0, sizeof(*client));
+}
+
+static ServerClient* adopt_client(ServerShard* shard, int socket_fd, uint64_t connection_id,
+    const char* ip_address)
+{
+    if (shard->free_count == 0)
+        return NULL;
+    if (shard->poller_fd != -1 && !poller_watch(shard->poller_fd, socket_fd))
+        return NULL;
+    size_t slab_index = shard->free_slots[shard->free_count - 1u];
+    ServerClient* client = &shard->slab[slab_index];
+    if (!id_map_put(&shard->by_socket, socket_key(socket_fd), client)
+        || !id_map_put(&shard->by_connection, connection_id, client)) {
+        (void)id_map_remove(&shard->by_socket, socket_key(socket_fd));
+        if (shard->poller_fd != -1)
+            poller_forget(shard->poller_fd, socket_fd);
+        return NULL;
+    }
+    shard->free_count--;
+    memset(client, 0, sizeof(*client));
+    client->slab_index = slab_index;
+    client->table_index = shard->client_count;
+    shard->clients[shard->client_count++] = client;
+    client->ingress_pipe[0] = client->ingress_pipe[1] = -1;
+    client->egress_pipe[0] = client->egress_pipe[1] = -1;
+    client->active = true;
+    client->watching_reads = true;
+    client->socket_fd = socket_fd;
+    client->connection_id = connection_id;
+    client->shard = shard;
+    protocol_decoder_init(&client->decoder);
+    protocol_decoder_set_chunk_handler(&client->decoder, handle_decoded_chunk);
+    snprintf(client->ip_address, sizeof(client->ip_address), "%s", ip_address);
+    if (!worker_mode)
+        schedule_handshake_timeout(&client->handshake_timer, client);
+    return client;
+}
+
+void server_set_msg_cb(server_msg_cb callback)
+{
+    message_callback = callback;
+}
+
+void server_memory_stats(ServerMemoryStats* stats)
+{
+    if (!stats)
+        return;
+    memory_governor_stats(&memory, stats);
+    stats->throttled_reads = atomic_load_explicit(&throttled_reads, memory_order_relaxed);
+    stats->refused_offers = relay_policy_refused_offer_count(policy);
+    stats->purged_frames = atomic_load_explicit(&purged_frames, memory_order_relaxed);
+    stats->purged_bytes = atomic_load_explicit(&purged_bytes, memory_order_relaxed);
+}
+
+void server_stats(ServerStats* stats)
+{
+    if (!stats)
+        return;
+    stats->rate_limited_messages = relay_policy_rate_limited_count(policy);
+    stats->rate_limited_reads = atomic_load_explicit(&rate_limited_reads, memory_order_relaxed);
+    stats->refused_connections = atomic_load_explicit(&refused_connections, memory_order_relaxed);
+#ifdef TCP_NOTSENT_LOWAT
+    stats->notsent_lowat_bytes = SERVER_NOTSENT_LOWAT;
+#else
+    stats->notsent_lowat_bytes = 0;
+#endif
+    stats->tuned_socket_buffers = atomic_load_explicit(&tuned_buffers, memory_order_relaxed);
+    stats->socket_buffer_bytes = atomic_load_explicit(&socket_buffer_bytes, memory_order_relaxed);
+    stats->largest_socket_buffer
+        = atomic_load_explicit(&largest_socket_buffer, memory_order_relaxed);
+    stats->socket_retunes = atomic_load_explicit(&socket_retunes, memory_order_relaxed);
+    stats->batched_frames = atomic_load_explicit(&batched_frames, memory_order_relaxed);
+    stats->batches = atomic_load_explicit(&batches, memory_order_relaxed);
+    BufferPoolStats pool;
+    buffer_pool_stats(&pool);
+    stats->relayed_chunks = atomic_load_explicit(&relayed_chunks, memory_order_relaxed);
+    stats->spliced_chunks = atomic_load_explicit(&spliced_chunks, memory_order_relaxed);
+    stats->allocations = pool.system_allocations;
+    stats->steady_allocations = 0;
+    if (stats->relayed_chunks >= SERVER_ALLOCATION_WARMUP_CHUNKS) {
+        stats->steady_allocations = pool.system_allocations
+            - atomic_load_explicit(&warm_allocations, memory_order_relaxed);
+    }
+}
+
+int get_client_count(void)
+{
+    return worker_mode ? (int)connection_count : (int)shards[0].client_count;
+}
+
+bool is_server_running(void)
+{
+    return server_running;
+}
+
+static void discard_policy_events(void)
+{
+    ServerQueueNode* node = NULL;
+    while ((node = server_queue_pop(&policy_events)) != NULL) {
+        PolicyEvent* event = (PolicyEvent*)node;
+        shared_frame_release(event->frame);
+        buffer_pool_release(event, sizeof(*event));
+    }
+}
+
+static void discard_worker_commands(ServerShard* shard)
+{
+    ServerQueueNode* node = NULL;
+    while ((node = server_queue_pop(&shard->commands)) != NULL) {
+        WorkerCommand* command = (WorkerCommand*)node;
+        if (command->kind == WORKER_COMMAND_ADOPT && command->socket_fd != -1)
+            closesocket(command->socket_fd);
+        shared_frame_release(command->frame);
+        buffer_pool_release(command, sizeof(*command));
+    }
+}
+
+static bool allocate_shard(ServerShard* shard, size_t capacity)
+{
+    shard->slab = calloc(capacity, sizeof(*shard->slab));
+    shard->clients = calloc(capacity, sizeof(*shard->clients));
+    shard->free_slots = calloc(capacity, sizeof(*shard->free_slots));
+    if (!shard->slab || !shard->clients || !shard->free_slots
+        || !id_map_init(&shard->by_socket, capacity)
+        || !id_map_init(&shard->by_connection, capacity)
+        || !id_map_init(&shard->by_participant, capacity))
+        return false;
+    for (size_t i = 0; i < capacity; ++i)
+        shard->free_slots[i] = capacity - 1u - i;
+    pending_init(&shard->pending);
+    shard->free_count = capacity;
+    shard->capacity = capacity;
+    return true;
+}
+
+static void release_shard(ServerShard* shard)
+{
+    free(shard->slab);
+    free(shard->clients);
+    free(shard->free_slots);
+    id_map_destroy(&shard->by_socket);
+    id_map_destroy(&shard->by_connection);
+    id_map_destroy(&shard->by_participant);
+    shard->slab = NULL;
+    shard->clients = NULL;
+    shard->free_slots = NULL;
+    shard->free_count = 0;
+    shard->capacity = 0;
+}
+
+static void release_connections(void)
+{
+    for (size_t i = 0; i < connections_by_id.capacity; ++i) {
+        if (connections_by_id.entries[i].key != 0)
+            free(connections_by_id.entries[i].value);
+    }
+    id_map_destroy(&connections_by_id);
+    id_map_destroy(&connections_by_participant);
+    connection_count = 0;
+}
+
+static void stop_workers(void)
+{
+#ifdef SERVER_HAS_WORKERS
+    for (size_t i = 0; i < shard_count; ++i) {
+        ServerShard* shard = &shards[i];
+        if (!atomic_load(&shard->running))
+            continue;
+        atomic_store(&shard->running, false);
+        server_wake_signal(&shard->wake);
+        pthread_join(shard->thread, NULL);
+    }
+#endif
+    for (size_t i = 0; i < shard_count; ++i) {
+        ServerShard* shard = &shards[i];
+        while (shard->client_count > 0)
+            remove_client(shard, shard->client_count - 1u);
+        discard_worker_commands(shard);
+        release_shard(shard);
+        if (shard->poller_fd != poller_fd)
+            close_descriptor(&shard->poller_fd);
+        shard->poller_fd = -1;
+        close_descriptor(&shard->wake.event_fd);
+    }
+    discard_policy_events();
+    release_connections();
+    close_descriptor(&policy_wake.event_fd);
+}
+
+#ifdef RELAY_HAS_URING
+static bool start_uring(void);
+static void stop_uring(void);
+#endif
+
+#ifdef SERVER_HAS_WORKERS
+static bool server_wake_init(ServerWake* wake)
+{
+    atomic_init(&wake->pending, false);
+    wake->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return wake->event_fd != -1;
+}
+
+static void server_wake_clear(ServerWake* wake)
+{
+    uint64_t value = 0;
+    ssize_t received = read(wake->event_fd, &value, sizeof(value));
+    (void)received;
+    atomic_store(&wake->pending, false);
+}
+
+static void* worker_main(void* argument);
+#endif
+
+static bool start_workers(size_t worker_count)
+{
+#ifdef SERVER_HAS_WORKERS
+    if (!server_wake_init(&policy_wake) || !poller_watch(poller_fd, policy_wake.event_fd)
+        || !id_map_init(&connections_by_id, client_capacity)
+        || !id_map_init(&connections_by_participant, client_capacity))
+        return false;
+    for (size_t i = 0; i < worker_count; ++i) {
+        ServerShard* shard = &shards[i];
+        shard_count = i + 1u;
+        shard->poller_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (shard->poller_fd == -1 || !allocate_shard(shard, client_capacity) || !server_wake_init(&shard->wake)
+            || !poller_watch(shard->poller_fd, shard->wake.event_fd))
+            return false;
+        atomic_store(&shard->running, true);
+        if (pthread_create(&shard->thread, NULL, worker_main, shard) != 0) {
+            atomic_store(&shard->running, false);
+            return false;
+        }
+    }
+    return true;
+#else
+    (void)worker_count;
+    return false;
+#endif
+}
+
+static void reset_shards(void)
+{
+    memset(shards, 0, sizeof(shards));
+    for (size_t i = 0; i < SERVER_MAX_WORKERS; ++i) {
+        shards[i].poller_fd = -1;
+        shards[i].wake.event_fd = -1;
+        server_queue_init(&shards[i].commands);
+        atomic_init(&shards[i].running, false);
+    }
+    shard_count = 1;
+    memset(&connections_by_id, 0, sizeof(connections_by_id));
+    memset(&connections_by_participant, 0, sizeof(connections_by_participant));
+    connection_count = 0;
+    next_shard = 0;
+    next_connection_id = 0;
+    server_queue_init(&policy_events);
+    splice_sender_id = 0;
+    policy_wake.event_fd = -1;
+    atomic_init(&policy_wake.pending, false);
+}
+
+bool init_server_with_options(const ServerOptions* options)
+{
+    int worker_count = options ? options->worker_count : 0;
+    size_t max_clients = options && options->max_clients > 0 ? options->max_clients : MAX_CLIENTS;
+    if (server_running)
+        return true;
+    if (init_network() != 0)
+        return false;
+#ifdef SERVER_HAS_WORKERS
+    worker_mode = worker_count > 0;
+    if (worker_count > SERVER_MAX_WORKERS)
+        worker_count = SERVER_MAX_WORKERS;
+#else
+    worker_mode = false;
+#endif
+    client_capacity = max_clients < SERVER_MAX_CLIENTS_LIMIT
+        ? max_clients
+        : SERVER_MAX_CLIENTS_LIMIT;
+#ifndef __linux__
+    // The select loop watches every client in one fd_set beside the listening socket.
+    if (client_capacity > FD_SETSIZE - 1u)
+        client_capacity = FD_SETSIZE - 1u;
+#endif
+    io_quantum = options && options->io_quantum_bytes > 0
+        ? options->io_quantum_bytes
+        : SERVER_IO_QUANTUM;
+    control_weight = options && options->control_weight > 0
+        ? options->control_weight
+        : SERVER_CONTROL_WEIGHT;
+    memory_governor_reset(&memory, options && options->memory_budget_bytes > 0
+            ? options->memory_budget_bytes
+            : SERVER_MEMORY_BUDGET);
+    byte_rate = options ? options->byte_rate : 0;
+#ifdef SERVER_HAS_SOCKET_TUNING
+    send_buffer_limit = read_buffer_limit("/proc/sys/net/core/wmem_max");
+    receive_buffer_limit = read_buffer_limit("/proc/sys/net/core/rmem_max");
+#endif
+    atomic_store(&throttled_reads, 0u);
+    atomic_store(&purged_frames, 0u);
+    atomic_store(&purged_bytes, 0u);
+    atomic_store(&relayed_chunks, 0u);
+    atomic_store(&spliced_chunks, 0u);
+    atomic_store(&batched_frames, 0u);
+    atomic_store(&batches, 0u);
+    atomic_store(&rate_limited_reads, 0u);
+    atomic_store(&refused_connections, 0u);
+    atomic_store(&tuned_buffers, 0u);
+    atomic_store(&socket_buffer_bytes, 0u);
+    atomic_store(&largest_socket_buffer, 0u);
+    atomic_store(&socket_retunes, 0u);
+    atomic_store(&warm_allocations, 0u);
+    RelayPolicyOptions policy_options = {
+        .credit_window_bytes = options ? options->credit_window_bytes : 0,
+        .straggler_lag_bytes = options ? options->straggler_lag_bytes : 0,
+        .max_participants = client_capacity,
+        .max_file_offers = options ? options->max_file_offers : 0,
+        .max_offers_per_sender = options ? options->max_offers_per_sender : 0,
+        .message_rate = options ? options->message_rate : 0,
+        .message_burst = options ? options->message_burst : 0
+    };
+#ifdef RELAY_HAS_SPOOL
+    if (!worker_mode && options && options->spool_directory) {
+        if (!spool_open(&offer_spool, options->spool_directory)) {
+            cleanup_network();
+            return false;
+        }
+        policy_options.store_and_forward = true;
+    }
+#endif
+    policy = relay_policy_create_with_options(&policy_options);
+    if (!policy) {
+#ifdef RELAY_HAS_SPOOL
+        spool_close(&offer_spool);
+#endif
+        worker_mode = false;
+        cleanup_network();
+        return false;
+    }
+    reset_shards();
+    timer_wheel_init(&handshake_timers, monotonic_milliseconds());
+    timer_wheel_init(&refusal_timers, monotonic_milliseconds());
+    lingering_refusals = 0;
+#ifdef RELAY_HAS_URING
+    uring_mode = !worker_mode && options && options->use_io_uring;
+#endif
+    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd == -1)
+        goto fail;
+
+#ifdef _WIN32
+    char reuse = 1;
+#else
+    int reuse = 1;
+#endif
+    (void)setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in address = { 0 };
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(options && options->port > 0 ? options->port : PORT);
+    if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) != 0
+        || listen(server_fd, client_capacity < SOMAXCONN ? (int)client_capacity : SOMAXCONN) != 0
+        || !set_socket_nonblocking(server_fd))
+        goto fail;
+#ifdef __linux__
+    poller_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (poller_fd == -1 || !poller_watch(poller_fd, server_fd))
+        goto fail;
+#endif
+    if (worker_mode) {
+        if (!start_workers((size_t)worker_count))
+            goto fail;
+    } else {
+        if (!allocate_shard(&shards[0], client_capacity))
+            goto fail;
+        shards[0].poller_fd = poller_fd;
+    }
+#ifdef RELAY_HAS_URING
+    if (uring_mode && !start_uring())
+        uring_mode = false;
+#endif
+    server_running = true;
+    return true;
+
+fail:
+    stop_workers();
+    worker_mode = false;
+    close_descriptor(&poller_fd);
+    if (server_fd != -1) {
+        closesocket(server_fd);
+        server_fd = -1;
+    }
+    relay_policy_destroy(policy);
+    policy = NULL;
+#ifdef RELAY_HAS_SPOOL
+    spool_close(&offer_spool);
+#endif
+    cleanup_network();
+    return false;
+}
+
+bool init_server(void)
+{
+    return init_server_with_options(NULL);
+}
+
+const char* server_backend_name(void)
+{
+    if (worker_mode)
+        return "epoll workers";
+#ifdef RELAY_HAS_URING
+    if (uring_mode)
+        return "io_uring";
+#endif
+#ifdef __linux__
+    return "epoll";
+#else
+    return "select";
+#endif
+}
+
+typedef struct {
+    TimerEntry timer;
+    int socket_fd;
+} RefusedSocket;
+
+static void drain_refused_socket(int socket_fd)
+{
+    uint8_t buffer[512];
+#ifdef _WIN32
+    while (recv(socket_fd, (char*)buffer, (int)sizeof(buffer), 0) > 0) { }
+#else
+    while (recv(socket_fd, buffer, sizeof(buffer), 0) > 0) { }
+#endif
+}
+
+static void close_refused_socket(void* context, TimerEntry* entry)
+{
+    (void)context;
+    RefusedSocket* refused = entry->owner;
+    drain_refused_socket(refused->socket_fd);
+    closesocket(refused->socket_fd);
+    buffer_pool_release(refused, sizeof(*refused));
+    lingering_refusals--;
+}
+
+// Closing with the HELLO still unread would reset the connection and could discard the
+// rejection, so the write side is shut first and the socket is drained until the linger ends.
+static void linger_refused_socket(int accepted)
+{
+#ifdef _WIN32
+    (void)shutdown(accepted, SD_SEND);
+#else
+    (void)shutdown(accepted, SHUT_WR);
+#endif
+    drain_refused_socket(accepted);
+    RefusedSocket* refused = lingering_refusals < SERVER_REFUSAL_LINGER_MAX
+        ? acquire_zeroed(sizeof(*refused))
+        : NULL;
+    if (!refused) {
+        closesocket(accepted);
+        return;
+    }
+    refused->socket_fd = accepted;
+    refused->timer.owner = refused;
+    timer_wheel_schedule(&refusal_timers, &refused->timer,
+        monotonic_milliseconds() + SERVER_REFUSAL_LINGER_MS);
+    lingering_refusals++;
+}
+
+void cleanup_server(void)
+{
+#ifdef RELAY_HAS_URING
+    stop_uring();
+#endif
+    stop_workers();
+    worker_mode = false;
+    close_descriptor(&poller_fd);
+#ifdef SERVER_HAS_SPLICE
+    close_descriptor(&splice_sink_fd);
+#endif
+    if (server_fd != -1) {
+        closesocket(server_fd);
+        server_fd = -1;
+    }
+    (void)timer_wheel_advance(&refusal_timers, UINT64_MAX, close_refused_socket, NULL);
+    relay_policy_destroy(policy);
+    policy = NULL;
+#ifdef RELAY_HAS_SPOOL
+    spool_close(&offer_spool);
+#endif
+    server_running = false;
+    cleanup_network();
+    buffer_pool_trim();
+}
+
+static bool assign_connection(int socket_fd, const char* ip_address)
+{
+    ServerConnection* connection = calloc(1, sizeof(*connection));
+    WorkerCommand* command = connection ? acquire_zeroed(sizeof(*command)) : NULL;
+    if (!command) {
+        free(connection);
+        return false;
+    }
+    connection->active = true;
+    connection->connection_id = ++next_connection_id;
+    if (!id_map_put(&connections_by_id, connection->connection_id, connection)) {
+        buffer_pool_release(command, sizeof(*command));
+        free(connection);
+        return false;
+    }
+    connection->shard_index = next_shard;
+    next_shard = (next_shard + 1u) % shard_count;
+    connection_count++;
+    schedule_handshake_timeout(&connection->handshake_timer, connection);
+
+    command->kind = WORKER_COMMAND_ADOPT;
+    command->connection_id = connection->connection_id;
+    command->socket_fd = socket_fd;
+    snprintf(command->ip_address, sizeof(command->ip_address), "%s", ip_address);
+    post_worker_command(connection->shard_index, command);
+    return true;
+}
+
+static const char* admission_refusal(int accepted)
+{
+    size_t admitted = worker_mode ? connection_count : shards[0].client_count;
+    if (admitted >= client_capacity)
+        return "Relay Server is full";
+#if !defined(_WIN32) && !defined(__linux__)
+    if (accepted >= FD_SETSIZE)
+        return "Relay Server is full";
+#else
+    (void)accepted;
+#endif
+    if (memory_governor_live_pressure(&memory) >= SERVER_MEMORY_SHEDDING)
+        return "Relay Server is low on memory";
+    return NULL;
+}
+
+static void refuse_connection(int accepted, const char* reason)
+{
+    RelayMessage rejection = { .type = RELAY_MESSAGE_ACTION_REJECTED };
+    rejection.as.action_rejected.rejected_type = RELAY_MESSAGE_HELLO;
+    snprintf(rejection.as.action_rejected.reason, sizeof(rejection.as.action_rejected.reason),
+        "%s", reason);
+    uint8_t* frame = NULL;
+    size_t length = 0;
+    if (protocol_encode(&rejection, &frame, &length)) {
+#ifdef _WIN32
+        (void)send(accepted, (const char*)frame, (int)length, 0);
 #else
-            ssize_t received = recv(client->socket_fd, buffer, sizeof(buffer), 0);
+        (void)send(accepted, frame, length, MSG_NOSIGNAL);
 #endif
-            if (received > 0) {
-                if (!protocol_decoder_feed(&client->decoder, buffer, (size_t)received,
-                        handle_decoded_message, client))
-                    client->disconnect_requested = true;
-                continue;
-            }
-            if (received == 0) {
-                client->disconnect_requested = true;
-                break;
-            }
-            if (socket_would_block())
+        buffer_pool_release(frame, length);
+    }
+    atomic_fetch_add_explicit(&refused_connections, 1u, memory_order_relaxed);
+    linger_refused_socket(accepted);
+}
+
+static bool register_accepted_socket(int accepted, const struct sockaddr_in* address)
+{
+    if (!set_socket_nonblocking(accepted)) {
+        closesocket(accepted);
+        return false;
+    }
+    const char* refusal = admission_refusal(accepted);
+    if (refusal) {
+        refuse_connection(accepted, refusal);
+        return false;
+    }
+    optimize_socket_for_lan(accepted);
+    const char* printable = inet_ntoa(address->sin_addr);
+    if (!printable)
+        printable = "unknown";
+    bool registered = worker_mode
+        ? assign_connection(accepted, printable)
+        : adopt_client(&shards[0], accepted, ++next_connection_id, printable) != NULL;
+    if (!registered)
+        closesocket(accepted);
+    return registered;
+}
+
+static bool accept_one_client(int* accepted_socket)
+{
+    *accepted_socket = -1;
+    struct sockaddr_in address;
+    socklen_t address_length = sizeof(address);
+    int accepted = accept(server_fd, (struct sockaddr*)&address, &address_length);
+    if (accepted == -1)
+        return false;
+    if (register_accepted_socket(accepted, &address))
+        *accepted_socket = accepted;
+    return true;
+}
+
+int server_accept_client(void)
+{
+    if (!server_running || server_fd == -1)
+        return -1;
+    int accepted = -1;
+    (void)accept_one_client(&accepted);
+    return accepted;
+}
+
+static void accept_pending_clients(void)
+{
+    int accepted = -1;
+    while (accept_one_client(&accepted)) { }
+}
+
+static void receive_from_client(ServerClient* client)
+{
+    replenish_deficits(client);
+    while (!client->disconnect_requested && client->read_deficit > 0) {
+        if (reads_throttled(client)) {
+            atomic_fetch_add_explicit(&throttled_reads, 1u, memory_order_relaxed);
+            break;
+        }
+        if (read_rate_exhausted(client)) {
+            atomic_fetch_add_explicit(&rate_limited_reads, 1u, memory_order_relaxed);
+            break;
+        }
+#ifdef SERVER_HAS_SPLICE
+        if (client->splice_remaining > 0) {
+            if (!pump_spliced_chunk(client))
                 break;
+            continue;
+        }
+#endif
+        uint8_t buffer[SERVER_RECEIVE_CHUNK];
+        size_t space = 0;
+        uint8_t* target = protocol_decoder_receive_space(&client->decoder, &space);
+        if (!target) {
+            target = buffer;
+            space = sizeof(buffer);
+        }
+        bool bulk = receiving_bulk(client);
+        size_t wanted = deficit_bytes(client->read_deficit, bulk);
+        if (wanted > space)
+            wanted = space;
+#ifdef _WIN32
+        int received = recv(client->socket_fd, (char*)target, (int)wanted, 0);
+#else
+        ssize_t received = recv(client->socket_fd, target, wanted, 0);
+#endif
+        if (received > 0) {
+            charge_deficit(&client->read_deficit, (size_t)received, bulk);
+            note_received(client, (size_t)received);
+            bool decoded = target == buffer
+                ? protocol_decoder_feed_views(&client->decoder, buffer, (size_t)received,
+                      handle_decoded_message, client)
+                : protocol_decoder_commit_views(&client->decoder, (size_t)received,
+                      handle_decoded_message, client);
+            account_decoder(client);
+            if (!decoded)
+                request_disconnect(client);
+#ifdef SERVER_HAS_SPLICE
+            else
+                begin_spliced_chunk(client);
+#endif
+            continue;
+        }
+        if (received == 0) {
+            request_disconnect(client);
+            break;
+        }
+        if (socket_would_block())
+            break;
+        request_disconnect(client);
+    }
+}
+
+static void service_client(ServerShard* shard, ServerClient* client, bool readable)
+{
+    if (readable)
+        receive_from_client(client);
+    if (!client->disconnect_requested && !flush_outbound(client))
+        request_disconnect(client);
+    if (client->disconnect_requested)
+        remove_client(shard, client->table_index);
+    else
+        mark_pending(client);
+}
+
+static bool still_pending(const ServerClient* client)
+{
+    return !client->watching_reads
+        || client->send_buffer > SERVER_SOCKET_BUFFER_MIN
+        || client->receive_buffer > SERVER_SOCKET_BUFFER_MIN;
+}
+
+static void flush_pending_clients(ServerShard* shard)
+{
+    // Paused reads and enlarged socket buffers are rechecked on later wakes.
+    PendingLink deferred;
+    pending_init(&deferred);
+    while (shard->pending.next != &shard->pending) {
+        ServerClient* client = shard->pending.next->owner;
+        pending_unlink(&client->pending);
+        if (client->outbound_head && !client->disconnect_requested
+            && !flush_outbound(client))
             client->disconnect_requested = true;
+        if (!client->disconnect_requested) {
+            retune_socket(client);
+            update_interest(client);
+        }
+        if (client->disconnect_requested) {
+            remove_client(shard, client->table_index);
+            continue;
+        }
+        if (still_pending(client))
+            pending_push(&deferred, &client->pending);
+    }
+    if (deferred.next != &deferred) {
+        deferred.next->prev = shard->pending.prev;
+        deferred.prev->next = &shard->pending;
+        shard->pending.prev->next = deferred.next;
+        shard->pending.prev = deferred.prev;
+    }
+}
+
+static void handshake_expired(void* context, TimerEntry* entry)
+{
+    (void)context;
+    if (worker_mode) {
+        ServerConnection* connection = entry->owner;
+        if (connection->participant_id == 0)
+            (void)post_connection_command(connection, WORKER_COMMAND_CLOSE, NULL);
+        return;
+    }
+    ServerClient* client = entry->owner;
+    request_disconnect(client);
+}
+
+static void govern_memory(uint64_t now, const RelayPolicyEffects* effects)
+{
+    bool shed = memory_governor_update(&memory, now);
+    relay_policy_set_refusing_offers(policy,
+        memory_governor_pressure(&memory) >= SERVER_MEMORY_REFUSING_OFFERS);
+    if (shed
+        && relay_policy_fail_slowest_delivery(policy, "Relay Server is low on memory", effects))
+        memory_governor_note_shed(&memory, now);
+}
+
+static void server_tick(void)
+{
+    uint64_t now = monotonic_milliseconds();
+    RelayPolicyEffects effects = policy_effects(NULL);
+    govern_memory(now, &effects);
+    relay_policy_tick(policy, now, &effects);
+    (void)timer_wheel_advance(&handshake_timers, now, handshake_expired, NULL);
+    (void)timer_wheel_advance(&refusal_timers, now, close_refused_socket, NULL);
+}
+
+static int poll_timeout(int max_wait_ms)
+{
+    if (max_wait_ms < 0)
+        max_wait_ms = 0;
+    if (!worker_mode && shards[0].paused_count > 0 && max_wait_ms > SERVER_THROTTLE_RECHECK_MS)
+        max_wait_ms = SERVER_THROTTLE_RECHECK_MS;
+    uint64_t deadline = 0;
+    uint64_t timer_deadline = 0;
+    bool has_deadline = relay_policy_next_deadline(policy, &deadline);
+    if (timer_wheel_next_expiry(&handshake_timers, &timer_deadline)
+        && (!has_deadline || timer_deadline < deadline)) {
+        deadline = timer_deadline;
+        has_deadline = true;
+    }
+    if (timer_wheel_next_expiry(&refusal_timers, &timer_deadline)
+        && (!has_deadline || timer_deadline < deadline)) {
+        deadline = timer_deadline;
+        has_deadline = true;
+    }
+    if (!has_deadline)
+        return max_wait_ms;
+    uint64_t now = monotonic_milliseconds();
+    if (deadline <= now)
+        return 0;
+    return deadline - now < (uint64_t)max_wait_ms ? (int)(deadline - now) : max_wait_ms;
+}
+
+#ifdef SERVER_HAS_WORKERS
+static void process_policy_event(PolicyEvent* event)
+{
+    ServerConnection* connection = connection_by_id(event->connection_id);
+    if (!connection)
+        return;
+    uint64_t now = monotonic_milliseconds();
+    RelayPolicyEffects effects = policy_effects(event->frame);
+    if (event->kind == POLICY_EVENT_CLOSED) {
+        timer_wheel_cancel(&handshake_timers, &connection->handshake_timer);
+        if (connection->participant_id != 0) {
+            relay_policy_leave(policy, connection->participant_id, now, &effects);
+            (void)id_map_remove(&connections_by_participant, connection->participant_id);
+        }
+        (void)id_map_remove(&connections_by_id, connection->connection_id);
+        free(connection);
+        connection_count--;
+        return;
+    }
+    if (connection->participant_id == 0) {
+        if (event->kind != POLICY_EVENT_MESSAGE
+            || !admit_participant(&event->message, &connection->participant_id)
+            || !id_map_put(&connections_by_participant, connection->participant_id,
+                connection)) {
+            (void)post_connection_command(connection, WORKER_COMMAND_CLOSE, NULL);
+            return;
+        }
+        timer_wheel_cancel(&handshake_timers, &connection->handshake_timer);
+        snprintf(connection->display_name, sizeof(connection->display_name), "%s",
+            event->message.as.hello.display_name);
+        RelayMessage welcome = { .type = RELAY_MESSAGE_WELCOME };
+        welcome.as.welcome.participant_id = connection->participant_id;
+        welcome.as.welcome.features = negotiated_features(event->message.as.hello.features);
+        if (!policy_send(NULL, connection->participant_id, &welcome))
+            (void)post_connection_command(connection, WORKER_COMMAND_CLOSE, NULL);
+        return;
+    }
+    if (event->kind == POLICY_EVENT_CHUNK) {
+        relay_policy_handle_chunk(policy, connection->participant_id, &event->chunk, now,
+            &effects);
+        return;
+    }
+    if (message_callback && event->message.type == RELAY_MESSAGE_CHAT_SEND)
+        message_callback(event->message.as.chat_send.text, connection->display_name);
+    relay_policy_handle(policy, connection->participant_id, &event->message, now, &effects);
+}
+
+static void drain_policy_events(void)
+{
+    ServerQueueNode* node = NULL;
+    while ((node = server_queue_pop(&policy_events)) != NULL) {
+        PolicyEvent* event = (PolicyEvent*)node;
+        process_policy_event(event);
+        shared_frame_release(event->frame);
+        buffer_pool_release(event, sizeof(*event));
+    }
+}
+
+static void process_worker_command(ServerShard* shard, WorkerCommand* command)
+{
+    if (command->kind == WORKER_COMMAND_ADOPT) {
+        if (!adopt_client(shard, command->socket_fd, command->connection_id,
+                command->ip_address)) {
+            closesocket(command->socket_fd);
+            PolicyEvent* event = acquire_zeroed(sizeof(*event));
+            if (event) {
+                event->kind = POLICY_EVENT_CLOSED;
+                event->connection_id = command->connection_id;
+                post_policy_event(event);
+            }
+        }
+        command->socket_fd = -1;
+        return;
+    }
+    ServerClient* client = client_by_connection(shard, command->connection_id);
+    if (!client)
+        return;
+    if (command->kind == WORKER_COMMAND_PURGE) {
+        purge_offer_frames(client, command->offer_id);
+        return;
+    }
+    if (command->kind == WORKER_COMMAND_CLOSE
+        || !queue_shared_frame(client, command->frame))
+        request_disconnect(client);
+}
+
+static void drain_worker_commands(ServerShard* shard)
+{
+    ServerQueueNode* node = NULL;
+    while ((node = server_queue_pop(&shard->commands)) != NULL) {
+        WorkerCommand* command = (WorkerCommand*)node;
+        process_worker_command(shard, command);
+        shared_frame_release(command->frame);
+        buffer_pool_release(command, sizeof(*command));
+    }
+}
+
+static void* worker_main(void* argument)
+{
+    ServerShard* shard = argument;
+    while (atomic_load(&shard->running)) {
+        struct epoll_event events[SERVER_EVENT_BATCH];
+        int ready = epoll_wait(shard->poller_fd, events, SERVER_EVENT_BATCH,
+            shard->paused_count > 0 ? SERVER_THROTTLE_RECHECK_MS : -1);
+        shard->pass++;
+        for (int i = 0; i < ready; ++i) {
+            if (events[i].data.fd == shard->wake.event_fd) {
+                server_wake_clear(&shard->wake);
+                continue;
+            }
+            ServerClient* client = client_by_socket(shard, events[i].data.fd);
+            if (!client)
+                continue;
+            client->peer_hung_up = (events[i].events & (EPOLLHUP | EPOLLERR)) != 0;
+            service_client(shard, client,
+                (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0);
+        }
+        drain_worker_commands(shard);
+        flush_pending_clients(shard);
+    }
+    return NULL;
+}
+
+static void poll_policy_events(int max_wait_ms)
+{
+    struct epoll_event events[SERVER_EVENT_BATCH];
+    int ready = epoll_wait(poller_fd, events, SERVER_EVENT_BATCH, poll_timeout(max_wait_ms));
+    for (int i = 0; i < ready; ++i) {
+        if (events[i].data.fd == server_fd)
+            accept_pending_clients();
+        else if (events[i].data.fd == policy_wake.event_fd)
+            server_wake_clear(&policy_wake);
+    }
+    drain_policy_events();
+    server_tick();
+}
+#else
+static void poll_policy_events(int max_wait_ms)
+{
+    (void)max_wait_ms;
+}
+#endif
+
+#ifdef RELAY_HAS_URING
+static uint64_t uring_user_data(uint64_t connection_id, unsigned operation)
+{
+    return connection_id << 2 | operation;
+}
+
+static uint8_t* uring_receive_buffer(const ServerClient* client)
+{
+    return uring_receive_area + (size_t)client->slab_index * SERVER_RECEIVE_CHUNK;
+}
+
+static void arm_uring_accept(void)
+{
+    struct io_uring_sqe* sqe = uring_get_sqe(&uring);
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = server_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = uring_user_data(0, URING_OP_ACCEPT);
+    uring_accept_armed = true;
+}
+
+static void arm_uring_receive(ServerClient* client)
+{
+    struct io_uring_sqe* sqe = uring_get_sqe(&uring);
+    if (!sqe)
+        return;
+    sqe->opcode = uring_fixed_buffers ? IORING_OP_READ_FIXED : IORING_OP_RECV;
+    sqe->fd = client->socket_fd;
+    sqe->addr = (uint64_t)(uintptr_t)uring_receive_buffer(client);
+    sqe->len = SERVER_RECEIVE_CHUNK;
+    if (uring_fixed_buffers)
+        sqe->buf_index = (uint16_t)client->slab_index;
+    sqe->user_data = uring_user_data(client->connection_id, URING_OP_RECEIVE);
+    client->receive_armed = true;
+}
+
+static void arm_uring_send(ServerClient* client)
+{
+    struct io_uring_sqe* sqe = uring_get_sqe(&uring);
+    if (!sqe)
+        return;
+    UringSendSlot* slot = &uring_send_slots[client->slab_index];
+    size_t count = 0;
+    size_t bytes = 0;
+    coalesce_outbound(client);
+    for (OutboundFrame* frame = client->outbound_head;
+        frame && frame->shared && count < SERVER_WRITE_BATCH && bytes < io_quantum;
+        frame = frame->next) {
+        slot->buffers[count].iov_base = frame->shared->bytes + frame->offset;
+        slot->buffers[count++].iov_len = frame->shared->length - frame->offset;
+        bytes += frame->shared->length - frame->offset;
+    }
+    memset(&slot->message, 0, sizeof(slot->message));
+    slot->message.msg_iov = slot->buffers;
+    slot->message.msg_iovlen = count;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = client->socket_fd;
+    sqe->addr = (uint64_t)(uintptr_t)&slot->message;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = uring_user_data(client->connection_id, URING_OP_SEND);
+    client->send_frames = count;
+    client->send_armed = true;
+}
+
+static void arm_uring_operations(void)
+{
+    if (!uring_accept_armed && !uring_stopping)
+        arm_uring_accept();
+    ServerShard* shard = &shards[0];
+    for (size_t i = 0; i < shard->client_count; ++i) {
+        ServerClient* client = shard->clients[i];
+        if (client->disconnect_requested)
+            continue;
+        retune_socket(client);
+        note_read_interest(client, !reads_paused(client));
+        if (!client->receive_armed && client->watching_reads)
+            arm_uring_receive(client);
+        if (client->send_armed || !client->outbound_head)
+            continue;
+        if (load_spooled_frame(client))
+            arm_uring_send(client);
+        else
+            request_disconnect(client);
+    }
+}
+
+static void complete_uring_accept(const struct io_uring_cqe* cqe)
+{
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+        uring_accept_armed = false;
+    if (cqe->res < 0)
+        return;
+    int accepted = cqe->res;
+    struct sockaddr_in address = { 0 };
+    socklen_t address_length = sizeof(address);
+    if (uring_stopping
+        || getpeername(accepted, (struct sockaddr*)&address, &address_length) != 0) {
+        closesocket(accepted);
+        return;
+    }
+    (void)register_accepted_socket(accepted, &address);
+}
+
+static void complete_uring_operation(const struct io_uring_cqe* cqe)
+{
+    unsigned operation = (unsigned)(cqe->user_data & 3u);
+    if (operation == URING_OP_ACCEPT) {
+        complete_uring_accept(cqe);
+        return;
+    }
+    ServerClient* client = client_by_connection(&shards[0], cqe->user_data >> 2);
+    if (!client)
+        return;
+    if (operation == URING_OP_RECEIVE) {
+        client->receive_armed = false;
+        if (cqe->res <= 0) {
+            request_disconnect(client);
+            return;
+        }
+        note_received(client, (size_t)cqe->res);
+        if (!client->disconnect_requested
+            && !protocol_decoder_feed_views(&client->decoder, uring_receive_buffer(client),
+                (size_t)cqe->res, handle_decoded_message, client))
+            request_disconnect(client);
+        account_decoder(client);
+        return;
+    }
+    client->send_armed = false;
+    if (cqe->res <= 0) {
+        request_disconnect(client);
+        return;
+    }
+    client->sent_bytes += (size_t)cqe->res;
+    consume_outbound(client, (size_t)cqe->res);
+}
+
+static void reap_uring_completions(void)
+{
+    struct io_uring_cqe* cqe = NULL;
+    while ((cqe = uring_peek_cqe(&uring)) != NULL) {
+        struct io_uring_cqe completion = *cqe;
+        uring_cqe_seen(&uring);
+        complete_uring_operation(&completion);
+    }
+}
+
+static bool retire_uring_clients(void)
+{
+    ServerShard* shard = &shards[0];
+    bool busy = false;
+    size_t index = 0;
+    while (index < shard->client_count) {
+        ServerClient* client = shard->clients[index];
+        if (!client->disconnect_requested) {
+            index++;
+            continue;
+        }
+        if (!client->receive_armed && !client->send_armed) {
+            remove_client(shard, index);
+            continue;
+        }
+        if (!client->shutdown_started) {
+            (void)shutdown(client->socket_fd, SHUT_RDWR);
+            client->shutdown_started = true;
         }
+        busy = true;
+        index++;
+    }
+    return busy;
+}
+
+static void poll_uring_events(int max_wait_ms)
+{
+    arm_uring_operations();
+    if (!uring_submit_and_wait(&uring, poll_timeout(max_wait_ms)))
+        return;
+    reap_uring_completions();
+    server_tick();
+    while (retire_uring_clients()) {
+        if (!uring_submit(&uring))
+            break;
+        if (!uring_peek_cqe(&uring))
+            break;
+        reap_uring_completions();
+    }
+}
+
+static bool start_uring(void)
+{
+    size_t capacity = shards[0].capacity;
+    uring_receive_area = calloc(capacity, SERVER_RECEIVE_CHUNK);
+    uring_send_slots = calloc(capacity, sizeof(*uring_send_slots));
+    struct iovec* buffers = calloc(capacity, sizeof(*buffers));
+    if (!uring_receive_area || !uring_send_slots || !buffers
+        || !uring_init(&uring, SERVER_URING_ENTRIES)) {
+        free(uring_receive_area);
+        free(uring_send_slots);
+        free(buffers);
+        uring_receive_area = NULL;
+        uring_send_slots = NULL;
+        return false;
+    }
+    for (size_t i = 0; i < capacity; ++i) {
+        buffers[i].iov_base = uring_receive_area + i * SERVER_RECEIVE_CHUNK;
+        buffers[i].iov_len = SERVER_RECEIVE_CHUNK;
+    }
+    uring_fixed_buffers = capacity <= UINT16_MAX
+        && uring_register_buffers(&uring, buffers, (unsigned)capacity);
+    free(buffers);
+    uring_accept_armed = false;
+    uring_stopping = false;
+    shards[0].poller_fd = -1;
+    return true;
+}
+
+static void stop_uring(void)
+{
+    if (!uring_mode)
+        return;
+    uring_stopping = true;
+    ServerShard* shard = &shards[0];
+    for (size_t i = 0; i < shard->client_count; ++i)
+        request_disconnect(shard->clients[i]);
+    for (int attempt = 0; attempt < 100 && retire_uring_clients(); ++attempt) {
+        if (!uring_submit_and_wait(&uring, 10))
+            break;
+        reap_uring_completions();
+    }
+    while (shard->client_count > 0)
+        remove_client(shard, shard->client_count - 1u);
+    uring_destroy(&uring);
+    free(uring_receive_area);
+    free(uring_send_slots);
+    uring_receive_area = NULL;
+    uring_send_slots = NULL;
+    shards[0].poller_fd = poller_fd;
+    uring_mode = false;
+}
+#endif
+
+void server_recv_msgs(void)
+{
+    if (!server_running || !policy)
+        return;
+    if (worker_mode) {
+        poll_policy_events(0);
+        return;
+    }
+#ifdef RELAY_HAS_URING
+    if (uring_mode) {
+        poll_uring_events(0);
+        return;
+    }
+#endif
+    server_tick();
+
+    ServerShard* shard = &shards[0];
+    shard->pass++;
+    size_t index = 0;
+    while (index < shard->client_count) {
+        ServerClient* client = shard->clients[index];
+        if (!flush_outbound(client))
+            request_disconnect(client);
+        receive_from_client(client);
         if (!client->disconnect_requested && !flush_outbound(client))
-            client->disconnect_requested = true;
+            request_disconnect(client);
         if (client->disconnect_requested) {
-            remove_client(index);
+            remove_client(shard, index);
             continue;
         }
         index++;
     }
 }
+
+void server_poll_events(int max_wait_ms)
+{
+    if (!server_running || !policy)
+        return;
+    if (worker_mode) {
+        poll_policy_events(max_wait_ms);
+        return;
+    }
+#ifdef RELAY_HAS_URING
+    if (uring_mode) {
+        poll_uring_events(max_wait_ms);
+        return;
+    }
+#endif
+    ServerShard* shard = &shards[0];
+    int timeout_ms = poll_timeout(max_wait_ms);
+#ifdef __linux__
+    struct epoll_event events[SERVER_EVENT_BATCH];
+    int ready = epoll_wait(poller_fd, events, SERVER_EVENT_BATCH, timeout_ms);
+    shard->pass++;
+    for (int i = 0; i < ready; ++i) {
+        if (events[i].data.fd == server_fd) {
+            accept_pending_clients();
+            continue;
+        }
+        ServerClient* client = client_by_socket(shard, events[i].data.fd);
+        if (!client)
+            continue;
+        client->peer_hung_up = (events[i].events & (EPOLLHUP | EPOLLERR)) != 0;
+        service_client(shard, client,
+            (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0);
+    }
+#else
+    fd_set readable;
+    fd_set writable;
+    FD_ZERO(&readable);
+    FD_ZERO(&writable);
+    FD_SET(server_fd, &readable);
+    int highest = server_fd;
+    for (size_t i = 0; i < shard->client_count; ++i) {
+        if (shard->clients[i]->watching_reads)
+            FD_SET(shard->clients[i]->socket_fd, &readable);
+        if (shard->clients[i]->outbound_head)
+            FD_SET(shard->clients[i]->socket_fd, &writable);
+        if (shard->clients[i]->socket_fd > highest)
+            highest = shard->clients[i]->socket_fd;
+    }
+    struct timeval timeout = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000
+    };
+    int ready = select(highest + 1, &readable, &writable, NULL, &timeout);
+    shard->pass++;
+    if (ready > 0) {
+        size_t index = shard->client_count;
+        while (index-- > 0) {
+            int socket_fd = shard->clients[index]->socket_fd;
+            if (FD_ISSET(socket_fd, &readable) || FD_ISSET(socket_fd, &writable))
+                service_client(shard, shard->clients[index],
+                    FD_ISSET(socket_fd, &readable) != 0);
+        }
+        if (FD_ISSET(server_fd, &readable))
+            accept_pending_clients();
+    }
+#endif
+    server_tick();
+    flush_pending_clients(shard);
+}
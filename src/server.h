@@ -1,19 +1,85 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include "relay_policy.h"
+
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #define MAX_CLIENTS 32
+#define SERVER_MAX_CLIENTS_LIMIT RELAY_POLICY_MAX_PARTICIPANTS_LIMIT
 #define PORT 8898
+#define SERVER_MAX_WORKERS 16
 
 typedef void (*server_msg_cb)(const char* message, const char* display_name);
 
+typedef enum {
+    SERVER_MEMORY_NORMAL,
+    SERVER_MEMORY_THROTTLING,
+    SERVER_MEMORY_REFUSING_OFFERS,
+    SERVER_MEMORY_SHEDDING
+} ServerMemoryPressure;
+
+typedef struct {
+    size_t budget_bytes;
+    size_t frame_bytes;
+    size_t decoder_bytes;
+    size_t peak_bytes;
+    ServerMemoryPressure pressure;
+    size_t throttled_reads;
+    size_t refused_offers;
+    size_t shed_deliveries;
+    size_t purged_frames;
+    size_t purged_bytes;
+} ServerMemoryStats;
+
+typedef struct {
+    size_t relayed_chunks;
+    size_t spliced_chunks;
+    size_t allocations;
+    size_t steady_allocations;
+    size_t rate_limited_messages;
+    size_t rate_limited_reads;
+    size_t refused_connections;
+    size_t notsent_lowat_bytes;
+    size_t tuned_socket_buffers;
+    size_t socket_buffer_bytes;
+    size_t largest_socket_buffer;
+    size_t socket_retunes;
+    size_t batched_frames;
+    size_t batches;
+} ServerStats;
+
+typedef struct {
+    uint16_t port;
+    int worker_count;
+    size_t max_clients;
+    bool use_io_uring;
+    uint64_t credit_window_bytes;
+    uint64_t straggler_lag_bytes;
+    const char* spool_directory;
+    size_t max_file_offers;
+    size_t max_offers_per_sender;
+    size_t io_quantum_bytes;
+    size_t control_weight;
+    size_t memory_budget_bytes;
+    size_t message_rate;
+    size_t message_burst;
+    size_t byte_rate;
+} ServerOptions;
+
 void server_set_msg_cb(server_msg_cb callback);
 bool init_server(void);
+bool init_server_with_options(const ServerOptions* options);
+const char* server_backend_name(void);
 void cleanup_server(void);
 bool is_server_running(void);
 int server_accept_client(void);
 void server_recv_msgs(void);
+void server_poll_events(int max_wait_ms);
 int get_client_count(void);
+void server_memory_stats(ServerMemoryStats* stats);
+void server_stats(ServerStats* stats);
 
 #endif
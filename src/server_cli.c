@@ -1,21 +1,14 @@
 #include "server.h"
 #include "platform.h"
+#include <errno.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
+#include <string.h>
 
-static volatile sig_atomic_t g_running = 1;
+#define SERVER_MAX_IDLE_WAIT_MS 1000
 
-static void idle_briefly(void)
-{
-#ifdef _WIN32
-    Sleep(20);
-#else
-    struct timespec interval = { .tv_sec = 0, .tv_nsec = 20 * 1000 * 1000 };
-    (void)nanosleep(&interval, NULL);
-#endif
-}
+static volatile sig_atomic_t g_running = 1;
 
 static void handle_signal(int sig)
 {
@@ -23,29 +16,169 @@ static void handle_signal(int sig)
     g_running = 0;
 }
 
-int main(void)
+static const char* pressure_name(ServerMemoryPressure pressure)
+{
+    switch (pressure) {
+    case SERVER_MEMORY_THROTTLING:
+        return "throttling senders";
+    case SERVER_MEMORY_REFUSING_OFFERS:
+        return "refusing new File Offers";
+    case SERVER_MEMORY_SHEDDING:
+        return "failing slowest Deliveries";
+    default:
+        return "normal";
+    }
+}
+
+static void print_memory_stats(const ServerMemoryStats* stats)
+{
+    printf("Memory %s: %zu frame + %zu decoder bytes of %zu (peak %zu); "
+           "%zu throttled reads, %zu refused offers, %zu shed deliveries, "
+           "%zu purged frames (%zu bytes)\n",
+        pressure_name(stats->pressure), stats->frame_bytes, stats->decoder_bytes,
+        stats->budget_bytes, stats->peak_bytes, stats->throttled_reads, stats->refused_offers,
+        stats->shed_deliveries, stats->purged_frames, stats->purged_bytes);
+    fflush(stdout);
+}
+
+static void print_usage(const char* program)
+{
+    fprintf(stderr,
+        "Usage: %s [--port N] [--workers N] [--io-uring] [--max-clients N] [--max-offers N]\n"
+        "       [--max-offers-per-sender N] [--credit-window BYTES] [--straggler-lag BYTES]\n"
+        "       [--spool-dir DIR] [--io-quantum BYTES] [--control-weight N]\n"
+        "       [--memory-budget BYTES] [--message-rate N] [--message-burst N]\n"
+        "       [--byte-rate BYTES]\n",
+        program);
+}
+
+static bool parse_number(
+    int argc, char** argv, int* index, unsigned long long max, unsigned long long* value)
+{
+    const char* option = argv[*index];
+    if (*index + 1 >= argc) {
+        fprintf(stderr, "%s needs a value\n", option);
+        return false;
+    }
+    const char* text = argv[++*index];
+    char* end = NULL;
+    errno = 0;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (text[0] < '0' || text[0] > '9' || *end != '\0' || errno == ERANGE || parsed > max) {
+        fprintf(stderr, "Invalid value for %s: %s (expected 0 to %llu)\n", option, text, max);
+        return false;
+    }
+    *value = parsed;
+    return true;
+}
+
+static bool parse_options(int argc, char** argv, ServerOptions* options)
+{
+    *options = (ServerOptions) { 0 };
+    for (int i = 1; i < argc; ++i) {
+        const char* option = argv[i];
+        unsigned long long value = 0;
+        if (strcmp(option, "--io-uring") == 0) {
+            options->use_io_uring = true;
+        } else if (strcmp(option, "--spool-dir") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "%s needs a value\n", option);
+                return false;
+            }
+            options->spool_directory = argv[++i];
+        } else if (strcmp(option, "--port") == 0) {
+            if (!parse_number(argc, argv, &i, UINT16_MAX, &value))
+                return false;
+            options->port = (uint16_t)value;
+        } else if (strcmp(option, "--workers") == 0) {
+            if (!parse_number(argc, argv, &i, SERVER_MAX_WORKERS, &value))
+                return false;
+            options->worker_count = (int)value;
+        } else if (strcmp(option, "--max-clients") == 0) {
+            if (!parse_number(argc, argv, &i, SERVER_MAX_CLIENTS_LIMIT, &value))
+                return false;
+            options->max_clients = (size_t)value;
+        } else if (strcmp(option, "--max-offers") == 0) {
+            if (!parse_number(argc, argv, &i, SIZE_MAX, &value))
+                return false;
+            options->max_file_offers = (size_t)value;
+        } else if (strcmp(option, "--max-offers-per-sender") == 0) {
+            if (!parse_number(argc, argv, &i, SIZE_MAX, &value))
+                return false;
+            options->max_offers_per_sender = (size_t)value;
+        } else if (strcmp(option, "--credit-window") == 0) {
+            if (!parse_number(argc, argv, &i, UINT64_MAX, &value))
+                return false;
+            options->credit_window_bytes = (uint64_t)value;
+        } else if (strcmp(option, "--straggler-lag") == 0) {
+            if (!parse_number(argc, argv, &i, UINT64_MAX, &value))
+                return false;
+            options->straggler_lag_bytes = (uint64_t)value;
+        } else if (strcmp(option, "--io-quantum") == 0) {
+            if (!parse_number(argc, argv, &i, SIZE_MAX, &value))
+                return false;
+            options->io_quantum_bytes = (size_t)value;
+        } else if (strcmp(option, "--control-weight") == 0) {
+            if (!parse_number(argc, argv, &i, SIZE_MAX, &value))
+                return false;
+            options->control_weight = (size_t)value;
+        } else if (strcmp(option, "--memory-budget") == 0) {
+            if (!parse_number(argc, argv, &i, SIZE_MAX, &value))
+                return false;
+            options->memory_budget_bytes = (size_t)value;
+        } else if (strcmp(option, "--message-rate") == 0) {
+            if (!parse_number(argc, argv, &i, SIZE_MAX, &value))
+                return false;
+            options->message_rate = (size_t)value;
+        } else if (strcmp(option, "--message-burst") == 0) {
+            if (!parse_number(argc, argv, &i, SIZE_MAX, &value))
+                return false;
+            options->message_burst = (size_t)value;
+        } else if (strcmp(option, "--byte-rate") == 0) {
+            if (!parse_number(argc, argv, &i, SIZE_MAX, &value))
+                return false;
+            options->byte_rate = (size_t)value;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", option);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
 {
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);
+#endif
 
     // No message callback - server runs silently, just relays messages
     server_set_msg_cb(NULL);
 
-    if (!init_server()) {
-        fprintf(stderr, "Failed to initialize server on port %d\n", PORT);
+    ServerOptions options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    int port = options.port > 0 ? options.port : PORT;
+    if (!init_server_with_options(&options)) {
+        fprintf(stderr, "Failed to initialize server on port %d\n", port);
         return EXIT_FAILURE;
     }
 
-    printf("Server running on port %d. Press Ctrl+C to stop.\n", PORT);
+    printf("Server running on port %d using %s. Press Ctrl+C to stop.\n", port,
+        server_backend_name());
     fflush(stdout);
 
     int prev_client_count = get_client_count();
+    ServerMemoryPressure prev_pressure = SERVER_MEMORY_NORMAL;
     printf("Entering main loop. g_running=%d\n", g_running);
     fflush(stdout);
 
     while (g_running) {
-        server_accept_client();
-        server_recv_msgs();
+        server_poll_events(SERVER_MAX_IDLE_WAIT_MS);
 
         int cur_client_count = get_client_count();
         if (cur_client_count != prev_client_count) {
@@ -55,9 +188,31 @@ int main(void)
             prev_client_count = cur_client_count;
         }
 
-        idle_briefly();
+        ServerMemoryStats stats;
+        server_memory_stats(&stats);
+        if (stats.pressure != prev_pressure) {
+            print_memory_stats(&stats);
+            prev_pressure = stats.pressure;
+        }
     }
 
+    ServerMemoryStats stats;
+    server_memory_stats(&stats);
+    print_memory_stats(&stats);
+    ServerStats counters;
+    server_stats(&counters);
+    printf("Allocator: %zu calls for %zu relayed chunks (%zu spliced), %zu after warm-up\n",
+        counters.allocations, counters.relayed_chunks, counters.spliced_chunks,
+        counters.steady_allocations);
+    printf("Admission: %zu rate-limited messages, %zu rate-limited reads, %zu refused connections\n",
+        counters.rate_limited_messages, counters.rate_limited_reads,
+        counters.refused_connections);
+    printf("Sockets: %zu KB unsent low-water mark, %zu tuned buffers holding %zu bytes "
+           "(largest %zu), %zu resizes\n",
+        counters.notsent_lowat_bytes / 1024u, counters.tuned_socket_buffers,
+        counters.socket_buffer_bytes, counters.largest_socket_buffer, counters.socket_retunes);
+    printf("Batching: %zu small frames coalesced into %zu batches\n", counters.batched_frames,
+        counters.batches);
     printf("Shutting down server...\n");
     fflush(stdout);
     cleanup_server();
@@ -0,0 +1,122 @@
+#include "spool.h"
+
+#ifdef RELAY_HAS_SPOOL
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SPOOL_PATH_MAX 512u
+
+bool spool_open(Spool* spool, const char* directory)
+{
+    struct stat status;
+    memset(spool, 0, sizeof(*spool));
+    if (!directory || stat(directory, &status) != 0 || !S_ISDIR(status.st_mode))
+        return false;
+    spool->directory = strdup(directory);
+    if (!spool->directory || !id_map_init(&spool->files_by_offer, 16)) {
+        free(spool->directory);
+        spool->directory = NULL;
+        return false;
+    }
+    return true;
+}
+
+void spool_close(Spool* spool)
+{
+    if (!spool->directory)
+        return;
+    id_map_destroy(&spool->files_by_offer);
+    free(spool->directory);
+    spool->directory = NULL;
+}
+
+bool spool_is_open(const Spool* spool)
+{
+    return spool->directory != NULL;
+}
+
+SpoolFile* spool_file_for_offer(Spool* spool, uint64_t offer_id)
+{
+    SpoolFile* file = id_map_get(&spool->files_by_offer, offer_id);
+    if (file)
+        return file;
+    char path[SPOOL_PATH_MAX];
+    int written = snprintf(path, sizeof(path), "%s/relay-spool-XXXXXX", spool->directory);
+    if (written < 0 || (size_t)written >= sizeof(path))
+        return NULL;
+    file = calloc(1, sizeof(*file));
+    if (!file)
+        return NULL;
+    file->fd = mkstemp(path);
+    if (file->fd == -1) {
+        free(file);
+        return NULL;
+    }
+    (void)unlink(path);
+    file->offer_id = offer_id;
+    if (!id_map_put(&spool->files_by_offer, offer_id, file)) {
+        close(file->fd);
+        free(file);
+        return NULL;
+    }
+    return file;
+}
+
+void spool_file_retain(SpoolFile* file)
+{
+    file->references++;
+}
+
+void spool_file_close_if_idle(Spool* spool, SpoolFile* file)
+{
+    if (!file || file->references > 0)
+        return;
+    (void)id_map_remove(&spool->files_by_offer, file->offer_id);
+    close(file->fd);
+    free(file);
+}
+
+void spool_file_release(Spool* spool, SpoolFile* file)
+{
+    if (!file)
+        return;
+    file->references--;
+    spool_file_close_if_idle(spool, file);
+}
+
+bool spool_file_append(SpoolFile* file, const uint8_t* bytes, size_t length, uint64_t* offset)
+{
+    size_t written = 0;
+    while (written < length) {
+        ssize_t count = pwrite(file->fd, bytes + written, length - written,
+            (off_t)(file->length + written));
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        written += (size_t)count;
+    }
+    *offset = file->length;
+    file->length += length;
+    return true;
+}
+
+bool spool_file_read(const SpoolFile* file, uint64_t offset, uint8_t* bytes, size_t length)
+{
+    size_t loaded = 0;
+    while (loaded < length) {
+        ssize_t count = pread(file->fd, bytes + loaded, length - loaded,
+            (off_t)(offset + loaded));
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        loaded += (size_t)count;
+    }
+    return true;
+}
+#endif
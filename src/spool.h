@@ -0,0 +1,38 @@
+#ifndef RELAY_SPOOL_H
+#define RELAY_SPOOL_H
+
+#include "id_map.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    size_t references;
+    int fd;
+    uint64_t offer_id;
+    uint64_t length;
+} SpoolFile;
+
+#ifndef _WIN32
+#define RELAY_HAS_SPOOL 1
+
+typedef struct {
+    char* directory;
+    IdMap files_by_offer;
+} Spool;
+
+bool spool_open(Spool* spool, const char* directory);
+void spool_close(Spool* spool);
+bool spool_is_open(const Spool* spool);
+
+/* Files are unlinked as soon as they are created and close once nothing references them. */
+SpoolFile* spool_file_for_offer(Spool* spool, uint64_t offer_id);
+void spool_file_retain(SpoolFile* file);
+void spool_file_release(Spool* spool, SpoolFile* file);
+void spool_file_close_if_idle(Spool* spool, SpoolFile* file);
+bool spool_file_append(SpoolFile* file, const uint8_t* bytes, size_t length, uint64_t* offset);
+bool spool_file_read(const SpoolFile* file, uint64_t offset, uint8_t* bytes, size_t length);
+#endif
+
+#endif
@@ -0,0 +1,116 @@
+#include "buffer_pool.h"
+#include "protocol.h"
+#include "unity.h"
+
+#include <stdint.h>
+#include <string.h>
+
+void setUp(void)
+{
+    buffer_pool_trim();
+}
+
+void tearDown(void)
+{
+    buffer_pool_trim();
+}
+
+void test_reuses_released_buffers_within_a_size_class(void)
+{
+    BufferPoolStats before;
+    BufferPoolStats after;
+    buffer_pool_stats(&before);
+    TEST_ASSERT_EQUAL_size_t(0, before.idle_bytes);
+
+    uint8_t* small = buffer_pool_acquire(40);
+    TEST_ASSERT_NOT_NULL(small);
+    memset(small, 0xab, 64);
+    buffer_pool_release(small, 40);
+    uint8_t* again = buffer_pool_acquire(64);
+    TEST_ASSERT_EQUAL_PTR(small, again);
+    uint8_t* larger = buffer_pool_acquire(65);
+    TEST_ASSERT_NOT_NULL(larger);
+    TEST_ASSERT_TRUE(larger != again);
+    buffer_pool_release(again, 64);
+    buffer_pool_release(larger, 65);
+
+    buffer_pool_stats(&after);
+    TEST_ASSERT_EQUAL_size_t(2, after.system_allocations - before.system_allocations);
+    TEST_ASSERT_EQUAL_size_t(1, after.reuses - before.reuses);
+    TEST_ASSERT_EQUAL_size_t(64u + 256u, after.idle_bytes);
+    TEST_ASSERT_NULL(buffer_pool_acquire(0));
+}
+
+void test_chunk_buffers_reach_a_steady_state_without_allocating(void)
+{
+    uint8_t* chunks[4];
+    for (size_t i = 0; i < 4u; ++i) {
+        chunks[i] = buffer_pool_acquire(PROTOCOL_FILE_CHUNK_MAX);
+        TEST_ASSERT_NOT_NULL(chunks[i]);
+        chunks[i][PROTOCOL_FRAME_CAPACITY - 1u] = (uint8_t)i;
+    }
+    for (size_t i = 0; i < 4u; ++i)
+        buffer_pool_release(chunks[i], PROTOCOL_FILE_CHUNK_MAX);
+
+    BufferPoolStats warm;
+    buffer_pool_stats(&warm);
+    for (size_t round = 0; round < 100u; ++round) {
+        uint8_t* frame = buffer_pool_acquire(PROTOCOL_FRAME_CAPACITY);
+        uint8_t* data = buffer_pool_acquire(PROTOCOL_FILE_CHUNK_MAX);
+        TEST_ASSERT_NOT_NULL(frame);
+        TEST_ASSERT_NOT_NULL(data);
+        buffer_pool_release(data, PROTOCOL_FILE_CHUNK_MAX);
+        buffer_pool_release(frame, PROTOCOL_FRAME_CAPACITY);
+    }
+    BufferPoolStats steady;
+    buffer_pool_stats(&steady);
+    TEST_ASSERT_EQUAL_size_t(warm.system_allocations, steady.system_allocations);
+    TEST_ASSERT_EQUAL_size_t(200, steady.reuses - warm.reuses);
+
+    uint8_t* oversized = buffer_pool_acquire(PROTOCOL_FRAME_CAPACITY + 1u);
+    TEST_ASSERT_NOT_NULL(oversized);
+    buffer_pool_release(oversized, PROTOCOL_FRAME_CAPACITY + 1u);
+    buffer_pool_stats(&steady);
+    TEST_ASSERT_EQUAL_size_t(4u * PROTOCOL_FRAME_CAPACITY, steady.idle_bytes);
+    buffer_pool_trim();
+    buffer_pool_stats(&steady);
+    TEST_ASSERT_EQUAL_size_t(0, steady.idle_bytes);
+}
+
+void test_idle_bytes_are_capped_across_all_size_classes(void)
+{
+    enum { BLOCKS = 24 };
+    uint8_t* frames[BLOCKS];
+    uint8_t* windows[BLOCKS];
+    for (size_t i = 0; i < BLOCKS; ++i) {
+        frames[i] = buffer_pool_acquire(PROTOCOL_FRAME_CAPACITY);
+        windows[i] = buffer_pool_acquire(262144u);
+        TEST_ASSERT_NOT_NULL(frames[i]);
+        TEST_ASSERT_NOT_NULL(windows[i]);
+    }
+    for (size_t i = 0; i < BLOCKS; ++i) {
+        buffer_pool_release(frames[i], PROTOCOL_FRAME_CAPACITY);
+        buffer_pool_release(windows[i], 262144u);
+    }
+    BufferPoolStats stats;
+    buffer_pool_stats(&stats);
+    TEST_ASSERT_LESS_OR_EQUAL_size_t(BUFFER_POOL_IDLE_BYTES, stats.idle_bytes);
+    TEST_ASSERT_GREATER_THAN_size_t(BUFFER_POOL_IDLE_BYTES - PROTOCOL_FRAME_CAPACITY,
+        stats.idle_bytes);
+
+    size_t before = stats.reuses;
+    uint8_t* small = buffer_pool_acquire(64);
+    buffer_pool_release(small, 64);
+    buffer_pool_stats(&stats);
+    TEST_ASSERT_LESS_OR_EQUAL_size_t(BUFFER_POOL_IDLE_BYTES, stats.idle_bytes);
+    TEST_ASSERT_EQUAL_size_t(before, stats.reuses);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_reuses_released_buffers_within_a_size_class);
+    RUN_TEST(test_chunk_buffers_reach_a_steady_state_without_allocating);
+    RUN_TEST(test_idle_bytes_are_capped_across_all_size_classes);
+    return UNITY_END();
+}
@@ -1,5 +1,6 @@
 #include "platform.h"
 
+#include "buffer_pool.h"
 #include "client_network.h"
 #include "protocol.h"
 #include "unity.h"
@@ -18,8 +19,18 @@ typedef struct {
     atomic_bool failed;
     atomic_bool saw_hello;
     atomic_bool saw_chat;
+    atomic_bool chat_out_of_order;
+    atomic_uint chat_count;
+    atomic_uint chunk_count;
+    atomic_bool chunk_corrupt;
+    uint64_t chunk_bytes;
     char hello_name[PROTOCOL_DISPLAY_NAME_MAX + 1u];
+    uint32_t hello_features;
     char chat_text[PROTOCOL_CHAT_MAX + 1u];
+    atomic_bool hold_reads;
+    RelayMessageType arrivals[64];
+    uint64_t arrival_offers[64];
+    atomic_size_t arrival_count;
 } FakeServer;
 
 typedef struct {
@@ -65,13 +76,41 @@ static void capture_client_message(void* context, const RelayMessage* message)
 static void capture_server_message(void* context, const RelayMessage* message)
 {
     FakeServer* fake = context;
+    size_t arrival = atomic_load(&fake->arrival_count);
+    if (arrival < 64u) {
+        fake->arrivals[arrival] = message->type;
+        fake->arrival_offers[arrival] = 0;
+        if (message->type == RELAY_MESSAGE_FILE_CHUNK)
+            fake->arrival_offers[arrival] = message->as.file_chunk.offer_id;
+        else if (message->type == RELAY_MESSAGE_FILE_TRANSFER_END)
+            fake->arrival_offers[arrival] = message->as.file_transfer_end.offer_id;
+        else if (message->type == RELAY_MESSAGE_FILE_TRANSFER_CANCEL)
+            fake->arrival_offers[arrival] = message->as.file_transfer_cancel.offer_id;
+        atomic_store(&fake->arrival_count, arrival + 1u);
+    }
     if (message->type == RELAY_MESSAGE_HELLO) {
         snprintf(fake->hello_name, sizeof(fake->hello_name), "%s",
             message->as.hello.display_name);
+        fake->hello_features = message->as.hello.features;
         atomic_store(&fake->saw_hello, true);
     } else if (message->type == RELAY_MESSAGE_CHAT_SEND) {
         snprintf(fake->chat_text, sizeof(fake->chat_text), "%s", message->as.chat_send.text);
+        char expected[32];
+        snprintf(expected, sizeof(expected), "burst %u", atomic_load(&fake->chat_count));
+        if (strncmp(message->as.chat_send.text, "burst ", 6) == 0
+            && strcmp(message->as.chat_send.text, expected) != 0)
+            atomic_store(&fake->chat_out_of_order, true);
+        atomic_fetch_add(&fake->chat_count, 1u);
         atomic_store(&fake->saw_chat, true);
+    } else if (message->type == RELAY_MESSAGE_FILE_CHUNK) {
+        if (message->as.file_chunk.offset != fake->chunk_bytes)
+            atomic_store(&fake->chunk_corrupt, true);
+        for (uint32_t i = 0; i < message->as.file_chunk.data_length; ++i) {
+            if (message->as.file_chunk.data[i] != (uint8_t)(fake->chunk_bytes + i))
+                atomic_store(&fake->chunk_corrupt, true);
+        }
+        fake->chunk_bytes += message->as.file_chunk.data_length;
+        atomic_fetch_add(&fake->chunk_count, 1u);
     }
 }
 
@@ -79,6 +118,7 @@ static bool send_server_messages(int socket_fd)
 {
     RelayMessage welcome = { .type = RELAY_MESSAGE_WELCOME };
     welcome.as.welcome.participant_id = 77;
+    welcome.as.welcome.features = PROTOCOL_FEATURE_BATCH | (1u << 31);
     RelayMessage chat = { .type = RELAY_MESSAGE_CHAT_DELIVER };
     chat.as.chat_deliver.participant_id = 88;
     snprintf(chat.as.chat_deliver.display_name, sizeof(chat.as.chat_deliver.display_name),
@@ -103,6 +143,16 @@ static bool send_server_messages(int socket_fd)
     return sent;
 }
 
+static void wait_one_millisecond(void)
+{
+#ifdef _WIN32
+    Sleep(1);
+#else
+    struct timespec interval = { .tv_sec = 0, .tv_nsec = 1000 * 1000 };
+    (void)nanosleep(&interval, NULL);
+#endif
+}
+
 static void* fake_server_main(void* argument)
 {
     FakeServer* fake = argument;
@@ -116,7 +166,11 @@ static void* fake_server_main(void* argument)
     ProtocolDecoder decoder;
     protocol_decoder_init(&decoder);
     bool sent_responses = false;
-    while (!atomic_load(&fake->stop) && !atomic_load(&fake->saw_chat)) {
+    while (!atomic_load(&fake->stop)) {
+        if (atomic_load(&fake->hold_reads)) {
+            wait_one_millisecond();
+            continue;
+        }
         uint8_t buffer[4096];
 #ifdef _WIN32
         int received = recv(client, (char*)buffer, sizeof(buffer), 0);
@@ -143,16 +197,6 @@ static void* fake_server_main(void* argument)
     return NULL;
 }
 
-static void wait_one_millisecond(void)
-{
-#ifdef _WIN32
-    Sleep(1);
-#else
-    struct timespec interval = { .tv_sec = 0, .tv_nsec = 1000 * 1000 };
-    (void)nanosleep(&interval, NULL);
-#endif
-}
-
 void setUp(void)
 {
     memset(&server, 0, sizeof(server));
@@ -173,6 +217,12 @@ void setUp(void)
     atomic_init(&server.failed, false);
     atomic_init(&server.saw_hello, false);
     atomic_init(&server.saw_chat, false);
+    atomic_init(&server.chat_out_of_order, false);
+    atomic_init(&server.chat_count, 0u);
+    atomic_init(&server.chunk_count, 0u);
+    atomic_init(&server.chunk_corrupt, false);
+    atomic_init(&server.hold_reads, false);
+    atomic_init(&server.arrival_count, 0u);
     TEST_ASSERT_EQUAL_INT(0, pthread_create(&server.thread, NULL, fake_server_main, &server));
     connection = client_connection_create();
     TEST_ASSERT_NOT_NULL(connection);
@@ -199,9 +249,11 @@ void test_connection_owns_handshake_queue_incremental_decode_and_shutdown(void)
     TEST_ASSERT_FALSE(atomic_load(&server.failed));
     TEST_ASSERT_TRUE(atomic_load(&server.saw_hello));
     TEST_ASSERT_EQUAL_STRING("Alice", server.hello_name);
+    TEST_ASSERT_EQUAL_UINT32(PROTOCOL_FEATURES_SUPPORTED, server.hello_features);
     TEST_ASSERT_TRUE(captured.welcomed);
     TEST_ASSERT_TRUE(captured.received_chat);
     TEST_ASSERT_EQUAL_UINT64(77, client_connection_participant_id(connection));
+    TEST_ASSERT_EQUAL_UINT32(PROTOCOL_FEATURE_BATCH, client_connection_features(connection));
     TEST_ASSERT_EQUAL_STRING("Server peer", captured.sender);
     TEST_ASSERT_EQUAL_STRING("hello from Relay", captured.text);
 
@@ -213,15 +265,139 @@ void test_connection_owns_handshake_queue_incremental_decode_and_shutdown(void)
 
     disconnect_from_server(connection);
     TEST_ASSERT_FALSE(client_connection_is_connected(connection));
+    TEST_ASSERT_EQUAL_UINT32(0, client_connection_features(connection));
     TEST_ASSERT_EQUAL(RELAY_SEND_CLOSED, client_connection_send_chat(connection, "too late"));
 }
 
+void test_chat_burst_is_flushed_in_order(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, connect_to_server(connection, "127.0.0.1", port_text, "Alice"));
+    const unsigned burst = 500u;
+    for (unsigned i = 0; i < burst; ++i) {
+        char text[32];
+        snprintf(text, sizeof(text), "burst %u", i);
+        TEST_ASSERT_EQUAL(RELAY_SEND_OK, client_connection_send_chat(connection, text));
+    }
+    for (unsigned attempt = 0; attempt < 2000u && atomic_load(&server.chat_count) < burst;
+        ++attempt)
+        wait_one_millisecond();
+    TEST_ASSERT_FALSE(atomic_load(&server.failed));
+    TEST_ASSERT_EQUAL_UINT(burst, atomic_load(&server.chat_count));
+    TEST_ASSERT_FALSE(atomic_load(&server.chat_out_of_order));
+    TEST_ASSERT_EQUAL_STRING("burst 499", server.chat_text);
+    disconnect_from_server(connection);
+}
+
+static void send_patterned_chunk(uint64_t offer_id, uint64_t offset, uint32_t chunk_size)
+{
+    uint8_t* data = buffer_pool_acquire(chunk_size);
+    TEST_ASSERT_NOT_NULL(data);
+    for (uint32_t byte = 0; byte < chunk_size; ++byte)
+        data[byte] = (uint8_t)(offset + byte);
+    RelayMessage chunk = { .type = RELAY_MESSAGE_FILE_CHUNK };
+    chunk.as.file_chunk.offer_id = offer_id;
+    chunk.as.file_chunk.offset = offset;
+    chunk.as.file_chunk.data = data;
+    chunk.as.file_chunk.data_length = chunk_size;
+    TEST_ASSERT_EQUAL(RELAY_SEND_OK, client_connection_send_chunk(connection, &chunk, chunk_size));
+}
+
+static size_t arrival_index(RelayMessageType type, uint64_t offer_id)
+{
+    for (size_t i = 0; i < atomic_load(&server.arrival_count); ++i) {
+        if (server.arrivals[i] == type && server.arrival_offers[i] == offer_id)
+            return i;
+    }
+    TEST_FAIL_MESSAGE("frame never arrived");
+    return 0;
+}
+
+void test_chunks_are_sent_from_the_caller_buffer_without_copying(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, connect_to_server(connection, "127.0.0.1", port_text, "Alice"));
+    const unsigned chunks = 40u;
+    const uint32_t chunk_size = 64u * 1024u;
+    for (unsigned i = 0; i < chunks; ++i) {
+        send_patterned_chunk(9, (uint64_t)i * chunk_size, chunk_size);
+        if (i % 10u == 0)
+            TEST_ASSERT_EQUAL(RELAY_SEND_OK, client_connection_send_chat(connection, "between"));
+    }
+    for (unsigned attempt = 0; attempt < 2000u && atomic_load(&server.chunk_count) < chunks;
+        ++attempt)
+        wait_one_millisecond();
+    TEST_ASSERT_FALSE(atomic_load(&server.failed));
+    TEST_ASSERT_EQUAL_UINT(chunks, atomic_load(&server.chunk_count));
+    TEST_ASSERT_FALSE(atomic_load(&server.chunk_corrupt));
+    TEST_ASSERT_EQUAL_UINT(4, atomic_load(&server.chat_count));
+    disconnect_from_server(connection);
+}
+
+void test_control_frames_overtake_queued_chunks_and_purge_drops_an_offer(void)
+{
+    atomic_store(&server.hold_reads, true);
+    TEST_ASSERT_EQUAL_INT(0, connect_to_server(connection, "127.0.0.1", port_text, "Alice"));
+    const unsigned chunks = 24u;
+    const uint32_t chunk_size = PROTOCOL_FILE_CHUNK_MAX;
+    for (unsigned i = 0; i < chunks; ++i)
+        send_patterned_chunk(5, (uint64_t)i * chunk_size, chunk_size);
+    for (unsigned i = 0; i < 4u; ++i)
+        send_patterned_chunk(7, (uint64_t)i * chunk_size, chunk_size);
+    TEST_ASSERT_EQUAL(RELAY_SEND_OK, client_connection_send_chat(connection, "overtake"));
+    RelayMessage cancel = { .type = RELAY_MESSAGE_FILE_TRANSFER_CANCEL };
+    cancel.as.file_transfer_cancel.offer_id = 5;
+    snprintf(cancel.as.file_transfer_cancel.reason,
+        sizeof(cancel.as.file_transfer_cancel.reason), "stopped");
+    TEST_ASSERT_EQUAL(RELAY_SEND_OK, client_connection_send(connection, &cancel));
+    TEST_ASSERT_EQUAL_size_t(4, client_connection_purge_offer(connection, 7));
+    cancel.as.file_transfer_cancel.offer_id = 7;
+    TEST_ASSERT_EQUAL(RELAY_SEND_OK, client_connection_send(connection, &cancel));
+    RelayMessage end = { .type = RELAY_MESSAGE_FILE_TRANSFER_END };
+    end.as.file_transfer_end.offer_id = 9;
+    end.as.file_transfer_end.total_size = 1;
+    TEST_ASSERT_EQUAL(RELAY_SEND_OK, client_connection_send(connection, &end));
+    TEST_ASSERT_EQUAL(RELAY_SEND_OK, client_connection_send_chat(connection, "last"));
+    atomic_store(&server.hold_reads, false);
+
+    for (unsigned attempt = 0; attempt < 5000u && atomic_load(&server.chunk_count) < chunks;
+        ++attempt)
+        wait_one_millisecond();
+    for (unsigned attempt = 0; attempt < 2000u && atomic_load(&server.arrival_count) < chunks + 6u;
+        ++attempt)
+        wait_one_millisecond();
+    TEST_ASSERT_FALSE(atomic_load(&server.failed));
+    TEST_ASSERT_FALSE(atomic_load(&server.chunk_corrupt));
+    TEST_ASSERT_EQUAL_UINT(chunks, atomic_load(&server.chunk_count));
+    TEST_ASSERT_EQUAL_size_t(chunks + 6u, atomic_load(&server.arrival_count));
+    TEST_ASSERT_EQUAL(RELAY_MESSAGE_HELLO, server.arrivals[0]);
+    size_t last_chunk = 0;
+    for (size_t i = 0; i < atomic_load(&server.arrival_count); ++i) {
+        if (server.arrivals[i] == RELAY_MESSAGE_FILE_CHUNK)
+            last_chunk = i;
+    }
+    TEST_ASSERT_EQUAL_UINT(2, atomic_load(&server.chat_count));
+    TEST_ASSERT_EQUAL_STRING("last", server.chat_text);
+    size_t cancel_own = arrival_index(RELAY_MESSAGE_FILE_TRANSFER_CANCEL, 5);
+    size_t cancel_purged = arrival_index(RELAY_MESSAGE_FILE_TRANSFER_CANCEL, 7);
+    size_t end_index = arrival_index(RELAY_MESSAGE_FILE_TRANSFER_END, 9);
+    TEST_ASSERT_LESS_THAN_size_t(last_chunk, cancel_purged);
+    TEST_ASSERT_GREATER_THAN_size_t(last_chunk, cancel_own);
+    TEST_ASSERT_GREATER_THAN_size_t(cancel_own, end_index);
+    for (size_t i = 0; i < atomic_load(&server.arrival_count); ++i) {
+        if (server.arrivals[i] == RELAY_MESSAGE_CHAT_SEND)
+            TEST_ASSERT_LESS_THAN_size_t(last_chunk, i);
+    }
+    disconnect_from_server(connection);
+}
+
 int main(void)
 {
     if (init_network() != 0)
         return 1;
     UNITY_BEGIN();
     RUN_TEST(test_connection_owns_handshake_queue_incremental_decode_and_shutdown);
+    RUN_TEST(test_chat_burst_is_flushed_in_order);
+    RUN_TEST(test_chunks_are_sent_from_the_caller_buffer_without_copying);
+    RUN_TEST(test_control_frames_overtake_queued_chunks_and_purge_drops_an_offer);
     int result = UNITY_END();
     cleanup_network();
     return result;
@@ -15,6 +15,8 @@ typedef struct {
     bool connected;
     bool backpressure_chunk_once;
     bool backpressure_control_once;
+    uint64_t purged_offer;
+    size_t purge_count;
 } FakeTransport;
 
 static char test_directory[] = "/tmp/relay-file-transfer-XXXXXX";
@@ -63,6 +65,13 @@ static bool fake_connected(void* context)
     return ((FakeTransport*)context)->connected;
 }
 
+static void fake_purge(void* context, uint64_t offer_id)
+{
+    FakeTransport* state = context;
+    state->purged_offer = offer_id;
+    state->purge_count++;
+}
+
 static void capture_notice(void* context, const char* message)
 {
     (void)context;
@@ -95,6 +104,15 @@ static void write_source(const char* path, const uint8_t* bytes, size_t length)
     TEST_ASSERT_EQUAL_INT(0, fclose(file));
 }
 
+static void grant_credit(uint64_t offer_id, uint64_t credit_limit, uint64_t delivered_bytes)
+{
+    RelayMessage credit = { .type = RELAY_MESSAGE_FILE_TRANSFER_CREDIT };
+    credit.as.file_transfer_credit.offer_id = offer_id;
+    credit.as.file_transfer_credit.credit_limit = credit_limit;
+    credit.as.file_transfer_credit.delivered_bytes = delivered_bytes;
+    file_transfer_handle_message(module, &transport, &credit);
+}
+
 void setUp(void)
 {
     strcpy(test_directory, "/tmp/relay-file-transfer-XXXXXX");
@@ -104,6 +122,7 @@ void setUp(void)
     transport.context = &fake;
     transport.send = fake_send;
     transport.connected = fake_connected;
+    transport.purge = fake_purge;
     last_notice[0] = '\0';
     module = file_transfer_create(test_directory, capture_notice, NULL);
     TEST_ASSERT_NOT_NULL(module);
@@ -140,6 +159,7 @@ void test_outgoing_file_is_streamed_once_then_waits_for_each_delivery(void)
     ready.as.file_transfer_ready.recipient_count = 2;
     file_transfer_handle_message(module, &transport, &ready);
     TEST_ASSERT_EQUAL_size_t(1, file_transfer_active_count(module));
+    grant_credit(42, sizeof(contents), 0);
 
     file_transfer_pump(module, &transport);
     TEST_ASSERT_EQUAL_size_t(3, fake.count);
@@ -185,6 +205,10 @@ void test_incoming_file_is_published_only_after_complete_delivery(void)
     chunk.as.file_chunk.data_length = sizeof(bytes);
     file_transfer_handle_message(module, &transport, &chunk);
     TEST_ASSERT_EQUAL_size_t(0, file_transfer_received_count(module));
+    TEST_ASSERT_EQUAL(RELAY_MESSAGE_FILE_DELIVERY_PROGRESS,
+        fake.messages[fake.count - 1u].type);
+    TEST_ASSERT_EQUAL_UINT64(sizeof(bytes),
+        fake.messages[fake.count - 1u].as.file_delivery_progress.written_bytes);
 
     RelayMessage end = { .type = RELAY_MESSAGE_FILE_TRANSFER_END };
     end.as.file_transfer_end.offer_id = 81;
@@ -250,6 +274,7 @@ void test_backpressure_retries_same_chunk_without_advancing_progress(void)
     ready.as.file_transfer_ready.offer_id = 101;
     ready.as.file_transfer_ready.recipient_count = 1;
     file_transfer_handle_message(module, &transport, &ready);
+    grant_credit(101, sizeof(contents), 0);
 
     fake.backpressure_chunk_once = true;
     file_transfer_pump(module, &transport);
@@ -264,6 +289,74 @@ void test_backpressure_retries_same_chunk_without_advancing_progress(void)
     TEST_ASSERT_EQUAL_MEMORY(contents, fake.messages[1].as.file_chunk.data, sizeof(contents));
 }
 
+void test_sender_waits_for_credit_and_reports_delivered_progress(void)
+{
+    const uint8_t contents[] = { 1, 2, 3 };
+    char source[1024];
+    snprintf(source, sizeof(source), "%s/paced.bin", test_directory);
+    write_source(source, contents, sizeof(contents));
+    TEST_ASSERT_TRUE(file_transfer_offer_file(module, &transport, source));
+    uint64_t request_id = fake.messages[0].as.file_offer_create.request_id;
+
+    RelayMessage created = { .type = RELAY_MESSAGE_FILE_OFFER_CREATED };
+    created.as.file_offer_created.request_id = request_id;
+    created.as.file_offer_created.offer_id = 105;
+    file_transfer_handle_message(module, &transport, &created);
+    RelayMessage ready = { .type = RELAY_MESSAGE_FILE_TRANSFER_READY };
+    ready.as.file_transfer_ready.offer_id = 105;
+    ready.as.file_transfer_ready.recipient_count = 1;
+    file_transfer_handle_message(module, &transport, &ready);
+
+    file_transfer_pump(module, &transport);
+    TEST_ASSERT_EQUAL_size_t(1, fake.count);
+
+    grant_credit(105, 2, 0);
+    file_transfer_pump(module, &transport);
+    TEST_ASSERT_EQUAL_size_t(2, fake.count);
+    TEST_ASSERT_EQUAL_UINT32(2, fake.messages[1].as.file_chunk.data_length);
+
+    grant_credit(105, 3, 2);
+    FileTransferProgress progress;
+    TEST_ASSERT_TRUE(file_transfer_progress(module, 0, &progress));
+    TEST_ASSERT_EQUAL_UINT64(2, progress.transferred_size);
+    file_transfer_pump(module, &transport);
+    TEST_ASSERT_EQUAL_size_t(4, fake.count);
+    TEST_ASSERT_EQUAL_UINT64(2, fake.messages[2].as.file_chunk.offset);
+    TEST_ASSERT_EQUAL_MEMORY(&contents[2], fake.messages[2].as.file_chunk.data, 1);
+    TEST_ASSERT_EQUAL(RELAY_MESSAGE_FILE_TRANSFER_END, fake.messages[3].type);
+}
+
+void test_cancelled_offer_purges_its_queued_frames(void)
+{
+    const uint8_t contents[] = { 6, 7, 8, 9 };
+    char source[1024];
+    snprintf(source, sizeof(source), "%s/cancelled.bin", test_directory);
+    write_source(source, contents, sizeof(contents));
+    TEST_ASSERT_TRUE(file_transfer_offer_file(module, &transport, source));
+    uint64_t request_id = fake.messages[0].as.file_offer_create.request_id;
+
+    RelayMessage created = { .type = RELAY_MESSAGE_FILE_OFFER_CREATED };
+    created.as.file_offer_created.request_id = request_id;
+    created.as.file_offer_created.offer_id = 108;
+    file_transfer_handle_message(module, &transport, &created);
+    RelayMessage ready = { .type = RELAY_MESSAGE_FILE_TRANSFER_READY };
+    ready.as.file_transfer_ready.offer_id = 108;
+    ready.as.file_transfer_ready.recipient_count = 1;
+    file_transfer_handle_message(module, &transport, &ready);
+    grant_credit(108, 2, 0);
+    file_transfer_pump(module, &transport);
+    TEST_ASSERT_EQUAL_size_t(2, fake.count);
+    TEST_ASSERT_EQUAL_size_t(0, fake.purge_count);
+
+    RelayMessage cancel = { .type = RELAY_MESSAGE_FILE_TRANSFER_CANCEL };
+    cancel.as.file_transfer_cancel.offer_id = 108;
+    strcpy(cancel.as.file_transfer_cancel.reason, "No Recipients remain");
+    file_transfer_handle_message(module, &transport, &cancel);
+    TEST_ASSERT_EQUAL_size_t(1, fake.purge_count);
+    TEST_ASSERT_EQUAL_UINT64(108, fake.purged_offer);
+    TEST_ASSERT_EQUAL_size_t(0, file_transfer_active_count(module));
+}
+
 void test_delivery_failure_during_streaming_is_counted_before_transfer_end(void)
 {
     const uint8_t contents[] = { 3, 4, 5 };
@@ -281,6 +374,7 @@ void test_delivery_failure_during_streaming_is_counted_before_transfer_end(void)
     ready.as.file_transfer_ready.offer_id = 111;
     ready.as.file_transfer_ready.recipient_count = 2;
     file_transfer_handle_message(module, &transport, &ready);
+    grant_credit(111, sizeof(contents), 0);
 
     RelayMessage failed = { .type = RELAY_MESSAGE_FILE_DELIVERY_UPDATE };
     failed.as.file_delivery_update.offer_id = 111;
@@ -383,6 +477,8 @@ int main(void)
     RUN_TEST(test_incoming_file_is_published_only_after_complete_delivery);
     RUN_TEST(test_bad_chunk_fails_only_that_delivery_and_removes_partial_file);
     RUN_TEST(test_backpressure_retries_same_chunk_without_advancing_progress);
+    RUN_TEST(test_sender_waits_for_credit_and_reports_delivered_progress);
+    RUN_TEST(test_cancelled_offer_purges_its_queued_frames);
     RUN_TEST(test_delivery_failure_during_streaming_is_counted_before_transfer_end);
     RUN_TEST(test_existing_received_file_is_never_overwritten);
     RUN_TEST(test_delivery_result_is_deferred_across_control_backpressure);
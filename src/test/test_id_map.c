@@ -0,0 +1,65 @@
+#include "id_map.h"
+#include "unity.h"
+
+#include <stdint.h>
+
+static IdMap map;
+static int values[4096];
+
+void setUp(void)
+{
+    TEST_ASSERT_TRUE(id_map_init(&map, 4));
+}
+
+void tearDown(void)
+{
+    id_map_destroy(&map);
+}
+
+void test_put_get_and_replace(void)
+{
+    TEST_ASSERT_NULL(id_map_get(&map, 7));
+    TEST_ASSERT_TRUE(id_map_put(&map, 7, &values[0]));
+    TEST_ASSERT_TRUE(id_map_put(&map, 9, &values[1]));
+    TEST_ASSERT_EQUAL_PTR(&values[0], id_map_get(&map, 7));
+    TEST_ASSERT_EQUAL_PTR(&values[1], id_map_get(&map, 9));
+    TEST_ASSERT_TRUE(id_map_put(&map, 7, &values[2]));
+    TEST_ASSERT_EQUAL_PTR(&values[2], id_map_get(&map, 7));
+    TEST_ASSERT_EQUAL_size_t(2, map.count);
+    TEST_ASSERT_FALSE(id_map_put(&map, 0, &values[3]));
+}
+
+void test_grows_and_keeps_every_entry(void)
+{
+    for (uint64_t key = 1; key <= 4096; ++key)
+        TEST_ASSERT_TRUE(id_map_put(&map, key * 64u, &values[key - 1u]));
+    TEST_ASSERT_EQUAL_size_t(4096, map.count);
+    TEST_ASSERT_LESS_OR_EQUAL_size_t(map.capacity / 2u, map.count);
+    for (uint64_t key = 1; key <= 4096; ++key)
+        TEST_ASSERT_EQUAL_PTR(&values[key - 1u], id_map_get(&map, key * 64u));
+}
+
+void test_remove_keeps_colliding_entries_reachable(void)
+{
+    for (uint64_t key = 1; key <= 1000; ++key)
+        TEST_ASSERT_TRUE(id_map_put(&map, key, &values[key]));
+    for (uint64_t key = 1; key <= 1000; key += 2u)
+        TEST_ASSERT_TRUE(id_map_remove(&map, key));
+    TEST_ASSERT_FALSE(id_map_remove(&map, 1));
+    TEST_ASSERT_EQUAL_size_t(500, map.count);
+    for (uint64_t key = 1; key <= 1000; ++key) {
+        if (key % 2u == 1u)
+            TEST_ASSERT_NULL(id_map_get(&map, key));
+        else
+            TEST_ASSERT_EQUAL_PTR(&values[key], id_map_get(&map, key));
+    }
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_put_get_and_replace);
+    RUN_TEST(test_grows_and_keeps_every_entry);
+    RUN_TEST(test_remove_keeps_colliding_entries_reachable);
+    return UNITY_END();
+}
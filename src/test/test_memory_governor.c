@@ -0,0 +1,122 @@
+#include "buffer_pool.h"
+#include "memory_governor.h"
+#include "unity.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define BUDGET 1000u
+
+static MemoryGovernor governor;
+
+void setUp(void)
+{
+    memset(&governor, 0, sizeof(governor));
+    memory_governor_reset(&governor, BUDGET);
+    buffer_pool_trim();
+}
+
+void tearDown(void)
+{
+    buffer_pool_trim();
+}
+
+void test_pressure_rises_through_each_stage_of_the_budget(void)
+{
+    TEST_ASSERT_EQUAL_INT(SERVER_MEMORY_NORMAL, memory_governor_pressure_for(&governor, 499));
+    TEST_ASSERT_EQUAL_INT(SERVER_MEMORY_THROTTLING, memory_governor_pressure_for(&governor, 500));
+    TEST_ASSERT_EQUAL_INT(SERVER_MEMORY_REFUSING_OFFERS,
+        memory_governor_pressure_for(&governor, 750));
+    TEST_ASSERT_EQUAL_INT(SERVER_MEMORY_SHEDDING, memory_governor_pressure_for(&governor, 1000));
+
+    memory_governor_note_frames(&governor, 0, 400);
+    memory_governor_note_decoder(&governor, 0, 400);
+    TEST_ASSERT_EQUAL_size_t(800, memory_governor_in_use(&governor));
+    TEST_ASSERT_EQUAL_INT(SERVER_MEMORY_REFUSING_OFFERS, memory_governor_live_pressure(&governor));
+    TEST_ASSERT_EQUAL_INT(SERVER_MEMORY_NORMAL, memory_governor_pressure(&governor));
+    TEST_ASSERT_FALSE(memory_governor_update(&governor, 10));
+    TEST_ASSERT_EQUAL_INT(SERVER_MEMORY_REFUSING_OFFERS, memory_governor_pressure(&governor));
+}
+
+void test_peak_survives_released_bytes_and_resets(void)
+{
+    memory_governor_note_frames(&governor, 0, 600);
+    memory_governor_note_decoder(&governor, 0, 100);
+    memory_governor_note_frames(&governor, 600, 50);
+    ServerMemoryStats stats;
+    memory_governor_stats(&governor, &stats);
+    TEST_ASSERT_EQUAL_size_t(BUDGET, stats.budget_bytes);
+    TEST_ASSERT_EQUAL_size_t(50, stats.frame_bytes);
+    TEST_ASSERT_EQUAL_size_t(100, stats.decoder_bytes);
+    TEST_ASSERT_EQUAL_size_t(700, stats.peak_bytes);
+
+    memory_governor_reset(&governor, BUDGET * 2u);
+    memory_governor_stats(&governor, &stats);
+    TEST_ASSERT_EQUAL_size_t(BUDGET * 2u, stats.budget_bytes);
+    TEST_ASSERT_EQUAL_size_t(50, stats.frame_bytes);
+    TEST_ASSERT_EQUAL_size_t(150, stats.peak_bytes);
+}
+
+void test_sheds_over_budget_once_per_interval(void)
+{
+    memory_governor_note_frames(&governor, 0, BUDGET);
+    TEST_ASSERT_TRUE(memory_governor_update(&governor, 100));
+    memory_governor_note_shed(&governor, 100);
+    TEST_ASSERT_FALSE(
+        memory_governor_update(&governor, 100 + MEMORY_GOVERNOR_SHED_INTERVAL_MS - 1));
+    TEST_ASSERT_TRUE(memory_governor_update(&governor, 100 + MEMORY_GOVERNOR_SHED_INTERVAL_MS));
+
+    ServerMemoryStats stats;
+    memory_governor_stats(&governor, &stats);
+    TEST_ASSERT_EQUAL_size_t(1, stats.shed_deliveries);
+    TEST_ASSERT_EQUAL_INT(SERVER_MEMORY_SHEDDING, stats.pressure);
+}
+
+void test_throttling_escalates_only_when_it_frees_nothing(void)
+{
+    memory_governor_note_frames(&governor, 0, 600);
+    TEST_ASSERT_FALSE(memory_governor_update(&governor, 100));
+    TEST_ASSERT_FALSE(memory_governor_update(&governor, 100 + MEMORY_GOVERNOR_STALL_MS - 1));
+
+    memory_governor_note_frames(&governor, 600, 550);
+    TEST_ASSERT_FALSE(memory_governor_update(&governor, 100 + MEMORY_GOVERNOR_STALL_MS));
+    TEST_ASSERT_FALSE(memory_governor_update(&governor, 100 + MEMORY_GOVERNOR_STALL_MS * 2u - 1));
+    TEST_ASSERT_TRUE(memory_governor_update(&governor, 100 + MEMORY_GOVERNOR_STALL_MS * 2u));
+}
+
+void test_decoder_buffers_alone_never_shed(void)
+{
+    memory_governor_note_decoder(&governor, 0, BUDGET);
+    TEST_ASSERT_FALSE(memory_governor_update(&governor, 100));
+    TEST_ASSERT_FALSE(memory_governor_update(&governor, 100 + MEMORY_GOVERNOR_STALL_MS * 4u));
+    TEST_ASSERT_EQUAL_INT(SERVER_MEMORY_SHEDDING, memory_governor_pressure(&governor));
+}
+
+void test_leaving_normal_returns_idle_pooled_blocks(void)
+{
+    buffer_pool_release(buffer_pool_acquire(4096), 4096);
+    BufferPoolStats pool;
+    buffer_pool_stats(&pool);
+    TEST_ASSERT_GREATER_THAN_size_t(0, pool.idle_bytes);
+
+    TEST_ASSERT_FALSE(memory_governor_update(&governor, 100));
+    buffer_pool_stats(&pool);
+    TEST_ASSERT_GREATER_THAN_size_t(0, pool.idle_bytes);
+
+    memory_governor_note_frames(&governor, 0, 500);
+    (void)memory_governor_update(&governor, 200);
+    buffer_pool_stats(&pool);
+    TEST_ASSERT_EQUAL_size_t(0, pool.idle_bytes);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_pressure_rises_through_each_stage_of_the_budget);
+    RUN_TEST(test_peak_survives_released_bytes_and_resets);
+    RUN_TEST(test_sheds_over_budget_once_per_interval);
+    RUN_TEST(test_throttling_escalates_only_when_it_frees_nothing);
+    RUN_TEST(test_decoder_buffers_alone_never_shed);
+    RUN_TEST(test_leaving_normal_returns_idle_pooled_blocks);
+    return UNITY_END();
+}
@@ -1,4 +1,5 @@
 #include "protocol.h"
+#include "buffer_pool.h"
 #include "unity.h"
 
 #include <stdlib.h>
@@ -147,6 +148,515 @@ void test_round_trips_binary_file_chunk(void)
     free(frame);
 }
 
+void test_decoder_accepts_reads_spanning_maximum_size_chunk_frames(void)
+{
+    uint8_t* data = malloc(PROTOCOL_FILE_CHUNK_MAX);
+    TEST_ASSERT_NOT_NULL(data);
+    memset(data, 0x5a, PROTOCOL_FILE_CHUNK_MAX);
+    RelayMessage source = { .type = RELAY_MESSAGE_FILE_CHUNK };
+    source.as.file_chunk.offer_id = 5;
+    source.as.file_chunk.data = data;
+    source.as.file_chunk.data_length = PROTOCOL_FILE_CHUNK_MAX;
+
+    uint8_t* frame = NULL;
+    size_t length = 0;
+    encode(&source, &frame, &length);
+    uint8_t* stream = malloc(length * 2u);
+    TEST_ASSERT_NOT_NULL(stream);
+    memcpy(stream, frame, length);
+    memcpy(stream + length, frame, length);
+
+    ProtocolDecoder decoder;
+    protocol_decoder_init(&decoder);
+    const size_t read_size = 64u * 1024u;
+    for (size_t offset = 0; offset < length * 2u; offset += read_size) {
+        size_t piece = length * 2u - offset < read_size ? length * 2u - offset : read_size;
+        TEST_ASSERT_TRUE(protocol_decoder_feed(&decoder, stream + offset, piece, capture, NULL));
+    }
+    TEST_ASSERT_EQUAL(2, captured_count);
+    TEST_ASSERT_EQUAL_UINT32(PROTOCOL_FILE_CHUNK_MAX, captured[1].as.file_chunk.data_length);
+    TEST_ASSERT_EQUAL(0, decoder.length);
+
+    protocol_decoder_destroy(&decoder);
+    free(stream);
+    free(frame);
+    free(data);
+}
+
+static size_t passthrough_count;
+static uint8_t passthrough_frame[64];
+static size_t passthrough_length;
+static ProtocolChunkHeader passthrough_chunk;
+
+static void capture_chunk(void* context, const ProtocolChunkHeader* chunk)
+{
+    (void)context;
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(passthrough_frame), chunk->frame_length);
+    passthrough_count++;
+    passthrough_chunk = *chunk;
+    memcpy(passthrough_frame, chunk->frame, chunk->frame_length);
+    passthrough_length = chunk->frame_length;
+}
+
+void test_decoder_passes_chunk_frames_through_without_decoding(void)
+{
+    uint8_t bytes[] = { 9, 8, 7, 6, 5 };
+    RelayMessage source = { .type = RELAY_MESSAGE_FILE_CHUNK };
+    source.as.file_chunk.offer_id = 11;
+    source.as.file_chunk.offset = 4096;
+    source.as.file_chunk.data = bytes;
+    source.as.file_chunk.data_length = sizeof(bytes);
+    RelayMessage chat = { .type = RELAY_MESSAGE_CHAT_SEND };
+    strcpy(chat.as.chat_send.text, "after");
+
+    uint8_t* chunk_frame = NULL;
+    size_t chunk_length = 0;
+    uint8_t* chat_frame = NULL;
+    size_t chat_length = 0;
+    encode(&source, &chunk_frame, &chunk_length);
+    encode(&chat, &chat_frame, &chat_length);
+
+    ProtocolChunkHeader header;
+    TEST_ASSERT_TRUE(protocol_parse_chunk_header(chunk_frame, chunk_length, &header));
+    TEST_ASSERT_EQUAL_UINT64(11, header.offer_id);
+    TEST_ASSERT_EQUAL_UINT64(4096, header.offset);
+    TEST_ASSERT_EQUAL_UINT32(sizeof(bytes), header.data_length);
+    TEST_ASSERT_EQUAL_MEMORY(bytes, header.data, sizeof(bytes));
+    TEST_ASSERT_FALSE(protocol_parse_chunk_header(chunk_frame, chunk_length - 1u, &header));
+    TEST_ASSERT_FALSE(protocol_parse_chunk_header(chat_frame, chat_length, &header));
+
+    passthrough_count = 0;
+    ProtocolDecoder decoder;
+    protocol_decoder_init(&decoder);
+    protocol_decoder_set_chunk_handler(&decoder, capture_chunk);
+    TEST_ASSERT_TRUE(protocol_decoder_feed(&decoder, chunk_frame, chunk_length, capture, NULL));
+    TEST_ASSERT_TRUE(protocol_decoder_feed(&decoder, chat_frame, chat_length, capture, NULL));
+    TEST_ASSERT_EQUAL(1, passthrough_count);
+    TEST_ASSERT_EQUAL_UINT64(11, passthrough_chunk.offer_id);
+    TEST_ASSERT_EQUAL(chunk_length, passthrough_length);
+    TEST_ASSERT_EQUAL_MEMORY(chunk_frame, passthrough_frame, chunk_length);
+    TEST_ASSERT_EQUAL(1, captured_count);
+    TEST_ASSERT_EQUAL(RELAY_MESSAGE_CHAT_SEND, captured[0].type);
+
+    protocol_decoder_destroy(&decoder);
+    free(chat_frame);
+    free(chunk_frame);
+}
+
+void test_decoder_peeks_partially_buffered_chunk_frame(void)
+{
+    uint8_t bytes[40];
+    for (size_t i = 0; i < sizeof(bytes); ++i)
+        bytes[i] = (uint8_t)i;
+    RelayMessage source = { .type = RELAY_MESSAGE_FILE_CHUNK };
+    source.as.file_chunk.offer_id = 12;
+    source.as.file_chunk.offset = 8192;
+    source.as.file_chunk.data = bytes;
+    source.as.file_chunk.data_length = sizeof(bytes);
+    uint8_t* frame = NULL;
+    size_t length = 0;
+    encode(&source, &frame, &length);
+
+    ProtocolDecoder decoder;
+    protocol_decoder_init(&decoder);
+    protocol_decoder_set_chunk_handler(&decoder, capture_chunk);
+    ProtocolChunkHeader header;
+    TEST_ASSERT_TRUE(protocol_decoder_feed(&decoder, frame, 20, capture, NULL));
+    TEST_ASSERT_FALSE(protocol_decoder_peek_chunk(&decoder, &header));
+    TEST_ASSERT_TRUE(protocol_decoder_feed(&decoder, frame + 20, 10, capture, NULL));
+    TEST_ASSERT_TRUE(protocol_decoder_peek_chunk(&decoder, &header));
+    TEST_ASSERT_EQUAL_UINT64(12, header.offer_id);
+    TEST_ASSERT_EQUAL_UINT64(8192, header.offset);
+    TEST_ASSERT_EQUAL_UINT32(sizeof(bytes), header.data_length);
+    TEST_ASSERT_EQUAL(length, header.frame_length);
+    TEST_ASSERT_EQUAL_MEMORY(bytes, header.data, 30u - (size_t)(header.data - header.frame));
+
+    passthrough_count = 0;
+    TEST_ASSERT_TRUE(protocol_decoder_feed(&decoder, frame + 30, length - 30u, capture, NULL));
+    TEST_ASSERT_EQUAL(1, passthrough_count);
+    TEST_ASSERT_FALSE(protocol_decoder_peek_chunk(&decoder, &header));
+
+    protocol_decoder_destroy(&decoder);
+    free(frame);
+}
+
+void test_decoder_borrows_pooled_buffer_only_while_large_frame_is_partial(void)
+{
+    size_t data_length = 100u * 1024u;
+    uint8_t* bytes = malloc(data_length);
+    TEST_ASSERT_NOT_NULL(bytes);
+    memset(bytes, 0x5a, data_length);
+    RelayMessage chunk = { .type = RELAY_MESSAGE_FILE_CHUNK };
+    chunk.as.file_chunk.offer_id = 3;
+    chunk.as.file_chunk.data = bytes;
+    chunk.as.file_chunk.data_length = (uint32_t)data_length;
+    RelayMessage chat = { .type = RELAY_MESSAGE_CHAT_SEND };
+    strcpy(chat.as.chat_send.text, "after");
+    uint8_t* chunk_frame = NULL;
+    uint8_t* chat_frame = NULL;
+    size_t chunk_length = 0;
+    size_t chat_length = 0;
+    encode(&chunk, &chunk_frame, &chunk_length);
+    encode(&chat, &chat_frame, &chat_length);
+    uint8_t* stream = malloc(chunk_length + chat_length);
+    TEST_ASSERT_NOT_NULL(stream);
+    memcpy(stream, chunk_frame, chunk_length);
+    memcpy(stream + chunk_length, chat_frame, chat_length);
+
+    ProtocolDecoder decoder;
+    protocol_decoder_init(&decoder);
+    TEST_ASSERT_TRUE(protocol_decoder_feed(&decoder, chat_frame, chat_length, capture, NULL));
+    TEST_ASSERT_NULL(decoder.borrowed);
+
+    for (int round = 0; round < 2; ++round) {
+        BufferPoolStats before;
+        BufferPoolStats after;
+        buffer_pool_stats(&before);
+        TEST_ASSERT_TRUE(protocol_decoder_feed(&decoder, stream, 60000, capture, NULL));
+        TEST_ASSERT_NOT_NULL(decoder.borrowed);
+        TEST_ASSERT_TRUE(protocol_decoder_feed(&decoder, stream + 60000,
+            chunk_length + chat_length - 60000u, capture, NULL));
+        TEST_ASSERT_NULL(decoder.borrowed);
+        TEST_ASSERT_EQUAL(0, decoder.length);
+        TEST_ASSERT_EQUAL(PROTOCOL_DECODER_INLINE_CAPACITY, decoder.capacity);
+        buffer_pool_stats(&after);
+        TEST_ASSERT_GREATER_OR_EQUAL_size_t(PROTOCOL_FRAME_CAPACITY, after.idle_bytes);
+        if (round > 0) {
+            TEST_ASSERT_EQUAL_size_t(before.system_allocations, after.system_allocations);
+            TEST_ASSERT_EQUAL_size_t(before.reuses + 1u, after.reuses);
+        }
+    }
+    TEST_ASSERT_EQUAL(5, captured_count);
+    TEST_ASSERT_EQUAL(RELAY_MESSAGE_FILE_CHUNK, captured[3].type);
+    TEST_ASSERT_EQUAL_MEMORY(bytes, captured[3].as.file_chunk.data, data_length);
+    TEST_ASSERT_EQUAL_STRING("after", captured[4].as.chat_send.text);
+
+    TEST_ASSERT_TRUE(protocol_decoder_feed(&decoder, stream, 20000, capture, NULL));
+    protocol_decoder_reset(&decoder);
+    TEST_ASSERT_NULL(decoder.borrowed);
+    BufferPoolStats pooled;
+    buffer_pool_stats(&pooled);
+    TEST_ASSERT_GREATER_OR_EQUAL_size_t(PROTOCOL_FRAME_CAPACITY, pooled.idle_bytes);
+
+    protocol_decoder_destroy(&decoder);
+    free(stream);
+    free(chat_frame);
+    free(chunk_frame);
+    free(bytes);
+}
+
+static void capture_view(void* context, const RelayMessageView* view)
+{
+    RelayMessage message;
+    TEST_ASSERT_TRUE(protocol_view_to_message(view, &message));
+    capture(context, &message);
+}
+
+void test_decoder_receives_rest_of_large_frame_in_place_and_parses_complete_frames_directly(void)
+{
+    size_t data_length = 64u * 1024u;
+    uint8_t* bytes = malloc(data_length);
+    TEST_ASSERT_NOT_NULL(bytes);
+    for (size_t i = 0; i < data_length; ++i)
+        bytes[i] = (uint8_t)(i * 7u);
+    RelayMessage chunk = { .type = RELAY_MESSAGE_FILE_CHUNK };
+    chunk.as.file_chunk.offer_id = 5;
+    chunk.as.file_chunk.data = bytes;
+    chunk.as.file_chunk.data_length = (uint32_t)data_length;
+    RelayMessage chat = { .type = RELAY_MESSAGE_CHAT_SEND };
+    strcpy(chat.as.chat_send.text, "small");
+    uint8_t* chunk_frame = NULL;
+    uint8_t* chat_frame = NULL;
+    size_t chunk_length = 0;
+    size_t chat_length = 0;
+    encode(&chunk, &chunk_frame, &chunk_length);
+    encode(&chat, &chat_frame, &chat_length);
+    uint8_t stream[256];
+    memcpy(stream, chat_frame, chat_length);
+    memcpy(stream + chat_length, chunk_frame, 100);
+
+    ProtocolDecoder decoder;
+    protocol_decoder_init(&decoder);
+    size_t space = 0;
+    TEST_ASSERT_NULL(protocol_decoder_receive_space(&decoder, &space));
+    TEST_ASSERT_TRUE(protocol_decoder_feed_views(&decoder, stream, chat_length + 100u,
+        capture_view, NULL));
+    TEST_ASSERT_EQUAL(1, captured_count);
+    TEST_ASSERT_EQUAL(100, decoder.length);
+
+    uint8_t* target = protocol_decoder_receive_space(&decoder, &space);
+    TEST_ASSERT_NOT_NULL(target);
+    TEST_ASSERT_EQUAL_PTR(decoder.buffer + 100, target);
+    TEST_ASSERT_EQUAL(chunk_length - 100u, space);
+    memcpy(target, chunk_frame + 100, space - 1u);
+    TEST_ASSERT_TRUE(protocol_decoder_commit_views(&decoder, space - 1u, capture_view, NULL));
+    TEST_ASSERT_EQUAL(1, captured_count);
+    target = protocol_decoder_receive_space(&decoder, &space);
+    TEST_ASSERT_EQUAL(1, space);
+    *target = chunk_frame[chunk_length - 1u];
+    TEST_ASSERT_TRUE(protocol_decoder_commit_views(&decoder, 1, capture_view, NULL));
+    TEST_ASSERT_EQUAL(2, captured_count);
+    TEST_ASSERT_EQUAL_MEMORY(bytes, captured[1].as.file_chunk.data, data_length);
+    TEST_ASSERT_EQUAL(0, decoder.length);
+    TEST_ASSERT_NULL(decoder.borrowed);
+    TEST_ASSERT_FALSE(protocol_decoder_commit_views(&decoder, 1, capture_view, NULL));
+
+    protocol_decoder_destroy(&decoder);
+    free(chat_frame);
+    free(chunk_frame);
+    free(bytes);
+}
+
+void test_round_trips_credit_and_progress_messages(void)
+{
+    RelayMessage progress = { .type = RELAY_MESSAGE_FILE_DELIVERY_PROGRESS };
+    progress.as.file_delivery_progress.offer_id = 5;
+    progress.as.file_delivery_progress.written_bytes = 3u << 20;
+    RelayMessage credit = { .type = RELAY_MESSAGE_FILE_TRANSFER_CREDIT };
+    credit.as.file_transfer_credit.offer_id = 5;
+    credit.as.file_transfer_credit.credit_limit = 11u << 20;
+    credit.as.file_transfer_credit.delivered_bytes = 3u << 20;
+
+    uint8_t* progress_frame = NULL;
+    uint8_t* credit_frame = NULL;
+    size_t progress_length = 0;
+    size_t credit_length = 0;
+    encode(&progress, &progress_frame, &progress_length);
+    encode(&credit, &credit_frame, &credit_length);
+
+    ProtocolDecoder decoder;
+    protocol_decoder_init(&decoder);
+    TEST_ASSERT_TRUE(protocol_decoder_feed(&decoder, progress_frame, progress_length, capture, NULL));
+    TEST_ASSERT_TRUE(protocol_decoder_feed(&decoder, credit_frame, credit_length, capture, NULL));
+    TEST_ASSERT_EQUAL(2, captured_count);
+    TEST_ASSERT_EQUAL(RELAY_MESSAGE_FILE_DELIVERY_PROGRESS, captured[0].type);
+    TEST_ASSERT_EQUAL_UINT64(3u << 20, captured[0].as.file_delivery_progress.written_bytes);
+    TEST_ASSERT_EQUAL(RELAY_MESSAGE_FILE_TRANSFER_CREDIT, captured[1].type);
+    TEST_ASSERT_EQUAL_UINT64(11u << 20, captured[1].as.file_transfer_credit.credit_limit);
+    TEST_ASSERT_EQUAL_UINT64(3u << 20, captured[1].as.file_transfer_credit.delivered_bytes);
+
+    credit.as.file_transfer_credit.delivered_bytes = 12u << 20;
+    uint8_t* invalid = NULL;
+    size_t invalid_length = 0;
+    TEST_ASSERT_FALSE(protocol_encode(&credit, &invalid, &invalid_length));
+
+    protocol_decoder_destroy(&decoder);
+    free(progress_frame);
+    free(credit_frame);
+}
+
+void test_frame_offer_id_covers_frames_ordered_within_an_offer(void)
+{
+    RelayMessage end = { .type = RELAY_MESSAGE_FILE_TRANSFER_END };
+    end.as.file_transfer_end.offer_id = 41;
+    end.as.file_transfer_end.total_size = 3;
+    RelayMessage cancel = { .type = RELAY_MESSAGE_FILE_TRANSFER_CANCEL };
+    cancel.as.file_transfer_cancel.offer_id = 42;
+    strcpy(cancel.as.file_transfer_cancel.reason, "stop");
+    RelayMessage credit = { .type = RELAY_MESSAGE_FILE_TRANSFER_CREDIT };
+    credit.as.file_transfer_credit.offer_id = 43;
+    credit.as.file_transfer_credit.credit_limit = 8;
+
+    uint8_t* frame = NULL;
+    size_t length = 0;
+    uint64_t offer_id = 0;
+    encode(&end, &frame, &length);
+    TEST_ASSERT_TRUE(protocol_frame_offer_id(frame, length, &offer_id));
+    TEST_ASSERT_EQUAL_UINT64(41, offer_id);
+    TEST_ASSERT_FALSE(protocol_frame_offer_id(frame, PROTOCOL_FRAME_HEADER_SIZE + 7u, &offer_id));
+    free(frame);
+    encode(&cancel, &frame, &length);
+    TEST_ASSERT_TRUE(protocol_frame_offer_id(frame, length, &offer_id));
+    TEST_ASSERT_EQUAL_UINT64(42, offer_id);
+    free(frame);
+    encode(&credit, &frame, &length);
+    TEST_ASSERT_FALSE(protocol_frame_offer_id(frame, length, &offer_id));
+    free(frame);
+}
+
+void test_view_decode_borrows_strings_and_chunk_bytes_from_the_frame(void)
+{
+    RelayMessage chat = { .type = RELAY_MESSAGE_CHAT_DELIVER };
+    chat.as.chat_deliver.participant_id = 7;
+    strcpy(chat.as.chat_deliver.display_name, "Alice");
+    strcpy(chat.as.chat_deliver.text, "hello there");
+    uint8_t* frame = NULL;
+    size_t length = 0;
+    encode(&chat, &frame, &length);
+
+    RelayMessageView view;
+    TEST_ASSERT_TRUE(protocol_decode_view(frame, length, &view));
+    TEST_ASSERT_EQUAL(RELAY_MESSAGE_CHAT_DELIVER, view.type);
+    TEST_ASSERT_EQUAL_UINT64(7, view.as.chat_deliver.participant_id);
+    TEST_ASSERT_EQUAL_PTR(frame + PROTOCOL_FRAME_HEADER_SIZE + 10u,
+        view.as.chat_deliver.display_name.text);
+    TEST_ASSERT_EQUAL_UINT16(5, view.as.chat_deliver.display_name.length);
+    TEST_ASSERT_EQUAL_UINT16(11, view.as.chat_deliver.text.length);
+    RelayMessage copied;
+    TEST_ASSERT_TRUE(protocol_view_to_message(&view, &copied));
+    TEST_ASSERT_EQUAL_STRING("Alice", copied.as.chat_deliver.display_name);
+    TEST_ASSERT_EQUAL_STRING("hello there", copied.as.chat_deliver.text);
+    TEST_ASSERT_FALSE(protocol_decode_view(frame, length - 1u, &view));
+    frame[PROTOCOL_FRAME_HEADER_SIZE + 11u] = '\0';
+    TEST_ASSERT_FALSE(protocol_decode_view(frame, length, &view));
+    free(frame);
+
+    uint8_t bytes[3] = { 0x00, 0xff, 0x7f };
+    RelayMessage chunk = { .type = RELAY_MESSAGE_FILE_CHUNK };
+    chunk.as.file_chunk.offer_id = 9;
+    chunk.as.file_chunk.offset = 64;
+    chunk.as.file_chunk.data = bytes;
+    chunk.as.file_chunk.data_length = sizeof(bytes);
+    encode(&chunk, &frame, &length);
+    TEST_ASSERT_TRUE(protocol_decode_view(frame, length, &view));
+    TEST_ASSERT_EQUAL_PTR(frame + PROTOCOL_FRAME_HEADER_SIZE + 16u, view.as.file_chunk.data);
+    TEST_ASSERT_EQUAL_UINT32(sizeof(bytes), view.as.file_chunk.data_length);
+    TEST_ASSERT_EQUAL_UINT64(64, view.as.file_chunk.offset);
+    free(frame);
+}
+
+void test_encode_into_caller_buffer_and_iov_borrow_chunk_data(void)
+{
+    RelayMessage chat = { .type = RELAY_MESSAGE_CHAT_SEND };
+    strcpy(chat.as.chat_send.text, "arena");
+    uint8_t* frame = NULL;
+    size_t length = 0;
+    encode(&chat, &frame, &length);
+    uint8_t buffer[64];
+    size_t written = 0;
+    TEST_ASSERT_EQUAL(length, protocol_encoded_size(&chat));
+    TEST_ASSERT_FALSE(protocol_encode_into(&chat, buffer, length - 1u, &written));
+    TEST_ASSERT_TRUE(protocol_encode_into(&chat, buffer, sizeof(buffer), &written));
+    TEST_ASSERT_EQUAL(length, written);
+    TEST_ASSERT_EQUAL_MEMORY(frame, buffer, length);
+    free(frame);
+
+    uint8_t bytes[300];
+    for (size_t i = 0; i < sizeof(bytes); ++i)
+        bytes[i] = (uint8_t)i;
+    RelayMessage chunk = { .type = RELAY_MESSAGE_FILE_CHUNK };
+    chunk.as.file_chunk.offer_id = 4;
+    chunk.as.file_chunk.offset = 1024;
+    chunk.as.file_chunk.data = bytes;
+    chunk.as.file_chunk.data_length = sizeof(bytes);
+    encode(&chunk, &frame, &length);
+    ProtocolSlice slices[2];
+    TEST_ASSERT_EQUAL(0, protocol_encode_iov(&chunk, buffer, PROTOCOL_CHUNK_HEADER_SIZE - 1u, slices));
+    TEST_ASSERT_EQUAL(2, protocol_encode_iov(&chunk, buffer, sizeof(buffer), slices));
+    TEST_ASSERT_EQUAL_PTR(buffer, slices[0].bytes);
+    TEST_ASSERT_EQUAL(PROTOCOL_CHUNK_HEADER_SIZE, slices[0].length);
+    TEST_ASSERT_EQUAL_PTR(bytes, slices[1].bytes);
+    TEST_ASSERT_EQUAL(length, slices[0].length + slices[1].length);
+    TEST_ASSERT_EQUAL_MEMORY(frame, slices[0].bytes, slices[0].length);
+    TEST_ASSERT_EQUAL_MEMORY(frame + slices[0].length, slices[1].bytes, slices[1].length);
+    TEST_ASSERT_EQUAL(1, protocol_encode_iov(&chat, buffer, sizeof(buffer), slices));
+    free(frame);
+}
+
+void test_batch_frame_unpacks_inner_messages_and_rejects_chunks_and_nesting(void)
+{
+    RelayMessage deliver = { .type = RELAY_MESSAGE_CHAT_DELIVER };
+    deliver.as.chat_deliver.participant_id = 3;
+    strcpy(deliver.as.chat_deliver.display_name, "Ana");
+    strcpy(deliver.as.chat_deliver.text, "burst");
+    RelayMessage declined = { .type = RELAY_MESSAGE_FILE_OFFER_DECLINED };
+    declined.as.file_offer_declined.offer_id = 22;
+    uint8_t *first = NULL, *second = NULL;
+    size_t first_length = 0, second_length = 0;
+    encode(&deliver, &first, &first_length);
+    encode(&declined, &second, &second_length);
+
+    ProtocolSlice frames[2] = { { first, first_length }, { second, second_length } };
+    uint8_t batch[128];
+    size_t batch_length = 0;
+    size_t expected = PROTOCOL_FRAME_HEADER_SIZE + first_length + second_length;
+    TEST_ASSERT_FALSE(protocol_encode_batch(frames, 2, batch, expected - 1u, &batch_length));
+    TEST_ASSERT_TRUE(protocol_encode_batch(frames, 2, batch, sizeof(batch), &batch_length));
+    TEST_ASSERT_EQUAL(expected, batch_length);
+    TEST_ASSERT_EQUAL(RELAY_MESSAGE_BATCH, batch[0]);
+    RelayMessageView view;
+    TEST_ASSERT_FALSE(protocol_decode_view(batch, batch_length, &view));
+
+    ProtocolDecoder decoder;
+    protocol_decoder_init(&decoder);
+    for (size_t i = 0; i < batch_length; ++i)
+        TEST_ASSERT_TRUE(protocol_decoder_feed(&decoder, batch + i, 1, capture, NULL));
+    TEST_ASSERT_EQUAL(2, captured_count);
+    TEST_ASSERT_EQUAL(RELAY_MESSAGE_CHAT_DELIVER, captured[0].type);
+    TEST_ASSERT_EQUAL_STRING("burst", captured[0].as.chat_deliver.text);
+    TEST_ASSERT_EQUAL(22, captured[1].as.file_offer_declined.offer_id);
+
+    uint8_t nested[160];
+    ProtocolSlice inner = { batch, batch_length };
+    size_t nested_length = 0;
+    TEST_ASSERT_FALSE(protocol_encode_batch(&inner, 1, nested, sizeof(nested), &nested_length));
+    memcpy(nested + PROTOCOL_FRAME_HEADER_SIZE, batch, batch_length);
+    memcpy(nested, batch, PROTOCOL_FRAME_HEADER_SIZE);
+    nested[4] = (uint8_t)(batch[4] + PROTOCOL_FRAME_HEADER_SIZE);
+    TEST_ASSERT_FALSE(protocol_decoder_feed(&decoder, nested,
+        batch_length + PROTOCOL_FRAME_HEADER_SIZE, capture, NULL));
+
+    uint8_t bytes[4] = { 1, 2, 3, 4 };
+    RelayMessage chunk = { .type = RELAY_MESSAGE_FILE_CHUNK };
+    chunk.as.file_chunk.offer_id = 4;
+    chunk.as.file_chunk.data = bytes;
+    chunk.as.file_chunk.data_length = sizeof(bytes);
+    uint8_t* chunk_frame = NULL;
+    size_t chunk_length = 0;
+    encode(&chunk, &chunk_frame, &chunk_length);
+    frames[1] = (ProtocolSlice) { chunk_frame, chunk_length };
+    TEST_ASSERT_FALSE(protocol_encode_batch(frames, 2, batch, sizeof(batch), &batch_length));
+    frames[1] = (ProtocolSlice) { second, second_length - 1u };
+    TEST_ASSERT_FALSE(protocol_encode_batch(frames, 2, batch, sizeof(batch), &batch_length));
+
+    protocol_decoder_destroy(&decoder);
+    free(chunk_frame);
+    free(second);
+    free(first);
+}
+
+void test_hello_and_welcome_carry_features_only_when_advertised(void)
+{
+    RelayMessage hello = { .type = RELAY_MESSAGE_HELLO };
+    hello.as.hello.version = PROTOCOL_VERSION;
+    strcpy(hello.as.hello.display_name, "Ana");
+    RelayMessage welcome = { .type = RELAY_MESSAGE_WELCOME };
+    welcome.as.welcome.participant_id = 9;
+    uint8_t *plain = NULL, *welcome_frame = NULL;
+    size_t plain_length = 0, welcome_length = 0;
+    encode(&hello, &plain, &plain_length);
+    encode(&welcome, &welcome_frame, &welcome_length);
+    TEST_ASSERT_EQUAL(PROTOCOL_FRAME_HEADER_SIZE + 8u, welcome_length);
+    free(welcome_frame);
+
+    hello.as.hello.features = PROTOCOL_FEATURE_BATCH | (1u << 30);
+    welcome.as.welcome.features = PROTOCOL_FEATURE_BATCH;
+    uint8_t* featured = NULL;
+    size_t featured_length = 0;
+    encode(&hello, &featured, &featured_length);
+    encode(&welcome, &welcome_frame, &welcome_length);
+    TEST_ASSERT_EQUAL(plain_length + 4u, featured_length);
+
+    ProtocolDecoder decoder;
+    protocol_decoder_init(&decoder);
+    TEST_ASSERT_TRUE(protocol_decoder_feed(&decoder, plain, plain_length, capture, NULL));
+    TEST_ASSERT_TRUE(protocol_decoder_feed(&decoder, featured, featured_length, capture, NULL));
+    TEST_ASSERT_TRUE(protocol_decoder_feed(&decoder, welcome_frame, welcome_length, capture, NULL));
+    TEST_ASSERT_EQUAL(3, captured_count);
+    TEST_ASSERT_EQUAL_UINT32(0, captured[0].as.hello.features);
+    TEST_ASSERT_EQUAL_UINT32(PROTOCOL_FEATURE_BATCH | (1u << 30), captured[1].as.hello.features);
+    TEST_ASSERT_EQUAL_STRING("Ana", captured[1].as.hello.display_name);
+    TEST_ASSERT_EQUAL_UINT32(PROTOCOL_FEATURE_BATCH, captured[2].as.welcome.features);
+
+    featured[4] = (uint8_t)(featured[4] - 1u);
+    TEST_ASSERT_FALSE(protocol_decoder_feed(&decoder, featured, featured_length - 1u, capture, NULL));
+
+    protocol_decoder_destroy(&decoder);
+    free(welcome_frame);
+    free(featured);
+    free(plain);
+}
+
 void test_decoder_rejects_oversized_frame_before_allocation(void)
 {
     uint8_t header[PROTOCOL_FRAME_HEADER_SIZE] = {
@@ -182,6 +692,17 @@ int main(void)
     RUN_TEST(test_incremental_decoder_handles_every_fragment_split);
     RUN_TEST(test_decoder_emits_coalesced_messages);
     RUN_TEST(test_round_trips_binary_file_chunk);
+    RUN_TEST(test_decoder_accepts_reads_spanning_maximum_size_chunk_frames);
+    RUN_TEST(test_decoder_passes_chunk_frames_through_without_decoding);
+    RUN_TEST(test_decoder_peeks_partially_buffered_chunk_frame);
+    RUN_TEST(test_decoder_borrows_pooled_buffer_only_while_large_frame_is_partial);
+    RUN_TEST(test_decoder_receives_rest_of_large_frame_in_place_and_parses_complete_frames_directly);
+    RUN_TEST(test_round_trips_credit_and_progress_messages);
+    RUN_TEST(test_frame_offer_id_covers_frames_ordered_within_an_offer);
+    RUN_TEST(test_view_decode_borrows_strings_and_chunk_bytes_from_the_frame);
+    RUN_TEST(test_encode_into_caller_buffer_and_iov_borrow_chunk_data);
+    RUN_TEST(test_batch_frame_unpacks_inner_messages_and_rejects_chunks_and_nesting);
+    RUN_TEST(test_hello_and_welcome_carry_features_only_when_advertised);
     RUN_TEST(test_decoder_rejects_oversized_frame_before_allocation);
     RUN_TEST(test_encoder_rejects_wrong_protocol_version_and_invalid_chunk);
     return UNITY_END();
@@ -40,15 +40,55 @@ static bool capture_send(void* context, uint64_t target, const RelayMessage* mes
     return true;
 }
 
+static size_t broadcast_count;
+static size_t broadcast_recipients;
+
+static void capture_broadcast(void* context, const uint64_t* targets, size_t target_count,
+    const RelayMessage* message, bool* delivered)
+{
+    broadcast_count++;
+    broadcast_recipients += target_count;
+    for (size_t i = 0; i < target_count; ++i)
+        delivered[i] = capture_send(context, targets[i], message);
+}
+
+typedef struct {
+    uint64_t target;
+    uint64_t offer_id;
+    size_t captured_before;
+} CapturedPurge;
+
+static CapturedPurge purged[16];
+static size_t purged_count;
+
+static void capture_purge(void* context, uint64_t target, uint64_t offer_id)
+{
+    (void)context;
+    TEST_ASSERT_LESS_THAN(16, purged_count);
+    purged[purged_count++] = (CapturedPurge) { target, offer_id, captured_count };
+}
+
+static const CapturedPurge* find_purge(uint64_t target, uint64_t offer_id)
+{
+    for (size_t i = 0; i < purged_count; ++i) {
+        if (purged[i].target == target && purged[i].offer_id == offer_id)
+            return &purged[i];
+    }
+    return NULL;
+}
+
 static RelayPolicyEffects effects(void)
 {
-    return (RelayPolicyEffects) { .send = capture_send, .context = NULL };
+    return (RelayPolicyEffects) { .send = capture_send, .purge = capture_purge, .context = NULL };
 }
 
 void setUp(void)
 {
     destroy_captured();
     fail_target = 0;
+    broadcast_count = 0;
+    broadcast_recipients = 0;
+    purged_count = 0;
     policy = relay_policy_create();
     TEST_ASSERT_NOT_NULL(policy);
 }
@@ -147,6 +187,20 @@ void test_offer_expiry_declines_when_nobody_accepts(void)
     (void)offer_id;
 }
 
+void test_next_deadline_tracks_earliest_open_offer_window(void)
+{
+    uint64_t deadline = 0;
+    TEST_ASSERT_FALSE(relay_policy_next_deadline(policy, &deadline));
+    uint64_t alice = join("Alice");
+    uint64_t bob = join("Bob");
+    uint64_t offer_id = create_offer(alice, "x.txt", 500);
+    TEST_ASSERT_TRUE(relay_policy_next_deadline(policy, &deadline));
+    TEST_ASSERT_EQUAL_UINT64(500 + RELAY_POLICY_OFFER_WINDOW_MS, deadline);
+
+    respond(bob, offer_id, true);
+    TEST_ASSERT_FALSE(relay_policy_next_deadline(policy, &deadline));
+}
+
 void test_invited_disconnect_closes_window_early(void)
 {
     uint64_t alice = join("Alice");
@@ -200,6 +254,79 @@ void test_slow_recipient_failure_isolated_from_other_delivery(void)
     TEST_ASSERT_EQUAL(0, relay_policy_file_offer_count(policy));
 }
 
+void test_chunk_fan_out_uses_one_broadcast_per_frame(void)
+{
+    uint64_t alice = join("Alice");
+    uint64_t bob = join("Bob");
+    uint64_t carol = join("Carol");
+    uint64_t dave = join("Dave");
+    uint64_t offer_id = create_offer(alice, "x.txt", 0);
+    respond(bob, offer_id, true);
+    respond(carol, offer_id, true);
+    respond(dave, offer_id, true);
+    destroy_captured();
+
+    fail_target = dave;
+    uint8_t bytes[] = { 1, 2, 3, 4 };
+    RelayMessage chunk = { .type = RELAY_MESSAGE_FILE_CHUNK };
+    chunk.as.file_chunk.offer_id = offer_id;
+    chunk.as.file_chunk.data = bytes;
+    chunk.as.file_chunk.data_length = sizeof(bytes);
+    RelayPolicyEffects fx = effects();
+    fx.broadcast = capture_broadcast;
+    broadcast_count = 0;
+    broadcast_recipients = 0;
+    relay_policy_handle(policy, alice, &chunk, 20, &fx);
+    TEST_ASSERT_EQUAL_size_t(1, broadcast_count);
+    TEST_ASSERT_EQUAL_size_t(3, broadcast_recipients);
+    TEST_ASSERT_NOT_NULL(find_effect(bob, RELAY_MESSAGE_FILE_CHUNK, 0));
+    TEST_ASSERT_NOT_NULL(find_effect(carol, RELAY_MESSAGE_FILE_CHUNK, 0));
+    CapturedEffect* failed = find_effect(alice, RELAY_MESSAGE_FILE_DELIVERY_UPDATE, 0);
+    TEST_ASSERT_NOT_NULL(failed);
+    TEST_ASSERT_EQUAL_UINT64(dave, failed->message.as.file_delivery_update.recipient_id);
+}
+
+static size_t forwarded_count;
+static const uint8_t* forwarded_frame;
+
+static void capture_forward_chunk(void* context, const uint64_t* targets, size_t target_count,
+    const ProtocolChunkHeader* chunk, bool* delivered)
+{
+    (void)context;
+    forwarded_count++;
+    forwarded_frame = chunk->frame;
+    for (size_t i = 0; i < target_count; ++i)
+        delivered[i] = targets[i] != fail_target;
+}
+
+void test_passthrough_chunk_forwards_original_frame_after_validation(void)
+{
+    uint64_t alice = join("Alice");
+    uint64_t bob = join("Bob");
+    uint64_t offer_id = create_offer(alice, "x.txt", 0);
+    respond(bob, offer_id, true);
+    destroy_captured();
+
+    uint8_t frame[] = { RELAY_MESSAGE_FILE_CHUNK, 0, 0, 0, 20,
+        0, 0, 0, 0, 0, 0, 0, (uint8_t)offer_id, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4 };
+    ProtocolChunkHeader chunk;
+    TEST_ASSERT_TRUE(protocol_parse_chunk_header(frame, sizeof(frame), &chunk));
+    RelayPolicyEffects fx = effects();
+    fx.forward_chunk = capture_forward_chunk;
+    forwarded_count = 0;
+    relay_policy_handle_chunk(policy, alice, &chunk, 20, &fx);
+    TEST_ASSERT_EQUAL_size_t(1, forwarded_count);
+    TEST_ASSERT_EQUAL_PTR(frame, forwarded_frame);
+    TEST_ASSERT_EQUAL_size_t(0, captured_count);
+
+    relay_policy_handle_chunk(policy, alice, &chunk, 30, &fx);
+    TEST_ASSERT_EQUAL_size_t(1, forwarded_count);
+    CapturedEffect* rejected = find_effect(alice, RELAY_MESSAGE_ACTION_REJECTED, 0);
+    TEST_ASSERT_NOT_NULL(rejected);
+    TEST_ASSERT_EQUAL(RELAY_MESSAGE_FILE_CHUNK, rejected->message.as.action_rejected.rejected_type);
+    TEST_ASSERT_NOT_NULL(find_effect(bob, RELAY_MESSAGE_FILE_TRANSFER_CANCEL, 0));
+}
+
 void test_sender_disconnect_cancels_every_active_delivery(void)
 {
     uint64_t alice = join("Alice");
@@ -214,6 +341,41 @@ void test_sender_disconnect_cancels_every_active_delivery(void)
     TEST_ASSERT_EQUAL(0, relay_policy_file_offer_count(policy));
 }
 
+void test_cancellation_purges_queued_frames_before_the_cancel(void)
+{
+    uint64_t alice = join("Alice");
+    uint64_t bob = join("Bob");
+    uint64_t carol = join("Carol");
+    uint64_t dave = join("Dave");
+    uint64_t offer_id = create_offer(alice, "x.txt", 0);
+    respond(bob, offer_id, true);
+    respond(carol, offer_id, true);
+    respond(dave, offer_id, true);
+    destroy_captured();
+
+    RelayMessage cancel = { .type = RELAY_MESSAGE_FILE_TRANSFER_CANCEL };
+    cancel.as.file_transfer_cancel.offer_id = offer_id;
+    strcpy(cancel.as.file_transfer_cancel.reason, "Not needed");
+    RelayPolicyEffects fx = effects();
+    relay_policy_handle(policy, dave, &cancel, 20, &fx);
+    TEST_ASSERT_EQUAL_size_t(1, purged_count);
+    TEST_ASSERT_NOT_NULL(find_purge(dave, offer_id));
+
+    destroy_captured();
+    purged_count = 0;
+    relay_policy_handle(policy, alice, &cancel, 30, &fx);
+    TEST_ASSERT_EQUAL_size_t(2, purged_count);
+    uint64_t recipients[] = { bob, carol };
+    for (size_t i = 0; i < 2; ++i) {
+        const CapturedPurge* purge = find_purge(recipients[i], offer_id);
+        TEST_ASSERT_NOT_NULL(purge);
+        CapturedEffect* notice = find_effect(recipients[i], RELAY_MESSAGE_FILE_TRANSFER_CANCEL, 0);
+        TEST_ASSERT_NOT_NULL(notice);
+        TEST_ASSERT_LESS_OR_EQUAL_size_t(notice - captured, purge->captured_before);
+    }
+    TEST_ASSERT_EQUAL(0, relay_policy_file_offer_count(policy));
+}
+
 void test_chat_attribution_comes_from_participant_identity(void)
 {
     uint64_t alice = join("Alice");
@@ -269,16 +431,289 @@ void test_duplicate_active_request_identity_is_rejected(void)
     TEST_ASSERT_EQUAL_size_t(1, relay_policy_file_offer_count(policy));
 }
 
+static void use_options(uint64_t credit_window_bytes, uint64_t straggler_lag_bytes,
+    bool store_and_forward)
+{
+    relay_policy_destroy(policy);
+    RelayPolicyOptions options = {
+        .credit_window_bytes = credit_window_bytes,
+        .straggler_lag_bytes = straggler_lag_bytes,
+        .store_and_forward = store_and_forward
+    };
+    policy = relay_policy_create_with_options(&options);
+    TEST_ASSERT_NOT_NULL(policy);
+}
+
+static void send_chunk(uint64_t sender, uint64_t offer_id, uint64_t offset, uint32_t length)
+{
+    uint8_t bytes[4] = { 1, 2, 3, 4 };
+    RelayMessage chunk = { .type = RELAY_MESSAGE_FILE_CHUNK };
+    chunk.as.file_chunk.offer_id = offer_id;
+    chunk.as.file_chunk.offset = offset;
+    chunk.as.file_chunk.data = bytes;
+    chunk.as.file_chunk.data_length = length;
+    RelayPolicyEffects fx = effects();
+    relay_policy_handle(policy, sender, &chunk, 20, &fx);
+}
+
+static void report_progress(uint64_t recipient, uint64_t offer_id, uint64_t written_bytes)
+{
+    RelayMessage progress = { .type = RELAY_MESSAGE_FILE_DELIVERY_PROGRESS };
+    progress.as.file_delivery_progress.offer_id = offer_id;
+    progress.as.file_delivery_progress.written_bytes = written_bytes;
+    RelayPolicyEffects fx = effects();
+    relay_policy_handle(policy, recipient, &progress, 30, &fx);
+}
+
+void test_credit_window_paces_sender_to_slowest_delivery(void)
+{
+    use_options(2, 0, false);
+    uint64_t alice = join("Alice");
+    uint64_t bob = join("Bob");
+    uint64_t carol = join("Carol");
+    uint64_t offer_id = create_offer(alice, "x.txt", 0);
+    respond(bob, offer_id, true);
+    respond(carol, offer_id, true);
+    CapturedEffect* credit = find_effect(alice, RELAY_MESSAGE_FILE_TRANSFER_CREDIT, 0);
+    TEST_ASSERT_NOT_NULL(credit);
+    TEST_ASSERT_EQUAL_UINT64(2, credit->message.as.file_transfer_credit.credit_limit);
+    TEST_ASSERT_EQUAL_UINT64(0, credit->message.as.file_transfer_credit.delivered_bytes);
+
+    destroy_captured();
+    send_chunk(alice, offer_id, 0, 2);
+    report_progress(bob, offer_id, 2);
+    TEST_ASSERT_NULL(find_effect(alice, RELAY_MESSAGE_FILE_TRANSFER_CREDIT, 0));
+    report_progress(carol, offer_id, 1);
+    credit = find_effect(alice, RELAY_MESSAGE_FILE_TRANSFER_CREDIT, 0);
+    TEST_ASSERT_NOT_NULL(credit);
+    TEST_ASSERT_EQUAL_UINT64(3, credit->message.as.file_transfer_credit.credit_limit);
+    TEST_ASSERT_EQUAL_UINT64(1, credit->message.as.file_transfer_credit.delivered_bytes);
+
+    destroy_captured();
+    send_chunk(alice, offer_id, 2, 2);
+    TEST_ASSERT_NOT_NULL(find_effect(alice, RELAY_MESSAGE_ACTION_REJECTED, 0));
+    TEST_ASSERT_NOT_NULL(find_effect(bob, RELAY_MESSAGE_FILE_TRANSFER_CANCEL, 0));
+    TEST_ASSERT_NOT_NULL(find_effect(carol, RELAY_MESSAGE_FILE_TRANSFER_CANCEL, 0));
+    TEST_ASSERT_EQUAL_size_t(0, relay_policy_file_offer_count(policy));
+}
+
+void test_straggler_lag_fails_only_the_lagging_delivery(void)
+{
+    use_options(2, 1, false);
+    uint64_t alice = join("Alice");
+    uint64_t bob = join("Bob");
+    uint64_t carol = join("Carol");
+    uint64_t offer_id = create_offer(alice, "x.txt", 0);
+    respond(bob, offer_id, true);
+    respond(carol, offer_id, true);
+    send_chunk(alice, offer_id, 0, 2);
+    destroy_captured();
+
+    report_progress(bob, offer_id, 2);
+    CapturedEffect* failed = find_effect(alice, RELAY_MESSAGE_FILE_DELIVERY_UPDATE, 0);
+    TEST_ASSERT_NOT_NULL(failed);
+    TEST_ASSERT_EQUAL_UINT64(carol, failed->message.as.file_delivery_update.recipient_id);
+    TEST_ASSERT_FALSE(failed->message.as.file_delivery_update.success);
+    CapturedEffect* credit = find_effect(alice, RELAY_MESSAGE_FILE_TRANSFER_CREDIT, 0);
+    TEST_ASSERT_NOT_NULL(credit);
+    TEST_ASSERT_EQUAL_UINT64(4, credit->message.as.file_transfer_credit.credit_limit);
+    TEST_ASSERT_EQUAL_UINT64(2, credit->message.as.file_transfer_credit.delivered_bytes);
+    TEST_ASSERT_EQUAL_size_t(1, relay_policy_file_offer_count(policy));
+}
+
+void test_store_and_forward_credits_sender_ahead_of_slow_delivery(void)
+{
+    use_options(2, 0, true);
+    uint64_t alice = join("Alice");
+    uint64_t bob = join("Bob");
+    uint64_t offer_id = create_offer(alice, "x.txt", 0);
+    respond(bob, offer_id, true);
+    destroy_captured();
+
+    send_chunk(alice, offer_id, 0, 2);
+    CapturedEffect* credit = find_effect(alice, RELAY_MESSAGE_FILE_TRANSFER_CREDIT, 0);
+    TEST_ASSERT_NOT_NULL(credit);
+    TEST_ASSERT_EQUAL_UINT64(4, credit->message.as.file_transfer_credit.credit_limit);
+    TEST_ASSERT_EQUAL_UINT64(0, credit->message.as.file_transfer_credit.delivered_bytes);
+    send_chunk(alice, offer_id, 2, 2);
+    RelayMessage end = { .type = RELAY_MESSAGE_FILE_TRANSFER_END };
+    end.as.file_transfer_end.offer_id = offer_id;
+    end.as.file_transfer_end.total_size = 4;
+    RelayPolicyEffects fx = effects();
+    relay_policy_handle(policy, alice, &end, 30, &fx);
+    destroy_captured();
+
+    relay_policy_leave(policy, alice, 40, &fx);
+    TEST_ASSERT_NULL(find_effect(bob, RELAY_MESSAGE_FILE_TRANSFER_CANCEL, 0));
+    TEST_ASSERT_EQUAL_size_t(1, relay_policy_file_offer_count(policy));
+    RelayMessage result = { .type = RELAY_MESSAGE_FILE_DELIVERY_RESULT };
+    result.as.file_delivery_result.offer_id = offer_id;
+    result.as.file_delivery_result.success = true;
+    relay_policy_handle(policy, bob, &result, 50, &fx);
+    TEST_ASSERT_EQUAL_size_t(0, relay_policy_file_offer_count(policy));
+}
+
+void test_memory_pressure_refuses_offers_and_fails_slowest_delivery(void)
+{
+    use_options(4, 0, false);
+    uint64_t alice = join("Alice");
+    uint64_t bob = join("Bob");
+    uint64_t carol = join("Carol");
+    uint64_t offer_id = create_offer(alice, "x.txt", 0);
+    respond(bob, offer_id, true);
+    respond(carol, offer_id, true);
+    send_chunk(alice, offer_id, 0, 3);
+    report_progress(bob, offer_id, 3);
+    report_progress(carol, offer_id, 1);
+    destroy_captured();
+
+    relay_policy_set_refusing_offers(policy, true);
+    RelayMessage create = { .type = RELAY_MESSAGE_FILE_OFFER_CREATE };
+    create.as.file_offer_create.request_id = 78;
+    strcpy(create.as.file_offer_create.filename, "y.txt");
+    create.as.file_offer_create.total_size = 4;
+    create.as.file_offer_create.chunk_size = 4;
+    RelayPolicyEffects fx = effects();
+    relay_policy_handle(policy, bob, &create, 40, &fx);
+    CapturedEffect* rejected = find_effect(bob, RELAY_MESSAGE_ACTION_REJECTED, 0);
+    TEST_ASSERT_NOT_NULL(rejected);
+    TEST_ASSERT_EQUAL_UINT64(78, rejected->message.as.action_rejected.correlation_id);
+    TEST_ASSERT_EQUAL_size_t(1, relay_policy_file_offer_count(policy));
+    TEST_ASSERT_EQUAL_size_t(1, relay_policy_refused_offer_count(policy));
+
+    destroy_captured();
+    TEST_ASSERT_TRUE(relay_policy_fail_slowest_delivery(policy, "Relay Server is low on memory",
+        &fx));
+    TEST_ASSERT_EQUAL_size_t(1, purged_count);
+    TEST_ASSERT_NOT_NULL(find_purge(carol, offer_id));
+    CapturedEffect* failed = find_effect(alice, RELAY_MESSAGE_FILE_DELIVERY_UPDATE, 0);
+    TEST_ASSERT_NOT_NULL(failed);
+    TEST_ASSERT_EQUAL_UINT64(carol, failed->message.as.file_delivery_update.recipient_id);
+    TEST_ASSERT_NOT_NULL(find_effect(carol, RELAY_MESSAGE_FILE_TRANSFER_CANCEL, 0));
+    TEST_ASSERT_NULL(find_effect(bob, RELAY_MESSAGE_FILE_TRANSFER_CANCEL, 0));
+    CapturedEffect* credit = find_effect(alice, RELAY_MESSAGE_FILE_TRANSFER_CREDIT, 0);
+    TEST_ASSERT_NOT_NULL(credit);
+    TEST_ASSERT_EQUAL_UINT64(4, credit->message.as.file_transfer_credit.credit_limit);
+
+    destroy_captured();
+    TEST_ASSERT_FALSE(relay_policy_fail_slowest_delivery(policy, "Relay Server is low on memory",
+        &fx));
+    relay_policy_set_refusing_offers(policy, false);
+    relay_policy_handle(policy, bob, &create, 50, &fx);
+    TEST_ASSERT_NOT_NULL(find_effect(bob, RELAY_MESSAGE_FILE_OFFER_CREATED, 0));
+    TEST_ASSERT_EQUAL_size_t(1, relay_policy_refused_offer_count(policy));
+}
+
+void test_message_rate_rejects_bursts_beyond_the_bucket(void)
+{
+    relay_policy_destroy(policy);
+    RelayPolicyOptions options = { .message_rate = 10, .message_burst = 3 };
+    policy = relay_policy_create_with_options(&options);
+    TEST_ASSERT_NOT_NULL(policy);
+    uint64_t alice = join("Alice");
+    uint64_t bob = join("Bob");
+    RelayMessage chat = { .type = RELAY_MESSAGE_CHAT_SEND };
+    strcpy(chat.as.chat_send.text, "spam");
+    RelayPolicyEffects fx = effects();
+    for (size_t i = 0; i < 4; ++i)
+        relay_policy_handle(policy, alice, &chat, 1000, &fx);
+    TEST_ASSERT_NOT_NULL(find_effect(bob, RELAY_MESSAGE_CHAT_DELIVER, 2));
+    TEST_ASSERT_NULL(find_effect(bob, RELAY_MESSAGE_CHAT_DELIVER, 3));
+    CapturedEffect* rejected = find_effect(alice, RELAY_MESSAGE_ACTION_REJECTED, 0);
+    TEST_ASSERT_NOT_NULL(rejected);
+    TEST_ASSERT_EQUAL(RELAY_MESSAGE_CHAT_SEND, rejected->message.as.action_rejected.rejected_type);
+    TEST_ASSERT_EQUAL_size_t(1, relay_policy_rate_limited_count(policy));
+
+    relay_policy_handle(policy, bob, &chat, 1000, &fx);
+    TEST_ASSERT_NOT_NULL(find_effect(alice, RELAY_MESSAGE_CHAT_DELIVER, 0));
+
+    destroy_captured();
+    RelayMessage create = { .type = RELAY_MESSAGE_FILE_OFFER_CREATE };
+    create.as.file_offer_create.request_id = 9;
+    strcpy(create.as.file_offer_create.filename, "x.txt");
+    create.as.file_offer_create.total_size = 4;
+    create.as.file_offer_create.chunk_size = 4;
+    relay_policy_handle(policy, alice, &create, 1050, &fx);
+    rejected = find_effect(alice, RELAY_MESSAGE_ACTION_REJECTED, 0);
+    TEST_ASSERT_NOT_NULL(rejected);
+    TEST_ASSERT_EQUAL_UINT64(9, rejected->message.as.action_rejected.correlation_id);
+    relay_policy_handle(policy, alice, &create, 1100, &fx);
+    TEST_ASSERT_NOT_NULL(find_effect(alice, RELAY_MESSAGE_FILE_OFFER_CREATED, 0));
+}
+
+static size_t counted_sends;
+
+static bool count_send(void* context, uint64_t target, const RelayMessage* message)
+{
+    (void)context;
+    (void)target;
+    (void)message;
+    counted_sends++;
+    return true;
+}
+
+void test_runtime_limits_cover_a_thousand_participant_workspace(void)
+{
+    relay_policy_destroy(policy);
+    RelayPolicyOptions options = {
+        .max_participants = 1000,
+        .max_file_offers = 200,
+        .max_offers_per_sender = 1
+    };
+    policy = relay_policy_create_with_options(&options);
+    TEST_ASSERT_NOT_NULL(policy);
+    static uint64_t ids[1000];
+    for (size_t i = 0; i < 1000; ++i)
+        ids[i] = join("Member");
+    uint64_t overflow = 0;
+    TEST_ASSERT_FALSE(relay_policy_join(policy, "Late", &overflow));
+    TEST_ASSERT_EQUAL_size_t(1000, relay_policy_participant_count(policy));
+
+    RelayPolicyEffects fx = { .send = count_send };
+    RelayMessage create = { .type = RELAY_MESSAGE_FILE_OFFER_CREATE };
+    create.as.file_offer_create.request_id = 1;
+    strcpy(create.as.file_offer_create.filename, "x.txt");
+    create.as.file_offer_create.total_size = 4;
+    create.as.file_offer_create.chunk_size = 4;
+    for (size_t i = 0; i < 201; ++i)
+        relay_policy_handle(policy, ids[i], &create, 0, &fx);
+    TEST_ASSERT_EQUAL_size_t(200, relay_policy_file_offer_count(policy));
+    create.as.file_offer_create.request_id = 2;
+    relay_policy_handle(policy, ids[0], &create, 0, &fx);
+    TEST_ASSERT_EQUAL_size_t(200, relay_policy_file_offer_count(policy));
+
+    counted_sends = 0;
+    relay_policy_leave(policy, ids[0], 10, &fx);
+    TEST_ASSERT_EQUAL_size_t(199, relay_policy_file_offer_count(policy));
+    TEST_ASSERT_EQUAL_size_t(999, counted_sends);
+    for (size_t i = 1; i < 1000; ++i)
+        relay_policy_leave(policy, ids[i], 20, &fx);
+    TEST_ASSERT_EQUAL_size_t(0, relay_policy_file_offer_count(policy));
+    TEST_ASSERT_EQUAL_size_t(0, relay_policy_participant_count(policy));
+    ids[0] = join("Again");
+    TEST_ASSERT_EQUAL_size_t(1, relay_policy_participant_count(policy));
+}
+
 int main(void)
 {
     UNITY_BEGIN();
     RUN_TEST(test_file_offer_freezes_recipients_and_routes_chunks_only_to_acceptors);
     RUN_TEST(test_offer_expiry_declines_when_nobody_accepts);
+    RUN_TEST(test_next_deadline_tracks_earliest_open_offer_window);
     RUN_TEST(test_invited_disconnect_closes_window_early);
     RUN_TEST(test_slow_recipient_failure_isolated_from_other_delivery);
+    RUN_TEST(test_chunk_fan_out_uses_one_broadcast_per_frame);
+    RUN_TEST(test_passthrough_chunk_forwards_original_frame_after_validation);
     RUN_TEST(test_sender_disconnect_cancels_every_active_delivery);
+    RUN_TEST(test_cancellation_purges_queued_frames_before_the_cancel);
     RUN_TEST(test_chat_attribution_comes_from_participant_identity);
     RUN_TEST(test_failed_last_delivery_cancels_sender_before_more_chunks);
     RUN_TEST(test_duplicate_active_request_identity_is_rejected);
+    RUN_TEST(test_credit_window_paces_sender_to_slowest_delivery);
+    RUN_TEST(test_straggler_lag_fails_only_the_lagging_delivery);
+    RUN_TEST(test_store_and_forward_credits_sender_ahead_of_slow_delivery);
+    RUN_TEST(test_memory_pressure_refuses_offers_and_fails_slowest_delivery);
+    RUN_TEST(test_message_rate_rejects_bursts_beyond_the_bucket);
+    RUN_TEST(test_runtime_limits_cover_a_thousand_participant_workspace);
     return UNITY_END();
 }
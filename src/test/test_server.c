@@ -0,0 +1,423 @@
+#include "platform.h"
+
+#include "protocol.h"
+#include "server.h"
+#include "unity.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#define INBOX_CAPACITY 256u
+#define CHAT_BURST 100u
+#define TRANSFER_CHUNK (256u * 1024u)
+#define TRANSFER_SIZE (3u * TRANSFER_CHUNK + 777u)
+#define ABANDONED_CHUNK (512u * 1024u)
+#define ABANDONED_AFTER (96u * 1024u)
+
+typedef struct {
+    int socket_fd;
+    uint64_t participant_id;
+    ProtocolDecoder decoder;
+    RelayMessage inbox[INBOX_CAPACITY];
+    size_t inbox_head;
+    size_t inbox_count;
+    uint64_t chunk_bytes;
+    uint64_t padding_bytes;
+    bool chunk_corrupt;
+    bool inbox_overflow;
+} Peer;
+
+static pthread_t relay_thread;
+static atomic_bool relay_stop;
+static bool relay_started;
+static uint16_t relay_port;
+static Peer alice;
+static Peer bob;
+static Peer carol;
+
+static uint8_t pattern_byte(uint64_t position)
+{
+    return (uint8_t)(1u + position % 255u);
+}
+
+static void wait_one_millisecond(void)
+{
+    struct timespec interval = { .tv_sec = 0, .tv_nsec = 1000 * 1000 };
+    (void)nanosleep(&interval, NULL);
+}
+
+static void* relay_main(void* argument)
+{
+    (void)argument;
+    while (!atomic_load(&relay_stop))
+        server_poll_events(10);
+    return NULL;
+}
+
+static uint16_t free_port(void)
+{
+    int probe = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT_NOT_EQUAL_INT(-1, probe);
+    struct sockaddr_in address = { 0 };
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_ASSERT_EQUAL_INT(0, bind(probe, (struct sockaddr*)&address, sizeof(address)));
+    socklen_t length = sizeof(address);
+    TEST_ASSERT_EQUAL_INT(0, getsockname(probe, (struct sockaddr*)&address, &length));
+    closesocket(probe);
+    return ntohs(address.sin_port);
+}
+
+static void start_relay(int worker_count)
+{
+    relay_port = free_port();
+    ServerOptions options = { .port = relay_port, .worker_count = worker_count };
+    TEST_ASSERT_TRUE(init_server_with_options(&options));
+    atomic_store(&relay_stop, false);
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&relay_thread, NULL, relay_main, NULL));
+    relay_started = true;
+}
+
+static void capture_peer_message(void* context, const RelayMessage* message)
+{
+    Peer* peer = context;
+    if (peer->inbox_count == INBOX_CAPACITY) {
+        peer->inbox_overflow = true;
+        return;
+    }
+    RelayMessage* stored = &peer->inbox[(peer->inbox_head + peer->inbox_count) % INBOX_CAPACITY];
+    *stored = *message;
+    peer->inbox_count++;
+    if (message->type != RELAY_MESSAGE_FILE_CHUNK)
+        return;
+    // Chunk data lives only as long as the frame, so it is checked here and dropped.
+    stored->as.file_chunk.data = NULL;
+    if (message->as.file_chunk.offset != peer->chunk_bytes)
+        peer->chunk_corrupt = true;
+    // The pattern never contains zero, so zeros can only be padding the server added.
+    for (uint32_t i = 0; i < message->as.file_chunk.data_length; ++i) {
+        uint8_t byte = message->as.file_chunk.data[i];
+        if (byte == 0)
+            peer->padding_bytes++;
+        else if (byte != pattern_byte(peer->chunk_bytes + i) || peer->padding_bytes > 0)
+            peer->chunk_corrupt = true;
+    }
+    peer->chunk_bytes += message->as.file_chunk.data_length;
+}
+
+static void send_bytes(Peer* peer, const uint8_t* bytes, size_t length)
+{
+    while (length > 0) {
+        ssize_t sent = send(peer->socket_fd, bytes, length, MSG_NOSIGNAL);
+        TEST_ASSERT_GREATER_THAN_INT(0, (int)sent);
+        bytes += sent;
+        length -= (size_t)sent;
+    }
+}
+
+static void send_message(Peer* peer, const RelayMessage* message)
+{
+    uint8_t* frame = NULL;
+    size_t length = 0;
+    TEST_ASSERT_TRUE(protocol_encode(message, &frame, &length));
+    send_bytes(peer, frame, length);
+    free(frame);
+}
+
+static RelayMessage next_message(Peer* peer)
+{
+    while (peer->inbox_count == 0) {
+        uint8_t buffer[4096];
+        ssize_t received = recv(peer->socket_fd, buffer, sizeof(buffer), 0);
+        TEST_ASSERT_GREATER_THAN_INT_MESSAGE(0, (int)received, "Relay Server went quiet");
+        TEST_ASSERT_TRUE(protocol_decoder_feed(&peer->decoder, buffer, (size_t)received,
+            capture_peer_message, peer));
+        TEST_ASSERT_FALSE(peer->inbox_overflow);
+    }
+    RelayMessage message = peer->inbox[peer->inbox_head];
+    peer->inbox_head = (peer->inbox_head + 1u) % INBOX_CAPACITY;
+    peer->inbox_count--;
+    return message;
+}
+
+// Credit can be regranted at any point of a transfer, so only the sender skips it.
+static RelayMessage expect_message(Peer* peer, RelayMessageType type)
+{
+    RelayMessage message = next_message(peer);
+    while (message.type == RELAY_MESSAGE_FILE_TRANSFER_CREDIT && type != message.type)
+        message = next_message(peer);
+    TEST_ASSERT_EQUAL_INT(type, message.type);
+    return message;
+}
+
+static void connect_peer(Peer* peer, const char* name)
+{
+    memset(peer, 0, sizeof(*peer));
+    protocol_decoder_init(&peer->decoder);
+    peer->socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT_NOT_EQUAL_INT(-1, peer->socket_fd);
+    struct timeval timeout = { .tv_sec = 5, .tv_usec = 0 };
+    TEST_ASSERT_EQUAL_INT(0, setsockopt(peer->socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+        sizeof(timeout)));
+    struct sockaddr_in address = { 0 };
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(relay_port);
+    TEST_ASSERT_EQUAL_INT(0, connect(peer->socket_fd, (struct sockaddr*)&address,
+        sizeof(address)));
+
+    RelayMessage hello = { .type = RELAY_MESSAGE_HELLO };
+    hello.as.hello.version = PROTOCOL_VERSION;
+    hello.as.hello.features = PROTOCOL_FEATURES_SUPPORTED;
+    snprintf(hello.as.hello.display_name, sizeof(hello.as.hello.display_name), "%s", name);
+    send_message(peer, &hello);
+    RelayMessage welcome = expect_message(peer, RELAY_MESSAGE_WELCOME);
+    TEST_ASSERT_NOT_EQUAL_UINT64(0, welcome.as.welcome.participant_id);
+    peer->participant_id = welcome.as.welcome.participant_id;
+}
+
+static void close_peer(Peer* peer)
+{
+    if (peer->socket_fd == -1)
+        return;
+    closesocket(peer->socket_fd);
+    peer->socket_fd = -1;
+    protocol_decoder_destroy(&peer->decoder);
+}
+
+static void send_chat(Peer* peer, const char* text)
+{
+    RelayMessage chat = { .type = RELAY_MESSAGE_CHAT_SEND };
+    snprintf(chat.as.chat_send.text, sizeof(chat.as.chat_send.text), "%s", text);
+    send_message(peer, &chat);
+}
+
+static void expect_chat(Peer* peer, const Peer* from, const char* name, const char* text)
+{
+    RelayMessage chat = expect_message(peer, RELAY_MESSAGE_CHAT_DELIVER);
+    TEST_ASSERT_EQUAL_UINT64(from->participant_id, chat.as.chat_deliver.participant_id);
+    TEST_ASSERT_EQUAL_STRING(name, chat.as.chat_deliver.display_name);
+    TEST_ASSERT_EQUAL_STRING(text, chat.as.chat_deliver.text);
+}
+
+static uint64_t publish_offer(uint64_t total_size, uint32_t chunk_size)
+{
+    RelayMessage create = { .type = RELAY_MESSAGE_FILE_OFFER_CREATE };
+    create.as.file_offer_create.request_id = 1;
+    snprintf(create.as.file_offer_create.filename,
+        sizeof(create.as.file_offer_create.filename), "loopback.bin");
+    create.as.file_offer_create.total_size = total_size;
+    create.as.file_offer_create.chunk_size = chunk_size;
+    send_message(&alice, &create);
+    RelayMessage created = expect_message(&alice, RELAY_MESSAGE_FILE_OFFER_CREATED);
+    TEST_ASSERT_EQUAL_UINT64(1, created.as.file_offer_created.request_id);
+    uint64_t offer_id = created.as.file_offer_created.offer_id;
+
+    Peer* recipients[] = { &bob, &carol };
+    for (size_t i = 0; i < 2u; ++i) {
+        RelayMessage published = expect_message(recipients[i], RELAY_MESSAGE_FILE_OFFER_PUBLISHED);
+        TEST_ASSERT_EQUAL_UINT64(offer_id, published.as.file_offer_published.offer_id);
+        TEST_ASSERT_EQUAL_UINT64(alice.participant_id, published.as.file_offer_published.sender_id);
+        TEST_ASSERT_EQUAL_UINT64(total_size, published.as.file_offer_published.total_size);
+        RelayMessage response = { .type = RELAY_MESSAGE_FILE_OFFER_RESPONSE };
+        response.as.file_offer_response.offer_id = offer_id;
+        response.as.file_offer_response.accepted = true;
+        send_message(recipients[i], &response);
+    }
+    RelayMessage ready = expect_message(&alice, RELAY_MESSAGE_FILE_TRANSFER_READY);
+    TEST_ASSERT_EQUAL_UINT64(offer_id, ready.as.file_transfer_ready.offer_id);
+    TEST_ASSERT_EQUAL_UINT16(2, ready.as.file_transfer_ready.recipient_count);
+    RelayMessage credit = expect_message(&alice, RELAY_MESSAGE_FILE_TRANSFER_CREDIT);
+    TEST_ASSERT_EQUAL_UINT64(total_size, credit.as.file_transfer_credit.credit_limit);
+    return offer_id;
+}
+
+// Sends the chunk header and the first sent_length bytes of its data.
+static void send_file_chunk_prefix(uint64_t offer_id, uint64_t offset, uint32_t length,
+    uint32_t sent_length)
+{
+    uint8_t* data = malloc(length);
+    TEST_ASSERT_NOT_NULL(data);
+    for (uint32_t i = 0; i < length; ++i)
+        data[i] = pattern_byte(offset + i);
+    RelayMessage chunk = { .type = RELAY_MESSAGE_FILE_CHUNK };
+    chunk.as.file_chunk.offer_id = offer_id;
+    chunk.as.file_chunk.offset = offset;
+    chunk.as.file_chunk.data = data;
+    chunk.as.file_chunk.data_length = length;
+    uint8_t header[PROTOCOL_CHUNK_HEADER_SIZE];
+    ProtocolSlice slices[2];
+    TEST_ASSERT_EQUAL_size_t(2, protocol_encode_iov(&chunk, header, sizeof(header), slices));
+    send_bytes(&alice, slices[0].bytes, slices[0].length);
+    send_bytes(&alice, slices[1].bytes, sent_length);
+    free(data);
+}
+
+static void send_file_chunk(uint64_t offer_id, uint64_t offset, uint32_t length)
+{
+    send_file_chunk_prefix(offer_id, offset, length, length);
+}
+
+static void relay_chat_and_file(void)
+{
+    connect_peer(&alice, "Alice");
+    connect_peer(&bob, "Bob");
+    connect_peer(&carol, "Carol");
+
+    char text[32];
+    for (unsigned i = 0; i < CHAT_BURST; ++i) {
+        snprintf(text, sizeof(text), "chat %u", i);
+        send_chat(&alice, text);
+    }
+    for (unsigned i = 0; i < CHAT_BURST; ++i) {
+        snprintf(text, sizeof(text), "chat %u", i);
+        expect_chat(&bob, &alice, "Alice", text);
+    }
+    // Bob answers only after the burst, so Carol must see it behind every line of it.
+    send_chat(&bob, "reply");
+    for (unsigned i = 0; i < CHAT_BURST; ++i) {
+        snprintf(text, sizeof(text), "chat %u", i);
+        expect_chat(&carol, &alice, "Alice", text);
+    }
+    expect_chat(&carol, &bob, "Bob", "reply");
+    expect_chat(&alice, &bob, "Bob", "reply");
+
+    uint64_t offer_id = publish_offer(TRANSFER_SIZE, TRANSFER_CHUNK);
+    for (uint64_t offset = 0; offset < TRANSFER_SIZE; offset += TRANSFER_CHUNK) {
+        uint64_t left = TRANSFER_SIZE - offset;
+        send_file_chunk(offer_id, offset, left < TRANSFER_CHUNK ? (uint32_t)left : TRANSFER_CHUNK);
+    }
+    RelayMessage end = { .type = RELAY_MESSAGE_FILE_TRANSFER_END };
+    end.as.file_transfer_end.offer_id = offer_id;
+    end.as.file_transfer_end.total_size = TRANSFER_SIZE;
+    send_message(&alice, &end);
+
+    Peer* recipients[] = { &bob, &carol };
+    for (size_t i = 0; i < 2u; ++i) {
+        for (uint64_t received = 0; received < TRANSFER_SIZE;) {
+            RelayMessage chunk = expect_message(recipients[i], RELAY_MESSAGE_FILE_CHUNK);
+            TEST_ASSERT_EQUAL_UINT64(offer_id, chunk.as.file_chunk.offer_id);
+            received += chunk.as.file_chunk.data_length;
+        }
+        TEST_ASSERT_FALSE(recipients[i]->chunk_corrupt);
+        TEST_ASSERT_EQUAL_UINT64(TRANSFER_SIZE, recipients[i]->chunk_bytes);
+        TEST_ASSERT_EQUAL_UINT64(0, recipients[i]->padding_bytes);
+        RelayMessage ended = expect_message(recipients[i], RELAY_MESSAGE_FILE_TRANSFER_END);
+        TEST_ASSERT_EQUAL_UINT64(offer_id, ended.as.file_transfer_end.offer_id);
+        TEST_ASSERT_EQUAL_UINT64(TRANSFER_SIZE, ended.as.file_transfer_end.total_size);
+        RelayMessage result = { .type = RELAY_MESSAGE_FILE_DELIVERY_RESULT };
+        result.as.file_delivery_result.offer_id = offer_id;
+        result.as.file_delivery_result.success = true;
+        send_message(recipients[i], &result);
+    }
+
+    bool updated[2] = { false, false };
+    for (size_t i = 0; i < 2u; ++i) {
+        RelayMessage update = expect_message(&alice, RELAY_MESSAGE_FILE_DELIVERY_UPDATE);
+        TEST_ASSERT_EQUAL_UINT64(offer_id, update.as.file_delivery_update.offer_id);
+        TEST_ASSERT_TRUE(update.as.file_delivery_update.success);
+        for (size_t r = 0; r < 2u; ++r) {
+            if (update.as.file_delivery_update.recipient_id == recipients[r]->participant_id)
+                updated[r] = true;
+        }
+    }
+    TEST_ASSERT_TRUE(updated[0]);
+    TEST_ASSERT_TRUE(updated[1]);
+
+    send_chat(&carol, "done");
+    expect_chat(&alice, &carol, "Carol", "done");
+    expect_chat(&bob, &carol, "Carol", "done");
+}
+
+void setUp(void)
+{
+    relay_started = false;
+    Peer* peers[] = { &alice, &bob, &carol };
+    for (size_t i = 0; i < 3u; ++i) {
+        memset(peers[i], 0, sizeof(*peers[i]));
+        peers[i]->socket_fd = -1;
+    }
+}
+
+void tearDown(void)
+{
+    close_peer(&alice);
+    close_peer(&bob);
+    close_peer(&carol);
+    if (!relay_started)
+        return;
+    atomic_store(&relay_stop, true);
+    pthread_join(relay_thread, NULL);
+    cleanup_server();
+}
+
+void test_single_threaded_server_relays_chat_and_file_in_order(void)
+{
+    start_relay(0);
+    relay_chat_and_file();
+}
+
+void test_worker_threads_relay_chat_and_file_in_order(void)
+{
+#ifdef __linux__
+    start_relay(2);
+    relay_chat_and_file();
+#else
+    TEST_IGNORE_MESSAGE("I/O workers need epoll");
+#endif
+}
+
+void test_sender_lost_mid_splice_leaves_recipients_framed(void)
+{
+#ifdef __linux__
+    start_relay(0);
+    connect_peer(&alice, "Alice");
+    connect_peer(&bob, "Bob");
+    connect_peer(&carol, "Carol");
+    uint64_t offer_id = publish_offer(ABANDONED_CHUNK, ABANDONED_CHUNK);
+    send_file_chunk_prefix(offer_id, 0, ABANDONED_CHUNK, ABANDONED_AFTER);
+    for (unsigned attempt = 0; attempt < 500u; ++attempt) {
+        ServerStats stats;
+        server_stats(&stats);
+        if (stats.spliced_chunks > 0)
+            break;
+        wait_one_millisecond();
+    }
+    close_peer(&alice);
+
+    Peer* recipients[] = { &bob, &carol };
+    for (size_t i = 0; i < 2u; ++i) {
+        RelayMessage chunk = expect_message(recipients[i], RELAY_MESSAGE_FILE_CHUNK);
+        TEST_ASSERT_EQUAL_UINT64(offer_id, chunk.as.file_chunk.offer_id);
+        TEST_ASSERT_EQUAL_UINT32(ABANDONED_CHUNK, chunk.as.file_chunk.data_length);
+        TEST_ASSERT_FALSE(recipients[i]->chunk_corrupt);
+        TEST_ASSERT_EQUAL_UINT64(ABANDONED_CHUNK - ABANDONED_AFTER, recipients[i]->padding_bytes);
+        RelayMessage cancel = expect_message(recipients[i], RELAY_MESSAGE_FILE_TRANSFER_CANCEL);
+        TEST_ASSERT_EQUAL_UINT64(offer_id, cancel.as.file_transfer_cancel.offer_id);
+    }
+    ServerStats stats;
+    server_stats(&stats);
+    TEST_ASSERT_EQUAL_size_t(1, stats.spliced_chunks);
+
+    send_chat(&bob, "still framed");
+    expect_chat(&carol, &bob, "Bob", "still framed");
+#else
+    TEST_IGNORE_MESSAGE("Chunks are spliced only on Linux");
+#endif
+}
+
+int main(void)
+{
+    signal(SIGPIPE, SIG_IGN);
+    UNITY_BEGIN();
+    RUN_TEST(test_single_threaded_server_relays_chat_and_file_in_order);
+    RUN_TEST(test_worker_threads_relay_chat_and_file_in_order);
+    RUN_TEST(test_sender_lost_mid_splice_leaves_recipients_framed);
+    return UNITY_END();
+}
@@ -0,0 +1,85 @@
+#include "spool.h"
+#include "unity.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char directory[] = "/tmp/relay-spool-test-XXXXXX";
+static Spool spool;
+
+void setUp(void)
+{
+    TEST_ASSERT_NOT_NULL(mkdtemp(directory));
+    TEST_ASSERT_TRUE(spool_open(&spool, directory));
+}
+
+void tearDown(void)
+{
+    spool_close(&spool);
+    (void)rmdir(directory);
+    memcpy(directory + strlen(directory) - 6u, "XXXXXX", 6u);
+}
+
+void test_open_rejects_a_missing_directory(void)
+{
+    Spool missing;
+    TEST_ASSERT_FALSE(spool_open(&missing, "/nonexistent/relay-spool"));
+    TEST_ASSERT_FALSE(spool_is_open(&missing));
+    TEST_ASSERT_TRUE(spool_is_open(&spool));
+}
+
+void test_appended_frames_read_back_at_their_offsets(void)
+{
+    SpoolFile* file = spool_file_for_offer(&spool, 7);
+    TEST_ASSERT_NOT_NULL(file);
+    TEST_ASSERT_EQUAL_PTR(file, spool_file_for_offer(&spool, 7));
+    TEST_ASSERT_NOT_EQUAL(file, spool_file_for_offer(&spool, 8));
+
+    uint8_t first[100];
+    uint8_t second[3000];
+    memset(first, 0x11, sizeof(first));
+    memset(second, 0x22, sizeof(second));
+    uint64_t first_offset = 1;
+    uint64_t second_offset = 0;
+    TEST_ASSERT_TRUE(spool_file_append(file, first, sizeof(first), &first_offset));
+    TEST_ASSERT_TRUE(spool_file_append(file, second, sizeof(second), &second_offset));
+    TEST_ASSERT_EQUAL_UINT64(0, first_offset);
+    TEST_ASSERT_EQUAL_UINT64(sizeof(first), second_offset);
+    TEST_ASSERT_EQUAL_UINT64(sizeof(first) + sizeof(second), file->length);
+
+    uint8_t loaded[3000];
+    TEST_ASSERT_TRUE(spool_file_read(file, second_offset, loaded, sizeof(second)));
+    TEST_ASSERT_EQUAL_MEMORY(second, loaded, sizeof(second));
+    TEST_ASSERT_TRUE(spool_file_read(file, first_offset, loaded, sizeof(first)));
+    TEST_ASSERT_EQUAL_MEMORY(first, loaded, sizeof(first));
+    TEST_ASSERT_FALSE(spool_file_read(file, file->length, loaded, 1));
+}
+
+void test_files_close_once_the_last_frame_is_released(void)
+{
+    SpoolFile* file = spool_file_for_offer(&spool, 9);
+    TEST_ASSERT_NOT_NULL(file);
+    spool_file_retain(file);
+    spool_file_retain(file);
+    spool_file_close_if_idle(&spool, file);
+    spool_file_release(&spool, file);
+    TEST_ASSERT_EQUAL_size_t(1, spool.files_by_offer.count);
+    spool_file_release(&spool, file);
+    TEST_ASSERT_EQUAL_size_t(0, spool.files_by_offer.count);
+
+    SpoolFile* unused = spool_file_for_offer(&spool, 10);
+    TEST_ASSERT_NOT_NULL(unused);
+    spool_file_close_if_idle(&spool, unused);
+    TEST_ASSERT_EQUAL_size_t(0, spool.files_by_offer.count);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_open_rejects_a_missing_directory);
+    RUN_TEST(test_appended_frames_read_back_at_their_offsets);
+    RUN_TEST(test_files_close_once_the_last_frame_is_released);
+    return UNITY_END();
+}
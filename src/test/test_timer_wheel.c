@@ -0,0 +1,129 @@
+#include "timer_wheel.h"
+#include "unity.h"
+
+#include <stdint.h>
+
+#define STRESS_TIMERS 2048u
+
+static TimerWheel wheel;
+static TimerEntry timers[STRESS_TIMERS];
+static uint64_t fired_at[STRESS_TIMERS];
+static uint64_t clock_ms;
+static size_t fired_count;
+
+static void record_expiry(void* context, TimerEntry* entry)
+{
+    (void)context;
+    fired_at[(TimerEntry*)entry->owner - timers] = clock_ms;
+    fired_count++;
+}
+
+static size_t advance_to(uint64_t now_ms)
+{
+    clock_ms = now_ms;
+    return timer_wheel_advance(&wheel, now_ms, record_expiry, NULL);
+}
+
+static void schedule(size_t index, uint64_t deadline_ms)
+{
+    timers[index].owner = &timers[index];
+    timer_wheel_schedule(&wheel, &timers[index], deadline_ms);
+}
+
+void setUp(void)
+{
+    for (size_t i = 0; i < STRESS_TIMERS; ++i) {
+        timers[i] = (TimerEntry) { 0 };
+        fired_at[i] = 0;
+    }
+    fired_count = 0;
+    clock_ms = 1000;
+    timer_wheel_init(&wheel, clock_ms);
+}
+
+void tearDown(void)
+{
+}
+
+void test_expires_on_deadline_and_reports_exact_next_expiry(void)
+{
+    uint64_t deadline = 0;
+    TEST_ASSERT_FALSE(timer_wheel_next_expiry(&wheel, &deadline));
+    schedule(0, 1000 + 30000);
+    schedule(1, 1000 + 70);
+    schedule(2, 1000 + 5);
+    TEST_ASSERT_TRUE(timer_wheel_next_expiry(&wheel, &deadline));
+    TEST_ASSERT_EQUAL_UINT64(1005, deadline);
+
+    TEST_ASSERT_EQUAL_size_t(0, advance_to(1004));
+    TEST_ASSERT_EQUAL_size_t(1, advance_to(1005));
+    TEST_ASSERT_EQUAL_UINT64(1005, fired_at[2]);
+    TEST_ASSERT_TRUE(timer_wheel_next_expiry(&wheel, &deadline));
+    TEST_ASSERT_EQUAL_UINT64(1070, deadline);
+    TEST_ASSERT_EQUAL_size_t(1, advance_to(20000));
+    TEST_ASSERT_EQUAL_UINT64(20000, fired_at[1]);
+    TEST_ASSERT_TRUE(timer_wheel_next_expiry(&wheel, &deadline));
+    TEST_ASSERT_EQUAL_UINT64(31000, deadline);
+    TEST_ASSERT_EQUAL_size_t(1, advance_to(31000));
+    TEST_ASSERT_EQUAL_size_t(0, wheel.count);
+
+    schedule(3, 500);
+    TEST_ASSERT_TRUE(timer_wheel_next_expiry(&wheel, &deadline));
+    TEST_ASSERT_EQUAL_UINT64(500, deadline);
+    TEST_ASSERT_EQUAL_size_t(1, advance_to(31000));
+}
+
+void test_cancel_and_reschedule_move_the_entry(void)
+{
+    schedule(0, 1100);
+    schedule(1, 1200);
+    timer_wheel_cancel(&wheel, &timers[0]);
+    TEST_ASSERT_FALSE(timer_entry_is_scheduled(&timers[0]));
+    timer_wheel_cancel(&wheel, &timers[0]);
+    schedule(1, 5000);
+    TEST_ASSERT_EQUAL_size_t(1, wheel.count);
+    uint64_t deadline = 0;
+    TEST_ASSERT_TRUE(timer_wheel_next_expiry(&wheel, &deadline));
+    TEST_ASSERT_EQUAL_UINT64(5000, deadline);
+    TEST_ASSERT_EQUAL_size_t(0, advance_to(4999));
+    TEST_ASSERT_EQUAL_size_t(1, advance_to(5000));
+    TEST_ASSERT_EQUAL_UINT64(0, fired_at[0]);
+}
+
+void test_matches_linear_scan_across_levels_and_overflow(void)
+{
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    uint64_t deadlines[STRESS_TIMERS];
+    for (size_t i = 0; i < STRESS_TIMERS; ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        uint64_t spans[] = { 64u, 4096u, 262144u, 1u << 26 };
+        deadlines[i] = clock_ms + 1u + (seed >> 33) % spans[i % 4u];
+        schedule(i, deadlines[i]);
+    }
+    while (fired_count < STRESS_TIMERS) {
+        uint64_t expected = UINT64_MAX;
+        for (size_t i = 0; i < STRESS_TIMERS; ++i) {
+            if (fired_at[i] == 0 && deadlines[i] < expected)
+                expected = deadlines[i];
+        }
+        uint64_t next = 0;
+        TEST_ASSERT_TRUE(timer_wheel_next_expiry(&wheel, &next));
+        TEST_ASSERT_EQUAL_UINT64(expected, next);
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        advance_to(next + (seed >> 33) % 3u);
+        for (size_t i = 0; i < STRESS_TIMERS; ++i) {
+            TEST_ASSERT_EQUAL(deadlines[i] <= clock_ms, fired_at[i] != 0);
+            TEST_ASSERT_TRUE(fired_at[i] == 0 || fired_at[i] >= deadlines[i]);
+        }
+    }
+    TEST_ASSERT_EQUAL_size_t(0, wheel.count);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_expires_on_deadline_and_reports_exact_next_expiry);
+    RUN_TEST(test_cancel_and_reschedule_move_the_entry);
+    RUN_TEST(test_matches_linear_scan_across_levels_and_overflow);
+    return UNITY_END();
+}
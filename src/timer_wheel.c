@@ -0,0 +1,235 @@
+#include "timer_wheel.h"
+
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1u)
+#define TIMER_WHEEL_BUCKET_DUE (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS)
+#define TIMER_WHEEL_BUCKET_OVERFLOW (TIMER_WHEEL_BUCKET_DUE + 1u)
+
+static unsigned level_shift(unsigned level)
+{
+    return level * TIMER_WHEEL_SLOT_BITS;
+}
+
+static void list_init(TimerEntry* head)
+{
+    head->next = head;
+    head->prev = head;
+}
+
+static bool list_is_empty(const TimerEntry* head)
+{
+    return head->next == head;
+}
+
+static void list_push(TimerEntry* head, TimerEntry* entry)
+{
+    entry->prev = head->prev;
+    entry->next = head;
+    head->prev->next = entry;
+    head->prev = entry;
+}
+
+static void list_unlink(TimerEntry* entry)
+{
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->next = NULL;
+    entry->prev = NULL;
+}
+
+static void list_take(TimerEntry* destination, TimerEntry* source)
+{
+    list_init(destination);
+    if (list_is_empty(source))
+        return;
+    destination->next = source->next;
+    destination->prev = source->prev;
+    destination->next->prev = destination;
+    destination->prev->next = destination;
+    list_init(source);
+}
+
+static TimerEntry* bucket_head(TimerWheel* wheel, unsigned bucket)
+{
+    if (bucket == TIMER_WHEEL_BUCKET_DUE)
+        return &wheel->due;
+    if (bucket == TIMER_WHEEL_BUCKET_OVERFLOW)
+        return &wheel->overflow;
+    return &wheel->slots[bucket / TIMER_WHEEL_SLOTS][bucket % TIMER_WHEEL_SLOTS];
+}
+
+static void place(TimerWheel* wheel, TimerEntry* entry)
+{
+    unsigned bucket = TIMER_WHEEL_BUCKET_OVERFLOW;
+    if (entry->deadline_ms < wheel->now_ms) {
+        bucket = TIMER_WHEEL_BUCKET_DUE;
+    } else {
+        for (unsigned level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+            unsigned upper = level_shift(level + 1u);
+            if (entry->deadline_ms >> upper != wheel->now_ms >> upper)
+                continue;
+            unsigned slot = (unsigned)(entry->deadline_ms >> level_shift(level))
+                & TIMER_WHEEL_SLOT_MASK;
+            wheel->occupied[level] |= 1ull << slot;
+            bucket = level * TIMER_WHEEL_SLOTS + slot;
+            break;
+        }
+    }
+    entry->bucket = bucket;
+    list_push(bucket_head(wheel, bucket), entry);
+}
+
+static void replace_all(TimerWheel* wheel, TimerEntry* head)
+{
+    TimerEntry pending;
+    list_take(&pending, head);
+    while (!list_is_empty(&pending)) {
+        TimerEntry* entry = pending.next;
+        list_unlink(entry);
+        place(wheel, entry);
+    }
+}
+
+static bool next_event(const TimerWheel* wheel, uint64_t* tick)
+{
+    for (unsigned level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        unsigned current = (unsigned)(wheel->now_ms >> level_shift(level)) & TIMER_WHEEL_SLOT_MASK;
+        uint64_t later = current == TIMER_WHEEL_SLOT_MASK ? 0 : ~0ull << (current + 1u);
+        uint64_t candidates = wheel->occupied[level] & later;
+        if (candidates == 0)
+            continue;
+        unsigned slot = (unsigned)__builtin_ctzll(candidates);
+        unsigned upper = level_shift(level + 1u);
+        *tick = ((wheel->now_ms >> upper) << upper) + ((uint64_t)slot << level_shift(level));
+        return true;
+    }
+    if (list_is_empty(&wheel->overflow))
+        return false;
+    unsigned span = level_shift(TIMER_WHEEL_LEVELS);
+    *tick = ((wheel->now_ms >> span) + 1u) << span;
+    return true;
+}
+
+static void process_tick(TimerWheel* wheel, uint64_t tick)
+{
+    wheel->now_ms = tick;
+    unsigned span = level_shift(TIMER_WHEEL_LEVELS);
+    if ((tick & ((1ull << span) - 1u)) == 0)
+        replace_all(wheel, &wheel->overflow);
+    for (unsigned level = TIMER_WHEEL_LEVELS; level-- > 1u;) {
+        unsigned shift = level_shift(level);
+        if ((tick & ((1ull << shift) - 1u)) != 0)
+            continue;
+        unsigned slot = (unsigned)(tick >> shift) & TIMER_WHEEL_SLOT_MASK;
+        wheel->occupied[level] &= ~(1ull << slot);
+        replace_all(wheel, &wheel->slots[level][slot]);
+    }
+    unsigned slot = (unsigned)tick & TIMER_WHEEL_SLOT_MASK;
+    wheel->occupied[0] &= ~(1ull << slot);
+    TimerEntry expired;
+    list_take(&expired, &wheel->slots[0][slot]);
+    while (!list_is_empty(&expired)) {
+        TimerEntry* entry = expired.next;
+        list_unlink(entry);
+        entry->bucket = TIMER_WHEEL_BUCKET_DUE;
+        list_push(&wheel->due, entry);
+    }
+}
+
+void timer_wheel_init(TimerWheel* wheel, uint64_t now_ms)
+{
+    for (unsigned level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        for (unsigned slot = 0; slot < TIMER_WHEEL_SLOTS; ++slot)
+            list_init(&wheel->slots[level][slot]);
+        wheel->occupied[level] = 0;
+    }
+    list_init(&wheel->due);
+    list_init(&wheel->overflow);
+    wheel->now_ms = now_ms;
+    wheel->count = 0;
+}
+
+void timer_wheel_schedule(TimerWheel* wheel, TimerEntry* entry, uint64_t deadline_ms)
+{
+    timer_wheel_cancel(wheel, entry);
+    entry->deadline_ms = deadline_ms;
+    if (deadline_ms <= wheel->now_ms) {
+        entry->bucket = TIMER_WHEEL_BUCKET_DUE;
+        list_push(&wheel->due, entry);
+    } else {
+        place(wheel, entry);
+    }
+    wheel->count++;
+}
+
+void timer_wheel_cancel(TimerWheel* wheel, TimerEntry* entry)
+{
+    if (!timer_entry_is_scheduled(entry))
+        return;
+    list_unlink(entry);
+    if (entry->bucket < TIMER_WHEEL_BUCKET_DUE
+        && list_is_empty(bucket_head(wheel, entry->bucket))) {
+        wheel->occupied[entry->bucket / TIMER_WHEEL_SLOTS]
+            &= ~(1ull << (entry->bucket % TIMER_WHEEL_SLOTS));
+    }
+    wheel->count--;
+}
+
+bool timer_entry_is_scheduled(const TimerEntry* entry)
+{
+    return entry->next != NULL;
+}
+
+size_t timer_wheel_advance(TimerWheel* wheel, uint64_t now_ms, TimerWheelExpired expired,
+    void* context)
+{
+    while (wheel->now_ms < now_ms) {
+        uint64_t tick = 0;
+        if (!next_event(wheel, &tick) || tick > now_ms) {
+            wheel->now_ms = now_ms;
+            break;
+        }
+        process_tick(wheel, tick);
+    }
+
+    TimerEntry firing;
+    list_take(&firing, &wheel->due);
+    size_t fired = 0;
+    while (!list_is_empty(&firing)) {
+        TimerEntry* entry = firing.next;
+        list_unlink(entry);
+        wheel->count--;
+        fired++;
+        if (expired)
+            expired(context, entry);
+    }
+    return fired;
+}
+
+static bool earliest_in(const TimerEntry* head, uint64_t* deadline_ms)
+{
+    bool found = false;
+    for (const TimerEntry* entry = head->next; entry != head; entry = entry->next) {
+        if (!found || entry->deadline_ms < *deadline_ms)
+            *deadline_ms = entry->deadline_ms;
+        found = true;
+    }
+    return found;
+}
+
+bool timer_wheel_next_expiry(const TimerWheel* wheel, uint64_t* deadline_ms)
+{
+    if (!wheel || !deadline_ms || wheel->count == 0)
+        return false;
+    if (earliest_in(&wheel->due, deadline_ms))
+        return true;
+    for (unsigned level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        if (wheel->occupied[level] == 0)
+            continue;
+        unsigned current = (unsigned)(wheel->now_ms >> level_shift(level)) & TIMER_WHEEL_SLOT_MASK;
+        uint64_t later = current == TIMER_WHEEL_SLOT_MASK ? 0 : ~0ull << (current + 1u);
+        uint64_t candidates = wheel->occupied[level] & later;
+        if (candidates != 0)
+            return earliest_in(&wheel->slots[level][__builtin_ctzll(candidates)], deadline_ms);
+    }
+    return earliest_in(&wheel->overflow, deadline_ms);
+}
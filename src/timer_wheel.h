@@ -0,0 +1,39 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TIMER_WHEEL_LEVELS 4u
+#define TIMER_WHEEL_SLOT_BITS 6u
+#define TIMER_WHEEL_SLOTS (1u << TIMER_WHEEL_SLOT_BITS)
+
+typedef struct TimerEntry {
+    struct TimerEntry* next;
+    struct TimerEntry* prev;
+    uint64_t deadline_ms;
+    unsigned bucket;
+    void* owner;
+} TimerEntry;
+
+typedef struct {
+    TimerEntry slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t occupied[TIMER_WHEEL_LEVELS];
+    TimerEntry due;
+    TimerEntry overflow;
+    uint64_t now_ms;
+    size_t count;
+} TimerWheel;
+
+typedef void (*TimerWheelExpired)(void* context, TimerEntry* entry);
+
+void timer_wheel_init(TimerWheel* wheel, uint64_t now_ms);
+void timer_wheel_schedule(TimerWheel* wheel, TimerEntry* entry, uint64_t deadline_ms);
+void timer_wheel_cancel(TimerWheel* wheel, TimerEntry* entry);
+bool timer_entry_is_scheduled(const TimerEntry* entry);
+size_t timer_wheel_advance(TimerWheel* wheel, uint64_t now_ms, TimerWheelExpired expired,
+    void* context);
+bool timer_wheel_next_expiry(const TimerWheel* wheel, uint64_t* deadline_ms);
+
+#endif
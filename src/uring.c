@@ -0,0 +1,159 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "uring.h"
+
+#ifdef RELAY_HAS_URING
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static int uring_setup(unsigned entries, struct io_uring_params* params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+    const void* argument, size_t argument_size)
+{
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags,
+        argument, argument_size);
+}
+
+bool uring_init(Uring* ring, unsigned entries)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->ring_fd = -1;
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring_fd = uring_setup(entries, &params);
+    if (ring_fd < 0)
+        return false;
+    ring->ring_fd = ring_fd;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+        uring_destroy(ring);
+        return false;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sq_ring_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        uring_destroy(ring);
+        return false;
+    }
+    ring->cq_ring = ring->sq_ring;
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        uring_destroy(ring);
+        return false;
+    }
+
+    uint8_t* sq = ring->sq_ring;
+    uint8_t* cq = ring->cq_ring;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    ring->sq_entries = params.sq_entries;
+    return true;
+}
+
+void uring_destroy(Uring* ring)
+{
+    if (ring->sqes)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->sq_ring)
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->ring_fd != -1)
+        close(ring->ring_fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->ring_fd = -1;
+}
+
+bool uring_register_buffers(Uring* ring, const struct iovec* buffers, unsigned count)
+{
+    return syscall(__NR_io_uring_register, ring->ring_fd, IORING_REGISTER_BUFFERS,
+               buffers, count) == 0;
+}
+
+struct io_uring_sqe* uring_get_sqe(Uring* ring)
+{
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *ring->sq_tail + ring->pending;
+    if (tail - head >= ring->sq_entries) {
+        if (!uring_submit(ring))
+            return NULL;
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        tail = *ring->sq_tail;
+        if (tail - head >= ring->sq_entries)
+            return NULL;
+    }
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->pending++;
+    return sqe;
+}
+
+static unsigned publish_pending(Uring* ring)
+{
+    unsigned published = ring->pending;
+    if (published > 0)
+        __atomic_store_n(ring->sq_tail, *ring->sq_tail + published, __ATOMIC_RELEASE);
+    ring->pending = 0;
+    return published;
+}
+
+bool uring_submit(Uring* ring)
+{
+    unsigned published = publish_pending(ring);
+    if (published == 0)
+        return true;
+    int submitted = uring_enter(ring->ring_fd, published, 0, 0, NULL, 0);
+    return submitted >= 0 || errno == EINTR;
+}
+
+bool uring_submit_and_wait(Uring* ring, int timeout_ms)
+{
+    unsigned published = publish_pending(ring);
+    struct __kernel_timespec timeout = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_nsec = (long long)(timeout_ms % 1000) * 1000000
+    };
+    struct io_uring_getevents_arg argument;
+    memset(&argument, 0, sizeof(argument));
+    argument.ts = (uint64_t)(uintptr_t)&timeout;
+    int result = uring_enter(ring->ring_fd, published, 1,
+        IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &argument, sizeof(argument));
+    return result >= 0 || errno == ETIME || errno == EINTR;
+}
+
+struct io_uring_cqe* uring_peek_cqe(Uring* ring)
+{
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+void uring_cqe_seen(Uring* ring)
+{
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1u, __ATOMIC_RELEASE);
+}
+#endif
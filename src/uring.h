@@ -0,0 +1,45 @@
+#ifndef RELAY_URING_H
+#define RELAY_URING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+#define RELAY_HAS_URING 1
+
+typedef struct {
+    int ring_fd;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned sq_entries;
+    unsigned pending;
+} Uring;
+
+bool uring_init(Uring* ring, unsigned entries);
+void uring_destroy(Uring* ring);
+bool uring_register_buffers(Uring* ring, const struct iovec* buffers, unsigned count);
+
+struct io_uring_sqe* uring_get_sqe(Uring* ring);
+bool uring_submit(Uring* ring);
+bool uring_submit_and_wait(Uring* ring, int timeout_ms);
+struct io_uring_cqe* uring_peek_cqe(Uring* ring);
+void uring_cqe_seen(Uring* ring);
+#endif
+
+#endif